@@ -8,61 +8,924 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 #include <ngx_array.h>
+#include <ngx_sha1.h>
+
+#ifndef NGX_HEADER_INSPECT_SIMD
+#if (defined __x86_64__ && (defined __GNUC__ || defined __clang__))
+#define NGX_HEADER_INSPECT_SIMD 1
+#else
+#define NGX_HEADER_INSPECT_SIMD 0
+#endif
+#endif
+
+#if (NGX_HEADER_INSPECT_SIMD)
+#include <immintrin.h>
+#endif
+
+/* USDT probes, a nop each until a tracer attaches; NGX_HAVE_SDT comes from config */
+#if (NGX_HAVE_SDT)
+#include <sys/sdt.h>
+#define ngx_header_inspect_probe1(name, a1) DTRACE_PROBE1(nginx_header_inspect, name, a1)
+#define ngx_header_inspect_probe3(name, a1, a2, a3) DTRACE_PROBE3(nginx_header_inspect, name, a1, a2, a3)
+#define ngx_header_inspect_probe4(name, a1, a2, a3, a4) DTRACE_PROBE4(nginx_header_inspect, name, a1, a2, a3, a4)
+#define ngx_header_inspect_probe5(name, a1, a2, a3, a4, a5) DTRACE_PROBE5(nginx_header_inspect, name, a1, a2, a3, a4, a5)
+#else
+#define ngx_header_inspect_probe1(name, a1)
+#define ngx_header_inspect_probe3(name, a1, a2, a3)
+#define ngx_header_inspect_probe4(name, a1, a2, a3, a4)
+#define ngx_header_inspect_probe5(name, a1, a2, a3, a4, a5)
+#endif
+
+
+
+typedef enum {
+	NGX_HEADER_INSPECT_HDR_RANGE = 0,
+	NGX_HEADER_INSPECT_HDR_IF_RANGE,
+	NGX_HEADER_INSPECT_HDR_IF_UNMODIFIED_SINCE,
+	NGX_HEADER_INSPECT_HDR_IF_MODIFIED_SINCE,
+	NGX_HEADER_INSPECT_HDR_DATE,
+	NGX_HEADER_INSPECT_HDR_EXPIRES,
+	NGX_HEADER_INSPECT_HDR_LAST_MODIFIED,
+	NGX_HEADER_INSPECT_HDR_CONTENT_ENCODING,
+	NGX_HEADER_INSPECT_HDR_ACCEPT_ENCODING,
+	NGX_HEADER_INSPECT_HDR_CONTENT_LANGUAGE,
+	NGX_HEADER_INSPECT_HDR_ACCEPT_LANGUAGE,
+	NGX_HEADER_INSPECT_HDR_ACCEPT_CHARSET,
+	NGX_HEADER_INSPECT_HDR_CONTENT_LENGTH,
+	NGX_HEADER_INSPECT_HDR_MAX_FORWARDS,
+	NGX_HEADER_INSPECT_HDR_IF_MATCH,
+	NGX_HEADER_INSPECT_HDR_IF_NONE_MATCH,
+	NGX_HEADER_INSPECT_HDR_ALLOW,
+	NGX_HEADER_INSPECT_HDR_HOST,
+	NGX_HEADER_INSPECT_HDR_ACCEPT,
+	NGX_HEADER_INSPECT_HDR_CONNECTION,
+	NGX_HEADER_INSPECT_HDR_CONTENT_RANGE,
+	NGX_HEADER_INSPECT_HDR_USER_AGENT,
+	NGX_HEADER_INSPECT_HDR_UPGRADE,
+	NGX_HEADER_INSPECT_HDR_VIA,
+	NGX_HEADER_INSPECT_HDR_FROM,
+	NGX_HEADER_INSPECT_HDR_PRAGMA,
+	NGX_HEADER_INSPECT_HDR_CONTENT_TYPE,
+	NGX_HEADER_INSPECT_HDR_CONTENT_MD5,
+	NGX_HEADER_INSPECT_HDR_AUTHORIZATION,
+	NGX_HEADER_INSPECT_HDR_PROXY_AUTHORIZATION,
+	NGX_HEADER_INSPECT_HDR_EXPECT,
+	NGX_HEADER_INSPECT_HDR_WARNING,
+	NGX_HEADER_INSPECT_HDR_TRAILER,
+	NGX_HEADER_INSPECT_HDR_TRANSFER_ENCODING,
+	NGX_HEADER_INSPECT_HDR_TE,
+	NGX_HEADER_INSPECT_HDR_REFERER,
+	NGX_HEADER_INSPECT_HDR_CONTENT_LOCATION,
+	NGX_HEADER_INSPECT_HDR_CACHE_CONTROL,
+	NGX_HEADER_INSPECT_HDR_RULE,         /* inspect_headers_rule, see ngx_header_inspect_rule_t */
+	NGX_HEADER_INSPECT_HDR_OTHER,        /* no parser, only named in inspect_headers_policy */
+	NGX_HEADER_INSPECT_NHEADERS
+} ngx_header_inspect_header_id_e;
 
+typedef struct {
+	ngx_str_t  name;
+	ngx_uint_t id;
+} ngx_header_inspect_header_t;
+
+/* configurable token lists, see ngx_header_inspect_vocab_compile() */
+#define NGX_HEADER_INSPECT_WORD_MAX  32
+
+typedef enum {
+	NGX_HEADER_INSPECT_VOCAB_CONTENT_CODINGS = 0,
+	NGX_HEADER_INSPECT_VOCAB_TRANSFER_CODINGS,
+	NGX_HEADER_INSPECT_VOCAB_METHODS,
+	NGX_HEADER_INSPECT_VOCAB_CONNECTION_OPTIONS,
+	NGX_HEADER_INSPECT_VOCAB_CACHE_DIRECTIVES,
+	NGX_HEADER_INSPECT_VOCAB_DIGEST_PARAMS,
+	NGX_HEADER_INSPECT_NVOCABS
+} ngx_header_inspect_vocab_id_e;
+
+/* what may follow a cache-directive, words not listed take an optional token or quoted-string */
+typedef enum {
+	NGX_HEADER_INSPECT_CC_EXTENSION = 0,
+	NGX_HEADER_INSPECT_CC_NOARG,
+	NGX_HEADER_INSPECT_CC_DELTA,         /* "=" delta-seconds */
+	NGX_HEADER_INSPECT_CC_OPT_DELTA,     /* [ "=" delta-seconds ] */
+	NGX_HEADER_INSPECT_CC_MAX_AGE        /* "=" delta-seconds, at most inspect_headers_max_age */
+} ngx_header_inspect_cc_kind_e;
+
+typedef struct {
+	ngx_str_t  word;
+	ngx_uint_t kind;
+} ngx_header_inspect_vocab_kind_t;
+
+typedef struct {
+	ngx_uint_t                       caseless;
+	ngx_str_t                       *defaults;  /* ends with ngx_null_string */
+	ngx_header_inspect_vocab_kind_t *kinds;     /* NULL or ends with ngx_null_string */
+} ngx_header_inspect_vocab_spec_t;
+
+typedef struct {
+	uint64_t   w[NGX_HEADER_INSPECT_WORD_MAX / 8];  /* folded if caseless, zero padded */
+	size_t     len;                                 /* 0 for an empty slot */
+	ngx_uint_t kind;
+} ngx_header_inspect_word_t;
+
+typedef struct {
+	ngx_header_inspect_word_t *slots;  /* 1 << (64 - shift) of them */
+	uint64_t                   seed;   /* picked at config time so the words do not collide */
+	ngx_uint_t                 shift;
+	uint64_t                   fold;   /* 0x80 in every byte for caseless lists, else 0 */
+} ngx_header_inspect_vocab_t;
+
+/* counted per header in the inspect_headers_zone */
+typedef enum {
+	NGX_HEADER_INSPECT_STAT_INSPECTED = 0,
+	NGX_HEADER_INSPECT_STAT_BAD_CHAR,      /* CTL or obs-text, found before parsing */
+	NGX_HEADER_INSPECT_STAT_VIOLATION,     /* rejected by the header's parser or rule */
+	NGX_HEADER_INSPECT_STAT_BLOCKED,       /* the request was refused because of it */
+	NGX_HEADER_INSPECT_STAT_STRIPPED,      /* the header was removed because of it */
+	NGX_HEADER_INSPECT_NSTATS
+} ngx_header_inspect_stat_e;
+
+/* counted per request, ahead of the per-header counters of a worker */
+typedef enum {
+	NGX_HEADER_INSPECT_REQ_INSPECTED = 0,
+	NGX_HEADER_INSPECT_REQ_BLOCKED,
+	NGX_HEADER_INSPECT_REQ_UNINSPECTED,    /* headers without a parser or rule */
+	NGX_HEADER_INSPECT_REQ_STRIPPED,       /* headers removed unparsed, by allowlist or policy */
+	NGX_HEADER_INSPECT_REQ_PENALIZED,      /* rejected unparsed by inspect_headers_penalty */
+	NGX_HEADER_INSPECT_REQ_LIMITED,        /* rejected unparsed by inspect_headers_max_count or _max_total_size */
+	NGX_HEADER_INSPECT_NREQ_STATS
+} ngx_header_inspect_req_stat_e;
+
+/* why a value was rejected, named in ngx_header_inspect_errors[] */
+typedef enum {
+	NGX_HEADER_INSPECT_ERR_NONE = 0,
+	NGX_HEADER_INSPECT_ERR_INVALID,          /* rejected without a more specific reason */
+	NGX_HEADER_INSPECT_ERR_BAD_CHAR,         /* CTL or obs-text, found before parsing */
+	NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR,
+	NGX_HEADER_INSPECT_ERR_UNEXPECTED_END,
+	NGX_HEADER_INSPECT_ERR_TOO_SHORT,
+	NGX_HEADER_INSPECT_ERR_TOO_LONG,
+	NGX_HEADER_INSPECT_ERR_EMPTY,
+	NGX_HEADER_INSPECT_ERR_BAD_PREFIX,
+	NGX_HEADER_INSPECT_ERR_BAD_TOKEN,
+	NGX_HEADER_INSPECT_ERR_BAD_QVALUE,
+	NGX_HEADER_INSPECT_ERR_BAD_RANGE,
+	NGX_HEADER_INSPECT_ERR_TOO_MANY_SETS,
+	NGX_HEADER_INSPECT_ERR_TOO_LARGE,
+	NGX_HEADER_INSPECT_ERR_BAD_DATE,
+	NGX_HEADER_INSPECT_ERR_TRAILING,
+	NGX_HEADER_INSPECT_ERR_BAD_ETAG,
+	NGX_HEADER_INSPECT_ERR_BAD_BASE64,
+	NGX_HEADER_INSPECT_ERR_BAD_DIGEST,
+	NGX_HEADER_INSPECT_ERR_BAD_CREDENTIALS,
+	NGX_HEADER_INSPECT_ERR_TOO_MANY_HEADERS,
+	NGX_HEADER_INSPECT_ERR_DUPLICATE
+} ngx_header_inspect_err_e;
+
+/* index of a header counter in the slot of a worker */
+#define ngx_header_inspect_stat(row, stat) (NGX_HEADER_INSPECT_NREQ_STATS + (row) * NGX_HEADER_INSPECT_NSTATS + (stat))
+
+/*
+ * With inspect_headers_profile the parser calls are timed, the
+ * nanoseconds go into a log-linear histogram: 4 buckets per power of
+ * two, the last one takes everything from about 1.8 ms on.
+ */
+#define NGX_HEADER_INSPECT_HIST_SUB     2   /* log2 of the buckets per power of two */
+#define NGX_HEADER_INSPECT_HIST_BUCKETS 80
+
+typedef enum {
+	NGX_HEADER_INSPECT_PROF_CALLS = 0,
+	NGX_HEADER_INSPECT_PROF_BYTES,
+	NGX_HEADER_INSPECT_PROF_NSEC,
+	NGX_HEADER_INSPECT_PROF_HIST,
+	NGX_HEADER_INSPECT_PROF_SIZE = NGX_HEADER_INSPECT_PROF_HIST + NGX_HEADER_INSPECT_HIST_BUCKETS
+} ngx_header_inspect_prof_e;
+
+/* the profile counters follow those of all rows */
+#define ngx_header_inspect_prof(nrows, row, k) (ngx_header_inspect_stat(nrows, 0) + (row) * NGX_HEADER_INSPECT_PROF_SIZE + (k))
+
+/*
+ * In shared memory.  Each worker has a slot of stride counters (whole
+ * cache lines) and is the only one writing to it, so the counters are
+ * plain increments; the status handler sums up the slots.
+ */
+/*
+ * inspect_headers_census: the names of uninspected headers are counted
+ * in a count-min sketch of DEPTH rows of width counters, shared by all
+ * workers and updated with atomic adds.  A name whose estimate gets
+ * over floor, the smallest estimate in the top list once it is full,
+ * takes the zone mutex and goes into the top list, replacing the entry
+ * with the smallest estimate.  The counts shown are the estimates.
+ */
+#define NGX_HEADER_INSPECT_CENSUS_DEPTH 4
+#define NGX_HEADER_INSPECT_CENSUS_NAME  64        /* longer names are cut */
+
+typedef struct {
+	uint32_t     hash[2];      /* of the whole name, for the sketch */
+	ngx_uint_t   len;
+	u_char       name[NGX_HEADER_INSPECT_CENSUS_NAME];
+	ngx_atomic_t bytes;        /* value bytes since it is in the list */
+	ngx_atomic_t max_len;      /* longest value since then */
+} ngx_header_inspect_census_entry_t;
+
+typedef struct {
+	ngx_uint_t   width;        /* a power of two */
+	ngx_uint_t   top;
+	ngx_uint_t   lengths;      /* value lengths are added up */
+	ngx_atomic_t ntop;         /* entries in use */
+	ngx_atomic_t floor;
+	ngx_header_inspect_census_entry_t *entries;
+	ngx_atomic_t counters[1];  /* DEPTH * width */
+} ngx_header_inspect_census_t;
+
+/* what the status handler shows of an entry */
+typedef struct {
+	ngx_str_t    name;
+	uint64_t     count;
+	uint64_t     bytes;
+	uint64_t     max_len;
+} ngx_header_inspect_census_top_t;
+
+typedef struct ngx_header_inspect_stats_s ngx_header_inspect_stats_t;
+
+struct ngx_header_inspect_stats_s {
+	ngx_uint_t nworkers;
+	ngx_uint_t nrows;        /* the built-in headers, then one per inspect_headers_rule */
+	ngx_uint_t profile;      /* there are profile counters */
+	size_t     stride;
+	ngx_header_inspect_census_t *census;
+	ngx_atomic_t *pids;      /* of the workers counting here, 0 once they exited */
+	ngx_header_inspect_stats_t *next;
+	uint64_t   counters[1];
+};
+
+/* at shpool->data of inspect_headers_zone */
+typedef struct {
+	ngx_header_inspect_stats_t *stats;    /* the layout of the running configuration */
+	ngx_header_inspect_stats_t *retired;  /* earlier layouts, freed once their workers are gone */
+} ngx_header_inspect_zone_t;
+
+/* violations kept per request for $inspect_headers_violations, further ones are only counted */
+#define NGX_HEADER_INSPECT_MAX_VIOLATIONS 8
+
+/* bytes of a client-supplied name or value printed in an error_log line */
+#define NGX_HEADER_INSPECT_ALERT_EXCERPT  32
+
+typedef struct {
+	ngx_header_inspect_header_t *hdr;
+	ngx_uint_t                   index; /* of the header in the request */
+	ngx_uint_t                   code;  /* ngx_header_inspect_err_e */
+	ngx_int_t                    pos;
+	ngx_uint_t                   stripped; /* the header was removed instead of blocking */
+} ngx_header_inspect_violation_t;
+
+typedef struct {
+	uint64_t   nsec;         /* spent in the parsers, with inspect_headers_profile */
+	ngx_uint_t nviolations;
+	ngx_header_inspect_violation_t violations[NGX_HEADER_INSPECT_MAX_VIOLATIONS];
+	u_char    *strip;        /* bitmap by header index, removed once inspected */
+	ngx_uint_t nstripped;
+	u_char    *kept;         /* bitmap by policy slot, violations not stripped, all of them */
+	ngx_uint_t nslots;
+	unsigned   timed:1;
+	unsigned   blocked:1;
+	unsigned   penalized:1;  /* by inspect_headers_penalty, not parsed */
+	unsigned   limited:1;    /* over inspect_headers_max_count or _max_total_size, not parsed */
+} ngx_header_inspect_ctx_t;
+
+/*
+ * inspect_headers_log.  Violations wait in a small table until the next
+ * flush, so repeats of the same (client, header, code) become one line
+ * with a count; a slot taken by another event is written out first.
+ */
+#define NGX_HEADER_INSPECT_LOG_SLOTS       64
+#define NGX_HEADER_INSPECT_LOG_EXCERPT     64    /* bytes of the value, before escaping */
+#define NGX_HEADER_INSPECT_LOG_MAX_EXCERPT 1024
+
+/* a line without the client, header name, code and excerpt */
+#define NGX_HEADER_INSPECT_LOG_LINE                                            \
+	(sizeof("{\"time\":.,\"client\":\"\",\"header\":\"\",\"code\":\"\",\"offset\":,"      \
+	        "\"length\":,\"excerpt\":\"\",\"count\":}\n") - 1                         \
+	 + NGX_TIME_T_LEN + 3 + 3 * NGX_INT_T_LEN + NGX_SIZE_T_LEN)
+
+typedef struct {
+	ngx_header_inspect_header_t *hdr;   /* NULL in a free slot */
+	ngx_uint_t  code;
+	ngx_int_t   pos;
+	ngx_uint_t  count;
+	size_t      len;                    /* of the whole value */
+	size_t      excerpt_len;
+	u_char     *excerpt;
+	time_t      sec;                    /* of the first one */
+	ngx_msec_t  msec;
+	uint32_t    hash;
+	size_t      addr_len;
+	u_char      addr[NGX_SOCKADDR_STRLEN];
+} ngx_header_inspect_log_event_t;
+
+typedef struct {
+	ngx_open_file_t *file;
+	u_char          *start;
+	u_char          *pos;
+	u_char          *last;
+	ngx_event_t     *event;             /* writes everything out after flush */
+	ngx_msec_t       flush;
+	size_t           excerpt;
+	ngx_uint_t       rate;              /* lines per period, 0 for no limit */
+	ngx_msec_t       period;
+	uint64_t         tokens;            /* a line costs period of them */
+	ngx_msec_t       refilled;
+	ngx_uint_t       dropped;           /* events over the rate since the last line */
+	ngx_header_inspect_log_event_t *events;
+} ngx_header_inspect_log_t;
+
+/*
+ * inspect_headers_capture: a file mapped by every worker, so tools can
+ * read it while nginx runs.  The ring header is followed by the code
+ * names (NUL terminated) and, from offset slots on, nslots slots of
+ * slot_size bytes.  Each violating request that is sampled takes the
+ * next ticket and writes its record into slot ticket % nslots; the seq
+ * of the slot is odd while it is written, so a reader that copies a
+ * slot and sees the same even seq before and after has a whole record.
+ */
+#define NGX_HEADER_INSPECT_RING_VERSION 1
+#define NGX_HEADER_INSPECT_RING_SLOTS   4096      /* offset of the first slot */
+#define NGX_HEADER_INSPECT_RING_RECORD  4096      /* default slot size */
+
+typedef struct {
+	u_char       magic[4];     /* "NHIC" */
+	uint16_t     version;
+	uint16_t     ncodes;
+	uint32_t     nslots;
+	uint32_t     slot_size;
+	uint32_t     slots;
+	uint32_t     codes;        /* offset of the code names */
+	ngx_atomic_t next;         /* the next ticket */
+} ngx_header_inspect_ring_t;
+
+#define NGX_HEADER_INSPECT_REC_BLOCKED   0x0001
+#define NGX_HEADER_INSPECT_REC_TRUNCATED 0x0002  /* the headers did not all fit */
+#define NGX_HEADER_INSPECT_REC_STRIPPED  0x0004  /* headers with violations were removed, they are in here */
+
+/*
+ * A record: this header, nviolations ngx_header_inspect_rec_violation_t,
+ * the client address, then per header a uint16_t name and value length
+ * followed by the name and value.
+ */
+typedef struct {
+	uint64_t seq;              /* 2 * ticket + 1 while written, 2 * ticket + 2 once done */
+	uint64_t msec;             /* since the epoch */
+	uint32_t pid;
+	uint32_t len;              /* of what follows this header */
+	uint16_t flags;
+	uint16_t nviolations;
+	uint16_t nheaders;
+	uint16_t addr_len;
+} ngx_header_inspect_rec_t;
+
+typedef struct {
+	uint16_t index;            /* of the header in the request */
+	uint16_t code;             /* ngx_header_inspect_err_e */
+	int32_t  pos;
+} ngx_header_inspect_rec_violation_t;
+
+typedef struct {
+	ngx_str_t   path;
+	size_t      size;
+	size_t      record;
+	ngx_uint_t  sample;        /* record one in sample violating requests */
+	ngx_uint_t  seen;          /* violating requests of this worker */
+	ngx_header_inspect_ring_t *ring;
+} ngx_header_inspect_capture_t;
+
+/*
+ * inspect_headers_penalty, in a zone of its own.  Each client has a
+ * score, in thousandths of a request, that goes up by 1000 with every
+ * request with violations and down by threshold requests per window.
+ * At threshold the client is rejected for ttl, before its headers are
+ * parsed.  As in limit_req, the nodes are in an rbtree by key and an
+ * LRU queue, whose tail is freed when the zone is full.
+ */
+typedef struct {
+	u_char       color;
+	u_char       boxed;        /* until is set, LOCAL or REMOTE */
+	u_short      len;
+	ngx_queue_t  queue;
+	ngx_queue_t  box;          /* in the boxed queue when LOCAL */
+	ngx_msec_t   last;         /* the score was last lowered */
+	ngx_uint_t   score;
+	ngx_msec_t   until;
+	u_char       data[1];
+} ngx_header_inspect_penalty_node_t;
+
+#define NGX_HEADER_INSPECT_PENALTY_LOCAL   1  /* boxed here, sent to the peers */
+#define NGX_HEADER_INSPECT_PENALTY_REMOTE  2  /* boxed by a peer */
+
+typedef struct {
+	ngx_rbtree_t       rbtree;
+	ngx_rbtree_node_t  sentinel;
+	ngx_queue_t        queue;
+	ngx_queue_t        boxed;  /* the LOCAL nodes, for inspect_headers_penalty_sync */
+} ngx_header_inspect_penalty_sh_t;
+
+typedef struct {
+	ngx_header_inspect_penalty_sh_t *sh;
+	ngx_slab_pool_t           *shpool;
+	ngx_shm_zone_t            *zone;
+	ngx_http_complex_value_t   key;
+	ngx_uint_t                 threshold;  /* in thousandths */
+	ngx_msec_t                 window;
+	ngx_msec_t                 ttl;
+} ngx_header_inspect_penalty_t;
+
+/*
+ * inspect_headers_penalty_sync.  Worker 0 of each node sends the
+ * clients it boxed to every peer each interval, and merges what the
+ * peers send into its own zone; peers do not pass entries on.  A
+ * datagram is the magic, the version, a reserved byte, the number of
+ * entries and the time it was sent in seconds, both in network order,
+ * then per entry the milliseconds left in network order, the key
+ * length and the key, and last the HMAC-SHA1 of all that keyed with
+ * the secret.
+ */
+#define NGX_HEADER_INSPECT_SYNC_MAGIC    "NHIP"
+#define NGX_HEADER_INSPECT_SYNC_VERSION  2
+#define NGX_HEADER_INSPECT_SYNC_HEADER   12
+#define NGX_HEADER_INSPECT_SYNC_ENTRY    5      /* before the key */
+#define NGX_HEADER_INSPECT_SYNC_MAC      20     /* SHA1 digest */
+#define NGX_HEADER_INSPECT_SYNC_DGRAM    1400   /* fits a 1500 byte MTU */
+#define NGX_HEADER_INSPECT_SYNC_BATCH    16     /* datagrams per interval */
+#define NGX_HEADER_INSPECT_SYNC_SKEW     30     /* seconds a datagram may be early or late, against replays */
+#define NGX_HEADER_INSPECT_SYNC_READS    32     /* datagrams read per event */
+
+typedef struct {
+	ngx_header_inspect_penalty_t *penalty;
+	ngx_addr_t         listen;
+	ngx_array_t       *peers;       /* ngx_addr_t */
+	ngx_msec_t         interval;
+	ngx_sha1_t         ipad;        /* HMAC states after the padded secret */
+	ngx_sha1_t         opad;
+	ngx_uint_t         rejected;    /* datagrams with a bad MAC or time, logged per interval */
+	ngx_connection_t  *connection;  /* worker 0 only */
+	ngx_event_t        event;
+	u_char            *buf;         /* NGX_HEADER_INSPECT_SYNC_BATCH datagrams */
+	ngx_uint_t         failed;      /* opening the socket failed, and was logged */
+} ngx_header_inspect_sync_t;
+
+typedef struct {
+	/* lowercased header name -> ngx_header_inspect_header_t */
+	ngx_hash_t   headers;
+	ngx_array_t *rules;    /* ngx_header_inspect_rule_t */
+	ngx_array_t *others;   /* ngx_header_inspect_other_t */
+	/* compiled defaults of the inspect_headers_* token lists */
+	ngx_header_inspect_vocab_t *vocabs[NGX_HEADER_INSPECT_NVOCABS];
+
+	ngx_shm_zone_t             *zone;      /* inspect_headers_zone */
+	ngx_header_inspect_zone_t  *sh;
+	ngx_header_inspect_stats_t *stats;
+	uint64_t                   *counters;  /* the slot of this worker, NULL without a zone */
+	ngx_uint_t                  profile;   /* inspect_headers_profile is on somewhere */
+	ngx_uint_t                  post_read; /* a server inspects in NGX_HTTP_POST_READ_PHASE */
+
+	ngx_uint_t                  census_top;     /* inspect_headers_census, 0 if off */
+	ngx_uint_t                  census_width;
+	ngx_uint_t                  census_lengths;
+	ngx_header_inspect_census_t *census;
+
+	ngx_header_inspect_log_t   *vlog;      /* inspect_headers_log */
+	ngx_header_inspect_capture_t *capture; /* inspect_headers_capture */
+	ngx_header_inspect_penalty_t *penalty; /* inspect_headers_penalty */
+	ngx_header_inspect_sync_t  *sync;      /* inspect_headers_penalty_sync */
+} ngx_header_inspect_main_conf_t;
+
+/* byte classes, tested through ngx_header_inspect_chars[] */
+#define NGX_HEADER_INSPECT_DIGIT    0x0001
+#define NGX_HEADER_INSPECT_ALPHA    0x0002
+#define NGX_HEADER_INSPECT_LOWER    0x0004
+#define NGX_HEADER_INSPECT_HEX      0x0008
+#define NGX_HEADER_INSPECT_TCHAR    0x0010
+#define NGX_HEADER_INSPECT_TOKEN68  0x0020
+#define NGX_HEADER_INSPECT_BASE64   0x0040
+#define NGX_HEADER_INSPECT_HOST     0x0080
+#define NGX_HEADER_INSPECT_IP6      0x0100
+#define NGX_HEADER_INSPECT_LABEL    0x0200
+#define NGX_HEADER_INSPECT_PRODUCT  0x0400
+#define NGX_HEADER_INSPECT_COMMENT  0x0800
+#define NGX_HEADER_INSPECT_MEDIA    0x1000
+#define NGX_HEADER_INSPECT_CSDELIM  0x2000
+#define NGX_HEADER_INSPECT_QDTEXT   0x4000
+
+#define ngx_header_inspect_is(c, cls) (ngx_header_inspect_chars[(u_char) (c)] & (cls))
+
+/* bytes skipped in bulk by ngx_header_inspect_span() */
+typedef struct {
+	u_char   lo[16];  /* low nibble -> bitmask of the high nibbles (0-7) in the set */
+	uint32_t map[4];  /* the same set as a bitmap, for the scalar path */
+} ngx_header_inspect_set_t;
+
+typedef size_t (*ngx_header_inspect_span_pt)(u_char *p, size_t len, ngx_header_inspect_set_t *set);
+typedef size_t (*ngx_header_inspect_ctl_pt)(u_char *p, size_t len);
+typedef size_t (*ngx_header_inspect_decode_pt)(u_char *dst, u_char *src, size_t len);
+
+/* Basic credentials are decoded this many base64 characters at a time */
+#define NGX_HEADER_INSPECT_BASIC_CHUNK 1024
 
+/* inspect_headers_phase */
+#define NGX_HEADER_INSPECT_PHASE_POST_READ 0
+#define NGX_HEADER_INSPECT_PHASE_REWRITE   1
+
+/* inspect_headers_reject, the response to a blocked request, built with the configuration */
+typedef struct {
+	ngx_uint_t  status;        /* 400, 431 or NGX_HTTP_CLOSE */
+	ngx_str_t   status_line;
+	ngx_str_t   body;
+	ngx_flag_t  close;         /* no keep-alive after it */
+	ngx_flag_t  lingering;     /* off: closed once sent, not waiting for the client to stop sending */
+} ngx_header_inspect_reject_t;
 
 typedef struct {
 	ngx_flag_t inspect;
 	ngx_flag_t log;
 	ngx_flag_t log_uninspected;
 	ngx_flag_t block;
+	ngx_flag_t strip;      /* inspect_headers_strip_violations */
+	ngx_flag_t allowlist;  /* inspect_headers_strip_uninspected */
+	ngx_flag_t profile;
+	ngx_uint_t phase;      /* NGX_HEADER_INSPECT_PHASE_*, from the server level */
+
+	ngx_header_inspect_reject_t *reject;
+
+	ngx_array_t *policies; /* ngx_header_inspect_policy_t, as configured here */
+	u_char     *policy;    /* merged, ngx_header_inspect_policy_e by slot */
+	ngx_uint_t  npolicy;
+
+	ngx_int_t   max_count;       /* inspect_headers_max_count */
+	size_t      max_total_size;  /* inspect_headers_max_total_size, names and values */
+	ngx_flag_t  duplicates;      /* inspect_headers_check_duplicates */
+	ngx_array_t *lengths;  /* ngx_header_inspect_max_len_t, as configured here */
+	size_t     *max_len;   /* merged, by policy slot, 0 for no limit */
+	ngx_uint_t  nmax_len;
 
 	ngx_uint_t range_max_byteranges;
+	off_t      max_content_length;
+	ngx_int_t  max_forwards;
+	time_t     max_age;
+
+	ngx_header_inspect_vocab_t *vocabs[NGX_HEADER_INSPECT_NVOCABS];
 } ngx_header_inspect_loc_conf_t;
 
+/* table-driven recognisers, see ngx_header_inspect_dfa_run() */
+#define NGX_HEADER_INSPECT_DFA_DEAD   0
+#define NGX_HEADER_INSPECT_DFA_START  1
+#define NGX_HEADER_INSPECT_DFA_ANY    0xff  /* edge class standing for every byte */
+
+#define NGX_HEADER_INSPECT_DFA_ACCEPT 0x01
+#define NGX_HEADER_INSPECT_DFA_HOOK   0x02  /* entering the state calls dfa->hook */
+#define NGX_HEADER_INSPECT_DFA_SKIP   0x04  /* dfa->skip[state] is not empty */
+
+typedef struct {
+	ngx_uint_t  mask;   /* ngx_header_inspect_chars[] classes */
+	char       *chars;  /* additional bytes */
+} ngx_header_inspect_dfa_class_t;
+
+typedef struct {
+	u_char from;
+	u_char cls;
+	u_char to;
+} ngx_header_inspect_dfa_edge_t;
+
+/*
+ * The first violation in a value, filled in by its parser: the code,
+ * and the offset it was found at or -1 if it concerns the whole value.
+ */
+typedef struct {
+	ngx_uint_t code;
+	ngx_int_t  pos;
+} ngx_header_inspect_error_t;
+
+typedef struct {
+	ngx_header_inspect_loc_conf_t *conf;
+	ngx_header_inspect_error_t    *err;
+	ngx_uint_t                     te;
+} ngx_header_inspect_dfa_ctx_t;
+
+typedef ngx_int_t (*ngx_header_inspect_dfa_hook_pt)(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos);
+
+typedef struct {
+	ngx_uint_t                            nstates;  /* without the dead state */
+	const ngx_header_inspect_dfa_class_t *classes;  /* tried in order, like an if/else chain */
+	const ngx_header_inspect_dfa_edge_t  *edges;    /* missing edges lead to the dead state */
+	const u_char                         *accept;
+	const u_char                         *hooks;
+	ngx_header_inspect_dfa_hook_pt        hook;
+} ngx_header_inspect_dfa_spec_t;
+
+typedef struct {
+	u_char                          classes[256];  /* byte -> class, 0 for bytes in no class */
+	ngx_uint_t                      nclasses;
+	ngx_uint_t                      nstates;
+	u_char                         *next;          /* [state][class] -> state */
+	u_char                         *flags;         /* per state */
+	ngx_header_inspect_set_t       *skip;          /* per state, bytes that do not leave it */
+	ngx_header_inspect_dfa_hook_pt  hook;
+} ngx_header_inspect_dfa_t;
+
+typedef enum {
+	NGX_HEADER_INSPECT_DFA_USER_AGENT = 0,
+	NGX_HEADER_INSPECT_DFA_VIA,
+	NGX_HEADER_INSPECT_DFA_REFERER,
+	NGX_HEADER_INSPECT_DFA_TRANSFER_ENCODING,
+	NGX_HEADER_INSPECT_DFA_TRAILER,
+	NGX_HEADER_INSPECT_DFA_WARNING,
+	NGX_HEADER_INSPECT_DFA_DIGEST,
+	NGX_HEADER_INSPECT_DFA_FROM,
+	NGX_HEADER_INSPECT_NDFAS
+} ngx_header_inspect_dfa_id_e;
+
+typedef struct {
+	ngx_header_inspect_header_t  header;   /* id NGX_HEADER_INSPECT_HDR_RULE, must be first */
+	size_t                       max_len;  /* 0 for no limit */
+	ngx_header_inspect_dfa_t    *dfa;
+	ngx_uint_t                   row;      /* of its counters, after the built-in headers */
+} ngx_header_inspect_rule_t;
+
+/*
+ * inspect_headers_policy, per location an action for each header: the
+ * built-in headers by id, the rules by row, then the other headers
+ * named in a policy.
+ */
+typedef enum {
+	NGX_HEADER_INSPECT_POLICY_INSPECT = 0,  /* as inspect_headers_block_violations says */
+	NGX_HEADER_INSPECT_POLICY_LOG,          /* never blocks */
+	NGX_HEADER_INSPECT_POLICY_BLOCK,        /* always blocks */
+	NGX_HEADER_INSPECT_POLICY_STRIP,        /* removed from the request unparsed */
+	NGX_HEADER_INSPECT_POLICY_IGNORE        /* left alone */
+} ngx_header_inspect_policy_e;
+
+typedef struct {
+	ngx_header_inspect_header_t  header;   /* id NGX_HEADER_INSPECT_HDR_OTHER, must be first */
+	ngx_uint_t                   slot;     /* in the policy arrays */
+} ngx_header_inspect_other_t;
+
+/* headers that may appear once, by id, for inspect_headers_check_duplicates */
+#define NGX_HEADER_INSPECT_SINGLETONS                                            \
+	(((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_RANGE)                              \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_IF_RANGE)                         \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_IF_UNMODIFIED_SINCE)              \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_IF_MODIFIED_SINCE)                \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_DATE)                             \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_EXPIRES)                          \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_LAST_MODIFIED)                    \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_CONTENT_LENGTH)                   \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_MAX_FORWARDS)                     \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_HOST)                             \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_CONTENT_RANGE)                    \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_USER_AGENT)                       \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_FROM)                             \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_CONTENT_TYPE)                     \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_CONTENT_MD5)                      \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_AUTHORIZATION)                    \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_PROXY_AUTHORIZATION)              \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_REFERER)                          \
+	 | ((uint64_t) 1 << NGX_HEADER_INSPECT_HDR_CONTENT_LOCATION))
+
+typedef struct {
+	ngx_str_t   name;
+	ngx_uint_t  action;
+} ngx_header_inspect_policy_t;
+
+/* inspect_headers_max_len, slotted like the policies */
+typedef struct {
+	ngx_str_t   name;
+	size_t      max_len;
+} ngx_header_inspect_max_len_t;
+
+/* inspect_headers_rule regex compiler, see ngx_header_inspect_re_compile() */
+#define NGX_HEADER_INSPECT_RE_NONE       ((ngx_uint_t) -1)
+#define NGX_HEADER_INSPECT_RE_MAX_NFA    4096
+#define NGX_HEADER_INSPECT_RE_MAX_REPEAT 255
+
+typedef struct {
+	uint32_t bits[8];
+} ngx_header_inspect_re_set_t;
+
+typedef struct {
+	ngx_uint_t set;     /* bytes of sets[set] lead to 'to', NONE if there is no such edge */
+	ngx_uint_t to;
+	ngx_uint_t eps[2];  /* epsilon edges, NONE if unused */
+} ngx_header_inspect_re_state_t;
+
+typedef struct {
+	ngx_uint_t start;
+	ngx_uint_t end;     /* has no edges yet */
+} ngx_header_inspect_re_frag_t;
+
+typedef struct {
+	u_char      *start;
+	u_char      *p;
+	u_char      *end;
+	ngx_array_t  states;  /* ngx_header_inspect_re_state_t, the NFA */
+	ngx_array_t  sets;    /* ngx_header_inspect_re_set_t */
+	char        *err;
+} ngx_header_inspect_re_t;
+
+/* RFC 850 and asctime dates that passed lately, direct-mapped, private to each worker */
+#define NGX_HEADER_INSPECT_DATE_BITS   6
+#define NGX_HEADER_INSPECT_DATE_CACHE  (1 << NGX_HEADER_INSPECT_DATE_BITS)
+#define NGX_HEADER_INSPECT_DATE_MIN    24    /* shortest valid HTTP-date */
+#define NGX_HEADER_INSPECT_DATE_MAX    40    /* longer than any valid HTTP-date */
+
+typedef struct {
+	size_t len;
+	u_char data[NGX_HEADER_INSPECT_DATE_MAX];
+} ngx_header_inspect_date_t;
+
+/* recognisers generated from grammars/, they return like ngx_header_inspect_dfa_run() */
+typedef ngx_int_t (*ngx_header_inspect_grammar_pt)(ngx_str_t *value, ngx_uint_t *pos);
+
 
 
 static ngx_int_t ngx_header_inspect_init(ngx_conf_t *cf);
+static ngx_int_t ngx_header_inspect_add_variables(ngx_conf_t *cf);
+static size_t ngx_header_inspect_span_scalar(u_char *p, size_t len, ngx_header_inspect_set_t *set);
+static size_t ngx_header_inspect_ctl_scalar(u_char *p, size_t len);
+static size_t ngx_header_inspect_decode_base64_scalar(u_char *dst, u_char *src, size_t len);
 static ngx_int_t ngx_header_inspect_http_date(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len);
-static ngx_int_t ngx_header_inspect_parse_base64(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, u_char *data, ngx_uint_t maxlen);
+static ngx_int_t ngx_header_inspect_parse_base64(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, u_char *data, ngx_uint_t maxlen, size_t *n);
+static ngx_int_t ngx_header_inspect_basic_credentials(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, u_char *data, ngx_uint_t maxlen);
 static ngx_int_t ngx_header_inspect_parse_entity_tag(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len);
-static ngx_int_t ngx_header_inspect_parse_languagerange(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len);
-static ngx_int_t ngx_header_inspect_range_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_acceptencoding_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_contentencoding_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_acceptlanguage_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_contentlanguage_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_acceptcharset_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_digit_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_ifmatch_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_allow_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_host_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_accept_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_connection_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_contentrange_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_useragent_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_upgrade_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_via_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_from_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_ifrange_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_pragma_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_contenttype_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_date_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, char *header, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_contentmd5_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_authorization_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_expect_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_warning_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_trailer_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_transferencoding_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_referer_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
-static ngx_int_t ngx_header_inspect_cachecontrol_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_vocab_find(ngx_header_inspect_vocab_t *vocab, u_char *p, size_t len);
+static ngx_int_t ngx_header_inspect_range_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_acceptencoding_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_contentencoding_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_pt grammar, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_digit_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value, off_t max);
+static ngx_int_t ngx_header_inspect_allow_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_host_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_connection_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_contentrange_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_useragent_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_upgrade_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_via_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_from_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_ifrange_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_pragma_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_date_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_contentmd5_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_authorization_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_expect_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_warning_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_trailer_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_transferencoding_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_referer_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_cachecontrol_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_referer_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos);
+static ngx_int_t ngx_header_inspect_transferencoding_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos);
+static ngx_int_t ngx_header_inspect_trailer_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos);
+static ngx_int_t ngx_header_inspect_warning_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos);
+static ngx_int_t ngx_header_inspect_digest_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos);
+static ngx_int_t ngx_header_inspect_rule_header(ngx_header_inspect_rule_t *rule, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value);
+static ngx_int_t ngx_header_inspect_re_alt(ngx_header_inspect_re_t *re, ngx_header_inspect_re_frag_t *f);
 static ngx_int_t ngx_header_inspect_process_request(ngx_http_request_t *r);
-
+static ngx_int_t ngx_header_inspect_post_read(ngx_http_request_t *r);
+
+static char *ngx_header_inspect_rule(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_vocab_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_policy_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_max_len_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_reject_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_capture_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_penalty_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_penalty_sync_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_census_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_header_inspect_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static ngx_int_t ngx_header_inspect_init_module(ngx_cycle_t *cycle);
+static ngx_int_t ngx_header_inspect_init_process(ngx_cycle_t *cycle);
+static void ngx_header_inspect_exit_process(ngx_cycle_t *cycle);
+static void *ngx_header_inspect_create_main_conf(ngx_conf_t *cf);
 static void *ngx_header_inspect_create_conf(ngx_conf_t *cf);
 static char *ngx_header_inspect_merge_conf(ngx_conf_t *cf, void *parent, void *child);
 
 
 
+/* indexed by ngx_header_inspect_policy_e */
+static ngx_str_t ngx_header_inspect_policy_actions[] = {
+	ngx_string("inspect"),
+	ngx_string("log"),
+	ngx_string("block"),
+	ngx_string("strip"),
+	ngx_string("ignore"),
+	ngx_null_string
+};
+
+/* nginx has framed the request by these already, removing them would desync the upstream */
+static ngx_str_t ngx_header_inspect_unstrippable[] = {
+	ngx_string("Host"),
+	ngx_string("Content-Length"),
+	ngx_string("Transfer-Encoding"),
+	ngx_null_string
+};
+
+static ngx_conf_enum_t ngx_header_inspect_phases[] = {
+	{ ngx_string("post_read"), NGX_HEADER_INSPECT_PHASE_POST_READ },
+	{ ngx_string("rewrite"), NGX_HEADER_INSPECT_PHASE_REWRITE },
+	{ ngx_null_string, 0 }
+};
+
+static ngx_str_t ngx_header_inspect_content_codings[] = {
+	ngx_string("br"),
+	ngx_string("compress"),
+	ngx_string("deflate"),
+	ngx_string("exi"),
+	ngx_string("gzip"),
+	ngx_string("identity"),
+	ngx_string("pack200-gzip"),
+	ngx_string("zstd"),
+	ngx_null_string
+};
+
+static ngx_str_t ngx_header_inspect_transfer_codings[] = {
+	ngx_string("chunked"),
+	ngx_string("compress"),
+	ngx_string("deflate"),
+	ngx_string("gzip"),
+	ngx_string("identity"),
+	ngx_null_string
+};
+
+static ngx_str_t ngx_header_inspect_methods[] = {
+	ngx_string("GET"),
+	ngx_string("POST"),
+	ngx_string("PUT"),
+	ngx_string("HEAD"),
+	ngx_string("DELETE"),
+	ngx_string("OPTIONS"),
+	ngx_string("TRACE"),
+	ngx_string("CONNECT"),
+	ngx_string("PATCH"),
+	ngx_null_string
+};
+
+/* as per 13.5.1 of RFC2616 only hop-by-hop headers, plus close and keep-alive */
+static ngx_str_t ngx_header_inspect_connection_options[] = {
+	ngx_string("close"),
+	ngx_string("keep-alive"),
+	ngx_string("Proxy-Authenticate"),
+	ngx_string("Proxy-Authorization"),
+	ngx_string("TE"),
+	ngx_string("Trailer"),
+	ngx_string("Transfer-Encoding"),
+	ngx_string("Upgrade"),
+	ngx_null_string
+};
+
+static ngx_str_t ngx_header_inspect_cache_directives[] = {
+	ngx_string("no-cache"),
+	ngx_string("no-store"),
+	ngx_string("no-transform"),
+	ngx_string("only-if-cached"),
+	ngx_string("max-age"),
+	ngx_string("max-stale"),
+	ngx_string("min-fresh"),
+	ngx_null_string
+};
+
+static ngx_header_inspect_vocab_kind_t ngx_header_inspect_cache_directive_kinds[] = {
+	{ ngx_string("no-cache"),       NGX_HEADER_INSPECT_CC_NOARG },
+	{ ngx_string("no-store"),       NGX_HEADER_INSPECT_CC_NOARG },
+	{ ngx_string("no-transform"),   NGX_HEADER_INSPECT_CC_NOARG },
+	{ ngx_string("only-if-cached"), NGX_HEADER_INSPECT_CC_NOARG },
+	{ ngx_string("max-age"),        NGX_HEADER_INSPECT_CC_MAX_AGE },
+	{ ngx_string("min-fresh"),      NGX_HEADER_INSPECT_CC_DELTA },
+	{ ngx_string("max-stale"),      NGX_HEADER_INSPECT_CC_OPT_DELTA },
+	{ ngx_null_string,              0 }
+};
+
+/* the auth-params of RFC 2617 */
+static ngx_str_t ngx_header_inspect_digest_params[] = {
+	ngx_string("username"),
+	ngx_string("realm"),
+	ngx_string("nonce"),
+	ngx_string("uri"),
+	ngx_string("response"),
+	ngx_string("algorithm"),
+	ngx_string("cnonce"),
+	ngx_string("opaque"),
+	ngx_string("qop"),
+	ngx_string("nc"),
+	ngx_null_string
+};
+
+/* indexed by ngx_header_inspect_vocab_id_e, methods are case-sensitive */
+static ngx_header_inspect_vocab_spec_t ngx_header_inspect_vocab_specs[] = {
+	{ 1, ngx_header_inspect_content_codings,    NULL },
+	{ 1, ngx_header_inspect_transfer_codings,   NULL },
+	{ 0, ngx_header_inspect_methods,            NULL },
+	{ 1, ngx_header_inspect_connection_options, NULL },
+	{ 1, ngx_header_inspect_cache_directives,   ngx_header_inspect_cache_directive_kinds },
+	{ 1, ngx_header_inspect_digest_params,      NULL }
+};
+
 static ngx_command_t ngx_header_inspect_commands[] = {
 	{
 		ngx_string("inspect_headers"),
@@ -88,6 +951,30 @@ static ngx_command_t ngx_header_inspect_commands[] = {
 		offsetof(ngx_header_inspect_loc_conf_t, block),
 		NULL
 	},
+	{
+		ngx_string("inspect_headers_reject"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_reject_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_strip_violations"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+		ngx_conf_set_flag_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, strip),
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_strip_uninspected"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+		ngx_conf_set_flag_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, allowlist),
+		NULL
+	},
 	{
 		ngx_string("inspect_headers_log_uninspected"),
 		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
@@ -96,6 +983,30 @@ static ngx_command_t ngx_header_inspect_commands[] = {
 		offsetof(ngx_header_inspect_loc_conf_t, log_uninspected),
 		NULL
 	},
+	{
+		ngx_string("inspect_headers_policy"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_policy_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_phase"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
+		ngx_conf_set_enum_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, phase),
+		&ngx_header_inspect_phases
+	},
+	{
+		ngx_string("inspect_headers_profile"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+		ngx_conf_set_flag_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, profile),
+		NULL
+	},
 	{
 		ngx_string("inspect_headers_range_max_byteranges"),
 		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
@@ -104,17 +1015,685 @@ static ngx_command_t ngx_header_inspect_commands[] = {
 		offsetof(ngx_header_inspect_loc_conf_t, range_max_byteranges),
 		NULL
 	},
+	{
+		ngx_string("inspect_headers_max_content_length"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+		ngx_conf_set_off_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, max_content_length),
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_max_forwards"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+		ngx_conf_set_num_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, max_forwards),
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_max_age"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+		ngx_conf_set_sec_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, max_age),
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_max_count"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+		ngx_conf_set_num_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, max_count),
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_max_total_size"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+		ngx_conf_set_size_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, max_total_size),
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_max_len"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_max_len_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_check_duplicates"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+		ngx_conf_set_flag_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, duplicates),
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_content_codings"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_vocab_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, vocabs[NGX_HEADER_INSPECT_VOCAB_CONTENT_CODINGS]),
+		&ngx_header_inspect_vocab_specs[NGX_HEADER_INSPECT_VOCAB_CONTENT_CODINGS]
+	},
+	{
+		ngx_string("inspect_headers_transfer_codings"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_vocab_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, vocabs[NGX_HEADER_INSPECT_VOCAB_TRANSFER_CODINGS]),
+		&ngx_header_inspect_vocab_specs[NGX_HEADER_INSPECT_VOCAB_TRANSFER_CODINGS]
+	},
+	{
+		ngx_string("inspect_headers_methods"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_vocab_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, vocabs[NGX_HEADER_INSPECT_VOCAB_METHODS]),
+		&ngx_header_inspect_vocab_specs[NGX_HEADER_INSPECT_VOCAB_METHODS]
+	},
+	{
+		ngx_string("inspect_headers_connection_options"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_vocab_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, vocabs[NGX_HEADER_INSPECT_VOCAB_CONNECTION_OPTIONS]),
+		&ngx_header_inspect_vocab_specs[NGX_HEADER_INSPECT_VOCAB_CONNECTION_OPTIONS]
+	},
+	{
+		ngx_string("inspect_headers_cache_directives"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_vocab_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, vocabs[NGX_HEADER_INSPECT_VOCAB_CACHE_DIRECTIVES]),
+		&ngx_header_inspect_vocab_specs[NGX_HEADER_INSPECT_VOCAB_CACHE_DIRECTIVES]
+	},
+	{
+		ngx_string("inspect_headers_digest_params"),
+		NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_vocab_slot,
+		NGX_HTTP_LOC_CONF_OFFSET,
+		offsetof(ngx_header_inspect_loc_conf_t, vocabs[NGX_HEADER_INSPECT_VOCAB_DIGEST_PARAMS]),
+		&ngx_header_inspect_vocab_specs[NGX_HEADER_INSPECT_VOCAB_DIGEST_PARAMS]
+	},
+	{
+		ngx_string("inspect_headers_rule"),
+		NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE23,
+		ngx_header_inspect_rule,
+		NGX_HTTP_MAIN_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_zone"),
+		NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE2,
+		ngx_header_inspect_zone,
+		NGX_HTTP_MAIN_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_log"),
+		NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_log,
+		NGX_HTTP_MAIN_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_capture"),
+		NGX_HTTP_MAIN_CONF|NGX_CONF_2MORE,
+		ngx_header_inspect_capture_slot,
+		NGX_HTTP_MAIN_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_penalty"),
+		NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_penalty_slot,
+		NGX_HTTP_MAIN_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_penalty_sync"),
+		NGX_HTTP_MAIN_CONF|NGX_CONF_2MORE,
+		ngx_header_inspect_penalty_sync_slot,
+		NGX_HTTP_MAIN_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_census"),
+		NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+		ngx_header_inspect_census_slot,
+		NGX_HTTP_MAIN_CONF_OFFSET,
+		0,
+		NULL
+	},
+	{
+		ngx_string("inspect_headers_status"),
+		NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS,
+		ngx_header_inspect_status,
+		0,
+		0,
+		NULL
+	},
 	ngx_null_command
 };
 
-static ngx_http_module_t ngx_header_inspect_module_ctx = {
-	NULL,                             /* preconfiguration */
-	ngx_header_inspect_init,          /* postconfiguration */
+static ngx_int_t ngx_header_inspect_time_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_header_inspect_verdict_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_header_inspect_violations_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_header_inspect_count_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data);
+
+static ngx_http_variable_t ngx_header_inspect_vars[] = {
+	{ ngx_string("inspect_headers_time"), NULL, ngx_header_inspect_time_variable, 0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+	{ ngx_string("inspect_headers_verdict"), NULL, ngx_header_inspect_verdict_variable, 0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+	{ ngx_string("inspect_headers_violations"), NULL, ngx_header_inspect_violations_variable, 0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+	{ ngx_string("inspect_headers_count"), NULL, ngx_header_inspect_count_variable, 0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+	ngx_http_null_variable
+};
 
-	NULL,                             /* create main configuration */
-	NULL,                             /* init main configuration */
+/* indexed by ngx_header_inspect_err_e */
+static ngx_str_t ngx_header_inspect_errors[] = {
+	ngx_string(""),
+	ngx_string("invalid"),
+	ngx_string("bad_char"),
+	ngx_string("illegal_char"),
+	ngx_string("unexpected_end"),
+	ngx_string("too_short"),
+	ngx_string("too_long"),
+	ngx_string("empty"),
+	ngx_string("bad_prefix"),
+	ngx_string("bad_token"),
+	ngx_string("bad_qvalue"),
+	ngx_string("bad_range"),
+	ngx_string("too_many_sets"),
+	ngx_string("too_large"),
+	ngx_string("bad_date"),
+	ngx_string("trailing"),
+	ngx_string("bad_etag"),
+	ngx_string("bad_base64"),
+	ngx_string("bad_digest"),
+	ngx_string("bad_credentials"),
+	ngx_string("too_many_headers"),
+	ngx_string("duplicate")
+};
 
-	NULL,                             /* create server configuration */
+/* what the violations of inspect_headers_max_count and _max_total_size are put on */
+static ngx_header_inspect_other_t ngx_header_inspect_request = {
+	{ ngx_string("request"), NGX_HEADER_INSPECT_HDR_OTHER },
+	(ngx_uint_t) -1
+};
+
+static ngx_header_inspect_header_t ngx_header_inspect_headers[] = {
+	{ ngx_string("Range"),               NGX_HEADER_INSPECT_HDR_RANGE },
+	{ ngx_string("If-Range"),            NGX_HEADER_INSPECT_HDR_IF_RANGE },
+	{ ngx_string("If-Unmodified-Since"), NGX_HEADER_INSPECT_HDR_IF_UNMODIFIED_SINCE },
+	{ ngx_string("If-Modified-Since"),   NGX_HEADER_INSPECT_HDR_IF_MODIFIED_SINCE },
+	{ ngx_string("Date"),                NGX_HEADER_INSPECT_HDR_DATE },
+	{ ngx_string("Expires"),             NGX_HEADER_INSPECT_HDR_EXPIRES },
+	{ ngx_string("Last-Modified"),       NGX_HEADER_INSPECT_HDR_LAST_MODIFIED },
+	{ ngx_string("Content-Encoding"),    NGX_HEADER_INSPECT_HDR_CONTENT_ENCODING },
+	{ ngx_string("Accept-Encoding"),     NGX_HEADER_INSPECT_HDR_ACCEPT_ENCODING },
+	{ ngx_string("Content-Language"),    NGX_HEADER_INSPECT_HDR_CONTENT_LANGUAGE },
+	{ ngx_string("Accept-Language"),     NGX_HEADER_INSPECT_HDR_ACCEPT_LANGUAGE },
+	{ ngx_string("Accept-Charset"),      NGX_HEADER_INSPECT_HDR_ACCEPT_CHARSET },
+	{ ngx_string("Content-Length"),      NGX_HEADER_INSPECT_HDR_CONTENT_LENGTH },
+	{ ngx_string("Max-Forwards"),        NGX_HEADER_INSPECT_HDR_MAX_FORWARDS },
+	{ ngx_string("If-Match"),            NGX_HEADER_INSPECT_HDR_IF_MATCH },
+	{ ngx_string("If-None-Match"),       NGX_HEADER_INSPECT_HDR_IF_NONE_MATCH },
+	{ ngx_string("Allow"),               NGX_HEADER_INSPECT_HDR_ALLOW },
+	{ ngx_string("Host"),                NGX_HEADER_INSPECT_HDR_HOST },
+	{ ngx_string("Accept"),              NGX_HEADER_INSPECT_HDR_ACCEPT },
+	{ ngx_string("Connection"),          NGX_HEADER_INSPECT_HDR_CONNECTION },
+	{ ngx_string("Content-Range"),       NGX_HEADER_INSPECT_HDR_CONTENT_RANGE },
+	{ ngx_string("User-Agent"),          NGX_HEADER_INSPECT_HDR_USER_AGENT },
+	{ ngx_string("Upgrade"),             NGX_HEADER_INSPECT_HDR_UPGRADE },
+	{ ngx_string("Via"),                 NGX_HEADER_INSPECT_HDR_VIA },
+	{ ngx_string("From"),                NGX_HEADER_INSPECT_HDR_FROM },
+	{ ngx_string("Pragma"),              NGX_HEADER_INSPECT_HDR_PRAGMA },
+	{ ngx_string("Content-Type"),        NGX_HEADER_INSPECT_HDR_CONTENT_TYPE },
+	{ ngx_string("Content-MD5"),         NGX_HEADER_INSPECT_HDR_CONTENT_MD5 },
+	{ ngx_string("Authorization"),       NGX_HEADER_INSPECT_HDR_AUTHORIZATION },
+	{ ngx_string("Proxy-Authorization"), NGX_HEADER_INSPECT_HDR_PROXY_AUTHORIZATION },
+	{ ngx_string("Expect"),              NGX_HEADER_INSPECT_HDR_EXPECT },
+	{ ngx_string("Warning"),             NGX_HEADER_INSPECT_HDR_WARNING },
+	{ ngx_string("Trailer"),             NGX_HEADER_INSPECT_HDR_TRAILER },
+	{ ngx_string("Transfer-Encoding"),   NGX_HEADER_INSPECT_HDR_TRANSFER_ENCODING },
+	{ ngx_string("TE"),                  NGX_HEADER_INSPECT_HDR_TE },
+	{ ngx_string("Referer"),             NGX_HEADER_INSPECT_HDR_REFERER },
+	{ ngx_string("Content-Location"),    NGX_HEADER_INSPECT_HDR_CONTENT_LOCATION },
+	{ ngx_string("Cache-Control"),       NGX_HEADER_INSPECT_HDR_CACHE_CONTROL },
+	{ ngx_null_string, 0 }
+};
+
+static const uint16_t ngx_header_inspect_chars[256] = {
+	0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, /* 0x00 - 0x07 */
+	0x0000, 0x4000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, /* 0x08 - 0x0f */
+	0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, /* 0x10 - 0x17 */
+	0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, /* 0x18 - 0x1f */
+	0x4800, 0x4010, 0x0000, 0x4010, 0x4010, 0x4010, 0x4010, 0x4010, /* SP ! " # $ % & ' */
+	0x4000, 0x4000, 0x5010, 0x7870, 0x4800, 0x7eb0, 0x7db0, 0x4060, /* ( ) * + , - . / */
+	0x5ff9, 0x5ff9, 0x5ff9, 0x5ff9, 0x5ff9, 0x5ff9, 0x5ff9, 0x5ff9, /* 0 1 2 3 4 5 6 7 */
+	0x5ff9, 0x5ff9, 0x7900, 0x4800, 0x4000, 0x4000, 0x4000, 0x4000, /* 8 9 : ; < = > ? */
+	0x4000, 0x5ffa, 0x5ffa, 0x5ffa, 0x5ffa, 0x5ffa, 0x5ffa, 0x5ff2, /* @ A B C D E F G */
+	0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, /* H I J K L M N O */
+	0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, 0x5ff2, /* P Q R S T U V W */
+	0x5ff2, 0x5ff2, 0x5ff2, 0x4000, 0x0000, 0x4000, 0x4010, 0x7830, /* X Y Z [ \ ] ^ _ */
+	0x4010, 0x5ffe, 0x5ffe, 0x5ffe, 0x5ffe, 0x5ffe, 0x5ffe, 0x5ff6, /* ` a b c d e f g */
+	0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, /* h i j k l m n o */
+	0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, 0x5ff6, /* p q r s t u v w */
+	0x5ff6, 0x5ff6, 0x5ff6, 0x4000, 0x4010, 0x4000, 0x4030, 0x0000, /* x y z { | } ~ DEL */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0x80 - 0x87 */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0x88 - 0x8f */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0x90 - 0x97 */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0x98 - 0x9f */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xa0 - 0xa7 */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xa8 - 0xaf */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xb0 - 0xb7 */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xb8 - 0xbf */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xc0 - 0xc7 */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xc8 - 0xcf */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xd0 - 0xd7 */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xd8 - 0xdf */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xe0 - 0xe7 */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xe8 - 0xef */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xf0 - 0xf7 */
+	0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, /* 0xf8 - 0xff */
+};
+
+/* picked by CPU features in ngx_header_inspect_init_scan() */
+static ngx_header_inspect_span_pt ngx_header_inspect_span = ngx_header_inspect_span_scalar;
+static ngx_header_inspect_ctl_pt ngx_header_inspect_find_ctl = ngx_header_inspect_ctl_scalar;
+static ngx_header_inspect_decode_pt ngx_header_inspect_decode_base64 = ngx_header_inspect_decode_base64_scalar;
+
+/* the base64 alphabet without padding, filled in ngx_header_inspect_init_scan() */
+static ngx_header_inspect_set_t ngx_header_inspect_base64_set;
+
+/* keeps the first violation of a value, nested parsers may report again */
+#define ngx_header_inspect_error(err, c, p)                                    \
+	do {                                                                       \
+		if ( (err)->code == NGX_HEADER_INSPECT_ERR_NONE ) {                    \
+			(err)->code = (c);                                                 \
+			(err)->pos = (ngx_int_t) (p);                                      \
+		}                                                                      \
+	} while (0)
+
+/*
+ * Built-in recognisers.  Byte classes are listed in the order the bytes
+ * were tested in the hand-written parsers, class 0 catches everything else.
+ * States start at NGX_HEADER_INSPECT_DFA_START, 0 is the dead state.
+ */
+
+/* User-Agent */
+enum { UAS_START = 1, UAS_PROD, UAS_SLASH, UAS_VER, UAS_SPACE, UAS_PAREN, UAS_N = UAS_PAREN };
+enum { UAC_PRODUCT = 1, UAC_SLASH, UAC_SP, UAC_LPAREN, UAC_RPAREN, UAC_PUNCT };
+
+static const ngx_header_inspect_dfa_class_t ngx_header_inspect_useragent_classes[] = {
+	{ NGX_HEADER_INSPECT_PRODUCT, NULL },
+	{ 0, "/" },
+	{ 0, " " },
+	{ 0, "(" },
+	{ 0, ")" },
+	{ 0, ",:;+_" },
+	{ 0, NULL }
+};
+
+static const ngx_header_inspect_dfa_edge_t ngx_header_inspect_useragent_edges[] = {
+	{ UAS_START, UAC_PRODUCT, UAS_PROD },
+	{ UAS_SPACE, UAC_PRODUCT, UAS_PROD },
+	{ UAS_PROD,  UAC_PRODUCT, UAS_PROD },
+	{ UAS_VER,   UAC_PRODUCT, UAS_VER },
+	{ UAS_PAREN, UAC_PRODUCT, UAS_PAREN },
+	{ UAS_SLASH, UAC_PRODUCT, UAS_VER },
+	{ UAS_PROD,  UAC_SLASH,   UAS_SLASH },
+	{ UAS_VER,   UAC_SP,      UAS_SPACE },
+	{ UAS_SPACE, UAC_SP,      UAS_SPACE },
+	{ UAS_PAREN, UAC_SP,      UAS_PAREN },
+	{ UAS_SPACE, UAC_LPAREN,  UAS_PAREN },
+	{ UAS_PAREN, UAC_RPAREN,  UAS_SPACE },
+	{ UAS_PAREN, UAC_PUNCT,   UAS_PAREN },
+	{ 0, 0, 0 }
+};
+
+static const u_char ngx_header_inspect_useragent_accept[] = { UAS_SPACE, UAS_PROD, UAS_VER, 0 };
+
+/* Via */
+enum { VS_START = 1, VS_PROT, VS_SLASH, VS_VER, VS_SPACE1, VS_HOST, VS_COLON, VS_PORT, VS_DELIM, VS_SPACE2, VS_PAREN, VS_PARENEND, VS_SPACE3, VS_N = VS_SPACE3 };
+enum { VC_DIGIT = 1, VC_PRODUCT, VC_SP, VC_SLASH, VC_COLON, VC_LPAREN, VC_RPAREN, VC_COMMA };
+
+static const ngx_header_inspect_dfa_class_t ngx_header_inspect_via_classes[] = {
+	{ NGX_HEADER_INSPECT_DIGIT, NULL },
+	{ NGX_HEADER_INSPECT_PRODUCT, NULL },
+	{ 0, " " },
+	{ 0, "/" },
+	{ 0, ":" },
+	{ 0, "(" },
+	{ 0, ")" },
+	{ 0, "," },
+	{ 0, NULL }
+};
+
+static const ngx_header_inspect_dfa_edge_t ngx_header_inspect_via_edges[] = {
+	{ VS_START,    VC_DIGIT,   VS_PROT },
+	{ VS_SPACE3,   VC_DIGIT,   VS_PROT },
+	{ VS_SLASH,    VC_DIGIT,   VS_VER },
+	{ VS_SPACE1,   VC_DIGIT,   VS_HOST },
+	{ VS_COLON,    VC_DIGIT,   VS_PORT },
+	{ VS_PROT,     VC_DIGIT,   VS_PROT },
+	{ VS_VER,      VC_DIGIT,   VS_VER },
+	{ VS_PORT,     VC_DIGIT,   VS_PORT },
+	{ VS_HOST,     VC_DIGIT,   VS_HOST },
+	{ VS_PAREN,    VC_DIGIT,   VS_PAREN },
+	{ VS_START,    VC_PRODUCT, VS_PROT },
+	{ VS_SPACE3,   VC_PRODUCT, VS_PROT },
+	{ VS_SLASH,    VC_PRODUCT, VS_VER },
+	{ VS_SPACE1,   VC_PRODUCT, VS_HOST },
+	{ VS_PROT,     VC_PRODUCT, VS_PROT },
+	{ VS_VER,      VC_PRODUCT, VS_VER },
+	{ VS_HOST,     VC_PRODUCT, VS_HOST },
+	{ VS_PAREN,    VC_PRODUCT, VS_PAREN },
+	{ VS_PROT,     VC_SP,      VS_SPACE1 },
+	{ VS_VER,      VC_SP,      VS_SPACE1 },
+	{ VS_HOST,     VC_SP,      VS_SPACE2 },
+	{ VS_PORT,     VC_SP,      VS_SPACE2 },
+	{ VS_DELIM,    VC_SP,      VS_SPACE3 },
+	{ VS_SPACE1,   VC_SP,      VS_SPACE1 },
+	{ VS_SPACE2,   VC_SP,      VS_SPACE2 },
+	{ VS_SPACE3,   VC_SP,      VS_SPACE3 },
+	{ VS_PAREN,    VC_SP,      VS_PAREN },
+	{ VS_PROT,     VC_SLASH,   VS_SLASH },
+	{ VS_PAREN,    VC_SLASH,   VS_PAREN },
+	{ VS_HOST,     VC_COLON,   VS_COLON },
+	{ VS_PAREN,    VC_COLON,   VS_PAREN },
+	{ VS_SPACE2,   VC_LPAREN,  VS_PAREN },
+	{ VS_PAREN,    VC_RPAREN,  VS_PARENEND },
+	{ VS_HOST,     VC_COMMA,   VS_DELIM },
+	{ VS_PORT,     VC_COMMA,   VS_DELIM },
+	{ VS_PARENEND, VC_COMMA,   VS_DELIM },
+	{ VS_PAREN,    VC_COMMA,   VS_PAREN },
+	{ 0, 0, 0 }
+};
+
+static const u_char ngx_header_inspect_via_accept[] = { VS_HOST, VS_PORT, VS_PARENEND, 0 };
+
+/* Referer and Content-Location, absoluteURI only */
+enum { RS_START = 1, RS_SCHEME, RS_COLON, RS_SLASH1, RS_SLASH2, RS_HOST, RS_BR1, RS_IP6, RS_BR2, RS_COLON2, RS_PORT, RS_PATH, RS_N = RS_PATH };
+enum { RC_NONHEX = 1, RC_HEXALPHA, RC_DIGIT, RC_SLASH, RC_COLON, RC_LBRACKET, RC_RBRACKET };
+
+static const ngx_header_inspect_dfa_class_t ngx_header_inspect_referer_classes[] = {
+	{ 0, "ghijklmnopqrstuvwxyzGHIJKLMNOPQRSTUVWXYZ." },
+	{ NGX_HEADER_INSPECT_ALPHA, NULL },
+	{ NGX_HEADER_INSPECT_DIGIT, NULL },
+	{ 0, "/" },
+	{ 0, ":" },
+	{ 0, "[" },
+	{ 0, "]" },
+	{ 0, NULL }
+};
+
+static const ngx_header_inspect_dfa_edge_t ngx_header_inspect_referer_edges[] = {
+	{ RS_START,  RC_NONHEX,   RS_SCHEME },
+	{ RS_SLASH2, RC_NONHEX,   RS_HOST },
+	{ RS_HOST,   RC_NONHEX,   RS_HOST },
+	{ RS_SCHEME, RC_NONHEX,   RS_SCHEME },
+	{ RS_START,  RC_HEXALPHA, RS_SCHEME },
+	{ RS_SLASH2, RC_HEXALPHA, RS_HOST },
+	{ RS_BR1,    RC_HEXALPHA, RS_IP6 },
+	{ RS_HOST,   RC_HEXALPHA, RS_HOST },
+	{ RS_SCHEME, RC_HEXALPHA, RS_SCHEME },
+	{ RS_IP6,    RC_HEXALPHA, RS_IP6 },
+	{ RS_SLASH2, RC_DIGIT,    RS_HOST },
+	{ RS_COLON2, RC_DIGIT,    RS_PORT },
+	{ RS_BR1,    RC_DIGIT,    RS_IP6 },
+	{ RS_PORT,   RC_DIGIT,    RS_PORT },
+	{ RS_HOST,   RC_DIGIT,    RS_HOST },
+	{ RS_IP6,    RC_DIGIT,    RS_IP6 },
+	{ RS_COLON,  RC_SLASH,    RS_SLASH1 },
+	{ RS_SLASH1, RC_SLASH,    RS_SLASH2 },
+	{ RS_PORT,   RC_SLASH,    RS_PATH },
+	{ RS_HOST,   RC_SLASH,    RS_PATH },
+	{ RS_BR2,    RC_SLASH,    RS_PATH },
+	{ RS_SCHEME, RC_COLON,    RS_COLON },
+	{ RS_HOST,   RC_COLON,    RS_COLON2 },
+	{ RS_BR2,    RC_COLON,    RS_COLON2 },
+	{ RS_BR1,    RC_COLON,    RS_IP6 },
+	{ RS_IP6,    RC_COLON,    RS_IP6 },
+	{ RS_SLASH2, RC_LBRACKET, RS_BR1 },
+	{ RS_IP6,    RC_RBRACKET, RS_BR2 },
+	{ RS_PATH,   NGX_HEADER_INSPECT_DFA_ANY, RS_PATH },
+	{ 0, 0, 0 }
+};
+
+static const u_char ngx_header_inspect_referer_accept[] = { RS_PATH, RS_PORT, RS_HOST, RS_BR2, 0 };
+static const u_char ngx_header_inspect_referer_hooks[] = { RS_SCHEME, 0 };
+
+/* Transfer-Encoding and TE */
+enum { TS_START = 1, TS_FIELD, TS_PARDELIM, TS_PARKEY, TS_PAREQ, TS_PARVAL, TS_PARVALQ, TS_PARVALQE, TS_DELIM, TS_SPACE, TS_N = TS_SPACE };
+enum { TC_ALNUM = 1, TC_DOT, TC_COMMA, TC_SP, TC_SEMICOLON, TC_EQUAL, TC_DQUOTE };
+
+static const ngx_header_inspect_dfa_class_t ngx_header_inspect_transferencoding_classes[] = {
+	{ NGX_HEADER_INSPECT_ALPHA|NGX_HEADER_INSPECT_DIGIT, NULL },
+	{ 0, "." },
+	{ 0, "," },
+	{ 0, " " },
+	{ 0, ";" },
+	{ 0, "=" },
+	{ 0, "\"" },
+	{ 0, NULL }
+};
+
+static const ngx_header_inspect_dfa_edge_t ngx_header_inspect_transferencoding_edges[] = {
+	{ TS_START,    TC_ALNUM,     TS_FIELD },
+	{ TS_SPACE,    TC_ALNUM,     TS_FIELD },
+	/* TODO: if parkey is 'q', validate q-value */
+	{ TS_PARDELIM, TC_ALNUM,     TS_PARKEY },
+	{ TS_PAREQ,    TC_ALNUM,     TS_PARVAL },
+	{ TS_FIELD,    TC_ALNUM,     TS_FIELD },
+	{ TS_PARKEY,   TC_ALNUM,     TS_PARKEY },
+	{ TS_PARVAL,   TC_ALNUM,     TS_PARVAL },
+	{ TS_PARVALQ,  TC_ALNUM,     TS_PARVALQ },
+	{ TS_PARVAL,   TC_DOT,       TS_PARVAL },
+	{ TS_PARVALQ,  TC_DOT,       TS_PARVALQ },
+	{ TS_FIELD,    TC_COMMA,     TS_DELIM },
+	{ TS_PARVAL,   TC_COMMA,     TS_DELIM },
+	{ TS_PARVALQE, TC_COMMA,     TS_DELIM },
+	{ TS_PARVALQ,  TC_COMMA,     TS_PARVALQ },
+	{ TS_DELIM,    TC_SP,        TS_SPACE },
+	{ TS_PARVAL,   TC_SP,        TS_PARVAL },
+	{ TS_PARVALQ,  TC_SP,        TS_PARVALQ },
+	{ TS_PARDELIM, TC_SP,        TS_PARDELIM },
+	{ TS_FIELD,    TC_SEMICOLON, TS_PARDELIM },
+	{ TS_PARVAL,   TC_SEMICOLON, TS_PARDELIM },
+	{ TS_PARVALQE, TC_SEMICOLON, TS_PARDELIM },
+	{ TS_PARVALQ,  TC_SEMICOLON, TS_PARVALQ },
+	{ TS_PARKEY,   TC_EQUAL,     TS_PAREQ },
+	{ TS_PARVALQ,  TC_EQUAL,     TS_PARVALQ },
+	{ TS_PAREQ,    TC_DQUOTE,    TS_PARVALQ },
+	{ TS_PARVALQ,  TC_DQUOTE,    TS_PARVALQE },
+	{ TS_PARVALQ,  0,            TS_PARVALQ },
+	{ 0, 0, 0 }
+};
+
+static const u_char ngx_header_inspect_transferencoding_accept[] = { TS_FIELD, TS_PARVAL, TS_PARVALQE, 0 };
+static const u_char ngx_header_inspect_transferencoding_hooks[] = { TS_FIELD, 0 };
+
+/* Trailer */
+enum { TRS_START = 1, TRS_FIELD, TRS_DELIM, TRS_SPACE, TRS_N = TRS_SPACE };
+enum { TRC_LABEL = 1, TRC_COMMA, TRC_SP };
+
+static const ngx_header_inspect_dfa_class_t ngx_header_inspect_trailer_classes[] = {
+	{ NGX_HEADER_INSPECT_LABEL, NULL },
+	{ 0, "," },
+	{ 0, " " },
+	{ 0, NULL }
+};
+
+static const ngx_header_inspect_dfa_edge_t ngx_header_inspect_trailer_edges[] = {
+	{ TRS_START, TRC_LABEL, TRS_FIELD },
+	{ TRS_SPACE, TRC_LABEL, TRS_FIELD },
+	{ TRS_FIELD, TRC_LABEL, TRS_FIELD },
+	{ TRS_FIELD, TRC_COMMA, TRS_DELIM },
+	{ TRS_DELIM, TRC_SP,    TRS_SPACE },
+	{ 0, 0, 0 }
+};
+
+static const u_char ngx_header_inspect_trailer_accept[] = { TRS_FIELD, 0 };
+static const u_char ngx_header_inspect_trailer_hooks[] = { TRS_FIELD, 0 };
+
+/* Warning */
+enum { WS_START = 1, WS_CODE1, WS_CODE2, WS_CODE3, WS_SP1, WS_HOST, WS_COLON, WS_PORT, WS_SP2, WS_TXT, WS_TXTE, WS_SP3, WS_DATE, WS_DELIM, WS_SPACE, WS_N = WS_SPACE };
+enum { WC_DIGIT = 1, WC_ALPHA, WC_HOSTPUNCT, WC_COLON, WC_COMMA, WC_SP, WC_DQUOTE };
+
+static const ngx_header_inspect_dfa_class_t ngx_header_inspect_warning_classes[] = {
+	{ NGX_HEADER_INSPECT_DIGIT, NULL },
+	{ NGX_HEADER_INSPECT_ALPHA, NULL },
+	{ 0, "-." },
+	{ 0, ":" },
+	{ 0, "," },
+	{ 0, " " },
+	{ 0, "\"" },
+	{ 0, NULL }
+};
+
+static const ngx_header_inspect_dfa_edge_t ngx_header_inspect_warning_edges[] = {
+	{ WS_START, WC_DIGIT,     WS_CODE1 },
+	{ WS_SPACE, WC_DIGIT,     WS_CODE1 },
+	{ WS_CODE1, WC_DIGIT,     WS_CODE2 },
+	{ WS_CODE2, WC_DIGIT,     WS_CODE3 },
+	{ WS_SP1,   WC_DIGIT,     WS_HOST },
+	{ WS_COLON, WC_DIGIT,     WS_PORT },
+	{ WS_HOST,  WC_DIGIT,     WS_HOST },
+	{ WS_PORT,  WC_DIGIT,     WS_PORT },
+	{ WS_TXT,   WC_DIGIT,     WS_TXT },
+	{ WS_SP1,   WC_ALPHA,     WS_HOST },
+	{ WS_HOST,  WC_ALPHA,     WS_HOST },
+	{ WS_TXT,   WC_ALPHA,     WS_TXT },
+	{ WS_HOST,  WC_HOSTPUNCT, WS_HOST },
+	{ WS_TXT,   WC_HOSTPUNCT, WS_TXT },
+	{ WS_HOST,  WC_COLON,     WS_COLON },
+	{ WS_TXT,   WC_COLON,     WS_TXT },
+	{ WS_DATE,  WC_COMMA,     WS_DELIM },
+	{ WS_TXTE,  WC_COMMA,     WS_DELIM },
+	{ WS_TXT,   WC_COMMA,     WS_TXT },
+	{ WS_CODE3, WC_SP,        WS_SP1 },
+	{ WS_HOST,  WC_SP,        WS_SP2 },
+	{ WS_PORT,  WC_SP,        WS_SP2 },
+	{ WS_TXTE,  WC_SP,        WS_SP3 },
+	{ WS_DELIM, WC_SP,        WS_SPACE },
+	{ WS_TXT,   WC_SP,        WS_TXT },
+	{ WS_SP2,   WC_DQUOTE,    WS_TXT },
+	{ WS_TXT,   WC_DQUOTE,    WS_TXTE },
+	{ WS_SP3,   WC_DQUOTE,    WS_DATE },
+	{ WS_TXT,   0,            WS_TXT },
+	{ 0, 0, 0 }
+};
+
+static const u_char ngx_header_inspect_warning_accept[] = { WS_TXTE, WS_DATE, 0 };
+static const u_char ngx_header_inspect_warning_hooks[] = { WS_DATE, 0 };
+
+/* Authorization and Proxy-Authorization, Digest auth-params */
+enum { DS_START = 1, DS_KEY, DS_EQ, DS_VAL, DS_VALQ, DS_VALQE, DS_DELIM, DS_SPACE, DS_N = DS_SPACE };
+enum { DC_LOWER = 1, DC_COMMA, DC_EQUAL, DC_SP, DC_DQUOTE };
+
+static const ngx_header_inspect_dfa_class_t ngx_header_inspect_digest_classes[] = {
+	{ NGX_HEADER_INSPECT_LOWER, NULL },
+	{ 0, "," },
+	{ 0, "=" },
+	{ 0, " " },
+	{ 0, "\"" },
+	{ 0, NULL }
+};
+
+static const ngx_header_inspect_dfa_edge_t ngx_header_inspect_digest_edges[] = {
+	{ DS_START, DC_LOWER,  DS_KEY },
+	{ DS_SPACE, DC_LOWER,  DS_KEY },
+	{ DS_EQ,    DC_LOWER,  DS_VAL },
+	{ DS_VAL,   DC_LOWER,  DS_VAL },
+	{ DS_VALQ,  DC_LOWER,  DS_VALQ },
+	{ DS_KEY,   DC_LOWER,  DS_KEY },
+	{ DS_VAL,   DC_COMMA,  DS_DELIM },
+	{ DS_VALQE, DC_COMMA,  DS_DELIM },
+	{ DS_EQ,    DC_COMMA,  DS_DELIM },
+	{ DS_VALQ,  DC_COMMA,  DS_VALQ },
+	{ DS_KEY,   DC_EQUAL,  DS_EQ },
+	{ DS_VALQ,  DC_EQUAL,  DS_VALQ },
+	{ DS_DELIM, DC_SP,     DS_SPACE },
+	{ DS_VALQ,  DC_SP,     DS_VALQ },
+	{ DS_EQ,    DC_DQUOTE, DS_VALQ },
+	{ DS_VALQ,  DC_DQUOTE, DS_VALQE },
+	{ DS_VAL,   0,         DS_VAL },
+	{ DS_VALQ,  0,         DS_VALQ },
+	{ 0, 0, 0 }
+};
+
+static const u_char ngx_header_inspect_digest_accept[] = { DS_VALQE, DS_VAL, 0 };
+static const u_char ngx_header_inspect_digest_hooks[] = { DS_KEY, 0 };
+
+/* From */
+enum { FS_START = 1, FS_LOCALPART, FS_AT, FS_DOMAIN, FS_DOT, FS_N = FS_DOT };
+enum { FC_LABEL = 1, FC_PLUS, FC_DOT, FC_AT };
+
+static const ngx_header_inspect_dfa_class_t ngx_header_inspect_from_classes[] = {
+	{ NGX_HEADER_INSPECT_LABEL, NULL },
+	{ 0, "+" },
+	{ 0, "." },
+	{ 0, "@" },
+	{ 0, NULL }
+};
+
+static const ngx_header_inspect_dfa_edge_t ngx_header_inspect_from_edges[] = {
+	{ FS_START,     FC_LABEL, FS_LOCALPART },
+	{ FS_AT,        FC_LABEL, FS_DOMAIN },
+	{ FS_DOT,       FC_LABEL, FS_DOMAIN },
+	{ FS_LOCALPART, FC_LABEL, FS_LOCALPART },
+	{ FS_DOMAIN,    FC_LABEL, FS_DOMAIN },
+	{ FS_START,     FC_PLUS,  FS_LOCALPART },
+	{ FS_LOCALPART, FC_PLUS,  FS_LOCALPART },
+	{ FS_START,     FC_DOT,   FS_LOCALPART },
+	{ FS_LOCALPART, FC_DOT,   FS_LOCALPART },
+	{ FS_DOMAIN,    FC_DOT,   FS_DOT },
+	{ FS_LOCALPART, FC_AT,    FS_AT },
+	{ 0, 0, 0 }
+};
+
+static const u_char ngx_header_inspect_from_accept[] = { FS_DOMAIN, 0 };
+
+/* indexed by ngx_header_inspect_dfa_id_e */
+static const ngx_header_inspect_dfa_spec_t ngx_header_inspect_dfa_specs[] = {
+	{ UAS_N, ngx_header_inspect_useragent_classes, ngx_header_inspect_useragent_edges, ngx_header_inspect_useragent_accept, NULL, NULL },
+	{ VS_N, ngx_header_inspect_via_classes, ngx_header_inspect_via_edges, ngx_header_inspect_via_accept, NULL, NULL },
+	{ RS_N, ngx_header_inspect_referer_classes, ngx_header_inspect_referer_edges, ngx_header_inspect_referer_accept, ngx_header_inspect_referer_hooks, ngx_header_inspect_referer_hook },
+	{ TS_N, ngx_header_inspect_transferencoding_classes, ngx_header_inspect_transferencoding_edges, ngx_header_inspect_transferencoding_accept, ngx_header_inspect_transferencoding_hooks, ngx_header_inspect_transferencoding_hook },
+	{ TRS_N, ngx_header_inspect_trailer_classes, ngx_header_inspect_trailer_edges, ngx_header_inspect_trailer_accept, ngx_header_inspect_trailer_hooks, ngx_header_inspect_trailer_hook },
+	{ WS_N, ngx_header_inspect_warning_classes, ngx_header_inspect_warning_edges, ngx_header_inspect_warning_accept, ngx_header_inspect_warning_hooks, ngx_header_inspect_warning_hook },
+	{ DS_N, ngx_header_inspect_digest_classes, ngx_header_inspect_digest_edges, ngx_header_inspect_digest_accept, ngx_header_inspect_digest_hooks, ngx_header_inspect_digest_hook },
+	{ FS_N, ngx_header_inspect_from_classes, ngx_header_inspect_from_edges, ngx_header_inspect_from_accept, NULL, NULL }
+};
+
+/* compiled once per process, they do not depend on the configuration */
+static ngx_header_inspect_dfa_t *ngx_header_inspect_dfas[NGX_HEADER_INSPECT_NDFAS];
+
+/* filled at request time, each worker has its own copy */
+static ngx_header_inspect_date_t ngx_header_inspect_date_cache[NGX_HEADER_INSPECT_DATE_CACHE];
+
+/* header grammars compiled by tools/abnf2c.py, regenerated by ./configure */
+#include "ngx_http_header_inspect_grammars.h"
+
+static ngx_http_module_t ngx_header_inspect_module_ctx = {
+	ngx_header_inspect_add_variables, /* preconfiguration */
+	ngx_header_inspect_init,          /* postconfiguration */
+
+	ngx_header_inspect_create_main_conf, /* create main configuration */
+	NULL,                             /* init main configuration */
+
+	NULL,                             /* create server configuration */
 	NULL,                             /* merge server configuration */
 
 	ngx_header_inspect_create_conf,   /* create location configuration */
@@ -127,3403 +1706,6855 @@ ngx_module_t ngx_http_header_inspect_module = {
 	ngx_header_inspect_commands,    /* module directives */
 	NGX_HTTP_MODULE,                /* module type */
 	NULL,                           /* init master */
-	NULL,                           /* init module */
-	NULL,                           /* init process */
+	ngx_header_inspect_init_module, /* init module */
+	ngx_header_inspect_init_process, /* init process */
 	NULL,                           /* init thread */
 	NULL,                           /* exit thread */
-	NULL,                           /* exit process */
+	ngx_header_inspect_exit_process, /* exit process */
 	NULL,                           /* exit master */
 	NGX_MODULE_V1_PADDING
 };
 
 
 
-static ngx_int_t ngx_header_inspect_init(ngx_conf_t *cf) {
-	ngx_http_handler_pt       *h;
-	ngx_http_core_main_conf_t *cmcf;
-
-	cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+static ngx_int_t ngx_header_inspect_init_headers_hash(ngx_conf_t *cf, ngx_header_inspect_main_conf_t *mcf) {
+	ngx_array_t headers;
+	ngx_hash_key_t *hk;
+	ngx_hash_init_t hash;
+	ngx_header_inspect_header_t *header;
+	ngx_header_inspect_rule_t *rule;
+	ngx_header_inspect_other_t *other;
+	ngx_uint_t i;
 
-	h = ngx_array_push(&cmcf->phases[NGX_HTTP_REWRITE_PHASE].handlers);
-	if (h == NULL) {
+	if (ngx_array_init(&headers, cf->temp_pool, NGX_HEADER_INSPECT_NHEADERS, sizeof(ngx_hash_key_t)) != NGX_OK) {
 		return NGX_ERROR;
 	}
 
-	*h = ngx_header_inspect_process_request;
+	for (header = ngx_header_inspect_headers; header->name.len; header++) {
+		hk = ngx_array_push(&headers);
+		if (hk == NULL) {
+			return NGX_ERROR;
+		}
 
-	return NGX_OK;
+		hk->key = header->name;
+		hk->key_hash = ngx_hash_key_lc(header->name.data, header->name.len);
+		hk->value = header;
+	}
+
+	rule = mcf->rules ? mcf->rules->elts : NULL;
+	for (i = 0; mcf->rules && (i < mcf->rules->nelts); i++) {
+		hk = ngx_array_push(&headers);
+		if (hk == NULL) {
+			return NGX_ERROR;
+		}
+
+		hk->key = rule[i].header.name;
+		hk->key_hash = ngx_hash_key_lc(rule[i].header.name.data, rule[i].header.name.len);
+		hk->value = &rule[i].header;
+	}
+
+	other = mcf->others ? mcf->others->elts : NULL;
+	for (i = 0; mcf->others && (i < mcf->others->nelts); i++) {
+		hk = ngx_array_push(&headers);
+		if (hk == NULL) {
+			return NGX_ERROR;
+		}
+
+		hk->key = other[i].header.name;
+		hk->key_hash = ngx_hash_key_lc(other[i].header.name.data, other[i].header.name.len);
+		hk->value = &other[i].header;
+	}
+
+	hash.hash = &mcf->headers;
+	hash.key = ngx_hash_key_lc;
+	hash.max_size = 512;
+	hash.bucket_size = ngx_align(64, ngx_cacheline_size);
+	hash.name = "inspect_headers_hash";
+	hash.pool = cf->pool;
+	hash.temp_pool = NULL;
+
+	return ngx_hash_init(&hash, headers.elts, headers.nelts);
 }
 
-static ngx_int_t ngx_header_inspect_range_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i,a,b,setcount;
-	ngx_int_t rc = NGX_OK;
-	enum range_header_states {RHS_NEWSET,RHS_NUM1,DELIM,RHS_NUM2,RHS_SUFDELIM,RHS_SUFNUM} state;
+static size_t ngx_header_inspect_span_scalar(u_char *p, size_t len, ngx_header_inspect_set_t *set) {
+	size_t i;
 
-	if ( (value.len < 6) || (ngx_strncmp("bytes=", value.data, 6) != 0) ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Range header does not start with \"bytes=\"");
+	for (i = 0; i < len; i++) {
+		if ((p[i] & 0x80) || !(set->map[p[i] >> 5] & (1U << (p[i] & 0x1f)))) {
+			break;
 		}
-		rc = NGX_ERROR;
 	}
 
-	setcount = 1;
-	a = 0;
-	b = 0;
-	state = RHS_NEWSET;
+	return i;
+}
 
-	i = 6; /* start after bytes= */
-	for ( ; i < value.len ; i++ ) {
+static size_t ngx_header_inspect_ctl_scalar(u_char *p, size_t len) {
+	size_t i;
 
-		switch (value.data[i]) {
-			case ',':
-				if ( (state != DELIM) && (state != RHS_NUM2) && (state != RHS_SUFNUM) ) {
-					if ( conf->log ) {
-						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected ',' at position %d in Range header \"%s\"", i, value.data);
-					}
-					rc = NGX_ERROR;
-				}
-				if ( state == RHS_NUM2 ) {
-					/* verify a <= b in 'a-b' sets */
-					if ( a > b ) {
-						if ( conf->log ) {
-							ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid range definition at position %d in Range header \"%s\"", i, value.data);
-						}
-						rc = NGX_ERROR;
-					}
-				}
-				setcount++;
-				a = 0;
-				b = 0;
-				state = RHS_NEWSET;
-				break;
+	for (i = 0; i < len; i++) {
+		if (((p[i] < 0x20) && (p[i] != '\t')) || (p[i] >= 0x7f)) {
+			break;
+		}
+	}
 
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-				if ((state == RHS_NEWSET) || (state == RHS_NUM1)) {
-					a = a*10 + (value.data[i] - '0');
-					state = RHS_NUM1;
-				} else if ((state == DELIM) || (state == RHS_NUM2)) {
-					b = b*10 + (value.data[i] - '0');
-					state = RHS_NUM2;
-				} else if ((state == RHS_SUFDELIM) || (state == RHS_SUFNUM)) {
-					state = RHS_SUFNUM;
-				} else {
-					if ( conf->log ) {
-						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected digit at position %d in Range header \"%s\"", i, value.data);
-					}
-					rc = NGX_ERROR;
-				}
-				break;
+	return i;
+}
 
-			case '-':
-				if (state == RHS_NEWSET) {
-					state = RHS_SUFDELIM;
-				} else if (state == RHS_NUM1) {
-					state = DELIM;
-				} else {
-					if ( conf->log ) {
-						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected '-' at position %d in Range header \"%s\"", i, value.data);
-					}
-					rc = NGX_ERROR;
-				}
-				break;
+/* 6 bit value of a byte already checked to be in the base64 alphabet */
+#define ngx_header_inspect_base64_value(c) ((uint32_t) \
+	(((c) >= 'a') ? (c) - 'a' + 26 : ((c) >= 'A') ? (c) - 'A' : ((c) >= '0') ? (c) - '0' + 52 : ((c) == '+') ? 62 : 63))
+
+/* len characters of the alphabet (no padding, len % 4 != 1) to bytes, returns how many */
+static size_t ngx_header_inspect_decode_base64_scalar(u_char *dst, u_char *src, size_t len) {
+	size_t i, n = 0;
+	uint32_t v;
+
+	for (i = 0; i + 4 <= len; i += 4) {
+		v = (ngx_header_inspect_base64_value(src[i]) << 18) | (ngx_header_inspect_base64_value(src[i + 1]) << 12)
+			| (ngx_header_inspect_base64_value(src[i + 2]) << 6) | ngx_header_inspect_base64_value(src[i + 3]);
+		dst[n++] = (u_char) (v >> 16);
+		dst[n++] = (u_char) (v >> 8);
+		dst[n++] = (u_char) v;
+	}
 
-			default:
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Range header \"%s\"", i, value.data);
-				}
-				rc = NGX_ERROR;
+	/* 2 or 3 characters in front of the padding */
+	if (len - i >= 2) {
+		v = (ngx_header_inspect_base64_value(src[i]) << 18) | (ngx_header_inspect_base64_value(src[i + 1]) << 12);
+		dst[n++] = (u_char) (v >> 16);
+		if (len - i == 3) {
+			v |= ngx_header_inspect_base64_value(src[i + 2]) << 6;
+			dst[n++] = (u_char) (v >> 8);
 		}
+	}
 
-		if (setcount > conf->range_max_byteranges) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Range header contains more than %d byteranges", conf->range_max_byteranges);
-			}
-			return NGX_ERROR;
-			break;
+	return n;
+}
+
+#if (NGX_HEADER_INSPECT_SIMD)
+
+/* high nibble -> its bit in ngx_header_inspect_set_t.lo, none for obs-text */
+static const u_char ngx_header_inspect_nibble_hi[16] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+__attribute__((target("ssse3")))
+static size_t ngx_header_inspect_span_ssse3(u_char *p, size_t len, ngx_header_inspect_set_t *set) {
+	size_t i;
+	uint32_t m;
+	__m128i lo, hi, nib, v, t;
+
+	lo = _mm_loadu_si128((__m128i *) set->lo);
+	hi = _mm_loadu_si128((__m128i *) ngx_header_inspect_nibble_hi);
+	nib = _mm_set1_epi8(0x0f);
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((__m128i *) (p + i));
+		t = _mm_and_si128(_mm_shuffle_epi8(lo, _mm_and_si128(v, nib)),
+			_mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nib)));
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(t, _mm_setzero_si128()));
+		if (m) {
+			return i + __builtin_ctz(m);
 		}
 	}
 
-	if ((state != DELIM) && (state != RHS_NUM2) && (state != RHS_SUFNUM)) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Range header \"%s\" contains incomplete byteset definition", value.data);
+	return i + ngx_header_inspect_span_scalar(p + i, len - i, set);
+}
+
+__attribute__((target("avx2")))
+static size_t ngx_header_inspect_span_avx2(u_char *p, size_t len, ngx_header_inspect_set_t *set) {
+	size_t i;
+	uint32_t m;
+	__m256i lo, hi, nib, v, t;
+	__m128i v128, t128;
+
+	lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) set->lo));
+	hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) ngx_header_inspect_nibble_hi));
+	nib = _mm256_set1_epi8(0x0f);
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((__m256i *) (p + i));
+		t = _mm256_and_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(v, nib)),
+			_mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib)));
+		m = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(t, _mm256_setzero_si256()));
+		if (m) {
+			return i + __builtin_ctz(m);
 		}
-		rc = NGX_ERROR;
 	}
-	if ( state == RHS_NUM2 ) {
-		/* verify a <= b in 'a-b' sets */
-		if ( a > b ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid range definition at position %d in Range header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
+
+	/* stay with VEX encoded code for the tail, mixing in SSE code stalls on AVX-SSE transitions */
+	if (i + 16 <= len) {
+		v128 = _mm_loadu_si128((__m128i *) (p + i));
+		t128 = _mm_and_si128(_mm_shuffle_epi8(_mm256_castsi256_si128(lo), _mm_and_si128(v128, _mm256_castsi256_si128(nib))),
+			_mm_shuffle_epi8(_mm256_castsi256_si128(hi), _mm_and_si128(_mm_srli_epi16(v128, 4), _mm256_castsi256_si128(nib))));
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(t128, _mm_setzero_si128()));
+		if (m) {
+			return i + __builtin_ctz(m);
 		}
+		i += 16;
 	}
 
-	return rc;
+	return i + ngx_header_inspect_span_scalar(p + i, len - i, set);
 }
 
-static ngx_int_t ngx_header_inspect_http_date(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
-	ngx_uint_t i = 0;
-	enum http_date_type {RFC1123, RFC850, ASCTIME} type;
+static size_t ngx_header_inspect_ctl_sse2(u_char *p, size_t len) {
+	size_t i;
+	uint32_t m;
+	__m128i sp, del, tab, v, t;
 
-	if ( maxlen < 24 ) {
-		*len = i;
-		return NGX_ERROR;
+	sp = _mm_set1_epi8(0x20);
+	del = _mm_set1_epi8(0x7f);
+	tab = _mm_set1_epi8('\t');
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((__m128i *) (p + i));
+		/* signed compare, obs-text is negative and ends up below SP as well */
+		t = _mm_or_si128(_mm_cmplt_epi8(v, sp), _mm_cmpeq_epi8(v, del));
+		t = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), t);
+		m = _mm_movemask_epi8(t);
+		if (m) {
+			return i + __builtin_ctz(m);
+		}
 	}
 
-	if ((data[0] == 'M') && (data[1] == 'o') && (data[2] == 'n')) {
-	/* Mon(day) */
-		switch (data[3]) {
-			case ',':
-				type = RFC1123;
-				i = 4;
-				break;
-			case ' ':
-				type = ASCTIME;
-				i = 3;
-				break;
-			case 'd':
-				type = RFC850;
-				if (
-					(data[4] != 'a') ||
-					(data[5] != 'y') ||
-					(data[6] != ',')
-				) {
-					*len = i;
-					return NGX_ERROR;
-				}
-				i = 7;
-				break;
-			default:
-				*len = i;
-				return NGX_ERROR;
+	return i + ngx_header_inspect_ctl_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t ngx_header_inspect_ctl_avx2(u_char *p, size_t len) {
+	size_t i;
+	uint32_t m;
+	__m256i sp, del, tab, v, t;
+	__m128i v128, t128;
+
+	sp = _mm256_set1_epi8(0x20);
+	del = _mm256_set1_epi8(0x7f);
+	tab = _mm256_set1_epi8('\t');
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((__m256i *) (p + i));
+		t = _mm256_or_si256(_mm256_cmpgt_epi8(sp, v), _mm256_cmpeq_epi8(v, del));
+		t = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), t);
+		m = (uint32_t) _mm256_movemask_epi8(t);
+		if (m) {
+			return i + __builtin_ctz(m);
 		}
-	} else if ((data[0] == 'T') && (data[1] == 'u') && (data[2] == 'e')) {
-	/* Tue(sday) */
-		switch (data[3]) {
-			case ',':
-				type = RFC1123;
-				i = 4;
-				break;
-			case ' ':
-				type = ASCTIME;
-				i = 3;
-				break;
-			case 's':
-				type = RFC850;
-				if (
-					(data[4] != 'd') ||
-					(data[5] != 'a') ||
-					(data[6] != 'y') ||
-					(data[7] != ',')
-				) {
-					*len = i;
-					return NGX_ERROR;
-				}
-				i = 8;
-				break;
-			default:
-				*len = i;
-				return NGX_ERROR;
+	}
+
+	if (i + 16 <= len) {
+		v128 = _mm_loadu_si128((__m128i *) (p + i));
+		t128 = _mm_or_si128(_mm_cmplt_epi8(v128, _mm256_castsi256_si128(sp)), _mm_cmpeq_epi8(v128, _mm256_castsi256_si128(del)));
+		t128 = _mm_andnot_si128(_mm_cmpeq_epi8(v128, _mm256_castsi256_si128(tab)), t128);
+		m = _mm_movemask_epi8(t128);
+		if (m) {
+			return i + __builtin_ctz(m);
 		}
-	} else if ((data[0] == 'W') && (data[1] == 'e') && (data[2] == 'd')) {
-	/* Wed(nesday) */
-		switch (data[3]) {
-			case ',':
-				type = RFC1123;
-				i = 4;
-				break;
-			case ' ':
-				type = ASCTIME;
-				i = 3;
-				break;
-			case 'n':
-				type = RFC850;
-				if (
-					(data[4] != 'e') ||
-					(data[5] != 's') ||
-					(data[6] != 'd') ||
-					(data[7] != 'a') ||
-					(data[8] != 'y') ||
-					(data[9] != ',')
-				) {
-					*len = i;
-					return NGX_ERROR;
-				}
-				i = 10;
-				break;
-			default:
-				*len = i;
-				return NGX_ERROR;
+		i += 16;
+	}
+
+	return i + ngx_header_inspect_ctl_scalar(p + i, len - i);
+}
+
+/* as the scalar version, dst needs 4 bytes of room past the decoded data */
+__attribute__((target("ssse3")))
+static size_t ngx_header_inspect_decode_base64_ssse3(u_char *dst, u_char *src, size_t len) {
+	size_t i, n = 0;
+	__m128i offset, nib, slash, v, t;
+
+	/* added to each character by its high nibble, '/' shares the one of '+' and needs 3 less */
+	offset = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	nib = _mm_set1_epi8(0x0f);
+	slash = _mm_set1_epi8('/');
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((__m128i *) (src + i));
+		t = _mm_shuffle_epi8(offset, _mm_and_si128(_mm_srli_epi32(v, 4), nib));
+		t = _mm_add_epi8(t, _mm_and_si128(_mm_cmpeq_epi8(v, slash), _mm_set1_epi8(-3)));
+		v = _mm_add_epi8(v, t);
+
+		/* four 6 bit values per 32 bit lane to 24 bits, then drop the top byte of each lane */
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm_storeu_si128((__m128i *) (dst + n), v);
+		n += 12;
+	}
+
+	return n + ngx_header_inspect_decode_base64_scalar(dst + n, src + i, len - i);
+}
+
+#endif
+
+static void ngx_header_inspect_set_add(ngx_header_inspect_set_t *set, ngx_uint_t c) {
+	set->lo[c & 0x0f] |= (u_char) (1 << (c >> 4));
+	set->map[c >> 5] |= 1U << (c & 0x1f);
+}
+
+/* bytes looping on a state are skipped in bulk by ngx_header_inspect_span() */
+static void ngx_header_inspect_dfa_skip(ngx_header_inspect_dfa_t *dfa) {
+	ngx_uint_t c, state;
+
+	for (state = NGX_HEADER_INSPECT_DFA_START; state < dfa->nstates; state++) {
+		for (c = 0; c < 0x80; c++) {
+			if (dfa->next[state * dfa->nclasses + dfa->classes[c]] == state) {
+				ngx_header_inspect_set_add(&dfa->skip[state], c);
+				dfa->flags[state] |= NGX_HEADER_INSPECT_DFA_SKIP;
+			}
 		}
-	} else if ((data[0] == 'T') && (data[1] == 'h') && (data[2] == 'u')) {
-	/* Thu(rsday) */
-		switch (data[3]) {
-			case ',':
-				type = RFC1123;
-				i = 4;
-				break;
-			case ' ':
-				type = ASCTIME;
-				i = 3;
+	}
+}
+
+static ngx_header_inspect_dfa_t *ngx_header_inspect_dfa_compile(const ngx_header_inspect_dfa_spec_t *spec, ngx_log_t *log) {
+	ngx_header_inspect_dfa_t *dfa;
+	const ngx_header_inspect_dfa_class_t *cls;
+	const ngx_header_inspect_dfa_edge_t *e;
+	const u_char *s;
+	ngx_uint_t c, k, n;
+	u_char *row;
+
+	dfa = ngx_calloc(sizeof(ngx_header_inspect_dfa_t), log);
+	if (dfa == NULL) {
+		return NULL;
+	}
+
+	/* the first matching class wins, class 0 collects the rest */
+	for (c = 0; c < 256; c++) {
+		for (cls = spec->classes, k = 1; cls->mask || cls->chars; cls++, k++) {
+			if (ngx_header_inspect_is(c, cls->mask) || ((c != 0) && (cls->chars != NULL) && (ngx_strchr(cls->chars, c) != NULL))) {
+				dfa->classes[c] = (u_char) k;
 				break;
-			case 'r':
-				type = RFC850;
-				if (
-					(data[4] != 's') ||
-					(data[5] != 'd') ||
-					(data[6] != 'a') ||
-					(data[7] != 'y') ||
-					(data[8] != ',')
-				) {
-					*len = i;
-					return NGX_ERROR;
+			}
+		}
+	}
+
+	dfa->nclasses = (ngx_uint_t) (cls - spec->classes) + 1;
+	dfa->nstates = spec->nstates + 1;
+	dfa->hook = spec->hook;
+
+	n = dfa->nstates;
+	dfa->next = ngx_calloc(n * dfa->nclasses + n + sizeof(uint32_t) + n * sizeof(ngx_header_inspect_set_t), log);
+	if (dfa->next == NULL) {
+		ngx_free(dfa);
+		return NULL;
+	}
+	dfa->flags = dfa->next + n * dfa->nclasses;
+	dfa->skip = (ngx_header_inspect_set_t *) ngx_align_ptr(dfa->flags + n, sizeof(uint32_t));
+
+	for (e = spec->edges; e->from; e++) {
+		row = &dfa->next[e->from * dfa->nclasses];
+		if (e->cls == NGX_HEADER_INSPECT_DFA_ANY) {
+			ngx_memset(row, e->to, dfa->nclasses);
+		} else {
+			row[e->cls] = e->to;
+		}
+	}
+
+	for (s = spec->accept; s && *s; s++) {
+		dfa->flags[*s] |= NGX_HEADER_INSPECT_DFA_ACCEPT;
+	}
+	for (s = spec->hooks; s && *s; s++) {
+		dfa->flags[*s] |= NGX_HEADER_INSPECT_DFA_HOOK;
+	}
+
+	ngx_header_inspect_dfa_skip(dfa);
+
+	return dfa;
+}
+
+/*
+ * Runs value->data from *pos.  Returns NGX_OK if it ends in an accepting
+ * state, NGX_DECLINED on an illegal byte at *pos, NGX_AGAIN on a premature
+ * end, or NGX_ERROR when a hook rejected (and logged) the value.
+ */
+static ngx_int_t ngx_header_inspect_dfa_run(ngx_header_inspect_dfa_t *dfa, ngx_header_inspect_dfa_ctx_t *ctx, ngx_str_t *value, ngx_uint_t *pos) {
+	ngx_uint_t i, state, next;
+	ngx_int_t rc;
+
+	state = NGX_HEADER_INSPECT_DFA_START;
+
+	for (i = *pos; i < value->len; i++) {
+		next = dfa->next[state * dfa->nclasses + dfa->classes[value->data[i]]];
+
+		if (next != state) {
+			if (next == NGX_HEADER_INSPECT_DFA_DEAD) {
+				*pos = i;
+				return NGX_DECLINED;
+			}
+
+			if (dfa->flags[next] & NGX_HEADER_INSPECT_DFA_HOOK) {
+				rc = dfa->hook(ctx, next, value, &i);
+				if (rc != NGX_OK) {
+					*pos = i;
+					return rc;
 				}
-				i = 9;
-				break;
-			default:
-				*len = i;
+			}
+
+			state = next;
+		}
+
+		/* a run that keeps the state is handed to the span kernel, unless it ends right away */
+		if ((dfa->flags[state] & NGX_HEADER_INSPECT_DFA_SKIP)
+			&& (i + 2 < value->len)
+			&& (dfa->next[state * dfa->nclasses + dfa->classes[value->data[i + 1]]] == state))
+		{
+			i += 1 + ngx_header_inspect_span(&value->data[i + 2], value->len - i - 2, &dfa->skip[state]);
+		}
+	}
+
+	*pos = i;
+
+	return (dfa->flags[state] & NGX_HEADER_INSPECT_DFA_ACCEPT) ? NGX_OK : NGX_AGAIN;
+}
+
+static ngx_int_t ngx_header_inspect_init_dfas(ngx_log_t *log) {
+	ngx_uint_t i;
+
+	for (i = 0; i < NGX_HEADER_INSPECT_NDFAS; i++) {
+		if (ngx_header_inspect_dfas[i] != NULL) {
+			continue;
+		}
+
+		ngx_header_inspect_dfas[i] = ngx_header_inspect_dfa_compile(&ngx_header_inspect_dfa_specs[i], log);
+		if (ngx_header_inspect_dfas[i] == NULL) {
+			return NGX_ERROR;
+		}
+	}
+
+	return NGX_OK;
+}
+
+static ngx_uint_t ngx_header_inspect_re_state(ngx_header_inspect_re_t *re) {
+	ngx_header_inspect_re_state_t *st;
+
+	if (re->states.nelts == NGX_HEADER_INSPECT_RE_MAX_NFA) {
+		re->err = "too complex";
+		return NGX_HEADER_INSPECT_RE_NONE;
+	}
+
+	st = ngx_array_push(&re->states);
+	if (st == NULL) {
+		re->err = "out of memory";
+		return NGX_HEADER_INSPECT_RE_NONE;
+	}
+
+	st->set = NGX_HEADER_INSPECT_RE_NONE;
+	st->to = NGX_HEADER_INSPECT_RE_NONE;
+	st->eps[0] = NGX_HEADER_INSPECT_RE_NONE;
+	st->eps[1] = NGX_HEADER_INSPECT_RE_NONE;
+
+	return re->states.nelts - 1;
+}
+
+static void ngx_header_inspect_re_eps(ngx_header_inspect_re_t *re, ngx_uint_t from, ngx_uint_t to) {
+	ngx_header_inspect_re_state_t *st;
+
+	/* fragments only ever get edges added to their end, which has none yet */
+	st = &((ngx_header_inspect_re_state_t *) re->states.elts)[from];
+	st->eps[(st->eps[0] == NGX_HEADER_INSPECT_RE_NONE) ? 0 : 1] = to;
+}
+
+/* a fragment with a new start and end state, start leading to end by epsilon or over set */
+static ngx_int_t ngx_header_inspect_re_frag(ngx_header_inspect_re_t *re, ngx_header_inspect_re_set_t *set, ngx_header_inspect_re_frag_t *f) {
+	ngx_header_inspect_re_state_t *st;
+	ngx_header_inspect_re_set_t *s;
+
+	f->start = ngx_header_inspect_re_state(re);
+	f->end = ngx_header_inspect_re_state(re);
+	if ((f->start == NGX_HEADER_INSPECT_RE_NONE) || (f->end == NGX_HEADER_INSPECT_RE_NONE)) {
+		return NGX_ERROR;
+	}
+
+	if (set == NULL) {
+		ngx_header_inspect_re_eps(re, f->start, f->end);
+		return NGX_OK;
+	}
+
+	s = ngx_array_push(&re->sets);
+	if (s == NULL) {
+		re->err = "out of memory";
+		return NGX_ERROR;
+	}
+	*s = *set;
+
+	st = &((ngx_header_inspect_re_state_t *) re->states.elts)[f->start];
+	st->set = re->sets.nelts - 1;
+	st->to = f->end;
+
+	return NGX_OK;
+}
+
+static void ngx_header_inspect_re_set_add(ngx_header_inspect_re_set_t *set, ngx_uint_t lo, ngx_uint_t hi) {
+	for ( ; lo <= hi; lo++) {
+		set->bits[lo >> 5] |= 1U << (lo & 0x1f);
+	}
+}
+
+/*
+ * Parses the escape after a backslash.  Returns NGX_OK for a single byte
+ * in *c, NGX_DECLINED for a class already added to set.
+ */
+static ngx_int_t ngx_header_inspect_re_escape(ngx_header_inspect_re_t *re, ngx_header_inspect_re_set_t *set, ngx_uint_t *c) {
+	ngx_int_t n;
+
+	if (re->p == re->end) {
+		re->err = "trailing backslash";
+		return NGX_ERROR;
+	}
+
+	switch (*re->p++) {
+		case 'd':
+			ngx_header_inspect_re_set_add(set, '0', '9');
+			return NGX_DECLINED;
+		case 'w':
+			ngx_header_inspect_re_set_add(set, '0', '9');
+			ngx_header_inspect_re_set_add(set, 'A', 'Z');
+			ngx_header_inspect_re_set_add(set, 'a', 'z');
+			ngx_header_inspect_re_set_add(set, '_', '_');
+			return NGX_DECLINED;
+		case 's':
+			ngx_header_inspect_re_set_add(set, ' ', ' ');
+			ngx_header_inspect_re_set_add(set, '\t', '\t');
+			return NGX_DECLINED;
+		case 'x':
+			n = (re->end - re->p >= 2) ? ngx_hextoi(re->p, 2) : NGX_ERROR;
+			if (n == NGX_ERROR) {
+				re->err = "invalid \\x escape";
+				return NGX_ERROR;
+			}
+			re->p += 2;
+			*c = n;
+			return NGX_OK;
+		default:
+			if (ngx_header_inspect_is(re->p[-1], NGX_HEADER_INSPECT_DIGIT|NGX_HEADER_INSPECT_ALPHA)) {
+				re->err = "unknown escape";
+				return NGX_ERROR;
+			}
+			*c = re->p[-1];
+			return NGX_OK;
+	}
+}
+
+static ngx_int_t ngx_header_inspect_re_class(ngx_header_inspect_re_t *re, ngx_header_inspect_re_set_t *set) {
+	ngx_uint_t i, lo, hi, negate, first;
+	ngx_int_t rc;
+
+	negate = 0;
+	if ((re->p < re->end) && (*re->p == '^')) {
+		negate = 1;
+		re->p++;
+	}
+
+	/* a ']' right after the '[' or '[^' is a literal */
+	for (first = 1; (re->p < re->end) && (first || (*re->p != ']')); first = 0) {
+		lo = *re->p++;
+		if (lo == '\\') {
+			rc = ngx_header_inspect_re_escape(re, set, &lo);
+			if (rc == NGX_ERROR) {
 				return NGX_ERROR;
+			}
+			if (rc == NGX_DECLINED) {
+				continue;
+			}
 		}
-	} else if ((data[0] == 'F') && (data[1] == 'r') && (data[2] == 'i')) {
-	/* Fri(day) */
-		switch (data[3]) {
-			case ',':
-				type = RFC1123;
-				i = 4;
-				break;
-			case ' ':
-				type = ASCTIME;
-				i = 3;
-				break;
-			case 'd':
-				type = RFC850;
-				if (
-					(data[4] != 'a') ||
-					(data[5] != 'y') ||
-					(data[6] != ',')
-				) {
-					*len = i;
-					return NGX_ERROR;
-				}
-				i = 7;
-				break;
-			default:
-				*len = i;
+
+		hi = lo;
+		if ((re->end - re->p >= 2) && (re->p[0] == '-') && (re->p[1] != ']')) {
+			re->p++;
+			hi = *re->p++;
+			if ((hi == '\\') && (ngx_header_inspect_re_escape(re, set, &hi) != NGX_OK)) {
+				re->err = "invalid range";
+				return NGX_ERROR;
+			}
+			if (hi < lo) {
+				re->err = "invalid range";
+				return NGX_ERROR;
+			}
+		}
+
+		ngx_header_inspect_re_set_add(set, lo, hi);
+	}
+
+	if (re->p == re->end) {
+		re->err = "missing ]";
+		return NGX_ERROR;
+	}
+	re->p++;
+
+	if (negate) {
+		for (i = 0; i < 8; i++) {
+			set->bits[i] = ~set->bits[i];
+		}
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_re_atom(ngx_header_inspect_re_t *re, ngx_header_inspect_re_frag_t *f) {
+	ngx_header_inspect_re_set_t set;
+	ngx_uint_t c;
+	ngx_int_t rc;
+
+	ngx_memzero(&set, sizeof(ngx_header_inspect_re_set_t));
+
+	c = *re->p++;
+
+	switch (c) {
+		case '(':
+			if (ngx_header_inspect_re_alt(re, f) != NGX_OK) {
+				return NGX_ERROR;
+			}
+			if ((re->p == re->end) || (*re->p != ')')) {
+				re->err = "missing )";
+				return NGX_ERROR;
+			}
+			re->p++;
+			return NGX_OK;
+		case '[':
+			if (ngx_header_inspect_re_class(re, &set) != NGX_OK) {
+				return NGX_ERROR;
+			}
+			break;
+		case '.':
+			ngx_header_inspect_re_set_add(&set, 0, 255);
+			break;
+		case '\\':
+			rc = ngx_header_inspect_re_escape(re, &set, &c);
+			if (rc == NGX_ERROR) {
+				return NGX_ERROR;
+			}
+			if (rc == NGX_OK) {
+				ngx_header_inspect_re_set_add(&set, c, c);
+			}
+			break;
+		case '*':
+		case '+':
+		case '?':
+		case '{':
+			re->err = "nothing to repeat";
+			return NGX_ERROR;
+		case '^':
+		case '$':
+			re->err = "anchors are implied, escape a literal ^ or $";
+			return NGX_ERROR;
+		default:
+			ngx_header_inspect_re_set_add(&set, c, c);
+	}
+
+	return ngx_header_inspect_re_frag(re, &set, f);
+}
+
+/* returns NGX_DECLINED if there is no quantifier, max is NONE for no limit */
+static ngx_int_t ngx_header_inspect_re_quantifier(ngx_header_inspect_re_t *re, ngx_uint_t *min, ngx_uint_t *max) {
+	u_char *p, *comma, *close;
+	ngx_int_t n;
+
+	if (re->p == re->end) {
+		return NGX_DECLINED;
+	}
+
+	switch (*re->p) {
+		case '*':
+			*min = 0;
+			*max = NGX_HEADER_INSPECT_RE_NONE;
+			break;
+		case '+':
+			*min = 1;
+			*max = NGX_HEADER_INSPECT_RE_NONE;
+			break;
+		case '?':
+			*min = 0;
+			*max = 1;
+			break;
+		case '{':
+			p = re->p + 1;
+			close = ngx_strlchr(p, re->end, '}');
+			if (close == NULL) {
+				re->err = "missing }";
 				return NGX_ERROR;
+			}
+			comma = ngx_strlchr(p, close, ',');
+
+			n = ngx_atoi(p, (comma ? comma : close) - p);
+			if ((n == NGX_ERROR) || (n > NGX_HEADER_INSPECT_RE_MAX_REPEAT)) {
+				re->err = "invalid repeat count";
+				return NGX_ERROR;
+			}
+			*min = n;
+			*max = n;
+
+			if (comma) {
+				*max = NGX_HEADER_INSPECT_RE_NONE;
+				if (comma + 1 < close) {
+					n = ngx_atoi(comma + 1, close - comma - 1);
+					if ((n == NGX_ERROR) || (n > NGX_HEADER_INSPECT_RE_MAX_REPEAT) || ((ngx_uint_t) n < *min)) {
+						re->err = "invalid repeat count";
+						return NGX_ERROR;
+					}
+					*max = n;
+				}
+			}
+			re->p = close;
+			break;
+		default:
+			return NGX_DECLINED;
+	}
+
+	re->p++;
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_re_repeat(ngx_header_inspect_re_t *re, ngx_header_inspect_re_frag_t *f) {
+	ngx_header_inspect_re_frag_t a, r, e;
+	ngx_uint_t min, max, n, i, used;
+	u_char *atom, *p;
+	ngx_int_t rc;
+
+	atom = re->p;
+	if (ngx_header_inspect_re_atom(re, &a) != NGX_OK) {
+		return NGX_ERROR;
+	}
+
+	rc = ngx_header_inspect_re_quantifier(re, &min, &max);
+	if (rc == NGX_DECLINED) {
+		*f = a;
+		return NGX_OK;
+	}
+	if (rc == NGX_ERROR) {
+		return NGX_ERROR;
+	}
+	if ((re->p < re->end) && ngx_strchr("*+?{", *re->p)) {
+		re->err = "nested quantifier";
+		return NGX_ERROR;
+	}
+
+	if (ngx_header_inspect_re_frag(re, NULL, &r) != NGX_OK) {
+		return NGX_ERROR;
+	}
+
+	/* every copy of the atom beyond the first is parsed again */
+	n = (max == NGX_HEADER_INSPECT_RE_NONE) ? min + 1 : max;
+	used = 0;
+	for (i = 0; i < n; i++) {
+		if (used) {
+			p = re->p;
+			re->p = atom;
+			if (ngx_header_inspect_re_atom(re, &a) != NGX_OK) {
+				return NGX_ERROR;
+			}
+			re->p = p;
+		}
+		used = 1;
+
+		if (i >= min) {
+			/* a* and a? around a: start -> a.start, start -> end, a.end -> end (and a.start) */
+			if (ngx_header_inspect_re_frag(re, NULL, &e) != NGX_OK) {
+				return NGX_ERROR;
+			}
+			ngx_header_inspect_re_eps(re, a.end, e.end);
+			if (max == NGX_HEADER_INSPECT_RE_NONE) {
+				ngx_header_inspect_re_eps(re, a.end, a.start);
+			}
+			ngx_header_inspect_re_eps(re, e.start, a.start);
+			a.start = e.start;
+			a.end = e.end;
+		}
+
+		ngx_header_inspect_re_eps(re, r.end, a.start);
+		r.end = a.end;
+	}
+
+	*f = r;
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_re_concat(ngx_header_inspect_re_t *re, ngx_header_inspect_re_frag_t *f) {
+	ngx_header_inspect_re_frag_t a;
+
+	if (ngx_header_inspect_re_frag(re, NULL, f) != NGX_OK) {
+		return NGX_ERROR;
+	}
+
+	while ((re->p < re->end) && (*re->p != '|') && (*re->p != ')')) {
+		if (ngx_header_inspect_re_repeat(re, &a) != NGX_OK) {
+			return NGX_ERROR;
+		}
+		ngx_header_inspect_re_eps(re, f->end, a.start);
+		f->end = a.end;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_re_alt(ngx_header_inspect_re_t *re, ngx_header_inspect_re_frag_t *f) {
+	ngx_header_inspect_re_frag_t a, b;
+
+	if (ngx_header_inspect_re_concat(re, f) != NGX_OK) {
+		return NGX_ERROR;
+	}
+
+	while ((re->p < re->end) && (*re->p == '|')) {
+		re->p++;
+		a = *f;
+		if (ngx_header_inspect_re_concat(re, &b) != NGX_OK) {
+			return NGX_ERROR;
+		}
+
+		f->start = ngx_header_inspect_re_state(re);
+		f->end = ngx_header_inspect_re_state(re);
+		if ((f->start == NGX_HEADER_INSPECT_RE_NONE) || (f->end == NGX_HEADER_INSPECT_RE_NONE)) {
+			return NGX_ERROR;
+		}
+
+		ngx_header_inspect_re_eps(re, f->start, a.start);
+		ngx_header_inspect_re_eps(re, f->start, b.start);
+		ngx_header_inspect_re_eps(re, a.end, f->end);
+		ngx_header_inspect_re_eps(re, b.end, f->end);
+	}
+
+	return NGX_OK;
+}
+
+static void ngx_header_inspect_re_closure(ngx_header_inspect_re_state_t *states, ngx_uint_t n, uint32_t *set, ngx_uint_t *stack) {
+	ngx_uint_t s, t, j, sp;
+
+	sp = 0;
+	for (s = 0; s < n; s++) {
+		if (set[s >> 5] & (1U << (s & 0x1f))) {
+			stack[sp++] = s;
+		}
+	}
+
+	while (sp) {
+		s = stack[--sp];
+		for (j = 0; j < 2; j++) {
+			t = states[s].eps[j];
+			if ((t != NGX_HEADER_INSPECT_RE_NONE) && !(set[t >> 5] & (1U << (t & 0x1f)))) {
+				set[t >> 5] |= 1U << (t & 0x1f);
+				stack[sp++] = t;
+			}
+		}
+	}
+}
+
+/*
+ * Compiles an inspect_headers_rule regex into a DFA for
+ * ngx_header_inspect_dfa_run(), which matches the whole value.  The
+ * syntax is restricted to what a DFA can do: literals, ".", [classes],
+ * \d \w \s \xHH, groups, "|" and the *, +, ?, {n}, {n,} and {n,m}
+ * quantifiers, no backreferences or lookaround.  The NFA is built
+ * Thompson style and turned into a DFA by subset construction, so
+ * matching is a single pass over the value without backtracking.
+ */
+static ngx_header_inspect_dfa_t *ngx_header_inspect_re_compile(ngx_conf_t *cf, ngx_str_t *regex, char **err, ngx_uint_t *pos) {
+	ngx_header_inspect_re_t re;
+	ngx_header_inspect_re_frag_t f;
+	ngx_header_inspect_re_state_t *states;
+	ngx_header_inspect_re_set_t *sets;
+	ngx_header_inspect_dfa_t *dfa;
+	ngx_uint_t i, c, d, k, n, s, t, nwords, nclasses, ndfa, key;
+	ngx_uint_t map[512], rep[256], *stack;
+	uint32_t *dsets, *cur;
+	u_char classes[256], *next;
+
+	ngx_memzero(&re, sizeof(ngx_header_inspect_re_t));
+	re.start = regex->data;
+	re.p = regex->data;
+	re.end = regex->data + regex->len;
+	*err = "out of memory";
+	*pos = 0;
+
+	if ((ngx_array_init(&re.states, cf->temp_pool, 64, sizeof(ngx_header_inspect_re_state_t)) != NGX_OK)
+		|| (ngx_array_init(&re.sets, cf->temp_pool, 16, sizeof(ngx_header_inspect_re_set_t)) != NGX_OK))
+	{
+		return NULL;
+	}
+
+	/* the whole value has to match, anchors are allowed but implied */
+	if ((re.p < re.end) && (*re.p == '^')) {
+		re.p++;
+	}
+	if ((re.end - re.p >= 1) && (re.end[-1] == '$') && ((re.end - re.p < 2) || (re.end[-2] != '\\'))) {
+		re.end--;
+	}
+
+	if ((ngx_header_inspect_re_alt(&re, &f) != NGX_OK) || (re.p != re.end)) {
+		*err = re.err ? re.err : "unmatched )";
+		*pos = re.p - re.start;
+		return NULL;
+	}
+
+	states = re.states.elts;
+	sets = re.sets.elts;
+	n = re.states.nelts;
+
+	/* byte classes: split the bytes until no set cuts through a class */
+	ngx_memzero(classes, sizeof(classes));
+	nclasses = 1;
+	for (i = 0; i < re.sets.nelts; i++) {
+		for (k = 0; k < 2 * nclasses; k++) {
+			map[k] = NGX_HEADER_INSPECT_RE_NONE;
+		}
+		k = 0;
+		for (c = 0; c < 256; c++) {
+			key = classes[c] * 2 + ((sets[i].bits[c >> 5] >> (c & 0x1f)) & 1);
+			if (map[key] == NGX_HEADER_INSPECT_RE_NONE) {
+				map[key] = k++;
+			}
+			classes[c] = (u_char) map[key];
+		}
+		nclasses = k;
+	}
+	for (c = 256; c > 0; c--) {
+		rep[classes[c - 1]] = c - 1;
+	}
+
+	/* subset construction, DFA state d is the set of NFA states at dsets[d], 0 is the empty dead state */
+	nwords = (n + 31) / 32;
+	dsets = ngx_pcalloc(cf->temp_pool, 257 * nwords * sizeof(uint32_t));
+	next = ngx_pcalloc(cf->temp_pool, 256 * nclasses);
+	stack = ngx_palloc(cf->temp_pool, n * sizeof(ngx_uint_t));
+	if ((dsets == NULL) || (next == NULL) || (stack == NULL)) {
+		return NULL;
+	}
+
+	cur = &dsets[nwords];
+	cur[f.start >> 5] |= 1U << (f.start & 0x1f);
+	ngx_header_inspect_re_closure(states, n, cur, stack);
+	ndfa = 2;
+
+	for (d = 1; d < ndfa; d++) {
+		for (k = 0; k < nclasses; k++) {
+			cur = &dsets[ndfa * nwords];
+			ngx_memzero(cur, nwords * sizeof(uint32_t));
+
+			for (s = 0; s < n; s++) {
+				if ((dsets[d * nwords + (s >> 5)] & (1U << (s & 0x1f)))
+					&& (states[s].set != NGX_HEADER_INSPECT_RE_NONE)
+					&& (sets[states[s].set].bits[rep[k] >> 5] & (1U << (rep[k] & 0x1f))))
+				{
+					t = states[s].to;
+					cur[t >> 5] |= 1U << (t & 0x1f);
+				}
+			}
+			ngx_header_inspect_re_closure(states, n, cur, stack);
+
+			for (t = 0; t < ndfa; t++) {
+				if (ngx_memcmp(&dsets[t * nwords], cur, nwords * sizeof(uint32_t)) == 0) {
+					break;
+				}
+			}
+			if (t == ndfa) {
+				if (ndfa == 255) {
+					*err = "too many DFA states";
+					return NULL;
+				}
+				ndfa++;
+			}
+			next[d * nclasses + k] = (u_char) t;
+		}
+	}
+
+	dfa = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_dfa_t));
+	if (dfa == NULL) {
+		return NULL;
+	}
+
+	ngx_memcpy(dfa->classes, classes, sizeof(classes));
+	dfa->nclasses = nclasses;
+	dfa->nstates = ndfa;
+
+	dfa->next = ngx_pcalloc(cf->pool, ndfa * nclasses + ndfa + sizeof(uint32_t) + ndfa * sizeof(ngx_header_inspect_set_t));
+	if (dfa->next == NULL) {
+		return NULL;
+	}
+	dfa->flags = dfa->next + ndfa * nclasses;
+	dfa->skip = (ngx_header_inspect_set_t *) ngx_align_ptr(dfa->flags + ndfa, sizeof(uint32_t));
+
+	ngx_memcpy(dfa->next, next, ndfa * nclasses);
+	for (d = 1; d < ndfa; d++) {
+		if (dsets[d * nwords + (f.end >> 5)] & (1U << (f.end & 0x1f))) {
+			dfa->flags[d] |= NGX_HEADER_INSPECT_DFA_ACCEPT;
+		}
+	}
+
+	ngx_header_inspect_dfa_skip(dfa);
+
+	return dfa;
+}
+
+/* ASCII A-Z to lowercase in all 8 bytes at once, where fold has 0x80 */
+static ngx_inline uint64_t ngx_header_inspect_fold(uint64_t w, uint64_t fold) {
+	uint64_t b, upper;
+
+	b = w & 0x7f7f7f7f7f7f7f7fULL;
+	upper = (b + 0x3f3f3f3f3f3f3f3fULL) & ~(b + 0x2525252525252525ULL) & ~w & fold;
+
+	return w | (upper >> 2);
+}
+
+/* up to 8 bytes, zero padded */
+static ngx_inline uint64_t ngx_header_inspect_load(u_char *p, size_t len) {
+	uint64_t w = 0;
+
+	ngx_memcpy(&w, p, (len < 8) ? len : 8);
+
+	return w;
+}
+
+static size_t ngx_header_inspect_token_len(u_char *p, size_t len) {
+	size_t i;
+
+	for (i = 0; (i < len) && ngx_header_inspect_is(p[i], NGX_HEADER_INSPECT_TCHAR); i++) {
+		/* void */
+	}
+
+	return i;
+}
+
+/* the kind of the word in p, or NGX_DECLINED if it is not in the list */
+static ngx_int_t ngx_header_inspect_vocab_find(ngx_header_inspect_vocab_t *vocab, u_char *p, size_t len) {
+	uint64_t w[NGX_HEADER_INSPECT_WORD_MAX / 8], h;
+	ngx_header_inspect_word_t *word;
+	ngx_uint_t k, n;
+
+	if ((len == 0) || (len > NGX_HEADER_INSPECT_WORD_MAX)) {
+		return NGX_DECLINED;
+	}
+
+	n = (len + 7) / 8;
+	h = len;
+	for (k = 0; k < n; k++) {
+		w[k] = ngx_header_inspect_fold(ngx_header_inspect_load(p + 8 * k, len - 8 * k), vocab->fold);
+		h = (h ^ w[k]) * vocab->seed;
+	}
+
+	word = &vocab->slots[h >> vocab->shift];
+	if (word->len != len) {
+		return NGX_DECLINED;
+	}
+	for (k = 0; k < n; k++) {
+		if (word->w[k] != w[k]) {
+			return NGX_DECLINED;
+		}
+	}
+
+	return word->kind;
+}
+
+/*
+ * Token lists of the inspect_headers_* directives become a perfect hash:
+ * the seed is searched for at config time so that no two words share a
+ * slot, a lookup is then a pass over the token 8 bytes at a time plus
+ * one compare, no matter how many words the list has.
+ */
+static ngx_header_inspect_vocab_t *ngx_header_inspect_vocab_compile(ngx_conf_t *cf, ngx_header_inspect_vocab_spec_t *spec, ngx_str_t *words, ngx_uint_t nwords) {
+	ngx_header_inspect_vocab_t *vocab;
+	ngx_header_inspect_vocab_kind_t *kind;
+	ngx_header_inspect_word_t *word, *slots;
+	ngx_uint_t i, j, k, n, size, shift, tries;
+	uint64_t seed, h;
+
+	vocab = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_vocab_t));
+	slots = ngx_pcalloc(cf->temp_pool, nwords * sizeof(ngx_header_inspect_word_t));
+	if ((vocab == NULL) || (slots == NULL)) {
+		return NULL;
+	}
+	vocab->fold = spec->caseless ? 0x8080808080808080ULL : 0;
+
+	for (i = 0; i < nwords; i++) {
+		if ((words[i].len == 0) || (words[i].len > NGX_HEADER_INSPECT_WORD_MAX)
+			|| (ngx_header_inspect_token_len(words[i].data, words[i].len) != words[i].len))
+		{
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid token \"%V\", expected at most %d token characters", &words[i], NGX_HEADER_INSPECT_WORD_MAX);
+			return NULL;
+		}
+
+		word = &slots[i];
+		word->len = words[i].len;
+		for (k = 0; k < (word->len + 7) / 8; k++) {
+			word->w[k] = ngx_header_inspect_fold(ngx_header_inspect_load(words[i].data + 8 * k, word->len - 8 * k), vocab->fold);
+		}
+
+		for (kind = spec->kinds; kind && kind->word.len; kind++) {
+			if ((kind->word.len == words[i].len) && (ngx_strncasecmp(kind->word.data, words[i].data, words[i].len) == 0)) {
+				word->kind = kind->kind;
+				break;
+			}
+		}
+
+		for (j = 0; j < i; j++) {
+			if ((slots[j].len == word->len) && (ngx_memcmp(slots[j].w, word->w, sizeof(word->w)) == 0)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "duplicate token \"%V\"", &words[i]);
+				return NULL;
+			}
+		}
+	}
+
+	seed = 0x9e3779b97f4a7c15ULL;
+
+	/* a table at least twice the list, grown when no seed fits */
+	for (shift = 62, size = 4; size < 2 * nwords; size <<= 1) {
+		shift--;
+	}
+
+	for ( ;; ) {
+		vocab->slots = ngx_pcalloc(cf->pool, size * sizeof(ngx_header_inspect_word_t));
+		if (vocab->slots == NULL) {
+			return NULL;
+		}
+
+		for (tries = 0; tries < 64; tries++) {
+			seed = (seed * 6364136223846793005ULL + 1442695040888963407ULL) | 1;
+
+			for (i = 0; i < nwords; i++) {
+				n = (slots[i].len + 7) / 8;
+				h = slots[i].len;
+				for (k = 0; k < n; k++) {
+					h = (h ^ slots[i].w[k]) * seed;
+				}
+
+				word = &vocab->slots[h >> shift];
+				if (word->len) {
+					break;
+				}
+				*word = slots[i];
+			}
+
+			if (i == nwords) {
+				vocab->seed = seed;
+				vocab->shift = shift;
+				return vocab;
+			}
+
+			ngx_memzero(vocab->slots, size * sizeof(ngx_header_inspect_word_t));
+		}
+
+		if (shift == 48) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "cannot build a perfect hash for %ui tokens", nwords);
+			return NULL;
+		}
+		size <<= 1;
+		shift--;
+	}
+}
+
+static void ngx_header_inspect_init_scan(void) {
+	ngx_uint_t c;
+
+	ngx_header_inspect_span = ngx_header_inspect_span_scalar;
+	ngx_header_inspect_find_ctl = ngx_header_inspect_ctl_scalar;
+	ngx_header_inspect_decode_base64 = ngx_header_inspect_decode_base64_scalar;
+
+	for (c = 0; c < 0x80; c++) {
+		if (ngx_header_inspect_is(c, NGX_HEADER_INSPECT_BASE64)) {
+			ngx_header_inspect_set_add(&ngx_header_inspect_base64_set, c);
+		}
+	}
+
+#if (NGX_HEADER_INSPECT_SIMD)
+	ngx_header_inspect_find_ctl = ngx_header_inspect_ctl_sse2;
+
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		ngx_header_inspect_span = ngx_header_inspect_span_avx2;
+		ngx_header_inspect_find_ctl = ngx_header_inspect_ctl_avx2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		ngx_header_inspect_span = ngx_header_inspect_span_ssse3;
+	}
+
+	if (__builtin_cpu_supports("ssse3")) {
+		ngx_header_inspect_decode_base64 = ngx_header_inspect_decode_base64_ssse3;
+	}
+#endif
+}
+
+static ngx_int_t ngx_header_inspect_add_variables(ngx_conf_t *cf) {
+	ngx_http_variable_t *var, *v;
+
+	for (v = ngx_header_inspect_vars; v->name.len; v++) {
+		var = ngx_http_add_variable(cf, &v->name, v->flags);
+		if (var == NULL) {
+			return NGX_ERROR;
+		}
+
+		var->get_handler = v->get_handler;
+		var->data = v->data;
+	}
+
+	return NGX_OK;
+}
+
+/* the slot of a header in the policy arrays, its counter row unless an other header */
+static ngx_uint_t ngx_header_inspect_policy_index(ngx_header_inspect_header_t *hdr) {
+	switch (hdr->id) {
+		case NGX_HEADER_INSPECT_HDR_RULE:
+			return ((ngx_header_inspect_rule_t *) hdr)->row;
+		case NGX_HEADER_INSPECT_HDR_OTHER:
+			return ((ngx_header_inspect_other_t *) hdr)->slot;
+		default:
+			return hdr->id;
+	}
+}
+
+static ngx_uint_t ngx_header_inspect_policy(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_header_t *hdr) {
+	ngx_uint_t slot;
+
+	slot = ngx_header_inspect_policy_index(hdr);
+
+	return (slot < conf->npolicy) ? conf->policy[slot] : NGX_HEADER_INSPECT_POLICY_INSPECT;
+}
+
+/* whether a violation in a header with this policy removes the header rather than blocking */
+#define ngx_header_inspect_strips(conf, hdr, action)                             \
+	(((action) == NGX_HEADER_INSPECT_POLICY_INSPECT) && (conf)->strip            \
+	 && ((hdr)->id != NGX_HEADER_INSPECT_HDR_HOST)                               \
+	 && ((hdr)->id != NGX_HEADER_INSPECT_HDR_CONTENT_LENGTH)                     \
+	 && ((hdr)->id != NGX_HEADER_INSPECT_HDR_TRANSFER_ENCODING))
+
+/*
+ * Whether it blocks the request.  Checked after the above: the headers
+ * that frame the request cannot be stripped, so they block instead.
+ */
+#define ngx_header_inspect_blocks(conf, action)                                  \
+	(((action) == NGX_HEADER_INSPECT_POLICY_BLOCK)                               \
+	 || (((action) == NGX_HEADER_INSPECT_POLICY_INSPECT) && ((conf)->block || (conf)->strip)))
+
+/*
+ * Takes h[i] out of the request headers.  Nothing is moved, as the
+ * headers_in fields point into the list: the part is shortened from
+ * either end or cut in two around it, as the headers-more module does.
+ * The list is left so that ngx_list_push() does not write past a part.
+ */
+static ngx_int_t ngx_header_inspect_remove(ngx_http_request_t *r, ngx_list_part_t *part, ngx_uint_t i) {
+	ngx_list_t *list;
+	ngx_list_part_t *next;
+	ngx_table_elt_t *h;
+#if (nginx_version >= 1023000)
+	ngx_http_core_main_conf_t *cmcf;
+	ngx_http_header_t *hh;
+	ngx_table_elt_t **ph;
+#endif
+
+	list = &r->headers_in.headers;
+	h = part->elts;
+
+#if (nginx_version >= 1023000)
+	/* unlinked from r->headers_in.user_agent and the like, where repeated headers are chained */
+	cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
+	hh = ngx_hash_find(&cmcf->headers_in_hash, h[i].hash, h[i].lowcase_key, h[i].key.len);
+	if (hh && hh->offset) {
+		for (ph = (ngx_table_elt_t **) ((char *) &r->headers_in + hh->offset); *ph; ph = &(*ph)->next) {
+			if (*ph == &h[i]) {
+				*ph = h[i].next;
+				break;
+			}
+		}
+	}
+#endif
+
+	if (i == part->nelts - 1) {
+		part->nelts--;
+		return NGX_OK;
+	}
+
+	if (i == 0) {
+		part->elts = (char *) part->elts + list->size;
+		part->nelts--;
+		if (part == list->last) {
+			list->nalloc--;
+		}
+		return NGX_OK;
+	}
+
+	next = ngx_palloc(r->pool, sizeof(ngx_list_part_t));
+	if (next == NULL) {
+		return NGX_ERROR;
+	}
+
+	next->elts = &h[i + 1];
+	next->nelts = part->nelts - i - 1;
+	next->next = part->next;
+
+	part->nelts = i;
+	part->next = next;
+
+	if (part == list->last) {
+		list->last = next;
+		list->nalloc = next->nelts;
+	}
+
+	return NGX_OK;
+}
+
+static void ngx_header_inspect_cleanup(void *data) {
+	/* void, only marks the ctx in the pool */
+}
+
+/*
+ * The ctx lives in the main request.  An internal redirect clears the
+ * module ctxs, so the ctx is also found through its pool cleanup, the
+ * way ngx_http_realip_module does it.
+ */
+static ngx_header_inspect_ctx_t *ngx_header_inspect_get_ctx(ngx_http_request_t *r) {
+	ngx_header_inspect_ctx_t *ctx;
+	ngx_pool_cleanup_t *cln;
+
+	r = r->main;
+
+	ctx = ngx_http_get_module_ctx(r, ngx_http_header_inspect_module);
+
+	if ((ctx == NULL) && (r->internal || r->filter_finalize)) {
+		for (cln = r->pool->cleanup; cln; cln = cln->next) {
+			if (cln->handler == ngx_header_inspect_cleanup) {
+				ctx = cln->data;
+				ngx_http_set_ctx(r, ctx, ngx_http_header_inspect_module);
+				break;
+			}
+		}
+	}
+
+	return ctx;
+}
+
+static ngx_header_inspect_ctx_t *ngx_header_inspect_create_ctx(ngx_http_request_t *r) {
+	ngx_header_inspect_ctx_t *ctx;
+	ngx_pool_cleanup_t *cln;
+
+	r = r->main;
+
+	cln = ngx_pool_cleanup_add(r->pool, sizeof(ngx_header_inspect_ctx_t));
+	if (cln == NULL) {
+		return NULL;
+	}
+
+	ctx = cln->data;
+	ngx_memzero(ctx, sizeof(ngx_header_inspect_ctx_t));
+
+	cln->handler = ngx_header_inspect_cleanup;
+	ngx_http_set_ctx(r, ctx, ngx_http_header_inspect_module);
+
+	return ctx;
+}
+
+/* microseconds spent in the parsers, "-" in logs unless inspect_headers_profile was on */
+static ngx_int_t ngx_header_inspect_time_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+	ngx_header_inspect_ctx_t *ctx;
+	u_char *p;
+
+	ctx = ngx_header_inspect_get_ctx(r);
+	if ((ctx == NULL) || !ctx->timed) {
+		v->not_found = 1;
+		return NGX_OK;
+	}
+
+	p = ngx_pnalloc(r->pool, NGX_INT64_LEN + 4);
+	if (p == NULL) {
+		return NGX_ERROR;
+	}
+
+	v->len = ngx_sprintf(p, "%uL.%03uL", ctx->nsec / 1000, ctx->nsec % 1000) - p;
+	v->valid = 1;
+	v->no_cacheable = 0;
+	v->not_found = 0;
+	v->data = p;
+
+	return NGX_OK;
+}
+
+/* "pass", "strip", "violation", "block" or "penalty", not found if the headers were not inspected */
+static ngx_int_t ngx_header_inspect_verdict_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+	ngx_header_inspect_ctx_t *ctx;
+
+	ctx = ngx_header_inspect_get_ctx(r);
+	if (ctx == NULL) {
+		v->not_found = 1;
+		return NGX_OK;
+	}
+
+	if (ctx->penalized) {
+		v->len = sizeof("penalty") - 1;
+		v->data = (u_char *) "penalty";
+	} else if (ctx->blocked) {
+		v->len = sizeof("block") - 1;
+		v->data = (u_char *) "block";
+	} else if (ctx->nviolations > ctx->nstripped) {
+		v->len = sizeof("violation") - 1;
+		v->data = (u_char *) "violation";
+	} else if (ctx->nstripped) {
+		v->len = sizeof("strip") - 1;
+		v->data = (u_char *) "strip";
+	} else {
+		v->len = sizeof("pass") - 1;
+		v->data = (u_char *) "pass";
+	}
+
+	v->valid = 1;
+	v->no_cacheable = 0;
+	v->not_found = 0;
+
+	return NGX_OK;
+}
+
+/* "range:too_many_sets,user-agent:illegal_char@17", the first NGX_HEADER_INSPECT_MAX_VIOLATIONS of them */
+static ngx_int_t ngx_header_inspect_violations_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+	ngx_header_inspect_ctx_t *ctx;
+	ngx_header_inspect_violation_t *vl;
+	ngx_uint_t i, n;
+	size_t len;
+	u_char *p;
+
+	ctx = ngx_header_inspect_get_ctx(r);
+	if (ctx == NULL) {
+		v->not_found = 1;
+		return NGX_OK;
+	}
+
+	n = ngx_min(ctx->nviolations, NGX_HEADER_INSPECT_MAX_VIOLATIONS);
+	vl = ctx->violations;
+
+	len = 0;
+	for (i = 0; i < n; i++) {
+		len += vl[i].hdr->name.len + ngx_header_inspect_errors[vl[i].code].len + sizeof(":@,") - 1 + NGX_INT_T_LEN;
+	}
+
+	p = ngx_pnalloc(r->pool, len);
+	if (p == NULL) {
+		return NGX_ERROR;
+	}
+
+	v->data = p;
+
+	for (i = 0; i < n; i++) {
+		if (i) {
+			*p++ = ',';
+		}
+		ngx_strlow(p, vl[i].hdr->name.data, vl[i].hdr->name.len);
+		p += vl[i].hdr->name.len;
+		*p++ = ':';
+		p = ngx_cpymem(p, ngx_header_inspect_errors[vl[i].code].data, ngx_header_inspect_errors[vl[i].code].len);
+		if (vl[i].pos >= 0) {
+			p = ngx_sprintf(p, "@%i", vl[i].pos);
+		}
+	}
+
+	v->len = p - v->data;
+	v->valid = 1;
+	v->no_cacheable = 0;
+	v->not_found = 0;
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_count_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+	ngx_header_inspect_ctx_t *ctx;
+	u_char *p;
+
+	ctx = ngx_header_inspect_get_ctx(r);
+	if (ctx == NULL) {
+		v->not_found = 1;
+		return NGX_OK;
+	}
+
+	p = ngx_pnalloc(r->pool, NGX_INT_T_LEN);
+	if (p == NULL) {
+		return NGX_ERROR;
+	}
+
+	v->len = ngx_sprintf(p, "%ui", ctx->nviolations) - p;
+	v->valid = 1;
+	v->no_cacheable = 0;
+	v->not_found = 0;
+	v->data = p;
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_init(ngx_conf_t *cf) {
+	ngx_http_handler_pt       *h;
+	ngx_http_core_main_conf_t *cmcf;
+	ngx_header_inspect_main_conf_t *mcf;
+
+	mcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_header_inspect_module);
+
+	/* header names are matched case-insensitively, so HTTP/2 and HTTP/3 requests are inspected too */
+	if (ngx_header_inspect_init_headers_hash(cf, mcf) != NGX_OK) {
+		return NGX_ERROR;
+	}
+
+	ngx_header_inspect_init_scan();
+
+	if (mcf->sync) {
+		if (mcf->penalty == NULL) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"inspect_headers_penalty_sync\" requires \"inspect_headers_penalty\"");
+			return NGX_ERROR;
+		}
+		mcf->sync->penalty = mcf->penalty;
+	}
+
+	if (ngx_header_inspect_init_dfas(cf->log) != NGX_OK) {
+		return NGX_ERROR;
+	}
+
+	cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+
+	h = ngx_array_push(&cmcf->phases[NGX_HTTP_REWRITE_PHASE].handlers);
+	if (h == NULL) {
+		return NGX_ERROR;
+	}
+
+	*h = ngx_header_inspect_process_request;
+
+	if (mcf->post_read) {
+		h = ngx_array_push(&cmcf->phases[NGX_HTTP_POST_READ_PHASE].handlers);
+		if (h == NULL) {
+			return NGX_ERROR;
+		}
+
+		*h = ngx_header_inspect_post_read;
+	}
+
+	return NGX_OK;
+}
+
+/*
+ * The digits at the start of p as a number in *n, -1 in *n if that is
+ * above max (overflow included).  Returns how many digits there were.
+ */
+static size_t ngx_header_inspect_parse_num(u_char *p, size_t len, off_t max, off_t *n) {
+	uint64_t v = 0, d, cutoff;
+	ngx_uint_t over = 0;
+	size_t i = 0;
+#if (NGX_HAVE_LITTLE_ENDIAN)
+	uint64_t w;
+
+	cutoff = (uint64_t) max / 100000000;
+	while ( len - i >= 8 ) {
+		ngx_memcpy(&w, &p[i], 8);
+
+		/* digits have 3 in the high nibble and less than 10 in the low one */
+		if ( ((w & 0xf0f0f0f0f0f0f0f0ULL) ^ 0x3030303030303030ULL)
+			| (((w & 0x0f0f0f0f0f0f0f0fULL) + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) )
+		{
+			break;
+		}
+
+		/* pairs, then groups of 4, then all 8 digits */
+		w = ((w & 0x0f0f0f0f0f0f0f0fULL) * 2561) >> 8;
+		w = ((w & 0x00ff00ff00ff00ffULL) * 6553601) >> 16;
+		w = ((w & 0x0000ffff0000ffffULL) * 42949672960001ULL) >> 32;
+
+		if ( v > cutoff ) {
+			over = 1;
+		}
+		v = v * 100000000 + w;
+		if ( v > (uint64_t) max ) {
+			over = 1;
+		}
+		i += 8;
+	}
+#endif
+
+	cutoff = (uint64_t) max / 10;
+	for ( ; (i < len) && ngx_header_inspect_is(p[i], NGX_HEADER_INSPECT_DIGIT); i++ ) {
+		d = p[i] - '0';
+		if ( v > cutoff ) {
+			over = 1;
+		}
+		v = v * 10 + d;
+		if ( v > (uint64_t) max ) {
+			over = 1;
+		}
+	}
+
+	*n = over ? -1 : (off_t) v;
+	return i;
+}
+
+static ngx_int_t ngx_header_inspect_range_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i,n,setcount;
+	ngx_int_t rc = NGX_OK;
+	off_t a,b,c;
+	enum range_header_states {RHS_NEWSET,RHS_NUM1,DELIM,RHS_NUM2,RHS_SUFDELIM,RHS_SUFNUM} state;
+
+	if ( (value.len < 6) || (ngx_strncmp("bytes=", value.data, 6) != 0) ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_PREFIX, 0);
+		rc = NGX_ERROR;
+	}
+
+	setcount = 1;
+	a = 0;
+	b = 0;
+	state = RHS_NEWSET;
+
+	i = 6; /* start after bytes= */
+	for ( ; i < value.len ; i++ ) {
+
+		switch (value.data[i]) {
+			case ',':
+				if ( (state != DELIM) && (state != RHS_NUM2) && (state != RHS_SUFNUM) ) {
+					ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+					rc = NGX_ERROR;
+				}
+				if ( state == RHS_NUM2 ) {
+					/* verify a <= b in 'a-b' sets */
+					if ( a > b ) {
+						ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_RANGE, i);
+						rc = NGX_ERROR;
+					}
+				}
+				setcount++;
+				a = 0;
+				b = 0;
+				state = RHS_NEWSET;
+				break;
+
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+				if ( (state != RHS_NEWSET) && (state != DELIM) && (state != RHS_SUFDELIM) ) {
+					ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+					rc = NGX_ERROR;
+					break;
+				}
+				/* the whole run of digits at once */
+				n = ngx_header_inspect_parse_num(&(value.data[i]), value.len-i, NGX_MAX_OFF_T_VALUE, &c);
+				if ( c < 0 ) {
+					ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_LARGE, i);
+					rc = NGX_ERROR;
+				}
+				if ( state == RHS_NEWSET ) {
+					a = c;
+					state = RHS_NUM1;
+				} else if ( state == DELIM ) {
+					b = c;
+					state = RHS_NUM2;
+				} else {
+					state = RHS_SUFNUM;
+				}
+				i += n-1;
+				break;
+
+			case '-':
+				if (state == RHS_NEWSET) {
+					state = RHS_SUFDELIM;
+				} else if (state == RHS_NUM1) {
+					state = DELIM;
+				} else {
+					ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+					rc = NGX_ERROR;
+				}
+				break;
+
+			default:
+				ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+				rc = NGX_ERROR;
+		}
+
+		if (setcount > conf->range_max_byteranges) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_MANY_SETS, -1);
+			return NGX_ERROR;
+			break;
+		}
+	}
+
+	if ((state != DELIM) && (state != RHS_NUM2) && (state != RHS_SUFNUM)) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		rc = NGX_ERROR;
+	}
+	if ( state == RHS_NUM2 ) {
+		/* verify a <= b in 'a-b' sets */
+		if ( a > b ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_RANGE, i);
+			rc = NGX_ERROR;
+		}
+	}
+
+	return rc;
+}
+
+#if (NGX_HAVE_LITTLE_ENDIAN)
+
+/*
+ * IMF-fixdate "Sun, 06 Nov 1994 08:49:37 GMT" as four (overlapping)
+ * 8 byte words at offsets 0, 8, 16 and 21: the fixed bytes with their
+ * mask, and a mask of the bytes that must be digits.
+ */
+static const uint64_t ngx_header_inspect_imf_fixed[4] = {
+	0x200000202c000000ULL, 0x0000000020000000ULL, 0x003a00003a000020ULL, 0x544d472000003a00ULL
+};
+static const uint64_t ngx_header_inspect_imf_fixed_mask[4] = {
+	0xff0000ffff000000ULL, 0x00000000ff000000ULL, 0x00ff0000ff0000ffULL, 0xffffffff0000ff00ULL
+};
+static const uint64_t ngx_header_inspect_imf_digits[4] = {
+	0x00ffff0000000000ULL, 0xffffffff00000000ULL, 0xff00ffff00ffff00ULL, 0x00000000ffff00ffULL
+};
+
+/* "Sun," and "Nov " as 32 bit words, slot (w * multiplier) >> 29 resp. >> 28 */
+static const uint32_t ngx_header_inspect_imf_days[8] = {
+	0x2c6e7553 /* Sun */, 0, 0x2c697246 /* Fri */, 0x2c646557 /* Wed */,
+	0x2c6e6f4d /* Mon */, 0x2c746153 /* Sat */, 0x2c657554 /* Tue */, 0x2c756854 /* Thu */
+};
+static const uint32_t ngx_header_inspect_imf_months[16] = {
+	0x2074634f /* Oct */, 0x206c754a /* Jul */, 0x2079614d /* May */, 0,
+	0x20706553 /* Sep */, 0, 0, 0x20626546 /* Feb */,
+	0x2072614d /* Mar */, 0x20766f4e /* Nov */, 0x20636544 /* Dec */, 0x206e754a /* Jun */,
+	0x20677541 /* Aug */, 0x206e614a /* Jan */, 0, 0x20727041 /* Apr */
+};
+
+/* the first 29 bytes of data are an IMF-fixdate, checked without branches */
+static ngx_uint_t ngx_header_inspect_imf_fixdate(u_char *data) {
+	static const ngx_uint_t off[4] = { 0, 8, 16, 21 };
+	uint64_t w, x, bad;
+	uint32_t day, month;
+	ngx_uint_t k;
+
+	bad = 0;
+	for (k = 0; k < 4; k++) {
+		ngx_memcpy(&w, &data[off[k]], 8);
+		x = (w ^ 0x3030303030303030ULL) & ngx_header_inspect_imf_digits[k];
+		bad |= (w & ngx_header_inspect_imf_fixed_mask[k]) ^ ngx_header_inspect_imf_fixed[k];
+		/* digits are 0x30-0x39, so x is below 10 and adding 6 does not reach 0x10 */
+		bad |= (x | (x + 0x0606060606060606ULL)) & 0xf0f0f0f0f0f0f0f0ULL & ngx_header_inspect_imf_digits[k];
+	}
+
+	ngx_memcpy(&day, &data[0], 4);
+	ngx_memcpy(&month, &data[8], 4);
+	bad |= day ^ ngx_header_inspect_imf_days[(uint32_t) (day * 0xb337ff2dU) >> 29];
+	bad |= month ^ ngx_header_inspect_imf_months[(uint32_t) (month * 0xcf24cf6fU) >> 28];
+
+	return (bad == 0);
+}
+
+#endif
+
+static ngx_int_t ngx_header_inspect_http_date(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
+	ngx_uint_t i = 0;
+	enum http_date_type {RFC1123, RFC850, ASCTIME} type;
+
+#if (NGX_HAVE_LITTLE_ENDIAN)
+	/* what any current client sends, RFC 850 and asctime dates take the long way */
+	if ( (maxlen >= 29) && ngx_header_inspect_imf_fixdate(data) ) {
+		*len = 29;
+		return NGX_OK;
+	}
+#endif
+
+	if ( maxlen < 24 ) {
+		*len = i;
+		return NGX_ERROR;
+	}
+
+	if ((data[0] == 'M') && (data[1] == 'o') && (data[2] == 'n')) {
+	/* Mon(day) */
+		switch (data[3]) {
+			case ',':
+				type = RFC1123;
+				i = 4;
+				break;
+			case ' ':
+				type = ASCTIME;
+				i = 3;
+				break;
+			case 'd':
+				type = RFC850;
+				if (
+					(data[4] != 'a') ||
+					(data[5] != 'y') ||
+					(data[6] != ',')
+				) {
+					*len = i;
+					return NGX_ERROR;
+				}
+				i = 7;
+				break;
+			default:
+				*len = i;
+				return NGX_ERROR;
+		}
+	} else if ((data[0] == 'T') && (data[1] == 'u') && (data[2] == 'e')) {
+	/* Tue(sday) */
+		switch (data[3]) {
+			case ',':
+				type = RFC1123;
+				i = 4;
+				break;
+			case ' ':
+				type = ASCTIME;
+				i = 3;
+				break;
+			case 's':
+				type = RFC850;
+				if (
+					(data[4] != 'd') ||
+					(data[5] != 'a') ||
+					(data[6] != 'y') ||
+					(data[7] != ',')
+				) {
+					*len = i;
+					return NGX_ERROR;
+				}
+				i = 8;
+				break;
+			default:
+				*len = i;
+				return NGX_ERROR;
+		}
+	} else if ((data[0] == 'W') && (data[1] == 'e') && (data[2] == 'd')) {
+	/* Wed(nesday) */
+		switch (data[3]) {
+			case ',':
+				type = RFC1123;
+				i = 4;
+				break;
+			case ' ':
+				type = ASCTIME;
+				i = 3;
+				break;
+			case 'n':
+				type = RFC850;
+				if (
+					(data[4] != 'e') ||
+					(data[5] != 's') ||
+					(data[6] != 'd') ||
+					(data[7] != 'a') ||
+					(data[8] != 'y') ||
+					(data[9] != ',')
+				) {
+					*len = i;
+					return NGX_ERROR;
+				}
+				i = 10;
+				break;
+			default:
+				*len = i;
+				return NGX_ERROR;
+		}
+	} else if ((data[0] == 'T') && (data[1] == 'h') && (data[2] == 'u')) {
+	/* Thu(rsday) */
+		switch (data[3]) {
+			case ',':
+				type = RFC1123;
+				i = 4;
+				break;
+			case ' ':
+				type = ASCTIME;
+				i = 3;
+				break;
+			case 'r':
+				type = RFC850;
+				if (
+					(data[4] != 's') ||
+					(data[5] != 'd') ||
+					(data[6] != 'a') ||
+					(data[7] != 'y') ||
+					(data[8] != ',')
+				) {
+					*len = i;
+					return NGX_ERROR;
+				}
+				i = 9;
+				break;
+			default:
+				*len = i;
+				return NGX_ERROR;
+		}
+	} else if ((data[0] == 'F') && (data[1] == 'r') && (data[2] == 'i')) {
+	/* Fri(day) */
+		switch (data[3]) {
+			case ',':
+				type = RFC1123;
+				i = 4;
+				break;
+			case ' ':
+				type = ASCTIME;
+				i = 3;
+				break;
+			case 'd':
+				type = RFC850;
+				if (
+					(data[4] != 'a') ||
+					(data[5] != 'y') ||
+					(data[6] != ',')
+				) {
+					*len = i;
+					return NGX_ERROR;
+				}
+				i = 7;
+				break;
+			default:
+				*len = i;
+				return NGX_ERROR;
+		}
+	} else if ((data[0] == 'S') && (data[1] == 'a') && (data[2] == 't')) {
+	/* Sat(urday) */
+		switch (data[3]) {
+			case ',':
+				type = RFC1123;
+				i = 4;
+				break;
+			case ' ':
+				type = ASCTIME;
+				i = 3;
+				break;
+			case 'u':
+				type = RFC850;
+				if (
+					(data[4] != 'r') ||
+					(data[5] != 'd') ||
+					(data[6] != 'a') ||
+					(data[7] != 'y') ||
+					(data[8] != ',')
+				) {
+					*len = i;
+					return NGX_ERROR;
+				}
+				i = 9;
+				break;
+			default:
+				*len = i;
+				return NGX_ERROR;
+		}
+	} else if ((data[0] == 'S') && (data[1] == 'u') && (data[2] == 'n')) {
+	/* Sun(day) */
+		switch (data[3]) {
+			case ',':
+				type = RFC1123;
+				i = 4;
+				break;
+			case ' ':
+				type = ASCTIME;
+				i = 3;
+				break;
+			case 'd':
+				type = RFC850;
+				if (
+					(data[4] != 'a') ||
+					(data[5] != 'y') ||
+					(data[6] != ',')
+				) {
+					*len = i;
+					return NGX_ERROR;
+				}
+				i = 7;
+				break;
+			default:
+				*len = i;
+				return NGX_ERROR;
+		}
+	} else {
+		*len = i;
+		return NGX_ERROR;
+	}
+
+	switch (type) {
+		case RFC1123:
+			if (maxlen < 29) {
+				*len = i;
+				return NGX_ERROR;
+			}
+			break;
+		case RFC850:
+			if (maxlen < 30) {
+				*len = i;
+				return NGX_ERROR;
+			}
+			break;
+		case ASCTIME:
+			if (maxlen < 24) {
+				*len = i;
+				return NGX_ERROR;
+			}
+			break;
+		default:
+			*len = i;
+			return NGX_ERROR;
+	}
+
+	if (data[i] != ' ') {
+		*len = i;
+		return NGX_ERROR;
+	}
+	i++;
+
+	if (type == RFC1123) {
+	/* rfc1123: day */
+		if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if (data[i] != ' ') {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+	} else if (type == RFC850) {
+	/* rfc850: day */
+		if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if (data[i] != '-') {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+	}
+
+	/* month: Nov */
+	if (
+		((data[i] == 'J') && (data[i+1] == 'a') && (data[i+2] == 'n')) ||
+		((data[i] == 'F') && (data[i+1] == 'e') && (data[i+2] == 'b')) ||
+		((data[i] == 'M') && (data[i+1] == 'a') && (data[i+2] == 'r')) ||
+		((data[i] == 'A') && (data[i+1] == 'p') && (data[i+2] == 'r')) ||
+		((data[i] == 'M') && (data[i+1] == 'a') && (data[i+2] == 'y')) ||
+		((data[i] == 'J') && (data[i+1] == 'u') && (data[i+2] == 'n')) ||
+		((data[i] == 'J') && (data[i+1] == 'u') && (data[i+2] == 'l')) ||
+		((data[i] == 'A') && (data[i+1] == 'u') && (data[i+2] == 'g')) ||
+		((data[i] == 'S') && (data[i+1] == 'e') && (data[i+2] == 'p')) ||
+		((data[i] == 'O') && (data[i+1] == 'c') && (data[i+2] == 't')) ||
+		((data[i] == 'N') && (data[i+1] == 'o') && (data[i+2] == 'v')) ||
+		((data[i] == 'D') && (data[i+1] == 'e') && (data[i+2] == 'c'))
+	) {
+		i += 3;
+	} else {
+		*len = i;
+		return NGX_ERROR;
+	}
+
+	if (type == RFC1123) {
+	/* rfc1123: year */
+		if (data[i] != ' ') {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+	} else if (type == RFC850) {
+	/* rfc850: year */
+		if (data[i] != '-') {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+	} else if (type == ASCTIME) {
+	/* asctime: day */
+		if (data[i] != ' ') {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+		if ((data[i] != ' ') || !ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i++;
+	}
+	if (!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT)) {
+		*len = i;
+		return NGX_ERROR;
+	}
+	i++;
+	if (data[i] != ' ') {
+		*len = i;
+		return NGX_ERROR;
+	}
+	i++;
+
+	/* time 08:49:37 */
+	if (
+		!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT) ||
+		!ngx_header_inspect_is(data[i+1], NGX_HEADER_INSPECT_DIGIT) ||
+		(data[i+2] != ':')
+	) {
+		*len = i;
+		return NGX_ERROR;
+	}
+	i += 3;
+	if (
+		!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT) ||
+		!ngx_header_inspect_is(data[i+1], NGX_HEADER_INSPECT_DIGIT) ||
+		(data[i+2] != ':')
+	) {
+		*len = i;
+		return NGX_ERROR;
+	}
+	i += 3;
+	if (
+		!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT) ||
+		!ngx_header_inspect_is(data[i+1], NGX_HEADER_INSPECT_DIGIT) ||
+		(data[i+2] != ' ')
+	) {
+		*len = i;
+		return NGX_ERROR;
+	}
+	i += 3;
+
+	if (type == ASCTIME) {
+	/* asctime: year: 1994 */
+		if (
+			!ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_DIGIT) ||
+			!ngx_header_inspect_is(data[i+1], NGX_HEADER_INSPECT_DIGIT) ||
+			!ngx_header_inspect_is(data[i+2], NGX_HEADER_INSPECT_DIGIT) ||
+			!ngx_header_inspect_is(data[i+3], NGX_HEADER_INSPECT_DIGIT)
+		) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i += 4;
+	} else {
+		/* GMT */
+		if ((data[i] != 'G') || (data[i+1] != 'M') || (data[i+2] != 'T')) {
+			*len = i;
+			return NGX_ERROR;
+		}
+		i += 3;
+	}
+
+	*len = i;
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_parse_entity_tag(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
+	ngx_uint_t i = 0;
+
+	if ( maxlen < 2 ) {
+		*len = 0;
+		return NGX_ERROR;
+	}
+
+	if ( data[0] == 'W' ) {
+		if ( data[1] != '/' ) {
+			*len = 2;
+			return NGX_ERROR;
+		}
+		i = 2;
+	}
+
+	if ( i+1 >= maxlen ) {
+		*len = i;
+		return NGX_ERROR;
+	}
+
+	if ( data[i] != '"' ) {
+		*len = i+1;
+		return NGX_ERROR;
+	}
+	i++;
+
+	for ( ; i < maxlen-1 ; i++ ) {
+		if ( data[i] == '"' ) {
+			*len = i+1;
+			return NGX_OK;
+		}
+	}
+
+	*len = maxlen;
+	return NGX_ERROR;
+}
+
+static ngx_int_t ngx_header_inspect_parse_qvalue(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
+
+	*len = 0;
+
+	if ((maxlen < 3) || (data[0] != 'q') || (data[1] != '=')) {
+		return NGX_ERROR;
+	}
+
+	if (data[2] == '0') {
+		if ((maxlen == 3) || (data[3] != '.')) {
+			*len = 3;
+			return NGX_OK;
+		}
+		if (!ngx_header_inspect_is(data[4], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = 4;
+			return NGX_OK;
+		}
+		if (!ngx_header_inspect_is(data[5], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = 5;
+			return NGX_OK;
+		}
+		if (!ngx_header_inspect_is(data[6], NGX_HEADER_INSPECT_DIGIT)) {
+			*len = 6;
+		} else {
+			*len = 7;
+		}
+		return NGX_OK;
+	} else if (data[2] == '1') {
+		if ((maxlen == 3) || (data[3] != '.')) {
+			*len = 3;
+			return NGX_OK;
+		}
+		if (data[4] != '0') {
+			*len = 4;
+			return NGX_OK;
+		}
+		if (data[5] != '0') {
+			*len = 5;
+			return NGX_OK;
+		}
+		if (data[6] != '0') {
+			*len = 6;
+		} else {
+			*len = 7;
+		}
+		return NGX_OK;
+	} else {
+		*len = 2;
+		return NGX_ERROR;
+	}
+}
+
+static ngx_int_t ngx_header_inspect_parse_contentcoding(ngx_header_inspect_vocab_t *vocab, u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
+
+	if ((maxlen >= 1) && (data[0] == '*')) {
+		*len = 1;
+		return NGX_OK;
+	}
+
+	*len = ngx_header_inspect_token_len(data, maxlen);
+	if (ngx_header_inspect_vocab_find(vocab, data, *len) == NGX_DECLINED) {
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+/* headers recognised by a generated grammar alone */
+static ngx_int_t ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_pt grammar, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	rc = grammar(&value, &i);
+	if ( rc == NGX_DECLINED ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( rc == NGX_AGAIN ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_rule_header(ngx_header_inspect_rule_t *rule, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	if ( rule->max_len && (value.len > rule->max_len) ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_LONG, -1);
+		return NGX_ERROR;
+	}
+
+	rc = ngx_header_inspect_dfa_run(rule->dfa, NULL, &value, &i);
+	if ( rc == NGX_DECLINED ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( rc == NGX_AGAIN ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_digit_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value, off_t max) {
+	ngx_uint_t i = 0;
+	off_t n;
+
+	if ( value.len <= 0 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_EMPTY, -1);
+		return NGX_ERROR;
+	}
+
+	i = ngx_header_inspect_parse_num(value.data, value.len, max, &n);
+	if ( i != value.len ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( n < 0 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_LARGE, -1);
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_contentencoding_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_int_t rc = NGX_AGAIN;
+	ngx_uint_t i = 0;
+	ngx_uint_t v;
+
+	if ((value.len == 0) || ((value.len == 1) && (value.data[0] == '*'))) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_SHORT, -1);
+		return NGX_ERROR;
+	}
+
+	while ( i < value.len) {
+		if (value.data[i] == '*') {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		if (ngx_header_inspect_parse_contentcoding(conf->vocabs[NGX_HEADER_INSPECT_VOCAB_CONTENT_CODINGS], &(value.data[i]), value.len-i, &v) != NGX_OK) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		i += v;
+		if ((value.data[i] == ' ') && (i < value.len)) {
+			i++;
+		}
+		if (i == value.len) {
+			rc = NGX_OK;
+			break;
+		}
+		if (value.data[i] != ',') {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		i++;
+		if ((value.data[i] == ' ') && (i < value.len)) {
+			i++;
+		}
+	}
+
+	if (rc == NGX_AGAIN) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		rc = NGX_ERROR;
+	}
+
+	return rc;
+
+}
+
+static ngx_int_t ngx_header_inspect_acceptencoding_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_int_t rc = NGX_AGAIN;
+	ngx_uint_t i = 0;
+	ngx_uint_t v;
+
+	if ((value.len == 0) || ((value.len == 1) && (value.data[0] == '*'))) {
+		return NGX_OK;
+	}
+
+	while ( i < value.len) {
+		if (ngx_header_inspect_parse_contentcoding(conf->vocabs[NGX_HEADER_INSPECT_VOCAB_CONTENT_CODINGS], &(value.data[i]), value.len-i, &v) != NGX_OK) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		i += v;
+		if ((value.data[i] == ' ') && (i < value.len)) {
+			i++;
+		}
+		if (i == value.len) {
+			rc = NGX_OK;
+			break;
+		}
+		if (value.data[i] == ';') {
+			i++;
+			if (i >= value.len) {
+				ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+				rc = NGX_ERROR;
+				break;
+			}
+			if ((value.data[i] == ' ') && (i < value.len)) {
+				i++;
+			}
+			if (ngx_header_inspect_parse_qvalue(&(value.data[i]), value.len-i, &v) != NGX_OK) {
+				ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_QVALUE, i);
+				rc = NGX_ERROR;
+				break;
+			}
+			i += v;
+			if ((value.data[i] == ' ') && (i < value.len)) {
+				i++;
+			}
+			if (i == value.len) {
+				rc = NGX_OK;
+				break;
+			}
+		}
+		if (value.data[i] != ',') {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		i++;
+		if ((value.data[i] == ' ') && (i < value.len)) {
+			i++;
+		}
+	}
+
+	if (rc == NGX_AGAIN) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		rc = NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_parse_cache_directive(ngx_header_inspect_loc_conf_t *conf, u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
+	ngx_uint_t i, n;
+	ngx_int_t kind;
+	off_t delta;
+
+	n = ngx_header_inspect_token_len(data, maxlen);
+	kind = ngx_header_inspect_vocab_find(conf->vocabs[NGX_HEADER_INSPECT_VOCAB_CACHE_DIRECTIVES], data, n);
+	if ( kind == NGX_DECLINED ) {
+		return NGX_ERROR;
+	}
+	*len = n;
+
+	if ( (n == maxlen) || (data[n] != '=') ) {
+		return ((kind == NGX_HEADER_INSPECT_CC_DELTA) || (kind == NGX_HEADER_INSPECT_CC_MAX_AGE)) ? NGX_ERROR : NGX_OK;
+	}
+	i = n + 1;
+
+	switch (kind) {
+		case NGX_HEADER_INSPECT_CC_NOARG:
+			return NGX_ERROR;
+		case NGX_HEADER_INSPECT_CC_DELTA:
+		case NGX_HEADER_INSPECT_CC_OPT_DELTA:
+		case NGX_HEADER_INSPECT_CC_MAX_AGE:
+			i += ngx_header_inspect_parse_num(&data[i], maxlen - i, NGX_MAX_OFF_T_VALUE, &delta);
+			if ( i == n + 1 ) {
+				return NGX_ERROR;
+			}
+			/* RFC 9111 1.2.2: anything too large to represent counts as 2^31 */
+			if ( (delta < 0) || (delta > 2147483648LL) ) {
+				delta = 2147483648LL;
+			}
+			if ( (kind == NGX_HEADER_INSPECT_CC_MAX_AGE) && (delta > (off_t) conf->max_age) ) {
+				return NGX_ERROR;
+			}
+			break;
+		default:
+			/* token / quoted-string */
+			if ( (i < maxlen) && (data[i] == '"') ) {
+				for ( i++; (i < maxlen) && (data[i] != '"'); i++ ) {
+					if ( (data[i] == '\\') && (i + 1 < maxlen) ) {
+						i++;
+						continue;
+					}
+					if ( !ngx_header_inspect_is(data[i], NGX_HEADER_INSPECT_QDTEXT) ) {
+						return NGX_ERROR;
+					}
+				}
+				if ( i == maxlen ) {
+					return NGX_ERROR;
+				}
+				i++;
+			} else {
+				n = ngx_header_inspect_token_len(&data[i], maxlen - i);
+				if ( n == 0 ) {
+					return NGX_ERROR;
+				}
+				i += n;
+			}
+	}
+
+	*len = i;
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_cachecontrol_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_int_t rc = NGX_AGAIN;
+	ngx_uint_t i = 0;
+	ngx_uint_t v;
+
+	if (value.len < 1) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_SHORT, -1);
+		return NGX_ERROR;
+	}
+
+	while ( i < value.len ) {
+		if ( ngx_header_inspect_parse_cache_directive(conf, &(value.data[i]), value.len-i, &v) != NGX_OK ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		i += v;
+		if ((value.data[i] == ' ') && (i < value.len)) {
+			i++;
+		}
+		if (i == value.len) {
+			rc = NGX_OK;
+			break;
+		}
+		if (value.data[i] != ',') {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		i++;
+		if ((value.data[i] == ' ') && (i < value.len)) {
+			i++;
+		}
+	}
+	if ( rc == NGX_AGAIN ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		rc = NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_referer_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos) {
+	/* RS_SCHEME, entered on the first byte */
+	if (
+		!(
+		((value->len > 4) && (ngx_strncmp("http:", value->data, 5) == 0)) ||
+		((value->len > 5) && (ngx_strncmp("https:", value->data, 6) == 0)) ||
+		((value->len > 3) && (ngx_strncmp("ftp:", value->data, 4) == 0)) ||
+		((value->len > 4) && (ngx_strncmp("ftps:", value->data, 5) == 0))
+		)
+	) {
+		ngx_header_inspect_error(ctx->err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, 0);
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_referer_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_header_inspect_dfa_ctx_t ctx = { conf, err, 0 };
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	if ( value.len < 1 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_SHORT, -1);
+		return NGX_ERROR;
+	}
+
+	switch ( value.data[0] ) {
+		case '/':
+			/* relativePath */
+			return NGX_OK;
+			break;
+		case 'h':
+		case 'f':
+			/* absoluteURI */
+			rc = ngx_header_inspect_dfa_run(ngx_header_inspect_dfas[NGX_HEADER_INSPECT_DFA_REFERER], &ctx, &value, &i);
+			if ( rc == NGX_DECLINED ) {
+				ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+				return NGX_ERROR;
+			}
+			if ( rc == NGX_AGAIN ) {
+				ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+				return NGX_ERROR;
+			}
+			return rc;
+			break;
+		default:
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, 0);
+			return NGX_ERROR;
+	}
+}
+
+static ngx_int_t ngx_header_inspect_transferencoding_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos) {
+	ngx_uint_t i = *pos;
+	size_t n;
+
+	/* TS_FIELD: ensure transfer-coding is in inspect_headers_transfer_codings, TE may also ask for trailers */
+	n = ngx_header_inspect_token_len(&(value->data[i]), value->len - i);
+	if (
+		(ngx_header_inspect_vocab_find(ctx->conf->vocabs[NGX_HEADER_INSPECT_VOCAB_TRANSFER_CODINGS], &(value->data[i]), n) == NGX_DECLINED) &&
+		!((ctx->te == 1) && (n == 8) && (ngx_strncasecmp((u_char *) "trailers", &(value->data[i]), 8) == 0))
+	) {
+		ngx_header_inspect_error(ctx->err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, i);
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_transferencoding_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_header_inspect_dfa_ctx_t ctx = { conf, err, 0 };
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	if ( ngx_strncmp("TE", header, 2) == 0 ) {
+		ctx.te = 1;
+	}
+
+	rc = ngx_header_inspect_dfa_run(ngx_header_inspect_dfas[NGX_HEADER_INSPECT_DFA_TRANSFER_ENCODING], &ctx, &value, &i);
+	if ( rc == NGX_DECLINED ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( rc == NGX_AGAIN ) {
+		/* an empty TE header is fine */
+		if ( (ctx.te == 1) && (value.len == 0) ) {
+			return NGX_OK;
+		}
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_trailer_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos) {
+	ngx_uint_t i = *pos;
+
+	/* TRS_FIELD: ensure field is not Transfer-Encondig, Content-Length or Trailer */
+	if (
+		(((value->len-i)>=17) && (ngx_strncmp("Transfer-Encoding", &(value->data[i]), 17) == 0) && ((value->data[i+17] == ',') || (value->data[i+17] == '\0'))) ||
+		(((value->len-i)>=14) && (ngx_strncmp("Content-Length", &(value->data[i]), 14) == 0) && ((value->data[i+14] == ',') || (value->data[i+14] == '\0'))) ||
+		(((value->len-i)>=7) && (ngx_strncmp("Trailer", &(value->data[i]), 7) == 0) && ((value->data[i+7] == ',') || (value->data[i+7] == '\0')))
+	) {
+		ngx_header_inspect_error(ctx->err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, i);
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_trailer_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_header_inspect_dfa_ctx_t ctx = { conf, err, 0 };
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	rc = ngx_header_inspect_dfa_run(ngx_header_inspect_dfas[NGX_HEADER_INSPECT_DFA_TRAILER], &ctx, &value, &i);
+	if ( rc == NGX_DECLINED ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( rc == NGX_AGAIN ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_warning_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos) {
+	ngx_uint_t i, v;
+
+	/* WS_DATE: the quoted warn-date is parsed in one go */
+	i = *pos + 1; /* skip qoute */
+	if ( ngx_header_inspect_http_date(&(value->data[i]), value->len-i, &v) != NGX_OK ) {
+		ngx_header_inspect_error(ctx->err, NGX_HEADER_INSPECT_ERR_BAD_DATE, i);
+		return NGX_ERROR;
+	}
+	i += v;
+	if ( i >= value->len ) {
+		ngx_header_inspect_error(ctx->err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value->len);
+		return NGX_ERROR;
+	}
+
+	*pos = i;
+
+	if ( value->data[i] != '"' ) {
+		return NGX_DECLINED;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_warning_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_header_inspect_dfa_ctx_t ctx = { conf, err, 0 };
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	rc = ngx_header_inspect_dfa_run(ngx_header_inspect_dfas[NGX_HEADER_INSPECT_DFA_WARNING], &ctx, &value, &i);
+	if ( rc == NGX_DECLINED ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( rc == NGX_AGAIN ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_expect_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+
+	/* currently only the 'known' "100-continue" value is allowed */
+	if ( (value.len == 12) && (ngx_strncasecmp((u_char *)"100-continue", value.data, 12) == 0) ) {
+		return NGX_OK;
+	} else {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, -1);
+		return NGX_ERROR;
+	}
+}
+
+static ngx_int_t ngx_header_inspect_digest_hook(ngx_header_inspect_dfa_ctx_t *ctx, ngx_uint_t state, ngx_str_t *value, ngx_uint_t *pos) {
+	ngx_uint_t i = *pos;
+	size_t n;
+
+	/* DS_KEY: only the auth-params in inspect_headers_digest_params */
+	n = ngx_header_inspect_token_len(&(value->data[i]), value->len - i);
+	if ( ngx_header_inspect_vocab_find(ctx->conf->vocabs[NGX_HEADER_INSPECT_VOCAB_DIGEST_PARAMS], &(value->data[i]), n) == NGX_DECLINED ) {
+		ngx_header_inspect_error(ctx->err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, i);
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_authorization_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_header_inspect_dfa_ctx_t ctx = { conf, err, 0 };
+	ngx_uint_t i;
+	ngx_int_t rc;
+
+	if ( value.len == 0 ) {
+		return NGX_OK;
+	}
+
+	if ( (value.len >= 6) && (ngx_strncmp("Basic ", value.data, 6) == 0) ) {
+		rc = ngx_header_inspect_basic_credentials(conf, err, &(value.data[6]), value.len-6);
+		if ( (err->code != NGX_HEADER_INSPECT_ERR_NONE) && (err->pos >= 0) ) {
+			/* the base64 parser counts from the credentials */
+			err->pos += 6;
+		}
+		return rc;
+	}
+
+	if ( (value.len >= 7) && (ngx_strncmp("Digest ", value.data, 7) == 0) ) {
+		i = 7; /* start after "Digest " */
+		rc = ngx_header_inspect_dfa_run(ngx_header_inspect_dfas[NGX_HEADER_INSPECT_DFA_DIGEST], &ctx, &value, &i);
+		if ( rc == NGX_DECLINED ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			return NGX_ERROR;
+		}
+		if ( rc == NGX_AGAIN ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+			return NGX_ERROR;
+		}
+		return rc;
+	}
+
+	ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, 0);
+	return NGX_ERROR;
+}
+
+static ngx_int_t ngx_header_inspect_contentmd5_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	size_t n;
+
+	if ( ngx_header_inspect_parse_base64(conf, err, value.data, value.len, &n) != NGX_OK ) {
+		return NGX_ERROR;
+	}
+
+	/* 128 bits are 22 characters and "==" */
+	if ( n != 22 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_DIGEST, -1);
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+/* RFC 7617 user-pass: a ':' and no control characters once decoded */
+static ngx_int_t ngx_header_inspect_basic_credentials(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, u_char *data, ngx_uint_t maxlen) {
+	u_char buf[NGX_HEADER_INSPECT_BASIC_CHUNK / 4 * 3 + 4];
+	uint64_t w, x, colon = 0, ctl = 0;
+	size_t i, j, k, n, len;
+
+	if ( ngx_header_inspect_parse_base64(conf, err, data, maxlen, &len) != NGX_OK ) {
+		return NGX_ERROR;
+	}
+
+	for ( i = 0; i < len; i += n ) {
+		n = ngx_min(len - i, NGX_HEADER_INSPECT_BASIC_CHUNK);
+		k = ngx_header_inspect_decode_base64(buf, &data[i], n);
+
+		/* 8 bytes at a time: the top bit of a byte ends up set if it is below 0x20, DEL or ':' */
+		for ( j = 0; j + 8 <= k; j += 8 ) {
+			ngx_memcpy(&w, &buf[j], 8);
+			x = w ^ 0x7f7f7f7f7f7f7f7fULL;
+			ctl |= ((w - 0x2020202020202020ULL) & ~w) | ((x - 0x0101010101010101ULL) & ~x);
+			x = w ^ 0x3a3a3a3a3a3a3a3aULL;
+			colon |= (x - 0x0101010101010101ULL) & ~x;
+		}
+		ctl &= 0x8080808080808080ULL;
+		colon &= 0x8080808080808080ULL;
+		for ( ; j < k; j++ ) {
+			ctl |= (buf[j] < 0x20) | (buf[j] == 0x7f);
+			colon |= (buf[j] == ':');
+		}
+
+		if ( ctl ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_CREDENTIALS, -1);
+			return NGX_ERROR;
+		}
+	}
+
+	if ( !colon ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_CREDENTIALS, -1);
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+/*
+ * base64 as RFC 4648 has it: the alphabet, then "=" or "==" to fill up
+ * the last group of 4.  *n is the number of characters before the padding.
+ */
+static ngx_int_t ngx_header_inspect_parse_base64(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, u_char *data, ngx_uint_t maxlen, size_t *n) {
+	ngx_uint_t i, pad;
+
+	if ( maxlen == 0 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_EMPTY, -1);
+		return NGX_ERROR;
+	}
+
+	i = ngx_header_inspect_span(data, maxlen, &ngx_header_inspect_base64_set);
+
+	for ( pad = 0; (pad < 2) && (i + pad < maxlen) && (data[i + pad] == '='); pad++ ) {
+		/* void */
+	}
+
+	if ( i + pad < maxlen ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_BASE64, i + pad);
+		return NGX_ERROR;
+	}
+
+	if ( (maxlen % 4) != 0 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_BASE64, -1);
+		return NGX_ERROR;
+	}
+
+	*n = i;
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_pragma_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	/* currently only the 'known' "no-cache" value is allowed */
+	if ( (value.len == 8) && (ngx_strncasecmp((u_char *)"no-cache", value.data, 8) == 0) ) {
+		return NGX_OK;
+	} else {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, -1);
+		return NGX_ERROR;
+	}
+}
+
+static ngx_int_t ngx_header_inspect_from_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	if ( value.len < 3 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_SHORT, -1);
+		return NGX_ERROR;
+	}
+
+	rc = ngx_header_inspect_dfa_run(ngx_header_inspect_dfas[NGX_HEADER_INSPECT_DFA_FROM], NULL, &value, &i);
+	if ( rc == NGX_DECLINED ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( rc == NGX_AGAIN ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_via_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	if ( value.len < 3 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_SHORT, -1);
+		return NGX_ERROR;
+	}
+
+	rc = ngx_header_inspect_dfa_run(ngx_header_inspect_dfas[NGX_HEADER_INSPECT_DFA_VIA], NULL, &value, &i);
+	if ( rc == NGX_DECLINED ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( rc == NGX_AGAIN ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_upgrade_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i = 0;
+	u_char d;
+	ngx_int_t rc = NGX_OK;
+	enum upgrade_header_states { UPS_START, UPS_PROD, UPS_SLASH, UPS_VER, UPS_DELIM, UPS_SPACE } state;
+
+	if ( value.len < 1 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_SHORT, -1);
+		return NGX_ERROR;
+	}
+
+	state = UPS_START;
+	for ( i = 0; i < value.len ; i++ ) {
+		d = value.data[i];
+
+		if ( ngx_header_inspect_is(d, NGX_HEADER_INSPECT_PRODUCT) ) {
+			switch ( state ) {
+				case UPS_START:
+				case UPS_SPACE:
+					state = UPS_PROD;
+					break;
+				case UPS_SLASH:
+					state = UPS_VER;
+					break;
+				case UPS_PROD:
+				case UPS_VER:
+					break;
+				default:
+					rc = NGX_ERROR;
+			}
+		} else if ( d == '/' ) {
+			switch ( state ) {
+				case UPS_PROD:
+					state = UPS_SLASH;
+					break;
+				default:
+					rc = NGX_ERROR;
+			}
+		} else if ( d == ' ' ) {
+			switch ( state ) {
+				case UPS_DELIM:
+					state = UPS_SPACE;
+					break;
+				case UPS_SPACE:
+					break;
+				default:
+					rc = NGX_ERROR;
+			}
+		} else if ( d == ',' ) {
+			switch ( state ) {
+				case UPS_PROD:
+				case UPS_VER:
+					state = UPS_DELIM;
+					break;
+				default:
+					rc = NGX_ERROR;
+			}
+		} else {
+			rc = NGX_ERROR;
+		}
+		if ( rc == NGX_ERROR ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			return NGX_ERROR;
+		}
+	}
+	switch ( state ) {
+		case UPS_PROD:
+		case UPS_VER:
+			break;
+		default:
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+			return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_useragent_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i = 0;
+	ngx_int_t rc;
+
+	if ( value.len < 1 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_SHORT, -1);
+		return NGX_ERROR;
+	}
+
+	rc = ngx_header_inspect_dfa_run(ngx_header_inspect_dfas[NGX_HEADER_INSPECT_DFA_USER_AGENT], NULL, &value, &i);
+	if ( rc == NGX_DECLINED ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+		return NGX_ERROR;
+	}
+	if ( rc == NGX_AGAIN ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_contentrange_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i = 0;
+	ngx_int_t rc = NGX_OK;
+	off_t a,b,c,d;
+	size_t n;
+	enum contentrange_header_states {RHS_START, RHS_STAR1, RHS_NUM1,DELIM,RHS_NUM2,RHS_SLASH,RHS_STAR2, RHS_NUM3} state;
+
+	if ( (value.len < 6) || (ngx_strncmp("bytes ", value.data, 6) != 0) ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_PREFIX, 0);
+		return NGX_ERROR;
+	}
+	if ( value.len < 9 ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_SHORT, -1);
+		return NGX_ERROR;
+	}
+
+	state = RHS_START;
+	a = -1;
+	b = -1;
+	c = -1;
+
+	i = 6; /* start after "bytes " */
+	for ( ; i < value.len ; i++ ) {
+		switch ( value.data[i] ) {
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+				/* the whole run of digits at once */
+				n = ngx_header_inspect_parse_num(&(value.data[i]), value.len-i, NGX_MAX_OFF_T_VALUE, &d);
+				if ( d < 0 ) {
+					ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TOO_LARGE, i);
+					return NGX_ERROR;
+				}
+				switch ( state ) {
+					case RHS_START:
+						state = RHS_NUM1;
+						a = d;
+						break;
+					case DELIM:
+						state = RHS_NUM2;
+						b = d;
+						break;
+					case RHS_SLASH:
+						state = RHS_NUM3;
+						c = d;
+						break;
+					default:
+						rc = NGX_ERROR;
+				}
+				if ( rc != NGX_ERROR ) {
+					i += n-1;
+				}
+				break;
+			case '*':
+				switch ( state ) {
+					case RHS_START:
+						state = RHS_STAR1;
+						break;
+					case RHS_SLASH:
+						state = RHS_STAR2;
+						break;
+					default:
+						rc = NGX_ERROR;
+				}
+				break;
+			case '/':
+				switch ( state ) {
+					case RHS_STAR1:
+					case RHS_NUM2:
+						state = RHS_SLASH;
+						break;
+					default:
+						rc = NGX_ERROR;
+				}
+				break;
+			case '-':
+				switch ( state ) {
+					case RHS_NUM1:
+						state = DELIM;
+						break;
+					default:
+						rc = NGX_ERROR;
+				}
+				break;
+			default:
+				rc = NGX_ERROR;
+		}
+		if ( rc == NGX_ERROR ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			return NGX_ERROR;
+		}
+	}
+	switch ( state ) {
+		case RHS_NUM3:
+		case RHS_STAR2:
+			break;
+		default:
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+			return NGX_ERROR;
+	}
+
+	/* in "a-b/c" ensure a < b and b < c if any of them are defined */
+	if ( (a != -1) && (b != -1) ) {
+		if ( (a >= b) || ((c != -1) && (b >= c)) ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_RANGE, -1);
+			return NGX_ERROR;
+		}
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_connection_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t i = 0;
+	size_t n;
+
+	while ( i < value.len ) {
+		n = ngx_header_inspect_token_len(&(value.data[i]), value.len - i);
+		if ( ngx_header_inspect_vocab_find(conf->vocabs[NGX_HEADER_INSPECT_VOCAB_CONNECTION_OPTIONS], &(value.data[i]), n) == NGX_DECLINED ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, i);
+			return NGX_ERROR;
+		}
+		i += n;
+
+		if ( (i < value.len) && (value.data[i] == ' ') ) {
+			i++;
+		}
+
+		if ( i == value.len ) {
+			return NGX_OK;
+		}
+
+		if ( (i < value.len) && (value.data[i] != ',') ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			return NGX_ERROR;
+		}
+		i++;
+
+		if ( (i < value.len) && (value.data[i] == ' ') ) {
+			i++;
+		}
+	}
+
+	ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+	return NGX_ERROR;
+}
+
+static ngx_int_t ngx_header_inspect_host_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	u_char d = '\0';
+	ngx_uint_t i = 0;
+
+	if ( value.len == 0 ) {
+		return NGX_OK;
+	}
+
+	if ( value.data[0] == '[' ) {
+		i++;
+		/* IPv6 address */
+		while ( i < value.len ) {
+			d = value.data[i];
+			if (
+				!ngx_header_inspect_is(d, NGX_HEADER_INSPECT_IP6)
+				&& (d != ']')
+			) {
+				ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+				return NGX_ERROR;
+			}
+			if ( d == ']' ) {
+				break;
+			}
+			i++;
+		}
+		if ( d != ']' ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+			return NGX_ERROR;
+		}
+		if ( i+1 < value.len ) {
+			d = value.data[i+1];
+		}
+		i++;
+	} else {
+		/* IPv4 address or domain name */
+		while ( i < value.len ) {
+			d = value.data[i];
+
+			if ( 
+				!ngx_header_inspect_is(d, NGX_HEADER_INSPECT_HOST)
+				&& ((d != ':') || (i == 0))
+			) {
+				ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+				return NGX_ERROR;
+			}
+			if ( d == ':' ) {
+				break;
+			}
+			i++;
+		}
+	}
+
+	if ( (d == ':') && (i+1 < value.len) ) {
+		i++;
+		for ( ; i < value.len ; i++ ) {
+			if ( !ngx_header_inspect_is(value.data[i], NGX_HEADER_INSPECT_DIGIT) ) {
+				ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+				return NGX_ERROR;
+			}
+		}
+	}
+
+	if ( i != value.len ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		return NGX_ERROR;
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_allow_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_int_t rc = NGX_AGAIN;
+	ngx_uint_t i = 0;
+	size_t n;
+
+	if ( value.len == 0 ) {
+		return NGX_OK;
+	}
+
+	while ( i < value.len ) {
+		n = ngx_header_inspect_token_len(&(value.data[i]), value.len - i);
+		if ( ngx_header_inspect_vocab_find(conf->vocabs[NGX_HEADER_INSPECT_VOCAB_METHODS], &(value.data[i]), n) == NGX_DECLINED ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_TOKEN, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		i += n;
+		if ((value.data[i] == ' ') && (i < value.len)) {
+			i++;
+		}
+		if (i == value.len) {
+			rc = NGX_OK;
+			break;
+		}
+		if (value.data[i] != ',') {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_ILLEGAL_CHAR, i);
+			rc = NGX_ERROR;
+			break;
+		}
+		i++;
+		if ((value.data[i] == ' ') && (i < value.len)) {
+			i++;
+		}
+	}
+	if (rc == NGX_AGAIN) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_UNEXPECTED_END, value.len);
+		rc = NGX_ERROR;
+	}
+
+	return rc;
+}
+
+static ngx_int_t ngx_header_inspect_ifrange_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_uint_t v = 0;
+
+	if (((value.data[0] == 'W') && (value.data[1] == '/'))|| (value.data[0] == '"')) {
+	/* 1. entity-tag */
+		if ( (ngx_header_inspect_parse_entity_tag(value.data, value.len, &v) != NGX_OK) || (v != value.len) ) {
+			ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_ETAG, -1);
+			return NGX_ERROR;
+		}
+	} else {
+	/* 2. HTTP-date */
+		return ngx_header_inspect_date_header(conf, err, value);
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t ngx_header_inspect_date_header(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_str_t value) {
+	ngx_header_inspect_date_t *date = NULL;
+	uint64_t head, tail;
+	ngx_uint_t v;
+
+#if (NGX_HAVE_LITTLE_ENDIAN)
+	/* checking an IMF-fixdate is cheaper than a cache probe */
+	if ( (value.len == 29) && ngx_header_inspect_imf_fixdate(value.data) ) {
+		return NGX_OK;
+	}
+#endif
+
+	/* clients tend to repeat the same value over and over */
+	if ( (value.len >= NGX_HEADER_INSPECT_DATE_MIN) && (value.len <= NGX_HEADER_INSPECT_DATE_MAX) ) {
+		ngx_memcpy(&head, value.data, 8);
+		ngx_memcpy(&tail, value.data + value.len - 8, 8);
+		date = &ngx_header_inspect_date_cache[((head ^ tail ^ value.len) * 0x9e3779b97f4a7c15ULL) >> (64 - NGX_HEADER_INSPECT_DATE_BITS)];
+		if ( (date->len == value.len) && (ngx_memcmp(date->data, value.data, value.len) == 0) ) {
+			return NGX_OK;
+		}
+	}
+
+	/* HTTP-date */
+	if ( ngx_header_inspect_http_date(value.data, value.len, &v) != NGX_OK ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_BAD_DATE, -1);
+		return NGX_ERROR;
+	}
+	if ( value.len != v ) {
+		ngx_header_inspect_error(err, NGX_HEADER_INSPECT_ERR_TRAILING, -1);
+		return NGX_ERROR;
+	}
+
+	if ( date ) {
+		ngx_memcpy(date->data, value.data, value.len);
+		date->len = value.len;
+	}
+
+	return NGX_OK;
+}
+
+
+
+static ngx_int_t ngx_header_inspect_dispatch(ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_header_inspect_header_t *hdr, ngx_str_t value) {
+	ngx_int_t rc;
+
+	switch (hdr->id) {
+		case NGX_HEADER_INSPECT_HDR_RANGE:
+			rc = ngx_header_inspect_range_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_IF_RANGE:
+			rc = ngx_header_inspect_ifrange_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_IF_UNMODIFIED_SINCE:
+		case NGX_HEADER_INSPECT_HDR_IF_MODIFIED_SINCE:
+		case NGX_HEADER_INSPECT_HDR_DATE:
+		case NGX_HEADER_INSPECT_HDR_EXPIRES:
+		case NGX_HEADER_INSPECT_HDR_LAST_MODIFIED:
+			rc = ngx_header_inspect_date_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_CONTENT_ENCODING:
+			rc = ngx_header_inspect_contentencoding_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_ACCEPT_ENCODING:
+			rc = ngx_header_inspect_acceptencoding_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_CONTENT_LANGUAGE:
+			rc = ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_content_language, conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_ACCEPT_LANGUAGE:
+			rc = ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_accept_language, conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_ACCEPT_CHARSET:
+			rc = ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_accept_charset, conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_CONTENT_LENGTH:
+			rc = ngx_header_inspect_digit_header(conf, err, value, conf->max_content_length);
+			break;
+		case NGX_HEADER_INSPECT_HDR_MAX_FORWARDS:
+			rc = ngx_header_inspect_digit_header(conf, err, value, conf->max_forwards);
+			break;
+		case NGX_HEADER_INSPECT_HDR_IF_MATCH:
+			rc = ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_if_match, conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_IF_NONE_MATCH:
+			rc = ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_if_none_match, conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_ALLOW:
+			rc = ngx_header_inspect_allow_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_HOST:
+			rc = ngx_header_inspect_host_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_ACCEPT:
+			rc = ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_accept, conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_CONNECTION:
+			rc = ngx_header_inspect_connection_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_CONTENT_RANGE:
+			rc = ngx_header_inspect_contentrange_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_USER_AGENT:
+			rc = ngx_header_inspect_useragent_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_UPGRADE:
+			rc = ngx_header_inspect_upgrade_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_VIA:
+			rc = ngx_header_inspect_via_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_FROM:
+			rc = ngx_header_inspect_from_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_PRAGMA:
+			rc = ngx_header_inspect_pragma_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_CONTENT_TYPE:
+			rc = ngx_header_inspect_grammar_header(ngx_header_inspect_grammar_content_type, conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_CONTENT_MD5:
+			rc = ngx_header_inspect_contentmd5_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_AUTHORIZATION:
+		case NGX_HEADER_INSPECT_HDR_PROXY_AUTHORIZATION:
+			rc = ngx_header_inspect_authorization_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_EXPECT:
+			rc = ngx_header_inspect_expect_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_WARNING:
+			rc = ngx_header_inspect_warning_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_TRAILER:
+			rc = ngx_header_inspect_trailer_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_TRANSFER_ENCODING:
+		case NGX_HEADER_INSPECT_HDR_TE:
+			rc = ngx_header_inspect_transferencoding_header((char *) hdr->name.data, conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_REFERER:
+		case NGX_HEADER_INSPECT_HDR_CONTENT_LOCATION:
+			rc = ngx_header_inspect_referer_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_CACHE_CONTROL:
+			rc = ngx_header_inspect_cachecontrol_header(conf, err, value);
+			break;
+		case NGX_HEADER_INSPECT_HDR_RULE:
+			rc = ngx_header_inspect_rule_header((ngx_header_inspect_rule_t *) hdr, conf, err, value);
+			break;
+		default:
+			rc = NGX_OK;
+	}
+
+	return rc;
+}
+
+static ngx_inline uint64_t ngx_header_inspect_clock(void) {
+#if (NGX_HAVE_CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	struct timeval tv;
+
+	ngx_gettimeofday(&tv);
+	return (uint64_t) tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#endif
+}
+
+static ngx_uint_t ngx_header_inspect_hist_bucket(uint64_t ns) {
+	ngx_uint_t e, b;
+
+	if ( ns < (1 << NGX_HEADER_INSPECT_HIST_SUB) ) {
+		return (ngx_uint_t) ns;
+	}
+
+	/* the power of two, then the next bits below the leading one */
+#if (defined __GNUC__ || defined __clang__)
+	e = 63 - __builtin_clzll(ns);
+#else
+	for (e = NGX_HEADER_INSPECT_HIST_SUB; ns >> (e + 1); e++) {
+		/* void */
+	}
+#endif
+	b = ((e - NGX_HEADER_INSPECT_HIST_SUB + 1) << NGX_HEADER_INSPECT_HIST_SUB)
+		+ ((ns >> (e - NGX_HEADER_INSPECT_HIST_SUB)) & ((1 << NGX_HEADER_INSPECT_HIST_SUB) - 1));
+
+	return ngx_min(b, NGX_HEADER_INSPECT_HIST_BUCKETS - 1);
+}
+
+/* the smallest time in ns that no longer falls into bucket b */
+static uint64_t ngx_header_inspect_hist_bound(ngx_uint_t b) {
+	ngx_uint_t e, sub;
+
+	if ( b < (1 << NGX_HEADER_INSPECT_HIST_SUB) ) {
+		return b + 1;
+	}
+
+	e = (b >> NGX_HEADER_INSPECT_HIST_SUB) + NGX_HEADER_INSPECT_HIST_SUB - 1;
+	sub = b & ((1 << NGX_HEADER_INSPECT_HIST_SUB) - 1);
+
+	return (uint64_t) ((1 << NGX_HEADER_INSPECT_HIST_SUB) + sub + 1) << (e - NGX_HEADER_INSPECT_HIST_SUB);
+}
+
+/* ngx_header_inspect_dispatch() with a clock around it, for inspect_headers_profile */
+static ngx_int_t ngx_header_inspect_profile_header(ngx_header_inspect_ctx_t *ctx, ngx_header_inspect_main_conf_t *mcf, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_error_t *err, ngx_header_inspect_header_t *hdr, ngx_str_t value) {
+	ngx_header_inspect_stats_t *stats;
+	uint64_t start, ns, *prof;
+	ngx_uint_t row;
+	ngx_int_t rc;
+
+	start = ngx_header_inspect_clock();
+	rc = ngx_header_inspect_dispatch(conf, err, hdr, value);
+	ns = ngx_header_inspect_clock() - start;
+
+	ctx->nsec += ns;
+
+	stats = mcf->stats;
+	if ( (mcf->counters == NULL) || !stats->profile ) {
+		return rc;
+	}
+
+	row = ngx_header_inspect_policy_index(hdr);
+	prof = &mcf->counters[ngx_header_inspect_prof(stats->nrows, row, 0)];
+
+	prof[NGX_HEADER_INSPECT_PROF_CALLS]++;
+	prof[NGX_HEADER_INSPECT_PROF_BYTES] += value.len;
+	prof[NGX_HEADER_INSPECT_PROF_NSEC] += ns;
+	prof[NGX_HEADER_INSPECT_PROF_HIST + ngx_header_inspect_hist_bucket(ns)]++;
+
+	return rc;
+}
+
+/* JSON string contents: '"' and '\\' escaped, CTL, DEL and obs-text as \\u00XX */
+static u_char *ngx_header_inspect_escape_json(u_char *dst, u_char *src, size_t len) {
+	static u_char hex[] = "0123456789abcdef";
+	u_char c;
+
+	while (len--) {
+		c = *src++;
+
+		if ((c == '"') || (c == '\\')) {
+			*dst++ = '\\';
+			*dst++ = c;
+		} else if ((c < 0x20) || (c >= 0x7f)) {
+			*dst++ = '\\';
+			*dst++ = 'u';
+			*dst++ = '0';
+			*dst++ = '0';
+			*dst++ = hex[c >> 4];
+			*dst++ = hex[c & 0xf];
+		} else {
+			*dst++ = c;
+		}
+	}
+
+	return dst;
+}
+
+static void ngx_header_inspect_log_flush(ngx_header_inspect_log_t *vlog, ngx_log_t *log) {
+	size_t len;
+	ssize_t n;
+
+	len = vlog->pos - vlog->start;
+	if (len == 0) {
+		return;
+	}
+
+	n = ngx_write_fd(vlog->file->fd, vlog->start, len);
+
+	if (n == -1) {
+		ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, ngx_write_fd_n " to \"%s\" failed", vlog->file->name.data);
+	} else if ((size_t) n != len) {
+		ngx_log_error(NGX_LOG_ALERT, log, 0, ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz", vlog->file->name.data, n, len);
+	}
+
+	vlog->pos = vlog->start;
+}
+
+/* room for len more bytes in the buffer, false if a line of that size can never fit */
+static ngx_int_t ngx_header_inspect_log_reserve(ngx_header_inspect_log_t *vlog, ngx_log_t *log, size_t len) {
+	if (len > (size_t) (vlog->last - vlog->pos)) {
+		ngx_header_inspect_log_flush(vlog, log);
+	}
+
+	return len <= (size_t) (vlog->last - vlog->pos);
+}
+
+/* token bucket holding up to rate lines, refilled by rate per period */
+static ngx_int_t ngx_header_inspect_log_allow(ngx_header_inspect_log_t *vlog) {
+	ngx_msec_int_t elapsed;
+
+	if (vlog->rate == 0) {
+		return 1;
+	}
+
+	elapsed = (ngx_msec_int_t) (ngx_current_msec - vlog->refilled);
+	if (elapsed > 0) {
+		vlog->tokens = ngx_min(vlog->tokens + (uint64_t) elapsed * vlog->rate, (uint64_t) vlog->rate * vlog->period);
+		vlog->refilled = ngx_current_msec;
+	}
+
+	if (vlog->tokens < vlog->period) {
+		return 0;
+	}
+
+	vlog->tokens -= vlog->period;
+	return 1;
+}
+
+/* writes out the event in a slot and frees it */
+static void ngx_header_inspect_log_emit(ngx_header_inspect_log_t *vlog, ngx_log_t *log, ngx_header_inspect_log_event_t *ev) {
+	ngx_str_t *code;
+	ngx_time_t *tp;
+	size_t len;
+	u_char *p;
+
+	if (!ngx_header_inspect_log_allow(vlog)) {
+		vlog->dropped += ev->count;
+		ev->hdr = NULL;
+		return;
+	}
+
+	if (vlog->dropped) {
+		tp = ngx_timeofday();
+		if (ngx_header_inspect_log_reserve(vlog, log, sizeof("{\"time\":.,\"dropped\":}\n") - 1 + NGX_TIME_T_LEN + 3 + NGX_INT_T_LEN)) {
+			vlog->pos = ngx_sprintf(vlog->pos, "{\"time\":%T.%03M,\"dropped\":%ui}\n", tp->sec, tp->msec, vlog->dropped);
+			vlog->dropped = 0;
+		}
+	}
+
+	code = &ngx_header_inspect_errors[ev->code];
+	len = NGX_HEADER_INSPECT_LOG_LINE + ev->addr_len + ev->hdr->name.len + code->len + 6 * ev->excerpt_len;
+
+	if (ngx_header_inspect_log_reserve(vlog, log, len)) {
+		p = ngx_sprintf(vlog->pos, "{\"time\":%T.%03M,\"client\":\"", ev->sec, ev->msec);
+		p = ngx_cpymem(p, ev->addr, ev->addr_len);
+		p = ngx_cpymem(p, "\",\"header\":\"", sizeof("\",\"header\":\"") - 1);
+		ngx_strlow(p, ev->hdr->name.data, ev->hdr->name.len);
+		p += ev->hdr->name.len;
+		p = ngx_sprintf(p, "\",\"code\":\"%V\",\"offset\":%i,\"length\":%uz,\"excerpt\":\"", code, ev->pos, ev->len);
+		p = ngx_header_inspect_escape_json(p, ev->excerpt, ev->excerpt_len);
+		vlog->pos = ngx_sprintf(p, "\",\"count\":%ui}\n", ev->count);
+	}
+
+	ev->hdr = NULL;
+}
+
+static void ngx_header_inspect_log_flush_events(ngx_header_inspect_log_t *vlog, ngx_log_t *log) {
+	ngx_uint_t i;
+
+	for (i = 0; i < NGX_HEADER_INSPECT_LOG_SLOTS; i++) {
+		if (vlog->events[i].hdr) {
+			ngx_header_inspect_log_emit(vlog, log, &vlog->events[i]);
+		}
+	}
+
+	ngx_header_inspect_log_flush(vlog, log);
+}
+
+static void ngx_header_inspect_log_timer(ngx_event_t *ev) {
+	ngx_header_inspect_log_flush_events(ev->data, ev->log);
+}
+
+/* called by nginx when the log files are reopened */
+static void ngx_header_inspect_log_flush_file(ngx_open_file_t *file, ngx_log_t *log) {
+	ngx_header_inspect_log_flush_events(file->data, log);
+}
+
+static void ngx_header_inspect_log_violation(ngx_header_inspect_log_t *vlog, ngx_http_request_t *r, ngx_header_inspect_header_t *hdr, ngx_uint_t row, ngx_uint_t code, ngx_int_t pos, ngx_str_t *value) {
+	ngx_header_inspect_log_event_t *ev;
+	ngx_str_t *addr;
+	ngx_time_t *tp;
+	uint32_t hash;
+
+	addr = &r->connection->addr_text;
+
+	hash = ngx_crc32_short(addr->data, addr->len);
+	hash = ngx_hash(ngx_hash(hash, row), code);
+	ev = &vlog->events[hash % NGX_HEADER_INSPECT_LOG_SLOTS];
+
+	if (ev->hdr) {
+		if ((ev->hash == hash) && (ev->hdr == hdr) && (ev->code == code) && (ev->addr_len == addr->len) && (ngx_memcmp(ev->addr, addr->data, addr->len) == 0)) {
+			ev->count++;
+			return;
 		}
-	} else if ((data[0] == 'S') && (data[1] == 'a') && (data[2] == 't')) {
-	/* Sat(urday) */
-		switch (data[3]) {
-			case ',':
-				type = RFC1123;
-				i = 4;
-				break;
-			case ' ':
-				type = ASCTIME;
-				i = 3;
-				break;
-			case 'u':
-				type = RFC850;
-				if (
-					(data[4] != 'r') ||
-					(data[5] != 'd') ||
-					(data[6] != 'a') ||
-					(data[7] != 'y') ||
-					(data[8] != ',')
-				) {
-					*len = i;
-					return NGX_ERROR;
-				}
-				i = 9;
-				break;
-			default:
-				*len = i;
-				return NGX_ERROR;
+		ngx_header_inspect_log_emit(vlog, r->connection->log, ev);
+	}
+
+	tp = ngx_timeofday();
+
+	ev->hdr = hdr;
+	ev->code = code;
+	ev->pos = pos;
+	ev->count = 1;
+	ev->len = value->len;
+	ev->excerpt_len = ngx_min(value->len, vlog->excerpt);
+	ngx_memcpy(ev->excerpt, value->data, ev->excerpt_len);
+	ev->sec = tp->sec;
+	ev->msec = tp->msec;
+	ev->hash = hash;
+	ev->addr_len = ngx_min(addr->len, NGX_SOCKADDR_STRLEN);
+	ngx_memcpy(ev->addr, addr->data, ev->addr_len);
+
+	if (!vlog->event->timer_set) {
+		ngx_add_timer(vlog->event, vlog->flush);
+	}
+}
+
+static ngx_atomic_uint_t ngx_header_inspect_census_estimate(ngx_header_inspect_census_t *census, uint32_t *hash) {
+	ngx_atomic_uint_t est, c;
+	ngx_uint_t j;
+
+	est = (ngx_atomic_uint_t) -1;
+	for (j = 0; j < NGX_HEADER_INSPECT_CENSUS_DEPTH; j++) {
+		c = census->counters[j * census->width + ((hash[0] + j * hash[1]) & (census->width - 1))];
+		if (c < est) {
+			est = c;
 		}
-	} else if ((data[0] == 'S') && (data[1] == 'u') && (data[2] == 'n')) {
-	/* Sun(day) */
-		switch (data[3]) {
-			case ',':
-				type = RFC1123;
-				i = 4;
-				break;
-			case ' ':
-				type = ASCTIME;
-				i = 3;
-				break;
-			case 'd':
-				type = RFC850;
-				if (
-					(data[4] != 'a') ||
-					(data[5] != 'y') ||
-					(data[6] != ',')
-				) {
-					*len = i;
-					return NGX_ERROR;
-				}
-				i = 7;
-				break;
-			default:
-				*len = i;
-				return NGX_ERROR;
+	}
+
+	return est;
+}
+
+static ngx_header_inspect_census_entry_t *ngx_header_inspect_census_find(ngx_header_inspect_census_t *census, uint32_t *hash, u_char *name, size_t len) {
+	ngx_header_inspect_census_entry_t *e;
+	ngx_uint_t k, n;
+
+	n = census->ntop;
+	for (k = 0; k < n; k++) {
+		e = &census->entries[k];
+		if ((e->hash[0] == hash[0]) && (e->len == len) && (ngx_memcmp(e->name, name, len) == 0)) {
+			return e;
 		}
-	} else {
-		*len = i;
-		return NGX_ERROR;
 	}
 
-	switch (type) {
-		case RFC1123:
-			if (maxlen < 29) {
-				*len = i;
-				return NGX_ERROR;
-			}
-			break;
-		case RFC850:
-			if (maxlen < 30) {
-				*len = i;
-				return NGX_ERROR;
-			}
-			break;
-		case ASCTIME:
-			if (maxlen < 24) {
-				*len = i;
-				return NGX_ERROR;
-			}
+	return NULL;
+}
+
+static void ngx_header_inspect_census_value(ngx_header_inspect_census_t *census, ngx_header_inspect_census_entry_t *e, size_t len) {
+	ngx_atomic_uint_t max;
+
+	if (!census->lengths) {
+		return;
+	}
+
+	(void) ngx_atomic_fetch_add(&e->bytes, len);
+	do {
+		max = e->max_len;
+		if (len <= max) {
 			break;
-		default:
-			*len = i;
-			return NGX_ERROR;
+		}
+	} while (!ngx_atomic_cmp_set(&e->max_len, max, len));
+}
+
+/* counts an uninspected header, the top list is only locked for names that may enter it */
+static void ngx_header_inspect_census_add(ngx_header_inspect_main_conf_t *mcf, ngx_table_elt_t *h) {
+	ngx_header_inspect_census_t *census;
+	ngx_header_inspect_census_entry_t *e;
+	ngx_slab_pool_t *shpool;
+	ngx_atomic_uint_t est, c, min;
+	ngx_uint_t j, k, n;
+	uint32_t hash[2];
+	size_t len;
+
+	census = mcf->census;
+
+	/* two hashes make the DEPTH row indexes, nginx already has one of them */
+	hash[0] = ngx_crc32_short(h->lowcase_key, h->key.len);
+	hash[1] = (uint32_t) h->hash | 1;
+
+	est = (ngx_atomic_uint_t) -1;
+	for (j = 0; j < NGX_HEADER_INSPECT_CENSUS_DEPTH; j++) {
+		c = ngx_atomic_fetch_add(&census->counters[j * census->width + ((hash[0] + j * hash[1]) & (census->width - 1))], 1) + 1;
+		if (c < est) {
+			est = c;
+		}
 	}
 
-	if (data[i] != ' ') {
-		*len = i;
-		return NGX_ERROR;
+	if (est <= census->floor) {
+		return;
 	}
-	i++;
 
-	if (type == RFC1123) {
-	/* rfc1123: day */
-		if ((data[i] < '0') || (data[i] > '9')) {
-			*len = i;
-			return NGX_ERROR;
+	len = ngx_min(h->key.len, NGX_HEADER_INSPECT_CENSUS_NAME);
+
+	e = ngx_header_inspect_census_find(census, hash, h->lowcase_key, len);
+	if (e) {
+		ngx_header_inspect_census_value(census, e, h->value.len);
+		return;
+	}
+
+	shpool = (ngx_slab_pool_t *) mcf->zone->shm.addr;
+	ngx_shmtx_lock(&shpool->mutex);
+
+	/* another worker may have put it in meanwhile */
+	e = ngx_header_inspect_census_find(census, hash, h->lowcase_key, len);
+
+	if ((e == NULL) && (census->ntop < census->top)) {
+		e = &census->entries[census->ntop];
+	} else if (e == NULL) {
+		/* replace the entry with the smallest estimate, if it is smaller */
+		min = est;
+		for (k = 0; k < census->top; k++) {
+			c = ngx_header_inspect_census_estimate(census, census->entries[k].hash);
+			if (c < min) {
+				min = c;
+				e = &census->entries[k];
+			}
 		}
-		i++;
-		if ((data[i] < '0') || (data[i] > '9')) {
-			*len = i;
-			return NGX_ERROR;
+	}
+
+	if (e && (e->len != len || e->hash[0] != hash[0] || ngx_memcmp(e->name, h->lowcase_key, len) != 0)) {
+		e->hash[0] = hash[0];
+		e->hash[1] = hash[1];
+		e->len = len;
+		ngx_memcpy(e->name, h->lowcase_key, len);
+		e->bytes = 0;
+		e->max_len = 0;
+
+		/* the entry is complete before a lock-free find can reach it */
+		ngx_memory_barrier();
+		if (census->ntop < census->top) {
+			census->ntop++;
 		}
-		i++;
-		if (data[i] != ' ') {
-			*len = i;
-			return NGX_ERROR;
+	}
+
+	if (e) {
+		ngx_header_inspect_census_value(census, e, h->value.len);
+	}
+
+	/* once the list is full, only names over its smallest estimate take the lock */
+	n = census->ntop;
+	if (n == census->top) {
+		min = (ngx_atomic_uint_t) -1;
+		for (k = 0; k < n; k++) {
+			c = ngx_header_inspect_census_estimate(census, census->entries[k].hash);
+			if (c < min) {
+				min = c;
+			}
 		}
-		i++;
-	} else if (type == RFC850) {
-	/* rfc850: day */
-		if ((data[i] < '0') || (data[i] > '9')) {
-			*len = i;
-			return NGX_ERROR;
+		census->floor = min;
+	}
+
+	ngx_shmtx_unlock(&shpool->mutex);
+}
+
+static void ngx_header_inspect_capture(ngx_header_inspect_capture_t *cap, ngx_http_request_t *r, ngx_header_inspect_ctx_t *ctx) {
+	ngx_header_inspect_ring_t *ring;
+	ngx_header_inspect_rec_t *rec;
+	ngx_header_inspect_rec_violation_t rv;
+	ngx_list_part_t *part;
+	ngx_table_elt_t *h;
+	ngx_time_t *tp;
+	ngx_uint_t i, n, nheaders;
+	uint64_t ticket;
+	uint16_t len[2];
+	u_char *p, *last;
+
+	ring = cap->ring;
+
+	if (++cap->seen < cap->sample) {
+		return;
+	}
+	cap->seen = 0;
+
+	ticket = ngx_atomic_fetch_add(&ring->next, 1);
+	rec = (ngx_header_inspect_rec_t *) ((u_char *) ring + ring->slots + (ticket % ring->nslots) * ring->slot_size);
+	last = (u_char *) rec + ring->slot_size;
+
+	rec->seq = 2 * ticket + 1;
+	ngx_memory_barrier();
+
+	tp = ngx_timeofday();
+	rec->msec = (uint64_t) tp->sec * 1000 + tp->msec;
+	rec->pid = (uint32_t) ngx_pid;
+	rec->flags = ctx->blocked ? NGX_HEADER_INSPECT_REC_BLOCKED : 0;
+	if (ctx->nstripped) {
+		rec->flags |= NGX_HEADER_INSPECT_REC_STRIPPED;
+	}
+
+	/* a slot always has room for these, see ngx_header_inspect_capture_slot() */
+	p = (u_char *) (rec + 1);
+
+	n = ngx_min(ctx->nviolations, NGX_HEADER_INSPECT_MAX_VIOLATIONS);
+	for (i = 0; i < n; i++) {
+		rv.index = (uint16_t) ngx_min(ctx->violations[i].index, 0xffff);
+		rv.code = (uint16_t) ctx->violations[i].code;
+		rv.pos = (int32_t) ctx->violations[i].pos;
+		p = ngx_cpymem(p, &rv, sizeof(ngx_header_inspect_rec_violation_t));
+	}
+	rec->nviolations = (uint16_t) n;
+
+	n = ngx_min(r->connection->addr_text.len, NGX_SOCKADDR_STRLEN);
+	p = ngx_cpymem(p, r->connection->addr_text.data, n);
+	rec->addr_len = (uint16_t) n;
+
+	/* the header block as received, cut where the slot ends */
+	nheaders = 0;
+	part = &r->headers_in.headers.part;
+	do {
+		h = part->elts;
+		for (i = 0; i < part->nelts; i++) {
+			len[0] = (uint16_t) ngx_min(h[i].key.len, 0xffff);
+			len[1] = (uint16_t) ngx_min(h[i].value.len, 0xffff);
+
+			if ((size_t) (last - p) < sizeof(len) + len[0] + len[1]) {
+				rec->flags |= NGX_HEADER_INSPECT_REC_TRUNCATED;
+				if ((size_t) (last - p) <= sizeof(len) + len[0]) {
+					goto done;
+				}
+				len[1] = (uint16_t) (last - p - sizeof(len) - len[0]);
+			}
+
+			p = ngx_cpymem(p, len, sizeof(len));
+			p = ngx_cpymem(p, h[i].key.data, len[0]);
+			p = ngx_cpymem(p, h[i].value.data, len[1]);
+			nheaders++;
+
+			if (rec->flags & NGX_HEADER_INSPECT_REC_TRUNCATED) {
+				goto done;
+			}
 		}
-		i++;
-		if ((data[i] < '0') || (data[i] > '9')) {
-			*len = i;
-			return NGX_ERROR;
+		part = part->next;
+	} while ( part != NULL );
+
+done:
+
+	rec->nheaders = (uint16_t) ngx_min(nheaders, 0xffff);
+	rec->len = (uint32_t) (p - (u_char *) (rec + 1));
+
+	ngx_memory_barrier();
+	rec->seq = 2 * ticket + 2;
+}
+
+static void ngx_header_inspect_record(ngx_header_inspect_ctx_t *ctx, ngx_header_inspect_header_t *hdr, ngx_uint_t index, ngx_uint_t code, ngx_int_t pos) {
+	ngx_header_inspect_violation_t *v;
+
+	if (ctx->nviolations < NGX_HEADER_INSPECT_MAX_VIOLATIONS) {
+		v = &ctx->violations[ctx->nviolations];
+		v->hdr = hdr;
+		v->index = index;
+		v->code = code;
+		v->pos = pos;
+	}
+
+	ctx->nviolations++;
+}
+
+/*
+ * inspect_headers_strip_violations: the header is only marked here, and
+ * removed once all are inspected, so that the capture still has it.
+ * Index is of the header in the list as it is now; headers stripped
+ * right away later on all come after it.
+ */
+static ngx_int_t ngx_header_inspect_mark(ngx_http_request_t *r, ngx_header_inspect_ctx_t *ctx, ngx_uint_t index) {
+	ngx_list_part_t *part;
+	ngx_uint_t n;
+
+	if (ctx->strip == NULL) {
+		n = 0;
+		for (part = &r->headers_in.headers.part; part; part = part->next) {
+			n += part->nelts;
 		}
-		i++;
-		if (data[i] != '-') {
-			*len = i;
+
+		ctx->strip = ngx_pcalloc(r->pool, (n + 7) / 8);
+		if (ctx->strip == NULL) {
 			return NGX_ERROR;
 		}
-		i++;
 	}
 
-	/* month: Nov */
-	if (
-		((data[i] == 'J') && (data[i+1] == 'a') && (data[i+2] == 'n')) ||
-		((data[i] == 'F') && (data[i+1] == 'e') && (data[i+2] == 'b')) ||
-		((data[i] == 'M') && (data[i+1] == 'a') && (data[i+2] == 'r')) ||
-		((data[i] == 'A') && (data[i+1] == 'p') && (data[i+2] == 'r')) ||
-		((data[i] == 'M') && (data[i+1] == 'a') && (data[i+2] == 'y')) ||
-		((data[i] == 'J') && (data[i+1] == 'u') && (data[i+2] == 'n')) ||
-		((data[i] == 'J') && (data[i+1] == 'u') && (data[i+2] == 'l')) ||
-		((data[i] == 'A') && (data[i+1] == 'u') && (data[i+2] == 'g')) ||
-		((data[i] == 'S') && (data[i+1] == 'e') && (data[i+2] == 'p')) ||
-		((data[i] == 'O') && (data[i+1] == 'c') && (data[i+2] == 't')) ||
-		((data[i] == 'N') && (data[i+1] == 'o') && (data[i+2] == 'v')) ||
-		((data[i] == 'D') && (data[i+1] == 'e') && (data[i+2] == 'c'))
-	) {
-		i += 3;
-	} else {
-		*len = i;
-		return NGX_ERROR;
+	ctx->strip[index / 8] |= (u_char) (1 << (index % 8));
+	ctx->nstripped++;
+
+	/* the violation was just recorded */
+	if (ctx->nviolations <= NGX_HEADER_INSPECT_MAX_VIOLATIONS) {
+		ctx->violations[ctx->nviolations - 1].stripped = 1;
 	}
 
-	if (type == RFC1123) {
-	/* rfc1123: year */
-		if (data[i] != ' ') {
-			*len = i;
-			return NGX_ERROR;
-		}
-		i++;
-		if ((data[i] < '0') || (data[i] > '9')) {
-			*len = i;
+	return NGX_OK;
+}
+
+/*
+ * Notes the policy slot of a violation that was not stripped.  The
+ * violations array only has the first few, so the locations a request
+ * is redirected to decide from this whether to block.
+ */
+static ngx_int_t ngx_header_inspect_keep(ngx_http_request_t *r, ngx_header_inspect_main_conf_t *mcf, ngx_header_inspect_ctx_t *ctx, ngx_uint_t slot) {
+	if (ctx->kept == NULL) {
+		ctx->nslots = NGX_HEADER_INSPECT_HDR_RULE + (mcf->rules ? mcf->rules->nelts : 0) + (mcf->others ? mcf->others->nelts : 0);
+		ctx->kept = ngx_pcalloc(r->pool, (ctx->nslots + 7) / 8);
+		if (ctx->kept == NULL) {
 			return NGX_ERROR;
 		}
-		i++;
-		if ((data[i] < '0') || (data[i] > '9')) {
-			*len = i;
-			return NGX_ERROR;
+	}
+
+	if (slot < ctx->nslots) {
+		ctx->kept[slot / 8] |= (u_char) (1 << (slot % 8));
+	}
+
+	return NGX_OK;
+}
+
+/* removes the marked headers */
+static ngx_int_t ngx_header_inspect_strip(ngx_http_request_t *r, ngx_header_inspect_ctx_t *ctx) {
+	ngx_list_part_t *part;
+	ngx_uint_t i, index, n;
+
+	n = ctx->nstripped;
+	index = 0;
+	part = &r->headers_in.headers.part;
+	do {
+		for (i = 0; i < part->nelts; i++, index++) {
+			if (!(ctx->strip[index / 8] & (1 << (index % 8)))) {
+				continue;
+			}
+			if (ngx_header_inspect_remove(r, part, i) != NGX_OK) {
+				return NGX_ERROR;
+			}
+			if (--n == 0) {
+				return NGX_OK;
+			}
+			/* the next header is at i now, or in the next part */
+			i--;
 		}
-		i++;
-		if ((data[i] < '0') || (data[i] > '9')) {
-			*len = i;
-			return NGX_ERROR;
+		part = part->next;
+	} while ( part != NULL );
+
+	return NGX_OK;
+}
+
+static void ngx_header_inspect_penalty_insert(ngx_rbtree_node_t *temp, ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel) {
+	ngx_header_inspect_penalty_node_t *pn, *pnt;
+	ngx_rbtree_node_t **p;
+
+	for ( ;; ) {
+		if (node->key < temp->key) {
+			p = &temp->left;
+		} else if (node->key > temp->key) {
+			p = &temp->right;
+		} else {
+			pn = (ngx_header_inspect_penalty_node_t *) &node->color;
+			pnt = (ngx_header_inspect_penalty_node_t *) &temp->color;
+			p = (ngx_memn2cmp(pn->data, pnt->data, pn->len, pnt->len) < 0) ? &temp->left : &temp->right;
 		}
-		i++;
-	} else if (type == RFC850) {
-	/* rfc850: year */
-		if (data[i] != '-') {
-			*len = i;
-			return NGX_ERROR;
+
+		if (*p == sentinel) {
+			break;
 		}
-		i++;
-		if ((data[i] < '0') || (data[i] > '9')) {
-			*len = i;
-			return NGX_ERROR;
+		temp = *p;
+	}
+
+	*p = node;
+	node->parent = temp;
+	node->left = sentinel;
+	node->right = sentinel;
+	ngx_rbt_red(node);
+}
+
+static ngx_header_inspect_penalty_node_t *ngx_header_inspect_penalty_lookup(ngx_header_inspect_penalty_t *pen, ngx_str_t *key, uint32_t hash) {
+	ngx_header_inspect_penalty_node_t *pn;
+	ngx_rbtree_node_t *node, *sentinel;
+	ngx_int_t rc;
+
+	node = pen->sh->rbtree.root;
+	sentinel = pen->sh->rbtree.sentinel;
+
+	while (node != sentinel) {
+		if (hash < node->key) {
+			node = node->left;
+			continue;
 		}
-		i++;
-	} else if (type == ASCTIME) {
-	/* asctime: day */
-		if (data[i] != ' ') {
-			*len = i;
-			return NGX_ERROR;
+		if (hash > node->key) {
+			node = node->right;
+			continue;
 		}
-		i++;
-		if ((data[i] != ' ') || (data[i] < '0') || (data[i] > '9')) {
-			*len = i;
-			return NGX_ERROR;
+
+		pn = (ngx_header_inspect_penalty_node_t *) &node->color;
+		rc = ngx_memn2cmp(key->data, pn->data, key->len, (size_t) pn->len);
+		if (rc == 0) {
+			return pn;
 		}
-		i++;
-	}
-	if ((data[i] < '0') || (data[i] > '9')) {
-		*len = i;
-		return NGX_ERROR;
+		node = (rc < 0) ? node->left : node->right;
 	}
-	i++;
-	if (data[i] != ' ') {
-		*len = i;
-		return NGX_ERROR;
+
+	return NULL;
+}
+
+/* lowers the score for the time since it was last lowered, in steps of whole thousandths */
+static void ngx_header_inspect_penalty_decay(ngx_header_inspect_penalty_t *pen, ngx_header_inspect_penalty_node_t *pn, ngx_msec_t now) {
+	ngx_msec_int_t ms;
+	uint64_t dec;
+
+	ms = (ngx_msec_int_t) (now - pn->last);
+	if (ms <= 0) {
+		return;
 	}
-	i++;
 
-	/* time 08:49:37 */
-	if (
-		(data[i] < '0') || (data[i] > '9') ||
-		(data[i+1] < '0') || (data[i+1] > '9') ||
-		(data[i+2] != ':')
-	) {
-		*len = i;
-		return NGX_ERROR;
+	dec = (uint64_t) ms * pen->threshold / pen->window;
+	if (dec == 0) {
+		return;
 	}
-	i += 3;
-	if (
-		(data[i] < '0') || (data[i] > '9') ||
-		(data[i+1] < '0') || (data[i+1] > '9') ||
-		(data[i+2] != ':')
-	) {
-		*len = i;
-		return NGX_ERROR;
+
+	pn->score = (dec >= pn->score) ? 0 : pn->score - (ngx_uint_t) dec;
+	pn->last = now;
+}
+
+/* takes the node out of the box, and out of the boxed queue */
+static void ngx_header_inspect_penalty_unbox(ngx_header_inspect_penalty_node_t *pn) {
+	if (pn->boxed == NGX_HEADER_INSPECT_PENALTY_LOCAL) {
+		ngx_queue_remove(&pn->box);
 	}
-	i += 3;
-	if (
-		(data[i] < '0') || (data[i] > '9') ||
-		(data[i+1] < '0') || (data[i+1] > '9') ||
-		(data[i+2] != ' ')
-	) {
-		*len = i;
-		return NGX_ERROR;
+	pn->boxed = 0;
+}
+
+/* frees the oldest node when n is 0, then up to two more that are back at zero */
+static void ngx_header_inspect_penalty_expire(ngx_header_inspect_penalty_t *pen, ngx_uint_t n) {
+	ngx_header_inspect_penalty_node_t *pn;
+	ngx_rbtree_node_t *node;
+	ngx_queue_t *q;
+	ngx_msec_t now;
+
+	now = ngx_current_msec;
+
+	while (n < 3) {
+		if (ngx_queue_empty(&pen->sh->queue)) {
+			return;
+		}
+
+		q = ngx_queue_last(&pen->sh->queue);
+		pn = ngx_queue_data(q, ngx_header_inspect_penalty_node_t, queue);
+
+		if (n++ != 0) {
+			if (pn->boxed && ((ngx_msec_int_t) (pn->until - now) > 0)) {
+				return;
+			}
+			ngx_header_inspect_penalty_decay(pen, pn, now);
+			if (pn->score) {
+				return;
+			}
+		}
+
+		ngx_header_inspect_penalty_unbox(pn);
+		ngx_queue_remove(q);
+		node = (ngx_rbtree_node_t *) ((u_char *) pn - offsetof(ngx_rbtree_node_t, color));
+		ngx_rbtree_delete(&pen->sh->rbtree, node);
+		ngx_slab_free_locked(pen->shpool, node);
 	}
-	i += 3;
+}
 
-	if (type == ASCTIME) {
-	/* asctime: year: 1994 */
-		if (
-			(data[i] < '0') || (data[i] > '9') ||
-			(data[i+1] < '0') || (data[i+1] > '9') ||
-			(data[i+2] < '0') || (data[i+2] > '9') ||
-			(data[i+3] < '0') || (data[i+3] > '9')
-		) {
-			*len = i;
-			return NGX_ERROR;
+/* whether the client is in the box */
+static ngx_uint_t ngx_header_inspect_penalty_check(ngx_header_inspect_penalty_t *pen, ngx_str_t *key, uint32_t hash) {
+	ngx_header_inspect_penalty_node_t *pn;
+	ngx_uint_t boxed = 0;
+
+	ngx_shmtx_lock(&pen->shpool->mutex);
+
+	pn = ngx_header_inspect_penalty_lookup(pen, key, hash);
+	if (pn && pn->boxed) {
+		if ((ngx_msec_int_t) (pn->until - ngx_current_msec) > 0) {
+			/* kept at the head while the client keeps trying */
+			ngx_queue_remove(&pn->queue);
+			ngx_queue_insert_head(&pen->sh->queue, &pn->queue);
+			boxed = 1;
+		} else {
+			ngx_header_inspect_penalty_unbox(pn);
 		}
-		i += 4;
+	}
+
+	ngx_shmtx_unlock(&pen->shpool->mutex);
+
+	return boxed;
+}
+
+/* the node of the key at the head of the LRU queue, a new one if needed; with the zone locked */
+static ngx_header_inspect_penalty_node_t *ngx_header_inspect_penalty_node(ngx_header_inspect_penalty_t *pen, ngx_str_t *key, uint32_t hash, ngx_msec_t now) {
+	ngx_header_inspect_penalty_node_t *pn;
+	ngx_rbtree_node_t *node;
+	size_t size;
+
+	pn = ngx_header_inspect_penalty_lookup(pen, key, hash);
+	if (pn) {
+		ngx_queue_remove(&pn->queue);
+
 	} else {
-		/* GMT */
-		if ((data[i] != 'G') || (data[i+1] != 'M') || (data[i+2] != 'T')) {
-			*len = i;
-			return NGX_ERROR;
+		ngx_header_inspect_penalty_expire(pen, 1);
+
+		size = offsetof(ngx_rbtree_node_t, color) + offsetof(ngx_header_inspect_penalty_node_t, data) + key->len;
+
+		node = ngx_slab_alloc_locked(pen->shpool, size);
+		if (node == NULL) {
+			ngx_header_inspect_penalty_expire(pen, 0);
+
+			node = ngx_slab_alloc_locked(pen->shpool, size);
+			if (node == NULL) {
+				return NULL;
+			}
 		}
-		i += 3;
+
+		node->key = hash;
+		pn = (ngx_header_inspect_penalty_node_t *) &node->color;
+		pn->len = (u_short) key->len;
+		pn->boxed = 0;
+		pn->score = 0;
+		pn->last = now;
+		ngx_memcpy(pn->data, key->data, key->len);
+
+		ngx_rbtree_insert(&pen->sh->rbtree, node);
 	}
 
-	*len = i;
-	return NGX_OK;
+	ngx_queue_insert_head(&pen->sh->queue, &pn->queue);
+
+	return pn;
 }
 
-static ngx_int_t ngx_header_inspect_parse_entity_tag(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
-	ngx_uint_t i = 0;
+/* adds a request with violations, NGX_OK if that put the client in the box */
+static ngx_int_t ngx_header_inspect_penalty_add(ngx_header_inspect_penalty_t *pen, ngx_str_t *key, uint32_t hash) {
+	ngx_header_inspect_penalty_node_t *pn;
+	ngx_msec_t now;
+	ngx_int_t rc;
 
-	if ( maxlen < 2 ) {
-		*len = 0;
+	now = ngx_current_msec;
+
+	ngx_shmtx_lock(&pen->shpool->mutex);
+
+	pn = ngx_header_inspect_penalty_node(pen, key, hash, now);
+	if (pn == NULL) {
+		ngx_shmtx_unlock(&pen->shpool->mutex);
 		return NGX_ERROR;
 	}
 
-	if ( data[0] == 'W' ) {
-		if ( data[1] != '/' ) {
-			*len = 2;
-			return NGX_ERROR;
+	ngx_header_inspect_penalty_decay(pen, pn, now);
+
+	rc = NGX_DECLINED;
+
+	pn->score += 1000;
+	if (pn->score >= pen->threshold) {
+		/* starts over once out */
+		if (pn->boxed != NGX_HEADER_INSPECT_PENALTY_LOCAL) {
+			pn->boxed = NGX_HEADER_INSPECT_PENALTY_LOCAL;
+			ngx_queue_insert_head(&pen->sh->boxed, &pn->box);
 		}
-		i = 2;
+		pn->until = now + pen->ttl;
+		pn->score = 0;
+		pn->last = now;
+		rc = NGX_OK;
 	}
 
-	if ( i+1 >= maxlen ) {
-		*len = i;
-		return NGX_ERROR;
+	ngx_shmtx_unlock(&pen->shpool->mutex);
+
+	return rc;
+}
+
+/*
+ * Answers a blocked request.  Without inspect_headers_reject that is a
+ * 400 through the special response handler and error_page.  With it, the
+ * response built with the configuration is sent from here, and the
+ * request finalized: NGX_DONE tells the phase handler it is over.
+ */
+static ngx_int_t ngx_header_inspect_reject(ngx_http_request_t *r, ngx_header_inspect_loc_conf_t *conf) {
+	ngx_header_inspect_reject_t *rj;
+	ngx_chain_t out;
+	ngx_buf_t *b;
+	ngx_int_t rc;
+
+	rj = conf->reject;
+	if (rj == NULL) {
+		return NGX_HTTP_BAD_REQUEST;
 	}
 
-	if ( data[i] != '"' ) {
-		*len = i+1;
-		return NGX_ERROR;
+	/* 444, and subrequests, whose output is not the response, go the usual way */
+	if ((rj->status == NGX_HTTP_CLOSE) || (r != r->main) || r->header_sent) {
+		return rj->status;
 	}
-	i++;
 
-	for ( ; i < maxlen-1 ; i++ ) {
-		if ( data[i] == '"' ) {
-			*len = i+1;
-			return NGX_OK;
+	if (rj->close) {
+		r->keepalive = 0;
+	} else {
+		/* the body must not be taken for the next request */
+		rc = ngx_http_discard_request_body(r);
+		if (rc != NGX_OK) {
+			return rc;
 		}
 	}
 
-	*len = maxlen;
-	return NGX_ERROR;
-}
+	r->headers_out.status = rj->status;
+	r->headers_out.status_line = rj->status_line;
+	r->headers_out.content_length_n = rj->body.len;
+	ngx_str_set(&r->headers_out.content_type, "text/html");
+	r->headers_out.content_type_len = r->headers_out.content_type.len;
+	r->headers_out.content_type_lowcase = NULL;
+
+	rc = ngx_http_send_header(r);
+	if ((rc == NGX_ERROR) || (rc > NGX_OK) || r->header_only) {
+		ngx_http_finalize_request(r, rc);
+		return NGX_DONE;
+	}
 
-static ngx_int_t ngx_header_inspect_parse_qvalue(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
+	b = ngx_calloc_buf(r->pool);
+	if (b == NULL) {
+		ngx_http_finalize_request(r, NGX_ERROR);
+		return NGX_DONE;
+	}
 
-	*len = 0;
+	/* the body is shared by all requests, only read from */
+	b->pos = rj->body.data;
+	b->last = rj->body.data + rj->body.len;
+	b->memory = 1;
+	b->last_buf = 1;
+	b->last_in_chain = 1;
 
-	if ((maxlen < 3) || (data[0] != 'q') || (data[1] != '=')) {
-		return NGX_ERROR;
+	out.buf = b;
+	out.next = NULL;
+
+	rc = ngx_http_output_filter(r, &out);
+
+	/* all sent, as it usually is: closed now instead of lingering */
+	if (!rj->lingering && (rc == NGX_OK) && !r->connection->buffered) {
+		rc = NGX_HTTP_CLOSE;
 	}
 
-	if (data[2] == '0') {
-		if ((maxlen == 3) || (data[3] != '.')) {
-			*len = 3;
-			return NGX_OK;
-		}
-		if ((data[4] < '0') || (data[4] > '9')) {
-			*len = 4;
-			return NGX_OK;
-		}
-		if ((data[5] < '0') || (data[5] > '9')) {
-			*len = 5;
-			return NGX_OK;
-		}
-		if ((data[6] < '0') || (data[6] > '9')) {
-			*len = 6;
-		} else {
-			*len = 7;
-		}
-		return NGX_OK;
-	} else if (data[2] == '1') {
-		if ((maxlen == 3) || (data[3] != '.')) {
-			*len = 3;
-			return NGX_OK;
-		}
-		if (data[4] != '0') {
-			*len = 4;
-			return NGX_OK;
-		}
-		if (data[5] != '0') {
-			*len = 5;
-			return NGX_OK;
+	ngx_http_finalize_request(r, rc);
+	return NGX_DONE;
+}
+
+/*
+ * inspect_headers_max_count and inspect_headers_max_total_size.  The
+ * count is the sum of the list parts, the size one pass over the name
+ * and value lengths.  Returns the error code, and the first header over
+ * the limit in *index and *elt.
+ */
+static ngx_uint_t ngx_header_inspect_limits(ngx_http_request_t *r, ngx_header_inspect_loc_conf_t *conf, ngx_uint_t *index, ngx_table_elt_t **elt) {
+	ngx_list_part_t *part;
+	ngx_table_elt_t *h;
+	ngx_uint_t i, n;
+	size_t total;
+
+	n = 0;
+	for (part = &r->headers_in.headers.part; part; part = part->next) {
+		n += part->nelts;
+	}
+
+	if (n > (ngx_uint_t) conf->max_count) {
+		n = conf->max_count;
+		*index = n;
+		for (part = &r->headers_in.headers.part; n >= part->nelts; part = part->next) {
+			n -= part->nelts;
 		}
-		if (data[6] != '0') {
-			*len = 6;
-		} else {
-			*len = 7;
+		h = part->elts;
+		*elt = &h[n];
+		return NGX_HEADER_INSPECT_ERR_TOO_MANY_HEADERS;
+	}
+
+	if (conf->max_total_size == NGX_MAX_SIZE_T_VALUE) {
+		return NGX_HEADER_INSPECT_ERR_NONE;
+	}
+
+	total = 0;
+	n = 0;
+	for (part = &r->headers_in.headers.part; part; part = part->next) {
+		h = part->elts;
+		for (i = 0; i < part->nelts; i++, n++) {
+			total += h[i].key.len + h[i].value.len;
+			if (total > conf->max_total_size) {
+				*index = n;
+				*elt = &h[i];
+				return NGX_HEADER_INSPECT_ERR_TOO_LARGE;
+			}
 		}
-		return NGX_OK;
-	} else {
-		*len = 2;
-		return NGX_ERROR;
 	}
+
+	return NGX_HEADER_INSPECT_ERR_NONE;
 }
 
-static ngx_int_t ngx_header_inspect_parse_contentcoding(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
+/*
+ * inspect_headers_phase post_read: rejects a request before the server
+ * rewrites and the location lookup, so only the server level settings
+ * apply.  The rewrite phase then finds the ctx and does not parse again.
+ */
+static ngx_int_t ngx_header_inspect_post_read(ngx_http_request_t *r) {
+	ngx_header_inspect_loc_conf_t *conf;
 
-	if (maxlen < 1) {
-		*len = 0;
-		return NGX_ERROR;
+	conf = ngx_http_get_module_loc_conf(r, ngx_http_header_inspect_module);
+
+	if (conf->phase != NGX_HEADER_INSPECT_PHASE_POST_READ) {
+		return NGX_DECLINED;
 	}
-	*len = 1;
 
-	switch (data[0]) {
-		case '*':
-			return NGX_OK;
-			break;
-		case 'c':
-			if ( (maxlen < 8) || (ngx_strncmp("compress", data, 8) != 0)) {
-				return NGX_ERROR;
+	return ngx_header_inspect_process_request(r);
+}
+
+static ngx_int_t ngx_header_inspect_process_request(ngx_http_request_t *r) {
+	ngx_header_inspect_main_conf_t *mcf;
+	ngx_header_inspect_loc_conf_t *conf;
+	ngx_header_inspect_header_t *hdr;
+	ngx_table_elt_t *h;
+	ngx_list_part_t *part;
+	ngx_log_t *log;
+	ngx_uint_t i, row, index, action, code;
+	ngx_int_t rc, pos;
+	ngx_header_inspect_ctx_t *ctx;
+	ngx_header_inspect_error_t err;
+	ngx_uint_t alert;
+	uint64_t *counters, *stat, seen;
+	ngx_str_t key;
+	uint32_t hash = 0;
+	size_t n;
+
+	conf = ngx_http_get_module_loc_conf(r, ngx_http_header_inspect_module);
+
+	if (!conf->inspect) {
+		return NGX_DECLINED;
+	}
+
+	/*
+	 * Internal redirects run this phase again, and subrequests share the
+	 * headers of the main request: the headers are inspected once, then
+	 * only the blocking of this location is applied to what was found.
+	 */
+	ctx = ngx_header_inspect_get_ctx(r);
+	if (ctx) {
+		if (ctx->penalized || ctx->limited) {
+			return ngx_header_inspect_reject(r, conf);
+		}
+		/* stripped headers are gone already */
+		for (i = 0; ctx->kept && (i < ctx->nslots); i++) {
+			if (!(ctx->kept[i / 8] & (1 << (i % 8)))) {
+				continue;
 			}
-			*len = 8;
-			break;
-		case 'd':
-			if ( (maxlen < 7) || (ngx_strncmp("deflate", data, 7) != 0)) {
-				return NGX_ERROR;
+			action = (i < conf->npolicy) ? conf->policy[i] : NGX_HEADER_INSPECT_POLICY_INSPECT;
+			if (ngx_header_inspect_blocks(conf, action)) {
+				ctx->blocked = 1;
+				return ngx_header_inspect_reject(r, conf);
 			}
-			*len = 7;
-			break;
-		case 'e':
-			if ( (maxlen < 3) || (ngx_strncmp("exi", data, 3) != 0)) {
-				return NGX_ERROR;
+		}
+		return NGX_DECLINED;
+	}
+
+	mcf = ngx_http_get_module_main_conf(r, ngx_http_header_inspect_module);
+	log = r->connection->log;
+
+	ngx_header_inspect_probe1(request_start, r);
+
+	counters = mcf->counters;
+
+	/* inspect_headers_log has the violations, error_log does not get them twice */
+	alert = conf->log && (mcf->vlog == NULL);
+
+	/* the verdict and violations, for the $inspect_headers_* variables */
+	ctx = ngx_header_inspect_create_ctx(r);
+	if (ctx == NULL) {
+		return NGX_HTTP_INTERNAL_SERVER_ERROR;
+	}
+	ctx->timed = conf->profile;
+
+	/* clients in the penalty box are turned away before anything is parsed */
+	key.len = 0;
+	if (mcf->penalty) {
+		if (ngx_http_complex_value(r, &mcf->penalty->key, &key) != NGX_OK) {
+			return NGX_HTTP_INTERNAL_SERVER_ERROR;
+		}
+		if (key.len > 65535) {
+			key.len = 0;
+		}
+		if (key.len) {
+			hash = ngx_crc32_short(key.data, key.len);
+			if (ngx_header_inspect_penalty_check(mcf->penalty, &key, hash)) {
+				if (counters) {
+					counters[NGX_HEADER_INSPECT_REQ_PENALIZED]++;
+				}
+				ctx->blocked = 1;
+				ctx->penalized = 1;
+				ngx_header_inspect_probe3(request_end, r, conf->reject ? (ngx_int_t) conf->reject->status : NGX_HTTP_BAD_REQUEST, 0);
+				return ngx_header_inspect_reject(r, conf);
 			}
-			*len = 3;
-			break;
-		case 'g':
-			if ( (maxlen < 4) || (ngx_strncmp("gzip", data, 4) != 0)) {
-				return NGX_ERROR;
+		}
+	}
+
+	/* limits of the whole request, before any value is looked at */
+	if ((conf->max_count != NGX_MAX_INT_T_VALUE) || (conf->max_total_size != NGX_MAX_SIZE_T_VALUE)) {
+		code = ngx_header_inspect_limits(r, conf, &index, &h);
+		if (code != NGX_HEADER_INSPECT_ERR_NONE) {
+			hdr = &ngx_header_inspect_request.header;
+			if (alert) {
+				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: request with %s headers, rejected at \"%*s\"",
+					(code == NGX_HEADER_INSPECT_ERR_TOO_LARGE) ? "too large" : "too many",
+					ngx_min(h->key.len, NGX_HEADER_INSPECT_ALERT_EXCERPT), h->key.data);
 			}
-			*len = 4;
-			break;
-		case 'i':
-			if ( (maxlen < 8) || (ngx_strncmp("identity", data, 8) != 0)) {
-				return NGX_ERROR;
+			if (counters) {
+				counters[NGX_HEADER_INSPECT_REQ_LIMITED]++;
 			}
-			*len = 8;
-			break;
-		case 'p':
-			if ( (maxlen < 12) || (ngx_strncmp("pack200-gzip", data, 12) != 0)) {
-				return NGX_ERROR;
+			ngx_header_inspect_record(ctx, hdr, index, code, -1);
+			if (mcf->vlog) {
+				ngx_header_inspect_log_violation(mcf->vlog, r, hdr, ngx_header_inspect_request.slot, code, -1, &h->value);
 			}
-			*len = 12;
-			break;
-		default:
-			return NGX_ERROR;
+			ngx_header_inspect_probe5(violation, r, ngx_header_inspect_request.slot, hdr->name.data, -1, ngx_header_inspect_errors[code].data);
+			ctx->blocked = 1;
+			ctx->limited = 1;
+			goto done;
+		}
 	}
 
-	return NGX_OK;
-}
+	if (counters) {
+		counters[NGX_HEADER_INSPECT_REQ_INSPECTED]++;
+	}
 
-static ngx_int_t ngx_header_inspect_parse_mediatype(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
-	ngx_uint_t i = 0;
-	u_char d;
-	ngx_uint_t secondpart = 0;
-	ngx_uint_t parameter = 0;
+	seen = 0;
+	index = 0;
+	part = &r->headers_in.headers.part;
+	do {
+		h = part->elts;
+		for (i = 0; i < part->nelts; i++, index++) {
+			/* one probe, reusing the hash nginx computed over the lowercased name */
+			hdr = ngx_hash_find(&mcf->headers, h[i].hash, h[i].lowcase_key, h[i].key.len);
 
-	if (maxlen < 1) {
-		*len = 0;
-		return NGX_ERROR;
-	}
+			action = hdr ? ngx_header_inspect_policy(conf, hdr) : NGX_HEADER_INSPECT_POLICY_INSPECT;
 
-	*len = 1;
-	while ( i < maxlen ) {
-		d = data[i];
-		if ( d == '/' ) {
-			if ( i < 1 ) {
-				*len = 1;
-				return NGX_ERROR;
-			} else {
-				if ( secondpart == 0 ) {
-					secondpart = 1;
-					i++;
+			if (action == NGX_HEADER_INSPECT_POLICY_IGNORE) {
+				continue;
+			}
+
+			/* inspect_headers_max_len, also for headers without a parser */
+			code = NGX_HEADER_INSPECT_ERR_NONE;
+			if (hdr && (action != NGX_HEADER_INSPECT_POLICY_STRIP)) {
+				row = ngx_header_inspect_policy_index(hdr);
+				if ((row < conf->nmax_len) && conf->max_len[row] && (h[i].value.len > conf->max_len[row])) {
+					code = NGX_HEADER_INSPECT_ERR_TOO_LONG;
+				}
+			}
+
+			if ((code == NGX_HEADER_INSPECT_ERR_NONE) && (action != NGX_HEADER_INSPECT_POLICY_STRIP) && ((hdr == NULL) || (hdr->id == NGX_HEADER_INSPECT_HDR_OTHER))) {
+				/* TODO: support for other headers */
+				if (counters) {
+					counters[NGX_HEADER_INSPECT_REQ_UNINSPECTED]++;
+				}
+				if (mcf->census) {
+					ngx_header_inspect_census_add(mcf, &h[i]);
+				}
+				if (conf->log_uninspected) {
+					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: uninspected header \"%*s: %*s\"",
+						ngx_min(h[i].key.len, NGX_HEADER_INSPECT_ALERT_EXCERPT), h[i].key.data,
+						ngx_min(h[i].value.len, NGX_HEADER_INSPECT_ALERT_EXCERPT), h[i].value.data);
+				}
+				if (!conf->allowlist) {
 					continue;
-				} else {
-					*len = i;
-					return NGX_ERROR;
 				}
+				action = NGX_HEADER_INSPECT_POLICY_STRIP;
 			}
-		}
 
-		if (
-			((d < '0') || (d > '9')) &&
-			((d < 'a') || (d > 'z')) &&
-			((d < 'A') || (d > 'Z')) &&
-			(d != '-') && (d != '_') &&
-			(d != '+') && (d != '.') &&
-			(d != ':') && (d != '*')
-			/* TODO: check with RFC which chars are valid */
-		) {
-			*len = i;
-			if (secondpart == 0) {
-				return NGX_ERROR;
-			} else {
-				if ( d == ';' ) {
-					parameter = 1;
-					break;
-				} else {
-					return NGX_OK;
+			if (action == NGX_HEADER_INSPECT_POLICY_STRIP) {
+				if (ngx_header_inspect_remove(r, part, i) != NGX_OK) {
+					return NGX_HTTP_INTERNAL_SERVER_ERROR;
 				}
+				if (counters) {
+					counters[NGX_HEADER_INSPECT_REQ_STRIPPED]++;
+				}
+				/* the next header is h[i] now, or in the next part */
+				h = part->elts;
+				i--;
+				index--;
+				continue;
 			}
-		}
-		i++;
-	}
 
-	if ( parameter ) {
-		if ( i+4 > maxlen ) {
-			return NGX_ERROR;
-		}
-		while ( i < maxlen ) {
-			if ( data[i] != ';' ) {
-				*len = i;
-				return NGX_OK;
+			row = ngx_header_inspect_policy_index(hdr);
+
+			/* other headers have no counters */
+			stat = NULL;
+			if (counters && (hdr->id != NGX_HEADER_INSPECT_HDR_OTHER)) {
+				stat = &counters[ngx_header_inspect_stat(row, 0)];
+				stat[NGX_HEADER_INSPECT_STAT_INSPECTED]++;
 			}
-			i++;
 
-			while ( (i < maxlen) && (data[i] == ' ') ) { i++; }
-			if ( i == maxlen ) {
-				*len = i;
-				return NGX_ERROR;
+			/* inspect_headers_check_duplicates, the second of a singleton is a violation */
+			if (conf->duplicates && (hdr->id < NGX_HEADER_INSPECT_HDR_RULE) && (NGX_HEADER_INSPECT_SINGLETONS & ((uint64_t) 1 << hdr->id))) {
+				if ((seen & ((uint64_t) 1 << hdr->id)) && (code == NGX_HEADER_INSPECT_ERR_NONE)) {
+					code = NGX_HEADER_INSPECT_ERR_DUPLICATE;
+				}
+				seen |= (uint64_t) 1 << hdr->id;
 			}
 
-			/* attribute */
-			while ( i < maxlen ) {
-				d = data[i];
+			pos = -1;
 
-				if ( d == '=' ) {
-					break;
+			if (code != NGX_HEADER_INSPECT_ERR_NONE) {
+				if (alert) {
+					if (code == NGX_HEADER_INSPECT_ERR_DUPLICATE) {
+						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: duplicate %V header", &hdr->name);
+					} else {
+						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: %V header longer than %uz bytes", &hdr->name, conf->max_len[row]);
+					}
+				}
+				if (stat) {
+					stat[NGX_HEADER_INSPECT_STAT_VIOLATION]++;
 				}
 
-				if (
-					((d < '0') || (d > '9')) &&
-					((d < 'a') || (d > 'z')) &&
-					((d < 'A') || (d > 'Z')) &&
-					(d != '-') && (d != '_') &&
-					(d != '+') && (d != '.') &&
-					(d != ':') && (d != '*')
-				) {
-					*len = i;
-					return NGX_ERROR;
+			} else {
+				/* most values are plain printable ASCII, so CTL and obs-text are rejected in bulk first */
+				n = ngx_header_inspect_find_ctl(h[i].value.data, h[i].value.len);
+				if (n != h[i].value.len) {
+					if (alert) {
+						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %uz in %V header", n, &hdr->name);
+					}
+					if (stat) {
+						stat[NGX_HEADER_INSPECT_STAT_BAD_CHAR]++;
+					}
+					code = NGX_HEADER_INSPECT_ERR_BAD_CHAR;
+					pos = n;
 				}
-				i++;
 			}
-			if ( i == maxlen ) {
-				*len = i;
-				return NGX_ERROR;
-			}
-			i++;
 
-			/* value */
-			/* TODO: what if value is double-quoted? */
-			while ( i < maxlen ) {
-				d = data[i];
+			if (code == NGX_HEADER_INSPECT_ERR_NONE) {
+				err.code = NGX_HEADER_INSPECT_ERR_NONE;
+				err.pos = -1;
+				ngx_header_inspect_probe4(validator_entry, r, row, hdr->name.data, h[i].value.len);
 
-				if ( d == ';' ) {
-					break;
+				if (conf->profile) {
+					rc = ngx_header_inspect_profile_header(ctx, mcf, conf, &err, hdr, h[i].value);
+				} else {
+					rc = ngx_header_inspect_dispatch(conf, &err, hdr, h[i].value);
 				}
 
-				if (
-					((d < '0') || (d > '9')) &&
-					((d < 'a') || (d > 'z')) &&
-					((d < 'A') || (d > 'Z')) &&
-					(d != '-') && (d != '_') &&
-					(d != '+') && (d != '.') &&
-					(d != ':') && (d != '*')
-				) {
-					*len = i;
-					return NGX_OK;
+				ngx_header_inspect_probe5(validator_return, r, row, h[i].value.len, rc, err.pos);
+
+				if (rc == NGX_OK) {
+					continue;
 				}
-				i++;
+
+				if (stat) {
+					stat[NGX_HEADER_INSPECT_STAT_VIOLATION]++;
+				}
+				if (err.code == NGX_HEADER_INSPECT_ERR_NONE) {
+					err.code = NGX_HEADER_INSPECT_ERR_INVALID;
+				}
+				code = err.code;
+				pos = err.pos;
+
+				/* one line from the code, the parsers do not format anything */
+				if (alert) {
+					n = ngx_min(h[i].value.len, NGX_HEADER_INSPECT_ALERT_EXCERPT);
+					if (pos >= 0) {
+						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: %V at position %i in %V header \"%*s\"", &ngx_header_inspect_errors[code], pos, &hdr->name, n, h[i].value.data);
+					} else {
+						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: %V in %V header \"%*s\"", &ngx_header_inspect_errors[code], &hdr->name, n, h[i].value.data);
+					}
+				}
+			}
+
+			ngx_header_inspect_record(ctx, hdr, index, code, pos);
+			if (mcf->vlog) {
+				ngx_header_inspect_log_violation(mcf->vlog, r, hdr, row, code, pos, &h[i].value);
+			}
+			ngx_header_inspect_probe5(violation, r, row, hdr->name.data, pos, ngx_header_inspect_errors[code].data);
+			if (ngx_header_inspect_strips(conf, hdr, action)) {
+				if (ngx_header_inspect_mark(r, ctx, index) != NGX_OK) {
+					return NGX_HTTP_INTERNAL_SERVER_ERROR;
+				}
+				if (stat) {
+					stat[NGX_HEADER_INSPECT_STAT_STRIPPED]++;
+				}
+				continue;
+			}
+			if (ngx_header_inspect_keep(r, mcf, ctx, row) != NGX_OK) {
+				return NGX_HTTP_INTERNAL_SERVER_ERROR;
+			}
+			if (ngx_header_inspect_blocks(conf, action)) {
+				if (stat) {
+					stat[NGX_HEADER_INSPECT_STAT_BLOCKED]++;
+				}
+				if (counters) {
+					counters[NGX_HEADER_INSPECT_REQ_BLOCKED]++;
+				}
+				ctx->blocked = 1;
+				goto done;
 			}
-			while ( (i < maxlen) && (data[i] == ' ') ) { i++; }
 		}
+		part = part->next;
+	} while ( part != NULL );
+
+done:
+
+	if (ctx->nviolations && mcf->capture) {
+		ngx_header_inspect_capture(mcf->capture, r, ctx);
 	}
 
-	*len = i;
-	if (secondpart == 0) {
-		return NGX_ERROR;
-	} else {
-		return NGX_OK;
+	if (ctx->nstripped && !ctx->blocked && (ngx_header_inspect_strip(r, ctx) != NGX_OK)) {
+		return NGX_HTTP_INTERNAL_SERVER_ERROR;
 	}
-}
 
-static ngx_int_t ngx_header_inspect_parse_charset(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
-	ngx_uint_t i;
-	u_char d;
-	ngx_uint_t alphacount = 0;
+	if (ctx->nviolations && key.len && (ngx_header_inspect_penalty_add(mcf->penalty, &key, hash) == NGX_OK) && conf->log) {
+		ngx_log_error(NGX_LOG_WARN, log, 0, "header_inspect: %V is in the penalty box for %M ms", &r->connection->addr_text, mcf->penalty->ttl);
+	}
 
-	if (maxlen < 1) {
-		*len = 0;
-		return NGX_ERROR;
+	rc = NGX_DECLINED;
+	if (ctx->blocked) {
+		rc = conf->reject ? (ngx_int_t) conf->reject->status : NGX_HTTP_BAD_REQUEST;
 	}
 
-	if (data[0] == '*') {
-		*len = 1;
-		return NGX_OK;
+	ngx_header_inspect_probe3(request_end, r, rc, ctx->nviolations);
+
+	if (ctx->blocked) {
+		return ngx_header_inspect_reject(r, conf);
 	}
 
-	*len = 1;
-	for ( i = 0; i < maxlen; i++ ) {
-		d = data[i];
-		if (
-			(d == '-') ||
-			(d == '_') ||
-			(d == '+') ||
-			(d == '.') ||
-			(d == ':')
-		) {
-			if (alphacount == 0) {
-				*len = i;
-				return NGX_ERROR;
-			}
-			alphacount = 0;
-			continue;
-		}
-		if (
-			((d < '0') || (d > '9')) &&
-			((d < 'a') || (d > 'z')) &&
-			((d < 'A') || (d > 'Z'))
-		) {
-			*len = i;
-			if (alphacount == 0) {
-				return NGX_ERROR;
-			} else {
-				return NGX_OK;
-			}
+	return rc;
+}
+
+
+
+static char *ngx_header_inspect_rule(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_main_conf_t *mcf = conf;
+	ngx_header_inspect_header_t *header;
+	ngx_header_inspect_rule_t *rule;
+	ngx_str_t *value;
+	ngx_uint_t i, pos;
+	ngx_int_t n;
+	char *err;
+
+	value = cf->args->elts;
+
+	for (i = 0; i < value[1].len; i++) {
+		if (!ngx_header_inspect_is(value[1].data[i], NGX_HEADER_INSPECT_TCHAR)) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid header name \"%V\"", &value[1]);
+			return NGX_CONF_ERROR;
 		}
-		alphacount++;
 	}
 
-	*len = i;
-	if (alphacount == 0) {
-		return NGX_ERROR;
-	} else {
-		return NGX_OK;
+	for (header = ngx_header_inspect_headers; header->name.len; header++) {
+		if ((header->name.len == value[1].len) && (ngx_strncasecmp(header->name.data, value[1].data, value[1].len) == 0)) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "header \"%V\" is inspected by the module already", &value[1]);
+			return NGX_CONF_ERROR;
+		}
 	}
-}
 
-static ngx_int_t ngx_header_inspect_parse_languagerange(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
-	ngx_uint_t i;
-	u_char d;
-	ngx_uint_t alphacount = 0;
+	if (mcf->rules == NULL) {
+		mcf->rules = ngx_array_create(cf->pool, 4, sizeof(ngx_header_inspect_rule_t));
+		if (mcf->rules == NULL) {
+			return NGX_CONF_ERROR;
+		}
+	}
 
-	if (maxlen < 1) {
-		*len = 0;
-		return NGX_ERROR;
+	rule = mcf->rules->elts;
+	for (i = 0; i < mcf->rules->nelts; i++) {
+		if ((rule[i].header.name.len == value[1].len) && (ngx_strncasecmp(rule[i].header.name.data, value[1].data, value[1].len) == 0)) {
+			return "is duplicate";
+		}
 	}
 
-	if (data[0] == '*') {
-		*len = 1;
-		return NGX_OK;
+	rule = ngx_array_push(mcf->rules);
+	if (rule == NULL) {
+		return NGX_CONF_ERROR;
 	}
+	ngx_memzero(rule, sizeof(ngx_header_inspect_rule_t));
 
-	*len = 1;
-	for ( i = 0; i < maxlen; i++ ) {
-		d = data[i];
-		if (d == '-') {
-			if (alphacount == 0) {
-				*len = i;
-				return NGX_ERROR;
-			}
-			alphacount = 0;
-			continue;
-		}
-		if (
-			((d < 'a') || (d > 'z')) &&
-			((d < 'A') || (d > 'Z'))
-		) {
-			*len = i;
-			if (alphacount == 0) {
-				return NGX_ERROR;
-			} else {
-				return NGX_OK;
-			}
+	rule->header.name = value[1];
+	rule->header.id = NGX_HEADER_INSPECT_HDR_RULE;
+	rule->row = NGX_HEADER_INSPECT_HDR_RULE + mcf->rules->nelts - 1;
+
+	if (cf->args->nelts == 4) {
+		if ((value[3].len <= 8) || (ngx_strncmp(value[3].data, "max_len=", 8) != 0)) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[3]);
+			return NGX_CONF_ERROR;
 		}
-		if (alphacount == 8) {
-			*len = i;
-			return NGX_ERROR;
+		n = ngx_atoi(value[3].data + 8, value[3].len - 8);
+		if ((n == NGX_ERROR) || (n == 0)) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid max_len \"%V\"", &value[3]);
+			return NGX_CONF_ERROR;
 		}
-		alphacount++;
+		rule->max_len = n;
 	}
 
-	*len = i;
-	if (alphacount == 0) {
-		return NGX_ERROR;
-	} else {
-		return NGX_OK;
+	rule->dfa = ngx_header_inspect_re_compile(cf, &value[2], &err, &pos);
+	if (rule->dfa == NULL) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid regex \"%V\" for header \"%V\": %s at position %ui", &value[2], &value[1], err, pos);
+		return NGX_CONF_ERROR;
 	}
+
+	return NGX_CONF_OK;
 }
 
-static ngx_int_t ngx_header_inspect_ifmatch_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
-	ngx_uint_t v;
+static char *ngx_header_inspect_vocab_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	char *p = conf;
+	ngx_header_inspect_vocab_t **vocab;
+	ngx_str_t *value;
 
-	if ( (value.len == 1) && (value.data[0] == '*') ) {
-		return NGX_OK;
+	vocab = (ngx_header_inspect_vocab_t **) (p + cmd->offset);
+	if (*vocab != NGX_CONF_UNSET_PTR) {
+		return "is duplicate";
+	}
+
+	value = cf->args->elts;
+
+	*vocab = ngx_header_inspect_vocab_compile(cf, cmd->post, &value[1], cf->args->nelts - 1);
+	if (*vocab == NULL) {
+		return NGX_CONF_ERROR;
 	}
 
-	if ( value.len < 2 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: %s header \"%s\" too short", header, value.data);
+	return NGX_CONF_OK;
+}
+
+static char *ngx_header_inspect_policy_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_loc_conf_t *lcf = conf;
+	ngx_header_inspect_policy_t *policy;
+	ngx_str_t *value, *action, name;
+	ngx_uint_t i, k;
+	u_char *eq;
+
+	value = cf->args->elts;
+
+	if (lcf->policies == NULL) {
+		lcf->policies = ngx_array_create(cf->pool, cf->args->nelts - 1, sizeof(ngx_header_inspect_policy_t));
+		if (lcf->policies == NULL) {
+			return NGX_CONF_ERROR;
 		}
-		return NGX_ERROR;
 	}
 
-	while ( i < value.len ) {
-		if ( ngx_header_inspect_parse_entity_tag(&(value.data[i]), value.len-i, &v) != NGX_OK ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid entity-tag at position %d in %s header \"%s\"", i, header, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
+	for (i = 1; i < cf->args->nelts; i++) {
+		eq = ngx_strlchr(value[i].data, value[i].data + value[i].len, '=');
+		if ((eq == NULL) || (eq == value[i].data)) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid policy \"%V\", expected header=action", &value[i]);
+			return NGX_CONF_ERROR;
 		}
-		i += v;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+
+		name.data = value[i].data;
+		name.len = eq - value[i].data;
+
+		for (action = ngx_header_inspect_policy_actions; action->len; action++) {
+			if (((size_t) (value[i].data + value[i].len - eq - 1) == action->len) && (ngx_strncmp(eq + 1, action->data, action->len) == 0)) {
+				break;
+			}
 		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
+		if (action->len == 0) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid action in \"%V\", expected inspect, log, block, strip or ignore", &value[i]);
+			return NGX_CONF_ERROR;
 		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in %s header \"%s\"", i, header, value.data);
+		k = action - ngx_header_inspect_policy_actions;
+
+		if (k == NGX_HEADER_INSPECT_POLICY_STRIP) {
+			for (action = ngx_header_inspect_unstrippable; action->len; action++) {
+				if ((action->len == name.len) && (ngx_strncasecmp(action->data, name.data, name.len) == 0)) {
+					ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "header \"%V\" cannot be stripped", &name);
+					return NGX_CONF_ERROR;
+				}
 			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
 		}
-	}
 
-	if (rc == NGX_AGAIN) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of %s header \"%s\"", header, value.data);
+		policy = ngx_array_push(lcf->policies);
+		if (policy == NULL) {
+			return NGX_CONF_ERROR;
 		}
-		rc = NGX_ERROR;
+		policy->name = name;
+		policy->action = k;
 	}
 
-	return rc;
+	return NGX_CONF_OK;
 }
 
-static ngx_int_t ngx_header_inspect_digit_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i = 0;
+static char *ngx_header_inspect_max_len_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_loc_conf_t *lcf = conf;
+	ngx_header_inspect_max_len_t *ml;
+	ngx_str_t *value, size;
+	ssize_t n;
+	ngx_uint_t i;
+	u_char *eq;
 
-	if ( value.len <= 0 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: %s header \"%s\" is empty", header, value.data);
+	value = cf->args->elts;
+
+	if (lcf->lengths == NULL) {
+		lcf->lengths = ngx_array_create(cf->pool, cf->args->nelts - 1, sizeof(ngx_header_inspect_max_len_t));
+		if (lcf->lengths == NULL) {
+			return NGX_CONF_ERROR;
 		}
-		return NGX_ERROR;
 	}
 
-	for ( i = 0; i < value.len; i++ ) {
-		if ( (value.data[i] < '0') || (value.data[i] > '9') ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid digit at position %d in %s header \"%s\"", i, header, value.data);
-			}
-			return NGX_ERROR;
+	for (i = 1; i < cf->args->nelts; i++) {
+		eq = ngx_strlchr(value[i].data, value[i].data + value[i].len, '=');
+		if ((eq == NULL) || (eq == value[i].data)) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid limit \"%V\", expected header=size", &value[i]);
+			return NGX_CONF_ERROR;
+		}
+
+		size.data = eq + 1;
+		size.len = value[i].data + value[i].len - size.data;
+		n = ngx_parse_size(&size);
+		if (n == NGX_ERROR) {
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid size in \"%V\"", &value[i]);
+			return NGX_CONF_ERROR;
+		}
+
+		ml = ngx_array_push(lcf->lengths);
+		if (ml == NULL) {
+			return NGX_CONF_ERROR;
 		}
+		ml->name.data = value[i].data;
+		ml->name.len = eq - value[i].data;
+		ml->max_len = n;
 	}
 
-	return NGX_OK;
+	return NGX_CONF_OK;
 }
 
-static ngx_int_t ngx_header_inspect_acceptcharset_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
-	ngx_uint_t v;
+static char *ngx_header_inspect_reject_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_loc_conf_t *lcf = conf;
+	ngx_header_inspect_reject_t *rj;
+	ngx_str_t *value;
+	ngx_uint_t i;
+	ngx_int_t n;
+	u_char *p;
 
-	if ((value.len == 0) || ((value.len == 1) && (value.data[0] == '*'))) {
-		return NGX_OK;
+	if (lcf->reject != NGX_CONF_UNSET_PTR) {
+		return "is duplicate";
 	}
 
-	while ( i < value.len ) {
-		if (ngx_header_inspect_parse_charset(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid charset at position %d in Accept-Charset header \"%s\"", i, value.data);
+	value = cf->args->elts;
+
+	rj = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_reject_t));
+	if (rj == NULL) {
+		return NGX_CONF_ERROR;
+	}
+	rj->status = NGX_HTTP_BAD_REQUEST;
+	rj->lingering = 1;
+
+	for (i = 1; i < cf->args->nelts; i++) {
+
+		if (ngx_strncmp(value[i].data, "status=", 7) == 0) {
+			n = ngx_atoi(value[i].data + 7, value[i].len - 7);
+			if ((n != NGX_HTTP_BAD_REQUEST) && (n != 431) && (n != NGX_HTTP_CLOSE)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid status \"%V\", expected 400, 431 or 444", &value[i]);
+				return NGX_CONF_ERROR;
 			}
-			rc = NGX_ERROR;
-			break;
+			rj->status = n;
+			continue;
 		}
-		i += v;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+
+		if (ngx_strcmp(value[i].data, "close") == 0) {
+			rj->close = 1;
+			continue;
 		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
+
+		if (ngx_strcmp(value[i].data, "lingering=on") == 0) {
+			rj->lingering = 1;
+			continue;
 		}
-		if (value.data[i] == ';') {
-			i++;
-			if (i >= value.len) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Accept-Charset header \"%s\"", value.data);
-				}
-				rc = NGX_ERROR;
-				break;
-			}
-			if ((value.data[i] == ' ') && (i < value.len)) {
-				i++;
-			}
-			if (ngx_header_inspect_parse_qvalue(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid qvalue at position %d in Accept-Charset header \"%s\"", i, value.data);
-				}
-				rc = NGX_ERROR;
-				break;
-			}
-			i += v;
-			if ((value.data[i] == ' ') && (i < value.len)) {
-				i++;
-			}
-			if (i == value.len) {
-				rc = NGX_OK;
-				break;
-			}
+
+		if (ngx_strcmp(value[i].data, "lingering=off") == 0) {
+			rj->lingering = 0;
+			continue;
+		}
+
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+		return NGX_CONF_ERROR;
+	}
+
+	if (rj->status == NGX_HTTP_CLOSE) {
+		/* nothing is sent, the connection is closed */
+		lcf->reject = rj;
+		return NGX_CONF_OK;
+	}
+
+	if (!rj->lingering && !rj->close) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "lingering=off needs close");
+		return NGX_CONF_ERROR;
+	}
+
+	/* nginx has no status line of its own for 431 */
+	if (rj->status == 431) {
+		ngx_str_set(&rj->status_line, "431 Request Header Fields Too Large");
+	} else {
+		ngx_str_set(&rj->status_line, "400 Bad Request");
+	}
+
+	rj->body.len = sizeof("<html>" CRLF "<head><title></title></head>" CRLF "<body>" CRLF "<center><h1></h1></center>" CRLF "</body>" CRLF "</html>" CRLF) - 1
+		+ 2 * rj->status_line.len;
+	rj->body.data = ngx_pnalloc(cf->pool, rj->body.len);
+	if (rj->body.data == NULL) {
+		return NGX_CONF_ERROR;
+	}
+
+	p = ngx_sprintf(rj->body.data, "<html>" CRLF "<head><title>%V</title></head>" CRLF "<body>" CRLF "<center><h1>%V</h1></center>" CRLF "</body>" CRLF "</html>" CRLF,
+		&rj->status_line, &rj->status_line);
+	rj->body.len = p - rj->body.data;
+
+	lcf->reject = rj;
+
+	return NGX_CONF_OK;
+}
+
+/*
+ * Policies name headers before all rules are known, so the names are
+ * only looked up when merging.  Other names get a slot of their own,
+ * after the rules, and go into the header hash like them.
+ */
+static ngx_int_t ngx_header_inspect_policy_find(ngx_conf_t *cf, ngx_header_inspect_main_conf_t *mcf, ngx_str_t *name, ngx_uint_t *slot) {
+	ngx_header_inspect_header_t *header;
+	ngx_header_inspect_rule_t *rule;
+	ngx_header_inspect_other_t *other;
+	ngx_uint_t i, nrules;
+
+	for (header = ngx_header_inspect_headers; header->name.len; header++) {
+		if ((header->name.len == name->len) && (ngx_strncasecmp(header->name.data, name->data, name->len) == 0)) {
+			*slot = header->id;
+			return NGX_OK;
 		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Accept-Charset header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
+	}
+
+	nrules = mcf->rules ? mcf->rules->nelts : 0;
+	rule = nrules ? mcf->rules->elts : NULL;
+	for (i = 0; i < nrules; i++) {
+		if ((rule[i].header.name.len == name->len) && (ngx_strncasecmp(rule[i].header.name.data, name->data, name->len) == 0)) {
+			*slot = rule[i].row;
+			return NGX_OK;
 		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+	}
+
+	if (mcf->others == NULL) {
+		mcf->others = ngx_array_create(cf->pool, 4, sizeof(ngx_header_inspect_other_t));
+		if (mcf->others == NULL) {
+			return NGX_ERROR;
 		}
 	}
 
-	if (rc == NGX_AGAIN) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Accept-Charset header \"%s\"", value.data);
+	other = mcf->others->elts;
+	for (i = 0; i < mcf->others->nelts; i++) {
+		if ((other[i].header.name.len == name->len) && (ngx_strncasecmp(other[i].header.name.data, name->data, name->len) == 0)) {
+			*slot = other[i].slot;
+			return NGX_OK;
 		}
-		rc = NGX_ERROR;
 	}
 
-	return rc;
+	other = ngx_array_push(mcf->others);
+	if (other == NULL) {
+		return NGX_ERROR;
+	}
+	other->header.name = *name;
+	other->header.id = NGX_HEADER_INSPECT_HDR_OTHER;
+	other->slot = NGX_HEADER_INSPECT_HDR_RULE + nrules + mcf->others->nelts - 1;
+
+	*slot = other->slot;
+	return NGX_OK;
 }
 
-static ngx_int_t ngx_header_inspect_contentlanguage_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
-	ngx_uint_t v;
+/* the policy array of conf: the one of prev, with the policies of conf applied */
+static ngx_int_t ngx_header_inspect_policy_merge(ngx_conf_t *cf, ngx_header_inspect_main_conf_t *mcf, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_loc_conf_t *prev) {
+	ngx_header_inspect_policy_t *policy;
+	ngx_uint_t i, n, *slots;
 
-	if ((value.len == 0) || ((value.len == 1) && (value.data[0] == '*'))) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Content-Language header \"%s\" too short", value.data);
+	if (conf->policy) {
+		return NGX_OK;
+	}
+
+	if (conf->policies == NULL) {
+		if (prev) {
+			conf->policy = prev->policy;
+			conf->npolicy = prev->npolicy;
 		}
+		return NGX_OK;
+	}
+
+	policy = conf->policies->elts;
+
+	slots = ngx_palloc(cf->temp_pool, conf->policies->nelts * sizeof(ngx_uint_t));
+	if (slots == NULL) {
 		return NGX_ERROR;
 	}
 
-	while ( i < value.len ) {
-		if (value.data[i] == '*') {
-		/* hack, to prevent parse_languagerange from matching '*' */
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Content-Language header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		if (ngx_header_inspect_parse_languagerange(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid language-range at position %d in Content-Language header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i += v;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
-		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
-		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Content-Language header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+	n = prev ? prev->npolicy : 0;
+	for (i = 0; i < conf->policies->nelts; i++) {
+		if (ngx_header_inspect_policy_find(cf, mcf, &policy[i].name, &slots[i]) != NGX_OK) {
+			return NGX_ERROR;
 		}
+		n = ngx_max(n, slots[i] + 1);
 	}
 
-	if (rc == NGX_AGAIN) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Content-Language header \"%s\"", value.data);
-		}
-		rc = NGX_ERROR;
+	conf->policy = ngx_pcalloc(cf->pool, n);
+	if (conf->policy == NULL) {
+		return NGX_ERROR;
 	}
+	conf->npolicy = n;
 
-	return rc;
+	if (prev && prev->npolicy) {
+		ngx_memcpy(conf->policy, prev->policy, prev->npolicy);
+	}
+	for (i = 0; i < conf->policies->nelts; i++) {
+		conf->policy[slots[i]] = (u_char) policy[i].action;
+	}
 
+	return NGX_OK;
 }
 
-static ngx_int_t ngx_header_inspect_acceptlanguage_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
-	ngx_uint_t v;
+/* the same for inspect_headers_max_len, where 0 is no limit */
+static ngx_int_t ngx_header_inspect_max_len_merge(ngx_conf_t *cf, ngx_header_inspect_main_conf_t *mcf, ngx_header_inspect_loc_conf_t *conf, ngx_header_inspect_loc_conf_t *prev) {
+	ngx_header_inspect_max_len_t *ml;
+	ngx_uint_t i, n, *slots;
 
-	if ((value.len == 0) || ((value.len == 1) && (value.data[0] == '*'))) {
+	if (conf->max_len) {
 		return NGX_OK;
 	}
 
-	while ( i < value.len ) {
-		if (ngx_header_inspect_parse_languagerange(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid language-range at position %d in Accept-Language header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i += v;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
-		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
-		}
-		if (value.data[i] == ';') {
-			i++;
-			if (i >= value.len) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Accept-Language header \"%s\"", value.data);
-				}
-				rc = NGX_ERROR;
-				break;
-			}
-			if ((value.data[i] == ' ') && (i < value.len)) {
-				i++;
-			}
-			if (ngx_header_inspect_parse_qvalue(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid qvalue at position %d in Accept-Language header \"%s\"", i, value.data);
-				}
-				rc = NGX_ERROR;
-				break;
-			}
-			i += v;
-			if ((value.data[i] == ' ') && (i < value.len)) {
-				i++;
-			}
-			if (i == value.len) {
-				rc = NGX_OK;
-				break;
-			}
-		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Accept-Language header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+	if (conf->lengths == NULL) {
+		if (prev) {
+			conf->max_len = prev->max_len;
+			conf->nmax_len = prev->nmax_len;
 		}
+		return NGX_OK;
 	}
 
-	if (rc == NGX_AGAIN) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Accept-Language header \"%s\"", value.data);
+	ml = conf->lengths->elts;
+
+	slots = ngx_palloc(cf->temp_pool, conf->lengths->nelts * sizeof(ngx_uint_t));
+	if (slots == NULL) {
+		return NGX_ERROR;
+	}
+
+	n = prev ? prev->nmax_len : 0;
+	for (i = 0; i < conf->lengths->nelts; i++) {
+		if (ngx_header_inspect_policy_find(cf, mcf, &ml[i].name, &slots[i]) != NGX_OK) {
+			return NGX_ERROR;
 		}
-		rc = NGX_ERROR;
+		n = ngx_max(n, slots[i] + 1);
 	}
 
-	return rc;
+	conf->max_len = ngx_pcalloc(cf->pool, n * sizeof(size_t));
+	if (conf->max_len == NULL) {
+		return NGX_ERROR;
+	}
+	conf->nmax_len = n;
+
+	if (prev && prev->nmax_len) {
+		ngx_memcpy(conf->max_len, prev->max_len, prev->nmax_len * sizeof(size_t));
+	}
+	for (i = 0; i < conf->lengths->nelts; i++) {
+		conf->max_len[slots[i]] = ml[i].max_len;
+	}
+
+	return NGX_OK;
 }
 
-static ngx_int_t ngx_header_inspect_contentencoding_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
-	ngx_uint_t v;
+static ngx_int_t ngx_header_inspect_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+	ngx_header_inspect_main_conf_t *mcf = shm_zone->data;
+	ngx_slab_pool_t *shpool;
 
-	if ((value.len == 0) || ((value.len == 1) && (value.data[0] == '*'))) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Content-Encoding header \"%s\" too short", value.data);
-		}
+	shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+	/* kept over reloads, ngx_header_inspect_init_module() checks the counters still fit */
+	if (shpool->data) {
+		mcf->sh = shpool->data;
+		mcf->stats = mcf->sh->stats;
+		return NGX_OK;
+	}
+
+	mcf->sh = ngx_slab_calloc(shpool, sizeof(ngx_header_inspect_zone_t));
+	if (mcf->sh == NULL) {
 		return NGX_ERROR;
 	}
+	shpool->data = mcf->sh;
 
-	while ( i < value.len) {
-		if (value.data[i] == '*') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Content-Encoding header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		if (ngx_header_inspect_parse_contentcoding(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid content-coding at position %d in Content-Encoding header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i += v;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
-		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
-		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Content-Encoding header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
-		}
+	return NGX_OK;
+}
+
+static char *ngx_header_inspect_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_main_conf_t *mcf = conf;
+	ngx_str_t *value;
+	ssize_t size;
+
+	if (mcf->zone) {
+		return "is duplicate";
 	}
 
-	if (rc == NGX_AGAIN) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Content-Encoding header \"%s\"", value.data);
-		}
-		rc = NGX_ERROR;
+	value = cf->args->elts;
+
+	size = ngx_parse_size(&value[2]);
+	if (size == NGX_ERROR) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid zone size \"%V\"", &value[2]);
+		return NGX_CONF_ERROR;
+	}
+	if (size < (ssize_t) (8 * ngx_pagesize)) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "zone \"%V\" is too small", &value[1]);
+		return NGX_CONF_ERROR;
 	}
 
-	return rc;
+	mcf->zone = ngx_shared_memory_add(cf, &value[1], size, &ngx_http_header_inspect_module);
+	if (mcf->zone == NULL) {
+		return NGX_CONF_ERROR;
+	}
+	if (mcf->zone->data) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "zone \"%V\" is already used", &value[1]);
+		return NGX_CONF_ERROR;
+	}
+
+	mcf->zone->init = ngx_header_inspect_init_zone;
+	mcf->zone->data = mcf;
 
+	return NGX_CONF_OK;
 }
 
-static ngx_int_t ngx_header_inspect_acceptencoding_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
-	ngx_uint_t v;
+static char *ngx_header_inspect_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_main_conf_t *mcf = conf;
+	ngx_header_inspect_log_t *vlog;
+	ngx_str_t *value, s;
+	ngx_uint_t i, k;
+	ngx_int_t n;
+	ssize_t size;
 
-	if ((value.len == 0) || ((value.len == 1) && (value.data[0] == '*'))) {
-		return NGX_OK;
+	if (mcf->vlog) {
+		return "is duplicate";
 	}
 
-	while ( i < value.len) {
-		if (ngx_header_inspect_parse_contentcoding(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid content-coding at position %d in Accept-Encoding header \"%s\"", i, value.data);
+	value = cf->args->elts;
+
+	vlog = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_log_t));
+	if (vlog == NULL) {
+		return NGX_CONF_ERROR;
+	}
+
+	size = 64 * 1024;
+	vlog->flush = 1000;
+	vlog->excerpt = NGX_HEADER_INSPECT_LOG_EXCERPT;
+
+	for (i = 2; i < cf->args->nelts; i++) {
+
+		if (ngx_strncmp(value[i].data, "buffer=", 7) == 0) {
+			s.data = value[i].data + 7;
+			s.len = value[i].len - 7;
+
+			size = ngx_parse_size(&s);
+			if ((size == NGX_ERROR) || (size == 0)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid buffer size \"%V\"", &s);
+				return NGX_CONF_ERROR;
 			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i += v;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
-		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
+			continue;
 		}
-		if (value.data[i] == ';') {
-			i++;
-			if (i >= value.len) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Accept-Encoding header \"%s\"", value.data);
-				}
-				rc = NGX_ERROR;
-				break;
-			}
-			if ((value.data[i] == ' ') && (i < value.len)) {
-				i++;
-			}
-			if (ngx_header_inspect_parse_qvalue(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid qvalue at position %d in Accept-Encoding header \"%s\"", i, value.data);
-				}
-				rc = NGX_ERROR;
-				break;
-			}
-			i += v;
-			if ((value.data[i] == ' ') && (i < value.len)) {
-				i++;
-			}
-			if (i == value.len) {
-				rc = NGX_OK;
-				break;
+
+		if (ngx_strncmp(value[i].data, "flush=", 6) == 0) {
+			s.data = value[i].data + 6;
+			s.len = value[i].len - 6;
+
+			n = ngx_parse_time(&s, 0);
+			if ((n == NGX_ERROR) || (n == 0)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid flush time \"%V\"", &s);
+				return NGX_CONF_ERROR;
 			}
+			vlog->flush = (ngx_msec_t) n;
+			continue;
 		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Accept-Encoding header \"%s\"", i, value.data);
+
+		if (ngx_strncmp(value[i].data, "rate=", 5) == 0) {
+			s.data = value[i].data + 5;
+			s.len = value[i].len - 5;
+
+			vlog->period = 1000;
+			if ((s.len > 2) && (ngx_strncmp(s.data + s.len - 2, "/m", 2) == 0)) {
+				vlog->period = 60000;
+				s.len -= 2;
+			} else if ((s.len > 2) && (ngx_strncmp(s.data + s.len - 2, "/s", 2) == 0)) {
+				s.len -= 2;
 			}
-			rc = NGX_ERROR;
-			break;
+
+			n = ngx_atoi(s.data, s.len);
+			if ((n == NGX_ERROR) || (n == 0)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid rate \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
+			}
+			vlog->rate = n;
+			continue;
 		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+
+		if (ngx_strncmp(value[i].data, "excerpt=", 8) == 0) {
+			n = ngx_atoi(value[i].data + 8, value[i].len - 8);
+			if ((n == NGX_ERROR) || (n > NGX_HEADER_INSPECT_LOG_MAX_EXCERPT)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid excerpt length \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
+			}
+			vlog->excerpt = n;
+			continue;
 		}
+
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+		return NGX_CONF_ERROR;
 	}
 
-	if (rc == NGX_AGAIN) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Accept-Encoding header \"%s\"", value.data);
+	/* a line with the longest excerpt, client and built-in header name has to fit */
+	if ((size_t) size < NGX_HEADER_INSPECT_LOG_LINE + NGX_SOCKADDR_STRLEN + 64 + 6 * vlog->excerpt) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "buffer of \"%V\" is too small for excerpts of %uz bytes", &value[1], vlog->excerpt);
+		return NGX_CONF_ERROR;
+	}
+
+	vlog->file = ngx_conf_open_file(cf->cycle, &value[1]);
+	if (vlog->file == NULL) {
+		return NGX_CONF_ERROR;
+	}
+	if (vlog->file->data) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"%V\" is already used by a buffered log", &value[1]);
+		return NGX_CONF_ERROR;
+	}
+
+	vlog->file->flush = ngx_header_inspect_log_flush_file;
+	vlog->file->data = vlog;
+
+	vlog->start = ngx_pnalloc(cf->pool, size);
+	if (vlog->start == NULL) {
+		return NGX_CONF_ERROR;
+	}
+	vlog->pos = vlog->start;
+	vlog->last = vlog->start + size;
+
+	vlog->events = ngx_pcalloc(cf->pool, NGX_HEADER_INSPECT_LOG_SLOTS * sizeof(ngx_header_inspect_log_event_t));
+	if (vlog->events == NULL) {
+		return NGX_CONF_ERROR;
+	}
+	for (k = 0; k < NGX_HEADER_INSPECT_LOG_SLOTS; k++) {
+		vlog->events[k].excerpt = ngx_pnalloc(cf->pool, vlog->excerpt + 1);
+		if (vlog->events[k].excerpt == NULL) {
+			return NGX_CONF_ERROR;
 		}
-		rc = NGX_ERROR;
 	}
 
-	return rc;
+	vlog->event = ngx_pcalloc(cf->pool, sizeof(ngx_event_t));
+	if (vlog->event == NULL) {
+		return NGX_CONF_ERROR;
+	}
+	vlog->event->data = vlog;
+	vlog->event->handler = ngx_header_inspect_log_timer;
+	vlog->event->log = &cf->cycle->new_log;
+	vlog->event->cancelable = 1;
+
+	/* a full bucket to start with */
+	vlog->tokens = (uint64_t) vlog->rate * vlog->period;
+
+	mcf->vlog = vlog;
+
+	return NGX_CONF_OK;
 }
 
-static ngx_int_t ngx_header_inspect_parse_cache_directive(u_char *data, ngx_uint_t maxlen, ngx_uint_t *len) {
-	ngx_uint_t i = 0;
-	if ( (maxlen >= 8) && (ngx_strncmp("no-cache", data, 8) == 0) ) {
-		*len = 8;
-		return NGX_OK;
+static char *ngx_header_inspect_capture_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_main_conf_t *mcf = conf;
+	ngx_header_inspect_capture_t *cap;
+	ngx_str_t *value, s;
+	ngx_uint_t i;
+	ngx_int_t n;
+	ssize_t size;
+
+	if (mcf->capture) {
+		return "is duplicate";
 	}
-	if ( (maxlen >= 8) && (ngx_strncmp("no-store", data, 8) == 0) ) {
-		*len = 8;
-		return NGX_OK;
+
+	value = cf->args->elts;
+
+	cap = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_capture_t));
+	if (cap == NULL) {
+		return NGX_CONF_ERROR;
 	}
-	if ( (maxlen >= 12) && (ngx_strncmp("no-transform", data, 12) == 0) ) {
-		*len = 12;
-		return NGX_OK;
+
+	cap->path = value[1];
+	if (ngx_conf_full_name(cf->cycle, &cap->path, 0) != NGX_OK) {
+		return NGX_CONF_ERROR;
 	}
-	if ( (maxlen >= 14) && (ngx_strncmp("only-if-cached", data, 14) == 0) ) {
-		*len = 14;
-		return NGX_OK;
+
+	size = ngx_parse_size(&value[2]);
+	if (size == NGX_ERROR) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid capture size \"%V\"", &value[2]);
+		return NGX_CONF_ERROR;
 	}
-	if ( (maxlen >= 9) && (ngx_strncmp("max-stale", data, 9) == 0) ) {
-		*len = 9;
-		if ( maxlen >= 11 ) {
-			if ( (data[9] == '=') && (data[10] >= '0') && (data[10] <= '9') ) {
-				i = 11;
-				while ( (i <= maxlen) && (data[i] >= '0') && (data[i] <= '9') ) {
-					i++;
-				}
-				*len = i;
+	cap->size = size;
+	cap->record = NGX_HEADER_INSPECT_RING_RECORD;
+	cap->sample = 1;
+
+	for (i = 3; i < cf->args->nelts; i++) {
+
+		if (ngx_strncmp(value[i].data, "sample=", 7) == 0) {
+			n = ngx_atoi(value[i].data + 7, value[i].len - 7);
+			if ((n == NGX_ERROR) || (n == 0)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid sample \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
 			}
+			cap->sample = n;
+			continue;
 		}
-		return NGX_OK;
+
+		if (ngx_strncmp(value[i].data, "record=", 7) == 0) {
+			s.data = value[i].data + 7;
+			s.len = value[i].len - 7;
+
+			size = ngx_parse_size(&s);
+			if ((size == NGX_ERROR) || (size > 0xffffff)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid record size \"%V\"", &s);
+				return NGX_CONF_ERROR;
+			}
+			cap->record = size;
+			continue;
+		}
+
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+		return NGX_CONF_ERROR;
 	}
-	if ( (maxlen >= 9) && (ngx_strncmp("max-age=", data, 8) == 0) && (data[8] >= '0') && (data[8] <= '9') ) {
-		i = 9;
-		while ( (i < maxlen) && (data[i] >= '0') &&(data[i] <= '9') ) {
-			i++;
+
+	/* the violations and the client address are never cut */
+	cap->record = ngx_align(cap->record, 8);
+	if (cap->record < sizeof(ngx_header_inspect_rec_t) + NGX_HEADER_INSPECT_MAX_VIOLATIONS * sizeof(ngx_header_inspect_rec_violation_t) + NGX_SOCKADDR_STRLEN + 64) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "record size of \"%V\" is too small", &value[1]);
+		return NGX_CONF_ERROR;
+	}
+
+	if (cap->size < NGX_HEADER_INSPECT_RING_SLOTS + 16 * cap->record) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "capture \"%V\" is too small for 16 records", &value[1]);
+		return NGX_CONF_ERROR;
+	}
+
+	mcf->capture = cap;
+
+	return NGX_CONF_OK;
+}
+
+static ngx_int_t ngx_header_inspect_init_penalty_zone(ngx_shm_zone_t *shm_zone, void *data) {
+	ngx_header_inspect_penalty_t *open = data;
+	ngx_header_inspect_penalty_t *pen;
+	size_t len;
+
+	pen = shm_zone->data;
+
+	if (open) {
+		if ((pen->key.value.len != open->key.value.len) || (ngx_strncmp(pen->key.value.data, open->key.value.data, pen->key.value.len) != 0)) {
+			ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0, "inspect_headers_penalty zone \"%V\" uses the \"%V\" key while previously it used the \"%V\" key",
+				&shm_zone->shm.name, &pen->key.value, &open->key.value);
+			return NGX_ERROR;
 		}
-		*len = i;
+
+		pen->sh = open->sh;
+		pen->shpool = open->shpool;
 		return NGX_OK;
 	}
-	if ( (maxlen >= 11) && (ngx_strncmp("min-fresh=", data, 10) == 0) && (data[10] >= '0') && (data[10] <= '9') ) {
-		i = 11;
-		while ( (i < maxlen) && (data[i] >= '0') &&(data[i] <= '9') ) {
-			i++;
-		}
-		*len = i;
+
+	pen->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+	if (shm_zone->shm.exists) {
+		pen->sh = pen->shpool->data;
 		return NGX_OK;
 	}
 
-	return NGX_ERROR;
-}
+	pen->sh = ngx_slab_alloc(pen->shpool, sizeof(ngx_header_inspect_penalty_sh_t));
+	if (pen->sh == NULL) {
+		return NGX_ERROR;
+	}
+	pen->shpool->data = pen->sh;
 
-static ngx_int_t ngx_header_inspect_cachecontrol_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
-	ngx_uint_t v;
+	ngx_rbtree_init(&pen->sh->rbtree, &pen->sh->sentinel, ngx_header_inspect_penalty_insert);
+	ngx_queue_init(&pen->sh->queue);
+	ngx_queue_init(&pen->sh->boxed);
 
-	if (value.len < 1) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Cache-Control header \"%s\" too short", value.data);
-		}
+	len = sizeof(" in inspect_headers_penalty zone \"\"") + shm_zone->shm.name.len;
+	pen->shpool->log_ctx = ngx_slab_alloc(pen->shpool, len);
+	if (pen->shpool->log_ctx == NULL) {
 		return NGX_ERROR;
 	}
+	ngx_sprintf(pen->shpool->log_ctx, " in inspect_headers_penalty zone \"%V\"%Z", &shm_zone->shm.name);
 
-	while ( i < value.len ) {
-		if ( ngx_header_inspect_parse_cache_directive(&(value.data[i]), value.len-i, &v) != NGX_OK ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid cache-directive at position %d in Cache-Control header \"%s\"", i, value.data);
+	/* a full zone is expected, the oldest clients make room */
+	pen->shpool->log_nomem = 0;
+
+	return NGX_OK;
+}
+
+static char *ngx_header_inspect_penalty_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_main_conf_t *mcf = conf;
+	ngx_header_inspect_penalty_t *pen;
+	ngx_http_compile_complex_value_t ccv;
+	ngx_str_t *value, s, name, key;
+	ngx_uint_t i;
+	ngx_int_t n;
+	ssize_t size;
+	u_char *p;
+
+	if (mcf->penalty) {
+		return "is duplicate";
+	}
+
+	value = cf->args->elts;
+
+	pen = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_penalty_t));
+	if (pen == NULL) {
+		return NGX_CONF_ERROR;
+	}
+	pen->threshold = 10 * 1000;
+	pen->window = 60 * 1000;
+	pen->ttl = 600 * 1000;
+
+	ngx_str_set(&key, "$binary_remote_addr");
+	name.len = 0;
+	size = 0;
+
+	for (i = 1; i < cf->args->nelts; i++) {
+
+		if (ngx_strncmp(value[i].data, "zone=", 5) == 0) {
+			name.data = value[i].data + 5;
+			p = (u_char *) ngx_strchr(name.data, ':');
+			if (p == NULL) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid zone \"%V\", expected name:size", &value[i]);
+				return NGX_CONF_ERROR;
 			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i += v;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+			name.len = p - name.data;
+
+			s.data = p + 1;
+			s.len = value[i].data + value[i].len - s.data;
+			size = ngx_parse_size(&s);
+			if (size == NGX_ERROR) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid zone size \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
+			}
+			if (size < (ssize_t) (8 * ngx_pagesize)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "zone \"%V\" is too small", &value[i]);
+				return NGX_CONF_ERROR;
+			}
+			continue;
 		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
+
+		if (ngx_strncmp(value[i].data, "key=", 4) == 0) {
+			key.data = value[i].data + 4;
+			key.len = value[i].len - 4;
+			continue;
 		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Cache-Control header \"%s\"", i, value.data);
+
+		if (ngx_strncmp(value[i].data, "threshold=", 10) == 0) {
+			n = ngx_atoi(value[i].data + 10, value[i].len - 10);
+			if ((n == NGX_ERROR) || (n == 0) || (n > 1000000)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid threshold \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
 			}
-			rc = NGX_ERROR;
-			break;
+			pen->threshold = n * 1000;
+			continue;
 		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+
+		if ((ngx_strncmp(value[i].data, "window=", 7) == 0) || (ngx_strncmp(value[i].data, "ttl=", 4) == 0)) {
+			s.data = (u_char *) ngx_strchr(value[i].data, '=') + 1;
+			s.len = value[i].data + value[i].len - s.data;
+			n = ngx_parse_time(&s, 0);
+			if ((n == NGX_ERROR) || (n == 0)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid time \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
+			}
+			if (value[i].data[0] == 'w') {
+				pen->window = n;
+			} else {
+				pen->ttl = n;
+			}
+			continue;
 		}
+
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+		return NGX_CONF_ERROR;
 	}
-	if ( rc == NGX_AGAIN ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Cache-Control header \"%s\"", value.data);
-		}
-		rc = NGX_ERROR;
+
+	if (name.len == 0) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"%V\" must have \"zone\" parameter", &cmd->name);
+		return NGX_CONF_ERROR;
 	}
 
-	return rc;
+	ngx_memzero(&ccv, sizeof(ngx_http_compile_complex_value_t));
+	ccv.cf = cf;
+	ccv.value = &key;
+	ccv.complex_value = &pen->key;
+
+	if (ngx_http_compile_complex_value(&ccv) != NGX_OK) {
+		return NGX_CONF_ERROR;
+	}
+
+	pen->zone = ngx_shared_memory_add(cf, &name, size, &ngx_http_header_inspect_module);
+	if (pen->zone == NULL) {
+		return NGX_CONF_ERROR;
+	}
+	if (pen->zone->data) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "zone \"%V\" is already used", &name);
+		return NGX_CONF_ERROR;
+	}
+
+	pen->zone->init = ngx_header_inspect_init_penalty_zone;
+	pen->zone->data = pen;
+
+	mcf->penalty = pen;
+
+	return NGX_CONF_OK;
 }
 
-static ngx_int_t ngx_header_inspect_referer_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	enum referer_header_states { RS_START, RS_SCHEME, RS_COLON, RS_SLASH1, RS_SLASH2, RS_HOST, RS_BR1, RS_IP6, RS_BR2, RS_COLON2, RS_PORT, RS_PATH } state;
+/* HMAC (RFC 2104): hashes the secret padded with 0x36 and 0x5c once, so a datagram costs two SHA1 updates */
+static void ngx_header_inspect_sync_key(ngx_header_inspect_sync_t *sync, ngx_str_t *secret) {
+	u_char key[64], pad[64];
+	ngx_sha1_t sha1;
 	ngx_uint_t i;
-	ngx_int_t rc = NGX_OK;
-	u_char d;
 
-	if ( value.len < 1 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: %s header \"%s\" too short", header, value.data);
-		}
-		return NGX_ERROR;
+	ngx_memzero(key, sizeof(key));
+	if (secret->len > sizeof(key)) {
+		ngx_sha1_init(&sha1);
+		ngx_sha1_update(&sha1, secret->data, secret->len);
+		ngx_sha1_final(key, &sha1);
+	} else {
+		ngx_memcpy(key, secret->data, secret->len);
 	}
 
-	switch ( value.data[0] ) {
-		case '/':
-			/* relativePath */
-			return NGX_OK;
-			break;
-		case 'h':
-		case 'f':
-			/* absoluteURI */
-			state = RS_START;
-			for ( i = 0; i < value.len ; i++ ) {
-				d = value.data[i];
+	for (i = 0; i < sizeof(key); i++) {
+		pad[i] = key[i] ^ 0x36;
+	}
+	ngx_sha1_init(&sync->ipad);
+	ngx_sha1_update(&sync->ipad, pad, sizeof(pad));
 
-				if (
-					((d >= 'g') && (d <= 'z')) ||
-					((d >= 'G') && (d <= 'Z')) ||
-					(d == '.')
-				) {
-					switch ( state ) {
-						case RS_START:
-							if (
-								!(
-								((value.len > 4) && (ngx_strncmp("http:", value.data, 5) == 0)) ||
-								((value.len > 5) && (ngx_strncmp("https:", value.data, 6) == 0)) ||
-								((value.len > 3) && (ngx_strncmp("ftp:", value.data, 4) == 0)) ||
-								((value.len > 4) && (ngx_strncmp("ftps:", value.data, 5) == 0))
-								)
-							) {
-								if ( conf->log ) {
-									ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unknown scheme at begin of %s header \"%s\"", header, value.data);
-								}
-								return NGX_ERROR;
-							}
-							state = RS_SCHEME;
-							break;
-						case RS_SLASH2:
-							state = RS_HOST;
-							break;
-						case RS_HOST:
-						case RS_PATH:
-						case RS_SCHEME:
-							break;
-						default:
-							rc = NGX_ERROR;
-					}
-				} else if (
-					((d >= 'a') && (d <= 'f')) ||
-					((d >= 'A') && (d <= 'F'))
-				) {
-					switch ( state ) {
-						case RS_START:
-							if (
-								!(
-								((value.len > 4) && (ngx_strncmp("http:", value.data, 5) == 0)) ||
-								((value.len > 5) && (ngx_strncmp("https:", value.data, 6) == 0)) ||
-								((value.len > 3) && (ngx_strncmp("ftp:", value.data, 4) == 0)) ||
-								((value.len > 4) && (ngx_strncmp("ftps:", value.data, 5) == 0))
-								)
-							) {
-								if ( conf->log ) {
-									ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unknown scheme at begin of %s header \"%s\"", header, value.data);
-								}
-								return NGX_ERROR;
-							}
-							state = RS_SCHEME;
-							break;
-						case RS_SLASH2:
-							state = RS_HOST;
-							break;
-						case RS_BR1:
-							state = RS_IP6;
-							break;
-						case RS_HOST:
-						case RS_PATH:
-						case RS_SCHEME:
-						case RS_IP6:
-							break;
-						default:
-							rc = NGX_ERROR;
-					}
-				} else if ( (d >= '0') && (d <= '9') ) {
-					switch ( state ) {
-						case RS_SLASH2:
-							state = RS_HOST;
-							break;
-						case RS_COLON2:
-							state = RS_PORT;
-							break;
-						case RS_BR1:
-							state = RS_IP6;
-							break;
-						case RS_PORT:
-						case RS_HOST:
-						case RS_PATH:
-						case RS_IP6:
-							break;
-						default:
-							rc = NGX_ERROR;
-					}
-				} else if ( d == '/' ) {
-					switch ( state ) {
-						case RS_COLON:
-							state = RS_SLASH1;
-							break;
-						case RS_SLASH1:
-							state = RS_SLASH2;
-							break;
-						case RS_PORT:
-						case RS_HOST:
-						case RS_BR2:
-							state = RS_PATH;
-							break;
-						case RS_PATH:
-							break;
-						default:
-							rc = NGX_ERROR;
-					}
-				} else if ( d == ':' ) {
-					switch ( state ) {
-						case RS_SCHEME:
-							state = RS_COLON;
-							break;
-						case RS_HOST:
-						case RS_BR2:
-							state = RS_COLON2;
-							break;
-						case RS_BR1:
-							state = RS_IP6;
-							break;
-						case RS_PATH:
-						case RS_IP6:
-							break;
-						default:
-							rc = NGX_ERROR;
-					}
-				} else if ( d == '[' ) {
-					switch ( state ) {
-						case RS_SLASH2:
-							state = RS_BR1;
-							break;
-						case RS_PATH:
-							break;
-						default:
-							rc = NGX_ERROR;
-					}
-				} else if ( d == ']' ) {
-					switch ( state ) {
-						case RS_IP6:
-							state = RS_BR2;
-							break;
-						case RS_PATH:
-							break;
-						default:
-							rc = NGX_ERROR;
-					}
-				} else {
-					switch ( state ) {
-						case RS_PATH:
-							break;
-						default:
-							rc = NGX_ERROR;
-					}
-				}
-				if ( rc == NGX_ERROR ) {
-					if ( conf->log ) {
-						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d of %s header \"%s\"", i, header, value.data);
-					}
-					return NGX_ERROR;
-				}
-			}
-			switch ( state ) {
-				case RS_PATH:
-				case RS_PORT:
-				case RS_HOST:
-				case RS_BR2:
-					return NGX_OK;
-				default:
-					if ( conf->log ) {
-						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of %s header \"%s\"", header, value.data);
-					}
-					return NGX_ERROR;
-			}
-			break;
-		default:
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at begin of %s header \"%s\"", header, value.data);
-			}
-			return NGX_ERROR;
+	for (i = 0; i < sizeof(key); i++) {
+		pad[i] = key[i] ^ 0x5c;
 	}
+	ngx_sha1_init(&sync->opad);
+	ngx_sha1_update(&sync->opad, pad, sizeof(pad));
 }
 
-static ngx_int_t ngx_header_inspect_transferencoding_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i;
-	ngx_int_t rc = NGX_OK;
-	enum transferencoding_header_states { TS_START, TS_FIELD, TS_PARDELIM, TS_PARKEY, TS_PAREQ, TS_PARVAL, TS_PARVALQ, TS_PARVALQE, TS_DELIM, TS_SPACE } state;
-	u_char d;
-	ngx_uint_t te_header = 0;
+static char *ngx_header_inspect_penalty_sync_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_main_conf_t *mcf = conf;
+	ngx_header_inspect_sync_t *sync;
+	ngx_str_t *value, s;
+	ngx_addr_t *peer;
+	ngx_uint_t i, j, secret;
+	ngx_int_t n;
+	ngx_url_t u;
+
+	if (mcf->sync) {
+		return "is duplicate";
+	}
 
-	if ( ngx_strncmp("TE", header, 2) == 0 ) {
-		te_header = 1;
+	value = cf->args->elts;
+
+	sync = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_sync_t));
+	if (sync == NULL) {
+		return NGX_CONF_ERROR;
 	}
+	sync->interval = 1000;
+	secret = 0;
 
-	state = TS_START;
-	for ( i = 0; i < value.len; i++ ) {
-		d = value.data[i];
+	sync->peers = ngx_array_create(cf->pool, 4, sizeof(ngx_addr_t));
+	if (sync->peers == NULL) {
+		return NGX_CONF_ERROR;
+	}
 
-		if (
-			((d >= 'a') && (d <= 'z')) ||
-			((d >= 'A') && (d <= 'Z')) ||
-			((d >= '0') && (d <= '9'))
-		) {
-			switch ( state ) {
-				case TS_START:
-				case TS_SPACE:
-					/* ensure transfer-codings is one of chunked, compress, deflate, gzip or identity */
-					state = TS_FIELD;
-					if (
-						!(
-							((value.len-i>=7) && (ngx_strncmp("chunked", &(value.data[i]),7) == 0) && ((value.data[i+7] == ',')||(value.data[i+7] == ';')||(value.data[i+7] == '\0'))) ||
-							((value.len-i>=8) && (ngx_strncmp("compress", &(value.data[i]),8) == 0) && ((value.data[i+8] == ',')||(value.data[i+8] == ';')||(value.data[i+8] == '\0'))) ||
-							((value.len-i>=7) && (ngx_strncmp("deflate", &(value.data[i]),7) == 0) && ((value.data[i+7] == ',')||(value.data[i+7] == ';')||(value.data[i+7] == '\0'))) ||
-							((value.len-i>=4) && (ngx_strncmp("gzip", &(value.data[i]),4) == 0) && ((value.data[i+4] == ',')||(value.data[i+4] == ';')||(value.data[i+4] == '\0'))) ||
-							((value.len-i>=8) && (ngx_strncmp("identity", &(value.data[i]),8) == 0) && ((value.data[i+8] == ',')||(value.data[i+8] == ';')||(value.data[i+8] == '\0'))) ||
-							((te_header == 1) && (value.len-i>=8) && (ngx_strncmp("trailers", &(value.data[i]),8) == 0) && ((value.data[i+8] == ',')||(value.data[i+8] == ';')||(value.data[i+8] == '\0')))
-						)
-					) {
-						if ( conf->log ) {
-							ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal field at position %d in %s header \"%s\"", i, header, value.data);
-						}
-						return NGX_ERROR;
-					}
-					break;
-				case TS_PARDELIM:
-					/* TODO: if parkey is 'q', validate q-value */
-					state = TS_PARKEY;
-					break;
-				case TS_PAREQ:
-					state = TS_PARVAL;
-					break;
-				case TS_FIELD:
-				case TS_PARKEY:
-				case TS_PARVAL:
-				case TS_PARVALQ:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == '.' ) {
-			switch ( state ) {
-				case TS_PARVAL:
-				case TS_PARVALQ:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ',' ) {
-			switch ( state ) {
-				case TS_FIELD:
-				case TS_PARVAL:
-				case TS_PARVALQE:
-					state = TS_DELIM;
-					break;
-				case TS_PARVALQ:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ' ' ) {
-			switch ( state ) {
-				case TS_DELIM:
-					state = TS_SPACE;
-					break;
-				case TS_PARVAL:
-				case TS_PARVALQ:
-				case TS_PARDELIM:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ';' ) {
-			switch ( state ) {
-				case TS_FIELD:
-				case TS_PARVAL:
-				case TS_PARVALQE:
-					state = TS_PARDELIM;
-					break;
-				case TS_PARVALQ:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == '=' ) {
-			switch ( state ) {
-				case TS_PARKEY:
-					state = TS_PAREQ;
-					break;
-				case TS_PARVALQ:
-					break;
-				default:
-					rc = NGX_ERROR;
+	for (i = 1; i < cf->args->nelts; i++) {
+
+		if ((ngx_strncmp(value[i].data, "listen=", 7) == 0) || (ngx_strncmp(value[i].data, "peer=", 5) == 0)) {
+			ngx_memzero(&u, sizeof(ngx_url_t));
+			u.url.data = (u_char *) ngx_strchr(value[i].data, '=') + 1;
+			u.url.len = value[i].data + value[i].len - u.url.data;
+			u.listen = (value[i].data[0] == 'l');
+
+			if (ngx_parse_url(cf->pool, &u) != NGX_OK) {
+				if (u.err) {
+					ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "%s in \"%V\"", u.err, &value[i]);
+				}
+				return NGX_CONF_ERROR;
 			}
-		} else if ( d == '"' ) {
-			switch ( state ) {
-				case TS_PAREQ:
-					state = TS_PARVALQ;
-					break;
-				case TS_PARVALQ:
-					state = TS_PARVALQE;
-					break;
-				default:
-					rc = NGX_ERROR;
+			if (u.no_port) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "no port in \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
 			}
-		} else {
-			switch ( state ) {
-				case TS_PARVALQ:
-					break;
-				default:
-					rc = NGX_ERROR;
+
+			if (u.listen) {
+				sync->listen.sockaddr = ngx_pcalloc(cf->pool, u.socklen);
+				if (sync->listen.sockaddr == NULL) {
+					return NGX_CONF_ERROR;
+				}
+				ngx_memcpy(sync->listen.sockaddr, &u.sockaddr, u.socklen);
+				sync->listen.socklen = u.socklen;
+				sync->listen.name = u.url;
+				continue;
 			}
-		}
-		if ( rc == NGX_ERROR ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in %s header \"%s\"", i, header, value.data);
+
+			/* every address of a name is a peer */
+			for (j = 0; j < u.naddrs; j++) {
+				peer = ngx_array_push(sync->peers);
+				if (peer == NULL) {
+					return NGX_CONF_ERROR;
+				}
+				*peer = u.addrs[j];
 			}
-			return NGX_ERROR;
+			continue;
 		}
-	}
-	switch ( state ) {
-		case TS_FIELD:
-		case TS_PARVAL:
-		case TS_PARVALQE:
-			break;
-		case TS_START:
-			if ( te_header == 1 ) {
-				break;
+
+		if (ngx_strncmp(value[i].data, "interval=", 9) == 0) {
+			s.data = value[i].data + 9;
+			s.len = value[i].len - 9;
+			n = ngx_parse_time(&s, 0);
+			if ((n == NGX_ERROR) || (n == 0)) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid interval \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
 			}
-		default:
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of %s header \"%s\"", header, value.data);
+			sync->interval = n;
+			continue;
+		}
+
+		if (ngx_strncmp(value[i].data, "secret=", 7) == 0) {
+			s.data = value[i].data + 7;
+			s.len = value[i].len - 7;
+			if (s.len < 16) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "secret in \"%V\" is shorter than 16 characters", &cmd->name);
+				return NGX_CONF_ERROR;
 			}
-			return NGX_ERROR;
+			ngx_header_inspect_sync_key(sync, &s);
+			secret = 1;
+			continue;
+		}
+
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+		return NGX_CONF_ERROR;
 	}
 
-	return NGX_OK;
+	if (sync->listen.sockaddr == NULL) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"%V\" must have \"listen\" parameter", &cmd->name);
+		return NGX_CONF_ERROR;
+	}
+	if (sync->peers->nelts == 0) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"%V\" must have \"peer\" parameter", &cmd->name);
+		return NGX_CONF_ERROR;
+	}
+	if (!secret) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"%V\" must have \"secret\" parameter", &cmd->name);
+		return NGX_CONF_ERROR;
+	}
+
+	sync->buf = ngx_palloc(cf->pool, NGX_HEADER_INSPECT_SYNC_BATCH * NGX_HEADER_INSPECT_SYNC_DGRAM);
+	if (sync->buf == NULL) {
+		return NGX_CONF_ERROR;
+	}
+
+	mcf->sync = sync;
+
+	return NGX_CONF_OK;
 }
 
-static ngx_int_t ngx_header_inspect_trailer_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
+static char *ngx_header_inspect_census_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_header_inspect_main_conf_t *mcf = conf;
+	ngx_str_t *value;
 	ngx_uint_t i;
-	ngx_int_t rc = NGX_OK;
-	enum trail_header_states { TS_START, TS_FIELD, TS_DELIM, TS_SPACE } state;
-	u_char d;
+	ngx_int_t n;
 
-	state = TS_START;
-	for ( i = 0; i < value.len; i++ ) {
-		d = value.data[i];
+	if (mcf->census_top) {
+		return "is duplicate";
+	}
 
-		if (
-			((d >= 'a') && (d <= 'z')) ||
-			((d >= 'A') && (d <= 'Z')) ||
-			((d >= '0') && (d <= '9')) ||
-			(d == '-')
-		) {
-			switch ( state ) {
-				case TS_START:
-				case TS_SPACE:
-					/* ensure field is not Transfer-Encondig, Content-Length or Trailer */
-					if (
-						(((value.len-i)>=17) && (ngx_strncmp("Transfer-Encoding", &(value.data[i]), 17) == 0) && ((value.data[i+17] == ',') || (value.data[i+17] == '\0'))) ||
-						(((value.len-i)>=14) && (ngx_strncmp("Content-Length", &(value.data[i]), 14) == 0) && ((value.data[i+14] == ',') || (value.data[i+14] == '\0'))) ||
-						(((value.len-i)>=7) && (ngx_strncmp("Trailer", &(value.data[i]), 7) == 0) && ((value.data[i+7] == ',') || (value.data[i+7] == '\0')))
-					) {
-						if ( conf->log ) {
-							ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal field at position %d in Trailer header \"%s\"", i, value.data);
-						}
-						return NGX_ERROR;
-					}
-					state = TS_FIELD;
-					break;
-				case TS_FIELD:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ',' ) {
-			switch ( state ) {
-				case TS_FIELD:
-					state = TS_DELIM;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ' ' ) {
-			switch ( state ) {
-				case TS_DELIM:
-					state = TS_SPACE;
-					break;
-				default:
-					rc = NGX_ERROR;
+	value = cf->args->elts;
+
+	n = ngx_atoi(value[1].data, value[1].len);
+	if ((n == NGX_ERROR) || (n == 0) || (n > 1024)) {
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid number of top headers \"%V\"", &value[1]);
+		return NGX_CONF_ERROR;
+	}
+	mcf->census_top = n;
+	mcf->census_width = 1024;
+
+	for (i = 2; i < cf->args->nelts; i++) {
+
+		if (ngx_strncmp(value[i].data, "width=", 6) == 0) {
+			n = ngx_atoi(value[i].data + 6, value[i].len - 6);
+			if ((n == NGX_ERROR) || (n < 64) || (n & (n - 1))) {
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "width must be a power of two from 64 on, not \"%V\"", &value[i]);
+				return NGX_CONF_ERROR;
 			}
-		} else {
-			rc = NGX_ERROR;
+			mcf->census_width = n;
+			continue;
 		}
-		if ( rc == NGX_ERROR ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in Trailer header \"%s\"", i, value.data);
-			}
-			return NGX_ERROR;
+
+		if (ngx_strcmp(value[i].data, "lengths") == 0) {
+			mcf->census_lengths = 1;
+			continue;
 		}
+
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+		return NGX_CONF_ERROR;
 	}
-	if ( state != TS_FIELD ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Trailer header \"%s\"", value.data);
-		}
-		return NGX_ERROR;
+
+	return NGX_CONF_OK;
+}
+
+static void ngx_header_inspect_capture_unmap(void *data) {
+	ngx_header_inspect_capture_t *cap = data;
+
+	if (munmap((void *) cap->ring, cap->size) == -1) {
+		ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno, "munmap(\"%V\") failed", &cap->path);
 	}
+}
 
-	return NGX_OK;
+/* a new, zeroed capture file in place of the old one, which the old workers keep */
+static ngx_header_inspect_ring_t *ngx_header_inspect_capture_create(ngx_cycle_t *cycle, ngx_header_inspect_capture_t *cap) {
+	ngx_header_inspect_ring_t *ring;
+	ngx_fd_t fd;
+
+	if ((ngx_delete_file(cap->path.data) == NGX_FILE_ERROR) && (ngx_errno != NGX_ENOENT)) {
+		ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno, ngx_delete_file_n " \"%V\" failed", &cap->path);
+		return NULL;
+	}
+
+	fd = ngx_open_file(cap->path.data, NGX_FILE_RDWR, NGX_FILE_CREATE_OR_OPEN, NGX_FILE_DEFAULT_ACCESS);
+	if (fd == NGX_INVALID_FILE) {
+		ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno, ngx_open_file_n " \"%V\" failed", &cap->path);
+		return NULL;
+	}
+
+	/* only grows a file nobody maps yet, which reads back as zeroes */
+	if (ftruncate(fd, cap->size) == -1) {
+		ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno, "ftruncate(\"%V\") failed", &cap->path);
+		ngx_close_file(fd);
+		return NULL;
+	}
+
+	ring = mmap(NULL, cap->size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+		ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno, ngx_close_file_n " \"%V\" failed", &cap->path);
+	}
+
+	if (ring == MAP_FAILED) {
+		ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno, "mmap(\"%V\") failed", &cap->path);
+		return NULL;
+	}
+
+	return ring;
 }
 
-static ngx_int_t ngx_header_inspect_warning_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i;
-	ngx_uint_t v;
-	ngx_int_t rc = NGX_OK;
-	enum warn_header_states { WS_START, WS_CODE1, WS_CODE2, WS_CODE3, WS_SP1, WS_HOST, WS_COLON, WS_PORT, WS_SP2, WS_TXT, WS_TXTE, WS_SP3, WS_DATE, WS_DELIM, WS_SPACE } state;
-	u_char d;
+/*
+ * Maps the capture file before the workers are forked, so they all
+ * share it.  A file that is still laid out the same is kept over a
+ * reload.  Otherwise it is replaced by a new one rather than truncated
+ * or cleared: the workers of the previous cycle keep writing to their
+ * mapping while they drain, and a shorter file would SIGBUS them.
+ */
+static ngx_int_t ngx_header_inspect_capture_map(ngx_cycle_t *cycle, ngx_header_inspect_capture_t *cap) {
+	ngx_header_inspect_ring_t *ring;
+	ngx_pool_cleanup_t *cln;
+	ngx_file_info_t fi;
+	ngx_fd_t fd;
+	ngx_uint_t i, nslots, fresh;
+	u_char *p, *last;
 
-	state = WS_START;
-	for ( i = 0; i < value.len ; i++ ) {
-		d = value.data[i];
+	nslots = (cap->size - NGX_HEADER_INSPECT_RING_SLOTS) / cap->record;
+	ring = NULL;
 
-		if ( (d >= '0') && (d <= '9') ) {
-			switch ( state ) {
-				case WS_START:
-				case WS_SPACE:
-					state = WS_CODE1;
-					break;
-				case WS_CODE1:
-					state = WS_CODE2;
-					break;
-				case WS_CODE2:
-					state = WS_CODE3;
-					break;
-				case WS_SP1:
-					state = WS_HOST;
-					break;
-				case WS_COLON:
-					state = WS_PORT;
-					break;
-				case WS_HOST:
-				case WS_PORT:
-				case WS_TXT:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( ((d >= 'a') && (d <= 'z')) || ((d >= 'A') && (d <= 'Z')) ) {
-			switch ( state ) {
-				case WS_SP1:
-					state = WS_HOST;
-					break;
-				case WS_HOST:
-				case WS_TXT:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( (d == '-') || (d == '.') ) {
-			switch ( state ) {
-				case WS_HOST:
-				case WS_TXT:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ':' ) {
-			switch ( state ) {
-				case WS_HOST:
-					state = WS_COLON;
-					break;
-				case WS_TXT:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ',' ) {
-			switch ( state ) {
-				case WS_DATE:
-				case WS_TXTE:
-					state = WS_DELIM;
-					break;
-				case WS_TXT:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ' ' ) {
-			switch ( state ) {
-				case WS_CODE3:
-					state = WS_SP1;
-					break;
-				case WS_HOST:
-				case WS_PORT:
-					state = WS_SP2;
-					break;
-				case WS_TXTE:
-					state = WS_SP3;
-					break;
-				case WS_DELIM:
-					state = WS_SPACE;
-					break;
-				case WS_TXT:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == '"' ) {
-			switch ( state ) {
-				case WS_SP2:
-					state = WS_TXT;
-					break;
-				case WS_TXT:
-					state = WS_TXTE;
-					break;
-				case WS_SP3:
-					state = WS_DATE;
-					i++; /* skip qoute */
-					if ( ngx_header_inspect_http_date(&(value.data[i]), value.len-i, &v) != NGX_OK ) {
-						if ( conf->log ) {
-							ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal date at position %d in Warning header \"%s\"", i, value.data);
-						}
-						return NGX_ERROR;
-					}
-					i += v;
-					if ( i >= value.len ) {
-						if ( conf->log ) {
-							ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Warning header \"%s\"", value.data);
-						}
-						return NGX_ERROR;
-					}
-					if ( value.data[i] != '"' ) {
-						rc = NGX_ERROR;
-					}
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else {
-			switch ( state ) {
-				case WS_TXT:
-					break;
-				default:
-					rc = NGX_ERROR;
+	fd = ngx_open_file(cap->path.data, NGX_FILE_RDWR, NGX_FILE_OPEN, 0);
+	if (fd != NGX_INVALID_FILE) {
+		if ((ngx_fd_info(fd, &fi) != NGX_FILE_ERROR) && (ngx_file_size(&fi) == (off_t) cap->size)) {
+			ring = mmap(NULL, cap->size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+			if (ring == MAP_FAILED) {
+				ring = NULL;
+			} else if ((ngx_memcmp(ring->magic, "NHIC", 4) != 0) || (ring->version != NGX_HEADER_INSPECT_RING_VERSION)
+				|| (ring->nslots != nslots) || (ring->slot_size != cap->record)) {
+				(void) munmap((void *) ring, cap->size);
+				ring = NULL;
 			}
 		}
-		if ( rc == NGX_ERROR ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in Warning header \"%s\"", i, value.data);
-			}
-			return NGX_ERROR;
+
+		if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+			ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno, ngx_close_file_n " \"%V\" failed", &cap->path);
 		}
 	}
-	switch ( state ) {
-		case WS_TXTE:
-		case WS_DATE:
-			break;
-		default:
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Warning header \"%s\"", value.data);
-			}
+
+	fresh = (ring == NULL);
+	if (fresh) {
+		ring = ngx_header_inspect_capture_create(cycle, cap);
+		if (ring == NULL) {
 			return NGX_ERROR;
+		}
 	}
 
-	return NGX_OK;
-}
+	cap->ring = ring;
 
-static ngx_int_t ngx_header_inspect_expect_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
+	cln = ngx_pool_cleanup_add(cycle->pool, 0);
+	if (cln == NULL) {
+		ngx_header_inspect_capture_unmap(cap);
+		return NGX_ERROR;
+	}
+	cln->handler = ngx_header_inspect_capture_unmap;
+	cln->data = cap;
 
-	/* currently only the 'known' "100-continue" value is allowed */
-	if ( (value.len == 12) && (ngx_strncasecmp((u_char *)"100-continue", value.data, 12) == 0) ) {
+	if (!fresh) {
 		return NGX_OK;
-	} else {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unknown value in Expect header \"%s\"", value.data);
+	}
+
+	ring->version = NGX_HEADER_INSPECT_RING_VERSION;
+	ring->ncodes = sizeof(ngx_header_inspect_errors) / sizeof(ngx_str_t);
+	ring->nslots = (uint32_t) nslots;
+	ring->slot_size = (uint32_t) cap->record;
+	ring->slots = NGX_HEADER_INSPECT_RING_SLOTS;
+	ring->codes = sizeof(ngx_header_inspect_ring_t);
+
+	/* the readers take the code names from here */
+	p = (u_char *) ring + ring->codes;
+	last = (u_char *) ring + ring->slots;
+	for (i = 0; i < ring->ncodes; i++) {
+		if ((size_t) (last - p) <= ngx_header_inspect_errors[i].len) {
+			ring->ncodes = (uint16_t) i;
+			break;
 		}
-		return NGX_ERROR;
+		p = ngx_cpymem(p, ngx_header_inspect_errors[i].data, ngx_header_inspect_errors[i].len);
+		*p++ = '\0';
 	}
-}
 
-static ngx_int_t ngx_header_inspect_authorization_header(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i;
-	ngx_int_t rc = NGX_OK;
-	enum digest_header_states { DS_START, DS_KEY, DS_EQ, DS_VAL, DS_VALQ, DS_VALQE, DS_DELIM, DS_SPACE } state;
-	u_char d;
+	/* last, a reader takes the file for ready once it is there */
+	ngx_memory_barrier();
+	ngx_memcpy(ring->magic, "NHIC", 4);
 
-	if ( value.len == 0 ) {
-		return NGX_OK;
-	}
+	return NGX_OK;
+}
 
-	if ( (value.len >= 6) && (ngx_strncmp("Basic ", value.data, 6) == 0) ) {
-		return ngx_header_inspect_parse_base64(header, conf, log, &(value.data[6]), value.len-6);
+static void ngx_header_inspect_stats_free(ngx_slab_pool_t *shpool, ngx_header_inspect_stats_t *stats) {
+	if (stats->census) {
+		if (stats->census->entries) {
+			ngx_slab_free(shpool, stats->census->entries);
+		}
+		ngx_slab_free(shpool, stats->census);
 	}
+	ngx_slab_free(shpool, stats);
+}
 
-	if ( (value.len >= 7) && (ngx_strncmp("Digest ", value.data, 7) == 0) ) {
-		i = 7; /* start after "Digest " */
-		state = DS_START;
-		for ( ; i < value.len; i++ ) {
-			d = value.data[i];
+/* frees the retired layouts no running worker counts into any more */
+static void ngx_header_inspect_stats_reap(ngx_slab_pool_t *shpool, ngx_header_inspect_zone_t *sh) {
+	ngx_header_inspect_stats_t *stats, **prev;
+	ngx_pid_t pid;
+	ngx_uint_t i;
 
-			if ( (d >= 'a') && (d <= 'z') ) {
-				switch ( state ) {
-					case DS_START:
-					case DS_SPACE:
-						state = DS_KEY;
-						if (
-							!(
-								(((value.len-i) >= 9) && (ngx_strncmp("username=", &(value.data[i]), 9) == 0)) ||
-								(((value.len-i) >= 6) && (ngx_strncmp("realm=", &(value.data[i]), 6) == 0)) ||
-								(((value.len-i) >= 6) && (ngx_strncmp("nonce=", &(value.data[i]), 6) == 0)) ||
-								(((value.len-i) >= 4) && (ngx_strncmp("uri=", &(value.data[i]), 4) == 0)) ||
-								(((value.len-i) >= 9) && (ngx_strncmp("response=", &(value.data[i]), 9) == 0)) ||
-								(((value.len-i) >= 10) && (ngx_strncmp("algorithm=", &(value.data[i]), 10) == 0)) ||
-								(((value.len-i) >= 7) && (ngx_strncmp("cnonce=", &(value.data[i]), 7) == 0)) ||
-								(((value.len-i) >= 7) && (ngx_strncmp("opaque=", &(value.data[i]), 7) == 0)) ||
-								(((value.len-i) >= 4) && (ngx_strncmp("qop=", &(value.data[i]), 4) == 0)) ||
-								(((value.len-i) >= 3) && (ngx_strncmp("nc=", &(value.data[i]), 3) == 0))
-							)
-						) {
-							if ( conf->log ) {
-								ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unknown auth-param at position %d in %s header \"%s\"", i, header, value.data);
-							}
-							return NGX_ERROR;
-						}
-						break;
-					case DS_EQ:
-						state = DS_VAL;
-						break;
-					case DS_VAL:
-					case DS_VALQ:
-					case DS_KEY:
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-			} else if ( d == ',' ) {
-				switch ( state ) {
-					case DS_VAL:
-					case DS_VALQE:
-					case DS_EQ:
-						state = DS_DELIM;
-						break;
-					case DS_VALQ:
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-			} else if ( d == '=' ) {
-				switch ( state ) {
-					case DS_KEY:
-						state = DS_EQ;
-						break;
-					case DS_VALQ:
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
+	prev = &sh->retired;
+	while (*prev) {
+		stats = *prev;
 
-			} else if ( d == ' ' ) {
-				switch ( state ) {
-					case DS_DELIM:
-						state = DS_SPACE;
-						break;
-					case DS_VALQ:
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-			} else if ( d == '"' ) {
-				switch ( state ) {
-					case DS_EQ:
-						state = DS_VALQ;
-						break;
-					case DS_VALQ:
-						state = DS_VALQE;
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-			} else if ( (d != '"') ) {
-				switch ( state ) {
-					case DS_VAL:
-					case DS_VALQ:
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-			} else {
-				rc = NGX_ERROR;
-			}
-			if ( rc == NGX_ERROR ) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in %s header \"%s\"", i, header, value.data);
-				}
-				return NGX_ERROR;
+		for (i = 0; i < stats->nworkers; i++) {
+			pid = (ngx_pid_t) stats->pids[i];
+			/* a worker that crashed never cleared its slot, but is gone all the same */
+			if (pid && (pid != ngx_pid) && ((kill(pid, 0) == 0) || (ngx_errno != NGX_ESRCH))) {
+				break;
 			}
 		}
-		switch ( state ) {
-			case DS_VALQE:
-			case DS_VAL:
-				break;
-			default:
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of %s header \"%s\"", header, value.data);
-				}
-				return NGX_ERROR;
+
+		if (i < stats->nworkers) {
+			prev = &stats->next;
+			continue;
+		}
+
+		*prev = stats->next;
+		ngx_header_inspect_stats_free(shpool, stats);
+	}
+}
+
+/* lays out the counters once worker_processes is known */
+static ngx_int_t ngx_header_inspect_init_module(ngx_cycle_t *cycle) {
+	ngx_header_inspect_main_conf_t *mcf;
+	ngx_header_inspect_stats_t *stats;
+	ngx_header_inspect_census_t *census;
+	ngx_slab_pool_t *shpool;
+	ngx_core_conf_t *ccf;
+	ngx_uint_t nworkers, nrows;
+	size_t stride;
+
+	mcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_header_inspect_module);
+	if (mcf == NULL) {
+		return NGX_OK;
+	}
+
+	if (mcf->capture && (ngx_header_inspect_capture_map(cycle, mcf->capture) != NGX_OK)) {
+		return NGX_ERROR;
+	}
+
+	if (mcf->zone == NULL) {
+		if (mcf->census_top) {
+			ngx_log_error(NGX_LOG_EMERG, cycle->log, 0, "inspect_headers_census needs an inspect_headers_zone");
+			return NGX_ERROR;
 		}
 		return NGX_OK;
 	}
 
-	if ( conf->log ) {
-		ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unknown auth-scheme in %s header \"%s\"", header, value.data);
+	ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+	nworkers = ccf->worker_processes;
+	nrows = NGX_HEADER_INSPECT_HDR_RULE + (mcf->rules ? mcf->rules->nelts : 0);
+	stride = ngx_header_inspect_stat(nrows, 0);
+	if (mcf->profile) {
+		stride += nrows * NGX_HEADER_INSPECT_PROF_SIZE;
 	}
-	return NGX_ERROR;
-}
+	stride = ngx_align(stride * sizeof(uint64_t), ngx_cacheline_size) / sizeof(uint64_t);
 
-static ngx_int_t ngx_header_inspect_contentmd5_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	return ngx_header_inspect_parse_base64("Content-MD5", conf, log, value.data, value.len);
-}
+	/* every reload, not only when the layout changes */
+	shpool = (ngx_slab_pool_t *) mcf->zone->shm.addr;
+	ngx_header_inspect_stats_reap(shpool, mcf->sh);
 
-static ngx_int_t ngx_header_inspect_parse_base64(char* header, ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, u_char *data, ngx_uint_t maxlen) {
-	ngx_uint_t i;
-	u_char d;
+	stats = mcf->stats;
+	census = stats ? stats->census : NULL;
+	if ((stats != NULL) && (stats->nworkers == nworkers) && (stats->nrows == nrows) && (stats->profile == mcf->profile)
+		&& (census ? (census->top == mcf->census_top) && (census->width == mcf->census_width) && (census->lengths == mcf->census_lengths) : (mcf->census_top == 0))) {
+		return NGX_OK;
+	}
 
-	if ( maxlen == 0 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: empty base64 value in %s header", header);
-		}
+	/*
+	 * A new layout starts from zero.  Workers of the previous cycle may
+	 * still be counting into the old one, so it is retired, and freed by
+	 * a later reload once they are all gone.
+	 */
+	stats = ngx_slab_calloc(shpool, offsetof(ngx_header_inspect_stats_t, counters) + nworkers * stride * sizeof(uint64_t) + ngx_cacheline_size
+		+ nworkers * sizeof(ngx_atomic_t));
+	if (stats == NULL) {
+		ngx_log_error(NGX_LOG_EMERG, cycle->log, 0, "inspect_headers_zone \"%V\" is too small", &mcf->zone->shm.name);
 		return NGX_ERROR;
 	}
 
-	for ( i = 0; i < maxlen; i++ ) {
-		d = data[i];
-
-		if ( (d >= '0') && (d <= '9') ) {
-			continue;
-		}
-		if ( (d >= 'a') && (d <= 'z') ) {
-			continue;
-		}
-		if ( (d >= 'A') && (d <= 'Z') ) {
-			continue;
-		}
-		if ( (d == '+') || (d == '/') ) {
-			continue;
-		}
-		if ( d == '=' ) {
-			continue;
-			i++;
-			while ( i < maxlen ) {
-				if ( data[i] != '=' ) {
-					if ( conf->log ) {
-						ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: trailing characters at position %d in base64 value \"%s\" of %s header", i, data, header);
-					}
-					return NGX_ERROR;
-				}
-				i++;
-			}
-			break;
+	stats->nworkers = nworkers;
+	stats->nrows = nrows;
+	stats->profile = mcf->profile;
+	stats->stride = stride;
+	stats->pids = (ngx_atomic_t *) ((uint64_t *) ngx_align_ptr(stats->counters, ngx_cacheline_size) + nworkers * stride);
+
+	if (mcf->census_top) {
+		census = ngx_slab_calloc(shpool, offsetof(ngx_header_inspect_census_t, counters) + NGX_HEADER_INSPECT_CENSUS_DEPTH * mcf->census_width * sizeof(ngx_atomic_t));
+		if (census == NULL) {
+			ngx_log_error(NGX_LOG_EMERG, cycle->log, 0, "inspect_headers_zone \"%V\" is too small for inspect_headers_census", &mcf->zone->shm.name);
+			ngx_header_inspect_stats_free(shpool, stats);
+			return NGX_ERROR;
 		}
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in base64 value \"%s\" of %s header", i, data, header);
+		stats->census = census;
+		census->entries = ngx_slab_calloc(shpool, mcf->census_top * sizeof(ngx_header_inspect_census_entry_t));
+		if (census->entries == NULL) {
+			ngx_log_error(NGX_LOG_EMERG, cycle->log, 0, "inspect_headers_zone \"%V\" is too small for inspect_headers_census", &mcf->zone->shm.name);
+			ngx_header_inspect_stats_free(shpool, stats);
+			return NGX_ERROR;
 		}
-		return NGX_ERROR;
+		census->width = mcf->census_width;
+		census->top = mcf->census_top;
+		census->lengths = mcf->census_lengths;
+	}
+
+	if (mcf->sh->stats) {
+		mcf->sh->stats->next = mcf->sh->retired;
+		mcf->sh->retired = mcf->sh->stats;
 	}
+	mcf->sh->stats = stats;
+	mcf->stats = stats;
 
 	return NGX_OK;
 }
 
-static ngx_int_t ngx_header_inspect_contenttype_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t v;
+/* whether the datagram came from a peer, whatever its port */
+static ngx_uint_t ngx_header_inspect_sync_peer(ngx_header_inspect_sync_t *sync, struct sockaddr *sa, socklen_t socklen) {
+	ngx_addr_t *peer;
+	ngx_uint_t i;
 
-	if ( value.len < 3 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Content-Type header \"%s\" too short", value.data);
+	peer = sync->peers->elts;
+	for (i = 0; i < sync->peers->nelts; i++) {
+		if (ngx_cmp_sockaddr(sa, socklen, peer[i].sockaddr, peer[i].socklen, 0) == NGX_OK) {
+			return 1;
 		}
-		return NGX_ERROR;
 	}
 
-	if (ngx_header_inspect_parse_mediatype(value.data, value.len, &v) != NGX_OK) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid media-type in Content-Type header \"%s\"", value.data);
-		}
-		return NGX_ERROR;
-	}
+	return 0;
+}
 
-	return NGX_OK;
+static void ngx_header_inspect_sync_mac(ngx_header_inspect_sync_t *sync, u_char *p, size_t len, u_char *mac) {
+	u_char inner[NGX_HEADER_INSPECT_SYNC_MAC];
+	ngx_sha1_t sha1;
+
+	sha1 = sync->ipad;
+	ngx_sha1_update(&sha1, p, len);
+	ngx_sha1_final(inner, &sha1);
+
+	sha1 = sync->opad;
+	ngx_sha1_update(&sha1, inner, sizeof(inner));
+	ngx_sha1_final(mac, &sha1);
 }
 
-static ngx_int_t ngx_header_inspect_pragma_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	/* currently only the 'known' "no-cache" value is allowed */
-	if ( (value.len == 8) && (ngx_strncasecmp((u_char *)"no-cache", value.data, 8) == 0) ) {
-		return NGX_OK;
-	} else {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unknown value in Pragama header \"%s\"", value.data);
-		}
-		return NGX_ERROR;
+/* checks the MAC in constant time, and that the datagram was sent less than NGX_HEADER_INSPECT_SYNC_SKEW seconds from now */
+static ngx_uint_t ngx_header_inspect_sync_verify(ngx_header_inspect_sync_t *sync, u_char *p, size_t len) {
+	u_char mac[NGX_HEADER_INSPECT_SYNC_MAC], diff;
+	uint32_t sent;
+	int32_t age;
+	ngx_uint_t i;
+
+	len -= NGX_HEADER_INSPECT_SYNC_MAC;
+	ngx_header_inspect_sync_mac(sync, p, len, mac);
+
+	diff = 0;
+	for (i = 0; i < NGX_HEADER_INSPECT_SYNC_MAC; i++) {
+		diff |= mac[i] ^ p[len + i];
 	}
+	if (diff) {
+		return 0;
+	}
+
+	sent = ((uint32_t) p[8] << 24) | ((uint32_t) p[9] << 16) | ((uint32_t) p[10] << 8) | p[11];
+	age = (int32_t) ((uint32_t) ngx_time() - sent);
+
+	return (age <= NGX_HEADER_INSPECT_SYNC_SKEW) && (age >= -NGX_HEADER_INSPECT_SYNC_SKEW);
 }
 
-static ngx_int_t ngx_header_inspect_from_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i = 0;
-	u_char d;
-	ngx_int_t rc = NGX_OK;
-	enum from_header_states { FS_START, FS_LOCALPART, FS_AT, FS_DOMAIN, FS_DOT } state;
+/* merges the entries of a datagram into the zone, returns how many clients were boxed by it */
+static ngx_uint_t ngx_header_inspect_sync_merge(ngx_header_inspect_sync_t *sync, u_char *p, size_t len) {
+	ngx_header_inspect_penalty_t *pen = sync->penalty;
+	ngx_header_inspect_penalty_node_t *pn;
+	ngx_uint_t count, merged;
+	ngx_msec_t now, left, until;
+	ngx_str_t key;
+	u_char *last;
+
+	if ((len < NGX_HEADER_INSPECT_SYNC_HEADER + NGX_HEADER_INSPECT_SYNC_MAC) || (ngx_memcmp(p, NGX_HEADER_INSPECT_SYNC_MAGIC, 4) != 0) || (p[4] != NGX_HEADER_INSPECT_SYNC_VERSION)) {
+		return 0;
+	}
 
-	if ( value.len < 3 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: From header \"%s\" too short", value.data);
-		}
-		return NGX_ERROR;
+	if (!ngx_header_inspect_sync_verify(sync, p, len)) {
+		sync->rejected++;
+		return 0;
 	}
 
-	state = FS_START;
-	for ( i = 0; i < value.len; i++ ) {
-		d = value.data[i];
-		if (
-			((d >= '0') && (d <= '9')) ||
-			((d >= 'a') && (d <= 'z')) ||
-			((d >= 'A') && (d <= 'Z')) ||
-			(d == '-')
-		) {
-			switch ( state ) {
-				case FS_START:
-					state = FS_LOCALPART;
-					break;
-				case FS_AT:
-				case FS_DOT:
-					state = FS_DOMAIN;
-					break;
-				case FS_LOCALPART:
-				case FS_DOMAIN:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == '+') {
-			switch ( state ) {
-				case FS_START:
-					state = FS_LOCALPART;
-					break;
-				case FS_LOCALPART:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == '.') {
-			switch ( state ) {
-				case FS_START:
-					state = FS_LOCALPART;
-					break;
-				case FS_LOCALPART:
-					break;
-				case FS_DOMAIN:
-					state = FS_DOT;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == '@') {
-			switch ( state ) {
-				case FS_LOCALPART:
-					state = FS_AT;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else {
-			rc = NGX_ERROR;
-		}
-		if ( rc == NGX_ERROR ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in From header \"%s\"", i, value.data);
-			}
-			return NGX_ERROR;
+	count = ((ngx_uint_t) p[6] << 8) | p[7];
+	last = p + len - NGX_HEADER_INSPECT_SYNC_MAC;
+	p += NGX_HEADER_INSPECT_SYNC_HEADER;
+
+	merged = 0;
+	now = ngx_current_msec;
+
+	ngx_shmtx_lock(&pen->shpool->mutex);
+
+	while (count--) {
+		if (last - p < NGX_HEADER_INSPECT_SYNC_ENTRY) {
+			break;
 		}
-	}
-	if ( state != FS_DOMAIN ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of From header \"%s\"", value.data);
+
+		left = ((ngx_msec_t) p[0] << 24) | ((ngx_msec_t) p[1] << 16) | ((ngx_msec_t) p[2] << 8) | p[3];
+		key.len = p[4];
+		key.data = p + NGX_HEADER_INSPECT_SYNC_ENTRY;
+		if ((size_t) (last - key.data) < key.len) {
+			break;
 		}
-		return NGX_ERROR;
-	}
+		p = key.data + key.len;
 
-	return NGX_OK;
-}
+		if ((key.len == 0) || (left == 0)) {
+			continue;
+		}
 
-static ngx_int_t ngx_header_inspect_via_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i = 0;
-	u_char d;
-	ngx_int_t rc = NGX_OK;
-	enum via_header_states { VS_START, VS_PROT, VS_SLASH, VS_VER, VS_SPACE1, VS_HOST, VS_COLON, VS_PORT, VS_DELIM, VS_SPACE2, VS_PAREN, VS_PARENEND, VS_SPACE3 } state;
+		/* a peer boxes for at most the ttl of this node */
+		until = now + ngx_min(left, pen->ttl);
 
-	if ( value.len < 3 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Via header \"%s\" too short", value.data);
+		pn = ngx_header_inspect_penalty_node(pen, &key, ngx_crc32_short(key.data, key.len), now);
+		if (pn == NULL) {
+			break;
 		}
-		return NGX_ERROR;
-	}
 
-	state = VS_START;
-	for ( i = 0; i < value.len; i++ ) {
-		d = value.data[i];
-		if ( ((d >= '0') && (d <= '9')) ) {
-			switch ( state ) {
-				case VS_START:
-				case VS_SPACE3:
-					state = VS_PROT;
-					break;
-				case VS_SLASH:
-					state = VS_VER;
-					break;
-				case VS_SPACE1:
-					state = VS_HOST;
-					break;
-				case VS_COLON:
-					state = VS_PORT;
-					break;
-				case VS_PROT:
-				case VS_VER:
-				case VS_PORT:
-				case VS_HOST:
-				case VS_PAREN:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (
-			((d >= 'a') && (d <= 'z')) ||
-			((d >= 'A') && (d <= 'Z')) ||
-			(d == '-') || (d == '.')
-		) {
-			switch ( state ) {
-				case VS_START:
-				case VS_SPACE3:
-					state = VS_PROT;
-					break;
-				case VS_SLASH:
-					state = VS_VER;
-					break;
-				case VS_SPACE1:
-					state = VS_HOST;
-					break;
-				case VS_PROT:
-				case VS_VER:
-				case VS_HOST:
-				case VS_PAREN:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == ' ') {
-			switch ( state ) {
-				case VS_PROT:
-				case VS_VER:
-					state = VS_SPACE1;
-					break;
-				case VS_HOST:
-				case VS_PORT:
-					state = VS_SPACE2;
-					break;
-				case VS_DELIM:
-					state = VS_SPACE3;
-					break;
-				case VS_SPACE1:
-				case VS_SPACE2:
-				case VS_SPACE3:
-				case VS_PAREN:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == '/') {
-			switch ( state ) {
-				case VS_PROT:
-					state = VS_SLASH;
-					break;
-				case VS_PAREN:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == ':') {
-			switch ( state ) {
-				case VS_HOST:
-					state = VS_COLON;
-					break;
-				case VS_PAREN:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == '(') {
-			switch ( state ) {
-				case VS_SPACE2:
-					state = VS_PAREN;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == ')') {
-			switch ( state ) {
-				case VS_PAREN:
-					state = VS_PARENEND;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (d == ',') {
-			switch ( state ) {
-				case VS_HOST:
-				case VS_PORT:
-				case VS_PARENEND:
-					state = VS_DELIM;
-					break;
-				case VS_PAREN:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else {
-			rc = NGX_ERROR;
+		if (pn->boxed && ((ngx_msec_int_t) (pn->until - now) <= 0)) {
+			ngx_header_inspect_penalty_unbox(pn);
 		}
-		if ( rc == NGX_ERROR ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in Via header \"%s\"", i, value.data);
-			}
-			return NGX_ERROR;
+
+		if (pn->boxed == 0) {
+			pn->boxed = NGX_HEADER_INSPECT_PENALTY_REMOTE;
+			pn->until = until;
+			merged++;
+		} else if ((ngx_msec_int_t) (until - pn->until) > 0) {
+			pn->until = until;
 		}
 	}
-	switch ( state ) {
-		case VS_HOST:
-		case VS_PORT:
-		case VS_PARENEND:
-			break;
-		default:
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Via header \"%s\"", value.data);
-			}
-			return NGX_ERROR;
-	}
 
-	return NGX_OK;
+	ngx_shmtx_unlock(&pen->shpool->mutex);
+
+	return merged;
 }
 
-static ngx_int_t ngx_header_inspect_upgrade_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i = 0;
-	u_char d;
-	ngx_int_t rc = NGX_OK;
-	enum upgrade_header_states { UPS_START, UPS_PROD, UPS_SLASH, UPS_VER, UPS_DELIM, UPS_SPACE } state;
+static void ngx_header_inspect_sync_read(ngx_event_t *rev) {
+	ngx_header_inspect_sync_t *sync;
+	ngx_connection_t *c;
+	ngx_sockaddr_t sa;
+	socklen_t socklen;
+	ngx_err_t err;
+	ngx_uint_t merged, i;
+	ssize_t n;
+	size_t len;
+	u_char buf[NGX_HEADER_INSPECT_SYNC_DGRAM];
+	u_char text[NGX_SOCKADDR_STRLEN];
 
-	if ( value.len < 1 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Upgrade header \"%s\" too short", value.data);
+	c = rev->data;
+	sync = c->data;
+
+	for (i = 0; /* void */ ; i++) {
+		/* a flood of datagrams must not starve the requests, read the rest after them */
+		if (i == NGX_HEADER_INSPECT_SYNC_READS) {
+			ngx_post_event(rev, &ngx_posted_events);
+			return;
 		}
-		return NGX_ERROR;
-	}
 
-	state = UPS_START;
-	for ( i = 0; i < value.len ; i++ ) {
-		d = value.data[i];
+		socklen = sizeof(ngx_sockaddr_t);
 
-		if (
-			((d >= '0') && (d <= '9')) ||
-			((d >= 'a') && (d <= 'z')) ||
-			((d >= 'A') && (d <= 'Z')) ||
-			(d == '-') || (d == '.')
-		) {
-			switch ( state ) {
-				case UPS_START:
-				case UPS_SPACE:
-					state = UPS_PROD;
-					break;
-				case UPS_SLASH:
-					state = UPS_VER;
-					break;
-				case UPS_PROD:
-				case UPS_VER:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == '/' ) {
-			switch ( state ) {
-				case UPS_PROD:
-					state = UPS_SLASH;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ' ' ) {
-			switch ( state ) {
-				case UPS_DELIM:
-					state = UPS_SPACE;
-					break;
-				case UPS_SPACE:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ',' ) {
-			switch ( state ) {
-				case UPS_PROD:
-				case UPS_VER:
-					state = UPS_DELIM;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else {
-			rc = NGX_ERROR;
-		}
-		if ( rc == NGX_ERROR ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in Upgrade header \"%s\"", i, value.data);
+		n = recvfrom(c->fd, buf, sizeof(buf), 0, &sa.sockaddr, &socklen);
+		if (n == -1) {
+			err = ngx_socket_errno;
+			if (err == NGX_EINTR) {
+				continue;
 			}
-			return NGX_ERROR;
-		}
-	}
-	switch ( state ) {
-		case UPS_PROD:
-		case UPS_VER:
-			break;
-		default:
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Upgrade header \"%s\"", value.data);
+			if (err != NGX_EAGAIN) {
+				ngx_log_error(NGX_LOG_ALERT, c->log, err, "header_inspect: recvfrom() failed");
 			}
-			return NGX_ERROR;
+			break;
+		}
+
+		if (!ngx_header_inspect_sync_peer(sync, &sa.sockaddr, socklen)) {
+			continue;
+		}
+
+		merged = ngx_header_inspect_sync_merge(sync, buf, n);
+		if (merged) {
+			len = ngx_sock_ntop(&sa.sockaddr, socklen, text, NGX_SOCKADDR_STRLEN, 1);
+			ngx_log_error(NGX_LOG_INFO, c->log, 0, "header_inspect: %ui clients boxed by %*s", merged, len, text);
+		}
 	}
 
-	return NGX_OK;
+	if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+		/* opened again by the next timer */
+		ngx_close_connection(c);
+		sync->connection = NULL;
+	}
 }
 
-static ngx_int_t ngx_header_inspect_useragent_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i = 0;
-	u_char d;
-	ngx_int_t rc = NGX_OK;
-	enum useragent_header_states { UAS_START, UAS_PROD, UAS_SLASH, UAS_VER, UAS_SPACE, UAS_PAREN } state;
+/*
+ * Packs the clients boxed here into up to NGX_HEADER_INSPECT_SYNC_BATCH
+ * datagrams, and sends them to every peer.  What is packed goes to the
+ * tail of the boxed queue, so a longer queue is sent over several
+ * intervals.  The zone is not locked while sending.
+ */
+static void ngx_header_inspect_sync_send(ngx_header_inspect_sync_t *sync, ngx_log_t *log) {
+	ngx_header_inspect_penalty_t *pen = sync->penalty;
+	ngx_header_inspect_penalty_node_t *pn;
+	ngx_queue_t *q, *first;
+	ngx_addr_t *peer;
+	ngx_msec_t now;
+	ngx_msec_int_t left;
+	ngx_uint_t n, i, j, count, entries;
+	size_t len[NGX_HEADER_INSPECT_SYNC_BATCH], bytes;
+	ngx_err_t err;
+	uint32_t sent;
+	u_char *start, *p;
+
+	now = ngx_current_msec;
+	first = NULL;
+	n = 0;
+	count = 0;
+	entries = 0;
+	start = sync->buf;
+	p = start + NGX_HEADER_INSPECT_SYNC_HEADER;
+
+	ngx_shmtx_lock(&pen->shpool->mutex);
+
+	while (!ngx_queue_empty(&pen->sh->boxed)) {
+		q = ngx_queue_head(&pen->sh->boxed);
+		if (q == first) {
+			break;
+		}
 
+		pn = ngx_queue_data(q, ngx_header_inspect_penalty_node_t, box);
 
-	if ( value.len < 1 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: User-Agent header \"%s\" too short", value.data);
+		left = (ngx_msec_int_t) (pn->until - now);
+		if (left <= 0) {
+			ngx_header_inspect_penalty_unbox(pn);
+			continue;
 		}
-		return NGX_ERROR;
-	}
 
-	state = UAS_START;
-	for ( i = 0; i < value.len ; i++ ) {
-		d = value.data[i];
-		if (
-			((d >= '0') && (d <= '9')) ||
-			((d >= 'a') && (d <= 'z')) ||
-			((d >= 'A') && (d <= 'Z')) ||
-			(d == '-') || (d == '.')
-		) {
-			switch ( state ) {
-				case UAS_START:
-				case UAS_SPACE:
-					state = UAS_PROD;
-					break;
-				case UAS_PROD:
-				case UAS_VER:
-				case UAS_PAREN:
-					break;
-				case UAS_SLASH:
-					state = UAS_VER;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == '/' ) {
-			switch ( state ) {
-				case UAS_PROD:
-					state = UAS_SLASH;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ' ' ) {
-			switch ( state ) {
-				case UAS_VER:
-					state = UAS_SPACE;
-					break;
-				case UAS_SPACE:
-				case UAS_PAREN:
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == '(' ) {
-			switch ( state ) {
-				case UAS_SPACE:
-					state = UAS_PAREN;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if ( d == ')' ) {
-			switch ( state ) {
-				case UAS_PAREN:
-					state = UAS_SPACE;
-					break;
-				default:
-					rc = NGX_ERROR;
-			}
-		} else if (
-			(d == ',') || (d == ':') || (d == ';') ||
-			(d == '+') || (d == '_')
-		) {
-			switch ( state ) {
-				case UAS_PAREN:
-					break;
-				default:
-					rc = NGX_ERROR;
+		if ((pn->len <= 255) && (p + NGX_HEADER_INSPECT_SYNC_ENTRY + pn->len + NGX_HEADER_INSPECT_SYNC_MAC > start + NGX_HEADER_INSPECT_SYNC_DGRAM)) {
+			start[6] = (u_char) (count >> 8);
+			start[7] = (u_char) count;
+			len[n++] = p - start;
+			if (n == NGX_HEADER_INSPECT_SYNC_BATCH) {
+				break;
 			}
-		} else {
-			rc = NGX_ERROR;
+			count = 0;
+			start += NGX_HEADER_INSPECT_SYNC_DGRAM;
+			p = start + NGX_HEADER_INSPECT_SYNC_HEADER;
 		}
-		if ( rc == NGX_ERROR ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in User-Agent header \"%s\"", i, value.data);
-			}
-			return NGX_ERROR;
+
+		ngx_queue_remove(q);
+		ngx_queue_insert_tail(&pen->sh->boxed, q);
+		if (first == NULL) {
+			first = q;
+		}
+
+		/* the length of a key is sent in one byte */
+		if (pn->len > 255) {
+			continue;
 		}
+
+		*p++ = (u_char) ((ngx_msec_t) left >> 24);
+		*p++ = (u_char) ((ngx_msec_t) left >> 16);
+		*p++ = (u_char) ((ngx_msec_t) left >> 8);
+		*p++ = (u_char) left;
+		*p++ = (u_char) pn->len;
+		p = ngx_cpymem(p, pn->data, pn->len);
+		count++;
+		entries++;
 	}
-	switch ( state ) {
-		case UAS_SPACE:
-		case UAS_PROD:
-		case UAS_VER:
-			break;
-		default:
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of User-Agent header \"%s\"", value.data);
+
+	ngx_shmtx_unlock(&pen->shpool->mutex);
+
+	if (count && (n < NGX_HEADER_INSPECT_SYNC_BATCH)) {
+		start[6] = (u_char) (count >> 8);
+		start[7] = (u_char) count;
+		len[n++] = p - start;
+	}
+
+	if (entries == 0) {
+		return;
+	}
+
+	sent = (uint32_t) ngx_time();
+
+	bytes = 0;
+	for (j = 0; j < n; j++) {
+		p = sync->buf + j * NGX_HEADER_INSPECT_SYNC_DGRAM;
+		ngx_memcpy(p, NGX_HEADER_INSPECT_SYNC_MAGIC, 4);
+		p[4] = NGX_HEADER_INSPECT_SYNC_VERSION;
+		p[5] = 0;
+		p[8] = (u_char) (sent >> 24);
+		p[9] = (u_char) (sent >> 16);
+		p[10] = (u_char) (sent >> 8);
+		p[11] = (u_char) sent;
+		ngx_header_inspect_sync_mac(sync, p, len[j], p + len[j]);
+		len[j] += NGX_HEADER_INSPECT_SYNC_MAC;
+		bytes += len[j];
+	}
+
+	peer = sync->peers->elts;
+	for (i = 0; i < sync->peers->nelts; i++) {
+		for (j = 0; j < n; j++) {
+			if (sendto(sync->connection->fd, sync->buf + j * NGX_HEADER_INSPECT_SYNC_DGRAM, len[j], 0, peer[i].sockaddr, peer[i].socklen) == -1) {
+				err = ngx_socket_errno;
+				/* a full socket buffer loses the rest, they are sent again next time */
+				if (err != NGX_EAGAIN) {
+					ngx_log_error(NGX_LOG_ERR, log, err, "header_inspect: sendto() to %V failed", &peer[i].name);
+				}
+				break;
 			}
-			return NGX_ERROR;
+		}
 	}
 
-	return NGX_OK;
+	ngx_log_error(NGX_LOG_INFO, log, 0, "header_inspect: sent %ui boxed clients in %ui datagrams of %uz bytes to %ui peers", entries, n, bytes, sync->peers->nelts);
 }
 
-static ngx_int_t ngx_header_inspect_contentrange_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i = 0;
-	ngx_int_t rc = NGX_OK;
-	ngx_int_t a,b,c;
-	enum contentrange_header_states {RHS_START, RHS_STAR1, RHS_NUM1,DELIM,RHS_NUM2,RHS_SLASH,RHS_STAR2, RHS_NUM3} state;
+static ngx_int_t ngx_header_inspect_sync_open(ngx_header_inspect_sync_t *sync, ngx_log_t *log) {
+	ngx_connection_t *c;
+	ngx_socket_t s;
+	int reuse = 1;
 
-	if ( (value.len < 6) || (ngx_strncmp("bytes ", value.data, 6) != 0) ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Content-Range header \"%s\"  does not start with \"bytes \"", value.data);
+	s = ngx_socket(sync->listen.sockaddr->sa_family, SOCK_DGRAM, 0);
+	if (s == (ngx_socket_t) -1) {
+		if (!sync->failed) {
+			ngx_log_error(NGX_LOG_ALERT, log, ngx_socket_errno, "header_inspect: " ngx_socket_n " failed");
 		}
+		sync->failed = 1;
 		return NGX_ERROR;
 	}
-	if ( value.len < 9 ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: Content-Range header \"%s\" is too short", value.data);
+
+	/* the workers of a reload bind the same address as the old ones */
+	(void) setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const void *) &reuse, sizeof(int));
+#if (NGX_HAVE_REUSEPORT) && defined(SO_REUSEPORT)
+	(void) setsockopt(s, SOL_SOCKET, SO_REUSEPORT, (const void *) &reuse, sizeof(int));
+#endif
+
+	if ((ngx_nonblocking(s) == -1) || (bind(s, sync->listen.sockaddr, sync->listen.socklen) == -1)) {
+		if (!sync->failed) {
+			ngx_log_error(NGX_LOG_ALERT, log, ngx_socket_errno, "header_inspect: cannot listen on %V for inspect_headers_penalty_sync, retrying", &sync->listen.name);
 		}
+		sync->failed = 1;
+		ngx_close_socket(s);
 		return NGX_ERROR;
 	}
 
-	state = RHS_START;
-	a = -1;
-	b = -1;
-	c = -1;
+	c = ngx_get_connection(s, log);
+	if (c == NULL) {
+		ngx_close_socket(s);
+		return NGX_ERROR;
+	}
 
-	i = 6; /* start after "bytes " */
-	for ( ; i < value.len ; i++ ) {
-		switch ( value.data[i] ) {
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-				switch ( state ) {
-					case RHS_START:
-						state = RHS_NUM1;
-						a = (value.data[i] - '0');
-						break;
-					case RHS_NUM1:
-						a = a*10+(value.data[i] - '0');
-						break;
-					case RHS_NUM2:
-						b = b*10+(value.data[i] - '0');
-						break;
-					case RHS_NUM3:
-						c = c*10+(value.data[i] - '0');
-						break;
-					case DELIM:
-						state = RHS_NUM2;
-						b = (value.data[i] - '0');
-						break;
-					case RHS_SLASH:
-						state = RHS_NUM3;
-						c = (value.data[i] - '0');
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-				break;
-			case '*':
-				switch ( state ) {
-					case RHS_START:
-						state = RHS_STAR1;
-						break;
-					case RHS_SLASH:
-						state = RHS_STAR2;
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-				break;
-			case '/':
-				switch ( state ) {
-					case RHS_STAR1:
-					case RHS_NUM2:
-						state = RHS_SLASH;
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-				break;
-			case '-':
-				switch ( state ) {
-					case RHS_NUM1:
-						state = DELIM;
-						break;
-					default:
-						rc = NGX_ERROR;
-				}
-				break;
-			default:
-				rc = NGX_ERROR;
-		}
-		if ( rc == NGX_ERROR ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in Content-Range header \"%s\"", i, value.data);
-			}
-			return NGX_ERROR;
-		}
+	c->data = sync;
+	c->log = log;
+	c->read->log = log;
+	c->write->log = log;
+	c->read->handler = ngx_header_inspect_sync_read;
+
+	if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+		ngx_close_connection(c);
+		return NGX_ERROR;
 	}
-	switch ( state ) {
-		case RHS_NUM3:
-		case RHS_STAR2:
-			break;
-		default:
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Content-Range header \"%s\"", value.data);
-			}
-			return NGX_ERROR;
+
+	if (sync->failed) {
+		ngx_log_error(NGX_LOG_NOTICE, log, 0, "header_inspect: listening on %V for inspect_headers_penalty_sync", &sync->listen.name);
 	}
+	sync->failed = 0;
+	sync->connection = c;
 
-	/* in "a-b/c" ensure a < b and b < c if any of them are defined */
-	if ( (a != -1) && (b != -1) ) {
-		if ( (a >= b) || ((c != -1) && (b >= c)) ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal range specification in Content-Range header \"%s\"", value.data);
-			}
-			return NGX_ERROR;
-		}
+	return NGX_OK;
+}
+
+static void ngx_header_inspect_sync_timer(ngx_event_t *ev) {
+	ngx_header_inspect_sync_t *sync = ev->data;
+
+	if ((sync->connection != NULL) || (ngx_header_inspect_sync_open(sync, ev->log) == NGX_OK)) {
+		ngx_header_inspect_sync_send(sync, ev->log);
+	}
+
+	if (sync->rejected) {
+		ngx_log_error(NGX_LOG_WARN, ev->log, 0, "header_inspect: dropped %ui datagrams from peers with a bad MAC or time, check the secret and the clocks", sync->rejected);
+		sync->rejected = 0;
+	}
+
+	ngx_add_timer(ev, sync->interval);
+}
+
+static ngx_int_t ngx_header_inspect_init_process(ngx_cycle_t *cycle) {
+	ngx_header_inspect_main_conf_t *mcf;
+	ngx_header_inspect_stats_t *stats;
+
+	mcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_header_inspect_module);
+	if (mcf == NULL) {
+		return NGX_OK;
+	}
+
+	/* one socket per node: worker 0 sends and merges for all of them */
+	if (mcf->sync && (ngx_worker == 0) && ((ngx_process == NGX_PROCESS_WORKER) || (ngx_process == NGX_PROCESS_SINGLE))) {
+		mcf->sync->event.data = mcf->sync;
+		mcf->sync->event.handler = ngx_header_inspect_sync_timer;
+		mcf->sync->event.log = cycle->log;
+		mcf->sync->event.cancelable = 1;
+
+		(void) ngx_header_inspect_sync_open(mcf->sync, cycle->log);
+		ngx_add_timer(&mcf->sync->event, mcf->sync->interval);
 	}
 
+	if (mcf->stats == NULL) {
+		return NGX_OK;
+	}
+
+	stats = mcf->stats;
+	if (ngx_worker < stats->nworkers) {
+		/* whole cache lines per worker, so no two workers share one */
+		mcf->counters = (uint64_t *) ngx_align_ptr(stats->counters, ngx_cacheline_size) + ngx_worker * stats->stride;
+		/* the layout is in use while this pid runs, see ngx_header_inspect_stats_reap() */
+		stats->pids[ngx_worker] = (ngx_atomic_uint_t) ngx_pid;
+	}
+	mcf->census = stats->census;
+
 	return NGX_OK;
 }
 
-static ngx_int_t ngx_header_inspect_connection_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t i = 0;
+/* what is still buffered for inspect_headers_log, the inspect_headers_penalty_sync socket and the counter slot */
+static void ngx_header_inspect_exit_process(ngx_cycle_t *cycle) {
+	ngx_header_inspect_main_conf_t *mcf;
 
-	while ( i < value.len ) {
-		/* as per 13.5.1 of RFC2616 only allow Keep-Alive, Proxy-Authenticate, Proxy-Authorization, TE, Trailer, Transfer-Encoding and Upgrade headers in Connection header */
-		if ( ((i+5) <= value.len) && (ngx_strncmp("close", &(value.data[i]), 5) == 0 ) ) {
-			i += 5;
-		} else if ( ((i+10) <= value.len) && (ngx_strncmp("keep-alive", &(value.data[i]), 10) == 0 ) ) {
-			i += 10;
-		} else if ( ((i+10) <= value.len) && (ngx_strncmp("Keep-Alive", &(value.data[i]), 10) == 0 ) ) {
-			i += 10;
-		} else if ( ((i+18) <= value.len) && (ngx_strncmp("Proxy-Authenticate", &(value.data[i]), 18) == 0 ) ) {
-			i += 18;
-		} else if ( ((i+19) <= value.len) && (ngx_strncmp("Proxy-Authorization", &(value.data[i]), 19) == 0 ) ) {
-			i += 19;
-		} else if ( ((i+2) <= value.len) && (ngx_strncmp("TE", &(value.data[i]), 2) == 0 ) ) {
-			i += 2;
-		} else if ( ((i+7) <= value.len) && (ngx_strncmp("Trailer", &(value.data[i]), 7) == 0 ) ) {
-			i += 7;
-		} else if ( ((i+17) <= value.len) && (ngx_strncmp("Transfer-Encoding", &(value.data[i]), 17) == 0 ) ) {
-			i += 17;
-		} else if ( ((i+7) <= value.len) && (ngx_strncmp("Upgrade", &(value.data[i]), 7) == 0 ) ) {
-			i += 7;
-		} else {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal value at position %d in Connection header \"%s\"", i, value.data);
-			}
-			return NGX_ERROR;
-		}
+	mcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_header_inspect_module);
+	if (mcf == NULL) {
+		return;
+	}
 
-		if ( (i < value.len) && (value.data[i] == ' ') ) {
-			i++;
-		}
+	if (mcf->sync && mcf->sync->connection) {
+		ngx_close_connection(mcf->sync->connection);
+		mcf->sync->connection = NULL;
+	}
 
-		if ( i == value.len ) {
-			return NGX_OK;
+	if (mcf->vlog) {
+		ngx_header_inspect_log_flush_events(mcf->vlog, cycle->log);
+	}
+
+	if (mcf->counters) {
+		(void) ngx_atomic_cmp_set(&mcf->stats->pids[ngx_worker], (ngx_atomic_uint_t) ngx_pid, 0);
+		mcf->counters = NULL;
+	}
+}
+
+static ngx_str_t ngx_header_inspect_stat_names[] = {
+	ngx_string("inspected"),
+	ngx_string("bad_char"),
+	ngx_string("violation"),
+	ngx_string("blocked"),
+	ngx_string("stripped")
+};
+
+static ngx_str_t ngx_header_inspect_req_stat_names[] = {
+	ngx_string("requests"),
+	ngx_string("blocked"),
+	ngx_string("uninspected"),
+	ngx_string("stripped"),
+	ngx_string("penalized"),
+	ngx_string("limited")
+};
+
+/* parser timings of the headers seen at least once, as summed up by the status handler */
+static u_char *ngx_header_inspect_status_profile(u_char *p, ngx_header_inspect_main_conf_t *mcf, uint64_t *sum, ngx_uint_t prometheus) {
+	ngx_header_inspect_rule_t *rule;
+	ngx_str_t *name;
+	ngx_uint_t nrows, row, k, first = 1;
+	uint64_t *prof, count, bound;
+
+	nrows = mcf->stats->nrows;
+	rule = mcf->rules ? mcf->rules->elts : NULL;
+
+	if (prometheus) {
+		p = ngx_sprintf(p, "# TYPE nginx_header_inspect_parser_seconds histogram\n");
+	} else {
+		p = ngx_sprintf(p, ",\"profile\":{");
+	}
+
+	for (row = 0; row < nrows; row++) {
+		prof = &sum[ngx_header_inspect_prof(nrows, row, 0)];
+		if (prof[NGX_HEADER_INSPECT_PROF_CALLS] == 0) {
+			continue;
+		}
+		name = (row < NGX_HEADER_INSPECT_HDR_RULE) ? &ngx_header_inspect_headers[row].name : &rule[row - NGX_HEADER_INSPECT_HDR_RULE].header.name;
+
+		if (prometheus) {
+			/* cumulative buckets, le is the largest time in seconds falling into them */
+			count = 0;
+			for (k = 0; k < NGX_HEADER_INSPECT_HIST_BUCKETS - 1; k++) {
+				count += prof[NGX_HEADER_INSPECT_PROF_HIST + k];
+				bound = ngx_header_inspect_hist_bound(k) - 1;
+				p = ngx_sprintf(p, "nginx_header_inspect_parser_seconds_bucket{header=\"%V\",le=\"%uL.%09uL\"} %uL\n",
+					name, bound / 1000000000, bound % 1000000000, count);
+			}
+			p = ngx_sprintf(p, "nginx_header_inspect_parser_seconds_bucket{header=\"%V\",le=\"+Inf\"} %uL\n"
+				"nginx_header_inspect_parser_seconds_sum{header=\"%V\"} %uL.%09uL\n"
+				"nginx_header_inspect_parser_seconds_count{header=\"%V\"} %uL\n",
+				name, prof[NGX_HEADER_INSPECT_PROF_CALLS],
+				name, prof[NGX_HEADER_INSPECT_PROF_NSEC] / 1000000000, prof[NGX_HEADER_INSPECT_PROF_NSEC] % 1000000000,
+				name, prof[NGX_HEADER_INSPECT_PROF_CALLS]);
+			continue;
 		}
 
-		if ( (i < value.len) && (value.data[i] != ',') ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal character at position %d in Connection header \"%s\"", i, value.data);
+		/* the histogram as [ns bound, count] pairs for the buckets that are not empty */
+		p = ngx_sprintf(p, "%s\"%V\":{\"calls\":%uL,\"bytes\":%uL,\"ns\":%uL,\"histogram\":[",
+			first ? "" : ",", name, prof[NGX_HEADER_INSPECT_PROF_CALLS], prof[NGX_HEADER_INSPECT_PROF_BYTES], prof[NGX_HEADER_INSPECT_PROF_NSEC]);
+		first = 0;
+
+		count = 0;
+		for (k = 0; k < NGX_HEADER_INSPECT_HIST_BUCKETS; k++) {
+			if (prof[NGX_HEADER_INSPECT_PROF_HIST + k] == 0) {
+				continue;
 			}
-			return NGX_ERROR;
+			if (k == NGX_HEADER_INSPECT_HIST_BUCKETS - 1) {
+				p = ngx_sprintf(p, "%s[null,%uL]", count ? "," : "", prof[NGX_HEADER_INSPECT_PROF_HIST + k]);
+			} else {
+				p = ngx_sprintf(p, "%s[%uL,%uL]", count ? "," : "", ngx_header_inspect_hist_bound(k) - 1, prof[NGX_HEADER_INSPECT_PROF_HIST + k]);
+			}
+			count++;
 		}
-		i++;
+		p = ngx_sprintf(p, "]}");
+	}
+
+	if (!prometheus) {
+		*p++ = '}';
+		return p;
+	}
+
+	/* a metric family may not be split up, so the bytes come in a second pass */
+	p = ngx_sprintf(p, "# TYPE nginx_header_inspect_parser_bytes_total counter\n");
+	for (row = 0; row < nrows; row++) {
+		prof = &sum[ngx_header_inspect_prof(nrows, row, 0)];
+		if (prof[NGX_HEADER_INSPECT_PROF_CALLS] == 0) {
+			continue;
+		}
+		name = (row < NGX_HEADER_INSPECT_HDR_RULE) ? &ngx_header_inspect_headers[row].name : &rule[row - NGX_HEADER_INSPECT_HDR_RULE].header.name;
+
+		p = ngx_sprintf(p, "nginx_header_inspect_parser_bytes_total{header=\"%V\"} %uL\n", name, prof[NGX_HEADER_INSPECT_PROF_BYTES]);
+	}
+
+	return p;
+}
+
+static int ngx_libc_cdecl ngx_header_inspect_census_cmp(const void *one, const void *two) {
+	const ngx_header_inspect_census_top_t *a = one, *b = two;
+
+	if (a->count != b->count) {
+		return (a->count < b->count) ? 1 : -1;
+	}
+	return 0;
+}
+
+/* a copy of the top list, taken under the zone mutex and sorted by estimate */
+static ngx_header_inspect_census_top_t *ngx_header_inspect_census_snapshot(ngx_pool_t *pool, ngx_header_inspect_main_conf_t *mcf, ngx_uint_t *n) {
+	ngx_header_inspect_census_t *census;
+	ngx_header_inspect_census_entry_t *e;
+	ngx_header_inspect_census_top_t *top;
+	ngx_slab_pool_t *shpool;
+	ngx_uint_t k;
 
-		if ( (i < value.len) && (value.data[i] == ' ') ) {
-			i++;
-		}
+	census = mcf->stats->census;
+
+	top = ngx_palloc(pool, census->top * sizeof(ngx_header_inspect_census_top_t) + census->top * NGX_HEADER_INSPECT_CENSUS_NAME);
+	if (top == NULL) {
+		return NULL;
 	}
 
-	if ( conf->log ) {
-		ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Connection header \"%s\"", value.data);
+	shpool = (ngx_slab_pool_t *) mcf->zone->shm.addr;
+	ngx_shmtx_lock(&shpool->mutex);
+
+	*n = census->ntop;
+	for (k = 0; k < *n; k++) {
+		e = &census->entries[k];
+		top[k].name.data = (u_char *) &top[census->top] + k * NGX_HEADER_INSPECT_CENSUS_NAME;
+		top[k].name.len = e->len;
+		ngx_memcpy(top[k].name.data, e->name, e->len);
+		top[k].count = ngx_header_inspect_census_estimate(census, e->hash);
+		top[k].bytes = e->bytes;
+		top[k].max_len = e->max_len;
 	}
-	return NGX_ERROR;
+
+	ngx_shmtx_unlock(&shpool->mutex);
+
+	ngx_qsort(top, *n, sizeof(ngx_header_inspect_census_top_t), ngx_header_inspect_census_cmp);
+
+	return top;
 }
 
-static ngx_int_t ngx_header_inspect_accept_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
-	ngx_uint_t v;
+/* Prometheus label values only know \\, \" and \n, other bytes that are not printable become '?' */
+static u_char *ngx_header_inspect_escape_label(u_char *dst, u_char *src, size_t len) {
+	u_char c;
 
-	if (value.len == 0) {
-		return NGX_OK;
-	}
+	while (len--) {
+		c = *src++;
 
-	while ( i < value.len ) {
-		if (ngx_header_inspect_parse_mediatype(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid media-type at position %d in Accept header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
-		}
-		i += v;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
-		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
+		if ((c == '"') || (c == '\\')) {
+			*dst++ = '\\';
+			*dst++ = c;
+		} else if ((c < 0x20) || (c >= 0x7f)) {
+			*dst++ = '?';
+		} else {
+			*dst++ = c;
 		}
-		if (value.data[i] == ';') {
-			i++;
-			if (i >= value.len) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Accept header \"%s\"", value.data);
-				}
-				rc = NGX_ERROR;
-				break;
-			}
-			if ((value.data[i] == ' ') && (i < value.len)) {
-				i++;
-			}
-			if (ngx_header_inspect_parse_qvalue(&(value.data[i]), value.len-i, &v) != NGX_OK) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid qvalue at position %d in Accept header \"%s\"", i, value.data);
-				}
-				rc = NGX_ERROR;
-				break;
-			}
-			/* TODO: parse additional parameters */
-			i += v;
-			if ((value.data[i] == ' ') && (i < value.len)) {
-				i++;
-			}
-			if (i == value.len) {
-				rc = NGX_OK;
-				break;
-			}
+	}
+
+	return dst;
+}
+
+static u_char *ngx_header_inspect_status_census(u_char *p, ngx_header_inspect_census_t *census, ngx_header_inspect_census_top_t *top, ngx_uint_t n, ngx_uint_t prometheus) {
+	ngx_uint_t k;
+
+	/* client supplied names, so they are escaped */
+	if (prometheus) {
+		p = ngx_sprintf(p, "# TYPE nginx_header_inspect_uninspected_headers_total counter\n");
+		for (k = 0; k < n; k++) {
+			p = ngx_sprintf(p, "nginx_header_inspect_uninspected_headers_total{header=\"");
+			p = ngx_header_inspect_escape_label(p, top[k].name.data, top[k].name.len);
+			p = ngx_sprintf(p, "\"} %uL\n", top[k].count);
 		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Accept header \"%s\"", i, value.data);
-			}
-			rc = NGX_ERROR;
-			break;
+		if (!census->lengths) {
+			return p;
 		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+		p = ngx_sprintf(p, "# TYPE nginx_header_inspect_uninspected_value_bytes_total counter\n");
+		for (k = 0; k < n; k++) {
+			p = ngx_sprintf(p, "nginx_header_inspect_uninspected_value_bytes_total{header=\"");
+			p = ngx_header_inspect_escape_label(p, top[k].name.data, top[k].name.len);
+			p = ngx_sprintf(p, "\"} %uL\n", top[k].bytes);
 		}
+		return p;
 	}
 
-	if (rc == NGX_AGAIN) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Accept header \"%s\"", value.data);
+	p = ngx_sprintf(p, ",\"uninspected_headers\":[");
+	for (k = 0; k < n; k++) {
+		p = ngx_sprintf(p, "%s{\"header\":\"", k ? "," : "");
+		p = ngx_header_inspect_escape_json(p, top[k].name.data, top[k].name.len);
+		p = ngx_sprintf(p, "\",\"count\":%uL", top[k].count);
+		if (census->lengths) {
+			p = ngx_sprintf(p, ",\"bytes\":%uL,\"max_len\":%uL", top[k].bytes, top[k].max_len);
 		}
-		rc = NGX_ERROR;
+		*p++ = '}';
 	}
+	*p++ = ']';
 
-	return rc;
+	return p;
 }
 
-static ngx_int_t ngx_header_inspect_host_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	u_char d = '\0';
-	ngx_uint_t i = 0;
+static ngx_int_t ngx_header_inspect_status_handler(ngx_http_request_t *r) {
+	ngx_header_inspect_main_conf_t *mcf;
+	ngx_header_inspect_stats_t *stats;
+	ngx_header_inspect_header_t *header;
+	ngx_header_inspect_rule_t *rule;
+	ngx_header_inspect_census_top_t *top;
+	ngx_str_t *name, format;
+	ngx_uint_t prometheus, nrows, row, k, w, ntop;
+	uint64_t *sum, *slot;
+	ngx_buf_t *b;
+	ngx_chain_t out;
+	size_t len, ncounters;
+	ngx_int_t rc;
 
-	if ( value.len == 0 ) {
-		return NGX_OK;
+	if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+		return NGX_HTTP_NOT_ALLOWED;
 	}
 
-	if ( value.data[0] == '[' ) {
-		i++;
-		/* IPv6 address */
-		while ( i < value.len ) {
-			d = value.data[i];
-			if (
-				((d < '0') || (d > '9'))
-				&& ((d < 'a') || (d > 'z'))
-				&& ((d < 'A') || (d > 'Z'))
-				&& (d != ':') && (d != '.')
-				&& (d != ']')
-			) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Host header \"%s\"", i, value.data);
-				}
-				return NGX_ERROR;
-			}
-			if ( d == ']' ) {
-				break;
-			}
-			i++;
-		}
-		if ( d != ']' ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Host header \"%s\"", value.data);
-			}
-			return NGX_ERROR;
-		}
-		if ( i+1 < value.len ) {
-			d = value.data[i+1];
-		}
-		i++;
-	} else {
-		/* IPv4 address or domain name */
-		while ( i < value.len ) {
-			d = value.data[i];
+	rc = ngx_http_discard_request_body(r);
+	if (rc != NGX_OK) {
+		return rc;
+	}
 
-			if ( 
-				((d < '0') || (d > '9'))
-				&& ((d < 'a') || (d > 'z'))
-				&& ((d < 'A') || (d > 'Z'))
-				&& (d != '.') && (d != '-')
-				&& ((d != ':') || (i == 0))
-			) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Host header \"%s\"", i, value.data);
-				}
-				return NGX_ERROR;
-			}
-			if ( d == ':' ) {
-				break;
-			}
-			i++;
-		}
+	mcf = ngx_http_get_module_main_conf(r, ngx_http_header_inspect_module);
+	stats = mcf->stats;
+	if (stats == NULL) {
+		ngx_log_error(NGX_LOG_ERR, r->connection->log, 0, "header_inspect: inspect_headers_status needs an inspect_headers_zone");
+		return NGX_HTTP_NOT_FOUND;
 	}
 
-	if ( (d == ':') && (i+1 < value.len) ) {
-		i++;
-		for ( ; i < value.len ; i++ ) {
-			if ( (value.data[i] < '0') || (value.data[i] > '9') ) {
-				if ( conf->log ) {
-					ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Host header \"%s\"", i, value.data);
-				}
-				return NGX_ERROR;
-			}
-		}
+	prometheus = (ngx_http_arg(r, (u_char *) "format", 6, &format) == NGX_OK)
+		&& (format.len == 10) && (ngx_strncmp(format.data, "prometheus", 10) == 0);
+
+	/* add up the slots of all workers */
+	nrows = stats->nrows;
+	ncounters = ngx_header_inspect_stat(nrows, 0);
+	if (stats->profile) {
+		ncounters += nrows * NGX_HEADER_INSPECT_PROF_SIZE;
+	}
+	sum = ngx_pcalloc(r->pool, ncounters * sizeof(uint64_t));
+	if (sum == NULL) {
+		return NGX_HTTP_INTERNAL_SERVER_ERROR;
 	}
 
-	if ( i != value.len ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Host header \"%s\"", value.data);
+	slot = (uint64_t *) ngx_align_ptr(stats->counters, ngx_cacheline_size);
+	for (w = 0; w < stats->nworkers; w++, slot += stats->stride) {
+		for (k = 0; k < ncounters; k++) {
+			sum[k] += slot[k];
 		}
-		return NGX_ERROR;
 	}
 
-	return NGX_OK;
-}
+	/* the longest lines are the Prometheus ones, a header name and a number each */
+	len = 1024;
+	rule = mcf->rules ? mcf->rules->elts : NULL;
+	for (row = 0; row < nrows; row++) {
+		name = (row < NGX_HEADER_INSPECT_HDR_RULE) ? &ngx_header_inspect_headers[row].name : &rule[row - NGX_HEADER_INSPECT_HDR_RULE].header.name;
+		len += NGX_HEADER_INSPECT_NSTATS * (name->len + 128);
+		if (stats->profile) {
+			len += (NGX_HEADER_INSPECT_HIST_BUCKETS + 3) * (name->len + 128);
+		}
+	}
 
-static ngx_int_t ngx_header_inspect_allow_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_int_t rc = NGX_AGAIN;
-	ngx_uint_t i = 0;
+	/* a snapshot of the top list, by estimate */
+	top = NULL;
+	ntop = 0;
+	if (stats->census) {
+		top = ngx_header_inspect_census_snapshot(r->pool, mcf, &ntop);
+		if (top == NULL) {
+			return NGX_HTTP_INTERNAL_SERVER_ERROR;
+		}
+		/* names may have to be escaped, 6 bytes for one, and come in up to two lines */
+		len += ntop * 2 * (6 * NGX_HEADER_INSPECT_CENSUS_NAME + 128);
+	}
 
-	if ( value.len == 0 ) {
-		return NGX_OK;
+	b = ngx_create_temp_buf(r->pool, len);
+	if (b == NULL) {
+		return NGX_HTTP_INTERNAL_SERVER_ERROR;
 	}
 
-	while ( i < value.len ) {
-		if ( (i+3 <= value.len) && (ngx_strncmp("GET", &(value.data[i]), 3) == 0) ) {
-			i += 3;
-		} else if ( (i+4 <= value.len) && (ngx_strncmp("POST", &(value.data[i]), 4) == 0) ) {
-			i += 4;
-		} else if ( (i+3 <= value.len) && (ngx_strncmp("PUT", &(value.data[i]), 3) == 0) ) {
-			i += 3;
-		} else if ( (i+4 <= value.len) && (ngx_strncmp("HEAD", &(value.data[i]), 4) == 0) ) {
-			i += 4;
-		} else if ( (i+6 <= value.len) && (ngx_strncmp("DELETE", &(value.data[i]), 6) == 0) ) {
-			i += 6;
-		} else if ( (i+7 <= value.len) && (ngx_strncmp("OPTIONS", &(value.data[i]), 7) == 0) ) {
-			i += 7;
-		} else if ( (i+5 <= value.len) && (ngx_strncmp("TRACE", &(value.data[i]), 5) == 0) ) {
-			i += 5;
-		} else if ( (i+7 <= value.len) && (ngx_strncmp("CONNECT", &(value.data[i]), 7) == 0) ) {
-			i += 7;
-		} else {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal method at position %d in Allow header \"%s\"", i, value.data);
-				rc = NGX_ERROR;
-				break;
-			}
+	if (prometheus) {
+		for (k = 0; k < NGX_HEADER_INSPECT_NREQ_STATS; k++) {
+			b->last = ngx_sprintf(b->last, "# TYPE nginx_header_inspect_%V_total counter\n" "nginx_header_inspect_%V_total %uL\n",
+				&ngx_header_inspect_req_stat_names[k], &ngx_header_inspect_req_stat_names[k], sum[k]);
 		}
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+		b->last = ngx_sprintf(b->last, "# TYPE nginx_header_inspect_headers_total counter\n");
+	} else {
+		b->last = ngx_sprintf(b->last, "{");
+		for (k = 0; k < NGX_HEADER_INSPECT_NREQ_STATS; k++) {
+			b->last = ngx_sprintf(b->last, "\"%V\":%uL,", &ngx_header_inspect_req_stat_names[k], sum[k]);
 		}
-		if (i == value.len) {
-			rc = NGX_OK;
-			break;
+		b->last = ngx_sprintf(b->last, "\"headers\":{");
+	}
+
+	/* header names are tokens, nothing to escape */
+	for (row = 0; row < nrows; row++) {
+		if (row < NGX_HEADER_INSPECT_HDR_RULE) {
+			header = &ngx_header_inspect_headers[row];
+		} else {
+			header = &rule[row - NGX_HEADER_INSPECT_HDR_RULE].header;
 		}
-		if (value.data[i] != ',') {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: illegal char at position %d in Allow header \"%s\"", i, value.data);
+		slot = &sum[ngx_header_inspect_stat(row, 0)];
+
+		if (prometheus) {
+			for (k = 0; k < NGX_HEADER_INSPECT_NSTATS; k++) {
+				b->last = ngx_sprintf(b->last, "nginx_header_inspect_headers_total{header=\"%V\",result=\"%V\"} %uL\n",
+					&header->name, &ngx_header_inspect_stat_names[k], slot[k]);
 			}
-			rc = NGX_ERROR;
-			break;
+			continue;
 		}
-		i++;
-		if ((value.data[i] == ' ') && (i < value.len)) {
-			i++;
+
+		b->last = ngx_sprintf(b->last, "%s\"%V\":{", row ? "," : "", &header->name);
+		for (k = 0; k < NGX_HEADER_INSPECT_NSTATS; k++) {
+			b->last = ngx_sprintf(b->last, "%s\"%V\":%uL", k ? "," : "", &ngx_header_inspect_stat_names[k], slot[k]);
 		}
+		*b->last++ = '}';
 	}
-	if (rc == NGX_AGAIN) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: unexpected end of Allow header \"%s\"", value.data);
-		}
-		rc = NGX_ERROR;
+
+	if (!prometheus) {
+		*b->last++ = '}';
 	}
 
-	return rc;
-}
+	if (stats->profile) {
+		b->last = ngx_header_inspect_status_profile(b->last, mcf, sum, prometheus);
+	}
 
-static ngx_int_t ngx_header_inspect_ifrange_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, ngx_str_t value) {
-	ngx_uint_t v = 0;
+	if (stats->census) {
+		b->last = ngx_header_inspect_status_census(b->last, stats->census, top, ntop, prometheus);
+	}
 
-	if (((value.data[0] == 'W') && (value.data[1] == '/'))|| (value.data[0] == '"')) {
-	/* 1. entity-tag */
-		if ( (ngx_header_inspect_parse_entity_tag(value.data, value.len, &v) != NGX_OK) || (v != value.len) ) {
-			if ( conf->log ) {
-				ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid entity-tag in If-Range header \"%s\"", value.data);
-			}
-			return NGX_ERROR;
-		}
+	if (!prometheus) {
+		b->last = ngx_sprintf(b->last, "}\n");
+	}
+
+	r->headers_out.status = NGX_HTTP_OK;
+	r->headers_out.content_length_n = b->last - b->pos;
+	if (prometheus) {
+		ngx_str_set(&r->headers_out.content_type, "text/plain; version=0.0.4");
 	} else {
-	/* 2. HTTP-date */
-		return ngx_header_inspect_date_header(conf, log, "If-Range", value);
+		ngx_str_set(&r->headers_out.content_type, "application/json");
 	}
+	r->headers_out.content_type_len = r->headers_out.content_type.len;
 
-	return NGX_OK;
-}
+	rc = ngx_http_send_header(r);
+	if ((rc == NGX_ERROR) || (rc > NGX_OK) || r->header_only) {
+		return rc;
+	}
 
-static ngx_int_t ngx_header_inspect_date_header(ngx_header_inspect_loc_conf_t *conf, ngx_log_t *log, char *header, ngx_str_t value) {
-	ngx_uint_t v;
+	b->last_buf = (r == r->main) ? 1 : 0;
+	b->last_in_chain = 1;
 
-	/* HTTP-date */
-	if ( ngx_header_inspect_http_date(value.data, value.len, &v) != NGX_OK ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: invalid HTTP-date in \"%s\" header \"%s\"", header, value.data);
-		}
-		return NGX_ERROR;
-	}
-	if ( value.len != v ) {
-		if ( conf->log ) {
-			ngx_log_error(NGX_LOG_ALERT, log, 0, "header_inspect: trailing characters in \"%s\" header \"%s\"", header, value.data);
-		}
-		return NGX_ERROR;
-	}
+	out.buf = b;
+	out.next = NULL;
 
-	return NGX_OK;
+	return ngx_http_output_filter(r, &out);
 }
 
+static char *ngx_header_inspect_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+	ngx_http_core_loc_conf_t *clcf;
 
+	clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+	clcf->handler = ngx_header_inspect_status_handler;
 
-static ngx_int_t ngx_header_inspect_process_request(ngx_http_request_t *r) {
-	ngx_header_inspect_loc_conf_t *conf;
-	ngx_table_elt_t *h;
-	ngx_list_part_t *part;
-	ngx_uint_t i;
-	ngx_int_t rc;
+	return NGX_CONF_OK;
+}
 
-	conf = ngx_http_get_module_loc_conf(r, ngx_http_header_inspect_module);
+static void *ngx_header_inspect_create_main_conf(ngx_conf_t *cf) {
+	ngx_header_inspect_main_conf_t *mcf;
+	ngx_header_inspect_vocab_spec_t *spec;
+	ngx_uint_t k, n;
 
-	if (conf->inspect) {
-		part = &r->headers_in.headers.part;
-		do {
-			h = part->elts;
-			for (i = 0; i < part->nelts; i++) {
-				if ((h[i].key.len == 5) && (ngx_strcmp("Range", h[i].key.data) == 0)) {
-					rc = ngx_header_inspect_range_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 8) && (ngx_strcmp("If-Range", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_ifrange_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 19) && (ngx_strcmp("If-Unmodified-Since", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_date_header(conf, r->connection->log, "If-Unmodified-Since", h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 17) && (ngx_strcmp("If-Modified-Since", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_date_header(conf, r->connection->log, "If-Modified-Since", h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 4) && (ngx_strcmp("Date", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_date_header(conf, r->connection->log, "Date", h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 7) && (ngx_strcmp("Expires", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_date_header(conf, r->connection->log, "Expires", h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 13) && (ngx_strcmp("Last-Modified", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_date_header(conf, r->connection->log, "Last-Modified", h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 16) && (ngx_strcmp("Content-Encoding", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_contentencoding_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 15) && (ngx_strcmp("Accept-Encoding", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_acceptencoding_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 16) && (ngx_strcmp("Content-Language", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_contentlanguage_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 15) && (ngx_strcmp("Accept-Language", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_acceptlanguage_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 14) && (ngx_strcmp("Accept-Charset", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_acceptcharset_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 14) && (ngx_strcmp("Content-Length", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_digit_header("Content-Length", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 12) && (ngx_strcmp("Max-Forwards", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_digit_header("Max-Forwards", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 8) && (ngx_strcmp("If-Match", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_ifmatch_header("If-Match", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 13) && (ngx_strcmp("If-None-Match", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_ifmatch_header("If-None-Match", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 5) && (ngx_strcmp("Allow", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_allow_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 4) && (ngx_strcmp("Host", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_host_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 6) && (ngx_strcmp("Accept", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_accept_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 10) && (ngx_strcmp("Connection", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_connection_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 13) && (ngx_strcmp("Content-Range", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_contentrange_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 10) && (ngx_strcmp("User-Agent", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_useragent_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 7) && (ngx_strcmp("Upgrade", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_upgrade_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 3) && (ngx_strcmp("Via", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_via_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 4) && (ngx_strcmp("From", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_from_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 6) && (ngx_strcmp("Pragma", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_pragma_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 12) && (ngx_strcmp("Content-Type", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_contenttype_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 11) && (ngx_strcmp("Content-MD5", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_contentmd5_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 13) && (ngx_strcmp("Authorization", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_authorization_header("Authorization", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 19) && (ngx_strcmp("Proxy-Authorization", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_authorization_header("Proxy-Authorization", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 6) && (ngx_strcmp("Expect", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_expect_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 7) && (ngx_strcmp("Warning", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_warning_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 7) && (ngx_strcmp("Trailer", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_trailer_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 17) && (ngx_strcmp("Transfer-Encoding", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_transferencoding_header("Transfer-Encoding", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 2) && (ngx_strcmp("TE", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_transferencoding_header("TE", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 7) && (ngx_strcmp("Referer", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_referer_header("Referer", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 16) && (ngx_strcmp("Content-Location", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_referer_header("Content-Location", conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else if ((h[i].key.len == 13) && (ngx_strcmp("Cache-Control", h[i].key.data) == 0) ) {
-					rc = ngx_header_inspect_cachecontrol_header(conf, r->connection->log, h[i].value);
-					if ((rc != NGX_OK) && conf->block) {
-						return NGX_HTTP_BAD_REQUEST;
-					}
-				} else {
-					/* TODO: support for other headers */
-					if (conf->log_uninspected) {
-						ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0, "header_inspect: uninspected header \"%s: %s\"", h[i].key.data, h[i].value.data);
-					}
-				}
-			}
-			part = part->next;
-		} while ( part != NULL );
+	mcf = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_main_conf_t));
+	if (mcf == NULL) {
+		return NULL;
 	}
 
-	return NGX_DECLINED;
-}
+	/* lists not set by a directive fall back to these */
+	for (k = 0; k < NGX_HEADER_INSPECT_NVOCABS; k++) {
+		spec = &ngx_header_inspect_vocab_specs[k];
+		for (n = 0; spec->defaults[n].len; n++) {
+			/* void */
+		}
 
+		mcf->vocabs[k] = ngx_header_inspect_vocab_compile(cf, spec, spec->defaults, n);
+		if (mcf->vocabs[k] == NULL) {
+			return NULL;
+		}
+	}
 
+	return mcf;
+}
 
 static void *ngx_header_inspect_create_conf(ngx_conf_t *cf) {
 	ngx_header_inspect_loc_conf_t *conf;
+	ngx_uint_t k;
 
 	conf = ngx_pcalloc(cf->pool, sizeof(ngx_header_inspect_loc_conf_t));
 	if (conf == NULL) {
@@ -3534,8 +8565,23 @@ static void *ngx_header_inspect_create_conf(ngx_conf_t *cf) {
 	conf->log = NGX_CONF_UNSET;
 	conf->block = NGX_CONF_UNSET;
 	conf->log_uninspected = NGX_CONF_UNSET;
+	conf->strip = NGX_CONF_UNSET;
+	conf->allowlist = NGX_CONF_UNSET;
+	conf->profile = NGX_CONF_UNSET;
+	conf->phase = NGX_CONF_UNSET_UINT;
+	conf->reject = NGX_CONF_UNSET_PTR;
 
 	conf->range_max_byteranges = NGX_CONF_UNSET_UINT;
+	conf->max_content_length = NGX_CONF_UNSET;
+	conf->max_forwards = NGX_CONF_UNSET;
+	conf->max_age = NGX_CONF_UNSET;
+	conf->max_count = NGX_CONF_UNSET;
+	conf->max_total_size = NGX_CONF_UNSET_SIZE;
+	conf->duplicates = NGX_CONF_UNSET;
+
+	for (k = 0; k < NGX_HEADER_INSPECT_NVOCABS; k++) {
+		conf->vocabs[k] = NGX_CONF_UNSET_PTR;
+	}
 
 	return conf;
 }
@@ -3543,13 +8589,55 @@ static void *ngx_header_inspect_create_conf(ngx_conf_t *cf) {
 static char *ngx_header_inspect_merge_conf(ngx_conf_t *cf, void *parent, void *child) {
 	ngx_header_inspect_loc_conf_t *prev = parent;
 	ngx_header_inspect_loc_conf_t *conf = child;
+	ngx_header_inspect_main_conf_t *mcf;
+	ngx_uint_t k;
 
 	ngx_conf_merge_off_value(conf->inspect, prev->inspect, 0);
 	ngx_conf_merge_off_value(conf->log, prev->log, 1);
 	ngx_conf_merge_off_value(conf->block, prev->block, 0);
 	ngx_conf_merge_off_value(conf->log_uninspected, prev->log_uninspected, 0);
+	ngx_conf_merge_off_value(conf->strip, prev->strip, 0);
+	ngx_conf_merge_off_value(conf->allowlist, prev->allowlist, 0);
+	ngx_conf_merge_off_value(conf->profile, prev->profile, 0);
+	ngx_conf_merge_uint_value(conf->phase, prev->phase, NGX_HEADER_INSPECT_PHASE_REWRITE);
+	ngx_conf_merge_ptr_value(conf->reject, prev->reject, NULL);
 
 	ngx_conf_merge_uint_value(conf->range_max_byteranges, prev->range_max_byteranges, 5);
+	ngx_conf_merge_off_value(conf->max_content_length, prev->max_content_length, NGX_MAX_OFF_T_VALUE);
+	ngx_conf_merge_value(conf->max_forwards, prev->max_forwards, NGX_MAX_INT_T_VALUE);
+	ngx_conf_merge_sec_value(conf->max_age, prev->max_age, NGX_MAX_TIME_T_VALUE);
+	ngx_conf_merge_value(conf->max_count, prev->max_count, NGX_MAX_INT_T_VALUE);
+	ngx_conf_merge_size_value(conf->max_total_size, prev->max_total_size, NGX_MAX_SIZE_T_VALUE);
+	ngx_conf_merge_value(conf->duplicates, prev->duplicates, 0);
+
+	mcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_header_inspect_module);
+	for (k = 0; k < NGX_HEADER_INSPECT_NVOCABS; k++) {
+		ngx_conf_merge_ptr_value(conf->vocabs[k], prev->vocabs[k], mcf->vocabs[k]);
+	}
+
+	/* the http level is never merged itself, its policies are taken in here */
+	if (ngx_header_inspect_policy_merge(cf, mcf, prev, NULL) != NGX_OK) {
+		return NGX_CONF_ERROR;
+	}
+	if (ngx_header_inspect_policy_merge(cf, mcf, conf, prev) != NGX_OK) {
+		return NGX_CONF_ERROR;
+	}
+	if (ngx_header_inspect_max_len_merge(cf, mcf, prev, NULL) != NGX_OK) {
+		return NGX_CONF_ERROR;
+	}
+	if (ngx_header_inspect_max_len_merge(cf, mcf, conf, prev) != NGX_OK) {
+		return NGX_CONF_ERROR;
+	}
+
+	/* the zone only gets room for histograms if they are used */
+	if (conf->profile) {
+		mcf->profile = 1;
+	}
+
+	/* and the POST_READ handler is only there if a server needs it */
+	if (conf->inspect && (conf->phase == NGX_HEADER_INSPECT_PHASE_POST_READ)) {
+		mcf->post_read = 1;
+	}
 
 	return NGX_CONF_OK;
 }
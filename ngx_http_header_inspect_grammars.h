@@ -0,0 +1,2414 @@
+/*
+ * Generated by tools/abnf2c.py from the grammars directory, do not edit.
+ */
+
+/* Accept-Charset: 19 states, 11 byte classes, from grammars/accept-charset.abnf */
+static const u_char ngx_header_inspect_grammar_accept_charset_classes[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 1,  2,  0,  2,  2,  2,  2,  2,  0,  0,  2,  2,  3,  2,  4,  0,
+	 5,  6,  7,  7,  7,  7,  7,  7,  7,  7,  0,  8,  0,  9,  0,  0,
+	 0,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2, 10,  2,  2,  2,  2,  2,  2,  2,  2,  2,  0,  0,  0,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2, 10,  2,  2,  2,  2,  2,  2,  2,  2,  2,  0,  2,  0,  2,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static ngx_int_t ngx_header_inspect_grammar_accept_charset(ngx_str_t *value, ngx_uint_t *pos) {
+	const u_char *cls = ngx_header_inspect_grammar_accept_charset_classes;
+	u_char *p, *end;
+
+	p = value->data + *pos;
+	end = value->data + value->len;
+
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s2;
+		case 2:
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+		case 10:
+			p++;
+			goto s3;
+		default:
+			goto reject;
+	}
+
+s2:
+	while ((p != end) && ((0x0000000aU >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if ((0x000004f4U >> cls[*p]) & 1) {
+		p++;
+		goto s3;
+	}
+	goto reject;
+
+s3:
+	while ((p != end) && ((0x000004f4U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s5;
+		case 8:
+			p++;
+			goto s6;
+		default:
+			goto reject;
+	}
+
+s4:
+	while ((p != end) && (cls[*p] == 3)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+		case 10:
+			p++;
+			goto s3;
+		case 1:
+			p++;
+			goto s7;
+		default:
+			goto reject;
+	}
+
+s5:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 8:
+			p++;
+			goto s6;
+		default:
+			goto reject;
+	}
+
+s6:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 10) {
+		p++;
+		goto s8;
+	}
+	goto reject;
+
+s7:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 2:
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+		case 10:
+			p++;
+			goto s3;
+		case 3:
+			p++;
+			goto s4;
+		default:
+			goto reject;
+	}
+
+s8:
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 9) {
+		p++;
+		goto s9;
+	}
+	goto reject;
+
+s9:
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 5:
+			p++;
+			goto s10;
+		case 6:
+			p++;
+			goto s11;
+		default:
+			goto reject;
+	}
+
+s10:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		case 4:
+			p++;
+			goto s13;
+		default:
+			goto reject;
+	}
+
+s11:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		case 4:
+			p++;
+			goto s14;
+		default:
+			goto reject;
+	}
+
+s12:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 3) {
+		p++;
+		goto s4;
+	}
+	goto reject;
+
+s13:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		case 5:
+		case 6:
+		case 7:
+			p++;
+			goto s15;
+		default:
+			goto reject;
+	}
+
+s14:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		case 5:
+			p++;
+			goto s16;
+		default:
+			goto reject;
+	}
+
+s15:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		case 5:
+		case 6:
+		case 7:
+			p++;
+			goto s17;
+		default:
+			goto reject;
+	}
+
+s16:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		case 5:
+			p++;
+			goto s18;
+		default:
+			goto reject;
+	}
+
+s17:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		case 5:
+		case 6:
+		case 7:
+			p++;
+			goto s19;
+		default:
+			goto reject;
+	}
+
+s18:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		case 5:
+			p++;
+			goto s19;
+		default:
+			goto reject;
+	}
+
+s19:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s12;
+		default:
+			goto reject;
+	}
+
+accept:
+	*pos = p - value->data;
+	return NGX_OK;
+
+again:
+	*pos = p - value->data;
+	return NGX_AGAIN;
+
+reject:
+	*pos = p - value->data;
+	return NGX_DECLINED;
+}
+
+/* Accept-Language: 35 states, 13 byte classes, from grammars/accept-language.abnf */
+static const u_char ngx_header_inspect_grammar_accept_language_classes[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  3,  4,  5,  0,
+	 6,  7,  8,  8,  8,  8,  8,  8,  8,  8,  0,  9,  0, 10,  0,  0,
+	 0, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 12, 11, 11, 11, 11, 11, 11, 11, 11, 11,  0,  0,  0,  0,  0,
+	 0, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 12, 11, 11, 11, 11, 11, 11, 11, 11, 11,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static ngx_int_t ngx_header_inspect_grammar_accept_language(ngx_str_t *value, ngx_uint_t *pos) {
+	const u_char *cls = ngx_header_inspect_grammar_accept_language_classes;
+	u_char *p, *end;
+
+	p = value->data + *pos;
+	end = value->data + value->len;
+
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s2;
+		case 2:
+			p++;
+			goto s3;
+		case 11:
+		case 12:
+			p++;
+			goto s4;
+		default:
+			goto reject;
+	}
+
+s2:
+	while ((p != end) && ((0x0000000aU >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s3;
+		case 11:
+		case 12:
+			p++;
+			goto s4;
+		default:
+			goto reject;
+	}
+
+s3:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		default:
+			goto reject;
+	}
+
+s4:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 11:
+		case 12:
+			p++;
+			goto s9;
+		default:
+			goto reject;
+	}
+
+s5:
+	while ((p != end) && (cls[*p] == 3)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s3;
+		case 11:
+		case 12:
+			p++;
+			goto s4;
+		case 1:
+			p++;
+			goto s10;
+		default:
+			goto reject;
+	}
+
+s6:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 9:
+			p++;
+			goto s7;
+		default:
+			goto reject;
+	}
+
+s7:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 12) {
+		p++;
+		goto s11;
+	}
+	goto reject;
+
+s8:
+	if (p == end) {
+		goto again;
+	}
+	if ((0x000019c0U >> cls[*p]) & 1) {
+		p++;
+		goto s12;
+	}
+	goto reject;
+
+s9:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 11:
+		case 12:
+			p++;
+			goto s13;
+		default:
+			goto reject;
+	}
+
+s10:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s3;
+		case 11:
+		case 12:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		default:
+			goto reject;
+	}
+
+s11:
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 10) {
+		p++;
+		goto s14;
+	}
+	goto reject;
+
+s12:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 6:
+		case 7:
+		case 8:
+		case 11:
+		case 12:
+			p++;
+			goto s15;
+		default:
+			goto reject;
+	}
+
+s13:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 11:
+		case 12:
+			p++;
+			goto s16;
+		default:
+			goto reject;
+	}
+
+s14:
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 6:
+			p++;
+			goto s17;
+		case 7:
+			p++;
+			goto s18;
+		default:
+			goto reject;
+	}
+
+s15:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 6:
+		case 7:
+		case 8:
+		case 11:
+		case 12:
+			p++;
+			goto s19;
+		default:
+			goto reject;
+	}
+
+s16:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 11:
+		case 12:
+			p++;
+			goto s20;
+		default:
+			goto reject;
+	}
+
+s17:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		case 5:
+			p++;
+			goto s22;
+		default:
+			goto reject;
+	}
+
+s18:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		case 5:
+			p++;
+			goto s23;
+		default:
+			goto reject;
+	}
+
+s19:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 6:
+		case 7:
+		case 8:
+		case 11:
+		case 12:
+			p++;
+			goto s24;
+		default:
+			goto reject;
+	}
+
+s20:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 11:
+		case 12:
+			p++;
+			goto s25;
+		default:
+			goto reject;
+	}
+
+s21:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 3) {
+		p++;
+		goto s5;
+	}
+	goto reject;
+
+s22:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		case 6:
+		case 7:
+		case 8:
+			p++;
+			goto s26;
+		default:
+			goto reject;
+	}
+
+s23:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		case 6:
+			p++;
+			goto s27;
+		default:
+			goto reject;
+	}
+
+s24:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 6:
+		case 7:
+		case 8:
+		case 11:
+		case 12:
+			p++;
+			goto s28;
+		default:
+			goto reject;
+	}
+
+s25:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 11:
+		case 12:
+			p++;
+			goto s29;
+		default:
+			goto reject;
+	}
+
+s26:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		case 6:
+		case 7:
+		case 8:
+			p++;
+			goto s30;
+		default:
+			goto reject;
+	}
+
+s27:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		case 6:
+			p++;
+			goto s31;
+		default:
+			goto reject;
+	}
+
+s28:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 6:
+		case 7:
+		case 8:
+		case 11:
+		case 12:
+			p++;
+			goto s32;
+		default:
+			goto reject;
+	}
+
+s29:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 11:
+		case 12:
+			p++;
+			goto s33;
+		default:
+			goto reject;
+	}
+
+s30:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		case 6:
+		case 7:
+		case 8:
+			p++;
+			goto s34;
+		default:
+			goto reject;
+	}
+
+s31:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		case 6:
+			p++;
+			goto s34;
+		default:
+			goto reject;
+	}
+
+s32:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 6:
+		case 7:
+		case 8:
+		case 11:
+		case 12:
+			p++;
+			goto s35;
+		default:
+			goto reject;
+	}
+
+s33:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		default:
+			goto reject;
+	}
+
+s34:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s21;
+		default:
+			goto reject;
+	}
+
+s35:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 9:
+			p++;
+			goto s7;
+		case 4:
+			p++;
+			goto s8;
+		case 6:
+		case 7:
+		case 8:
+		case 11:
+		case 12:
+			p++;
+			goto s33;
+		default:
+			goto reject;
+	}
+
+accept:
+	*pos = p - value->data;
+	return NGX_OK;
+
+again:
+	*pos = p - value->data;
+	return NGX_AGAIN;
+
+reject:
+	*pos = p - value->data;
+	return NGX_DECLINED;
+}
+
+/* Accept: 14 states, 10 byte classes, from grammars/accept.abnf */
+static const u_char ngx_header_inspect_grammar_accept_classes[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 1,  2,  3,  2,  2,  2,  2,  2,  4,  4,  2,  2,  5,  2,  2,  6,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  4,  7,  4,  8,  4,  4,
+	 4,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  4,  9,  4,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  4,  2,  4,  2,  0,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+};
+
+static ngx_int_t ngx_header_inspect_grammar_accept(ngx_str_t *value, ngx_uint_t *pos) {
+	const u_char *cls = ngx_header_inspect_grammar_accept_classes;
+	u_char *p, *end;
+
+	p = value->data + *pos;
+	end = value->data + value->len;
+
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 5:
+			p++;
+			goto s2;
+		case 2:
+			p++;
+			goto s3;
+		default:
+			goto reject;
+	}
+
+s2:
+	while ((p != end) && ((0x00000022U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 2) {
+		p++;
+		goto s3;
+	}
+	goto reject;
+
+s3:
+	while ((p != end) && (cls[*p] == 2)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 6) {
+		p++;
+		goto s4;
+	}
+	goto reject;
+
+s4:
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 2) {
+		p++;
+		goto s5;
+	}
+	goto reject;
+
+s5:
+	while ((p != end) && (cls[*p] == 2)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 5:
+			p++;
+			goto s6;
+		case 1:
+			p++;
+			goto s7;
+		case 7:
+			p++;
+			goto s8;
+		default:
+			goto reject;
+	}
+
+s6:
+	while ((p != end) && (cls[*p] == 5)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s3;
+		case 1:
+			p++;
+			goto s9;
+		default:
+			goto reject;
+	}
+
+s7:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 5:
+			p++;
+			goto s6;
+		case 7:
+			p++;
+			goto s8;
+		default:
+			goto reject;
+	}
+
+s8:
+	while ((p != end) && ((0x00000082U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 5:
+			p++;
+			goto s6;
+		case 2:
+			p++;
+			goto s10;
+		default:
+			goto reject;
+	}
+
+s9:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s3;
+		case 5:
+			p++;
+			goto s6;
+		default:
+			goto reject;
+	}
+
+s10:
+	while ((p != end) && (cls[*p] == 2)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 8) {
+		p++;
+		goto s11;
+	}
+	goto reject;
+
+s11:
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s5;
+		case 3:
+			p++;
+			goto s12;
+		default:
+			goto reject;
+	}
+
+s12:
+	while ((p != end) && ((0x000001f6U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s13;
+		case 9:
+			p++;
+			goto s14;
+		default:
+			goto reject;
+	}
+
+s13:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 5:
+			p++;
+			goto s6;
+		case 1:
+			p++;
+			goto s7;
+		case 7:
+			p++;
+			goto s8;
+		default:
+			goto reject;
+	}
+
+s14:
+	if (p == end) {
+		goto again;
+	}
+	if ((0x000003feU >> cls[*p]) & 1) {
+		p++;
+		goto s12;
+	}
+	goto reject;
+
+accept:
+	*pos = p - value->data;
+	return NGX_OK;
+
+again:
+	*pos = p - value->data;
+	return NGX_AGAIN;
+
+reject:
+	*pos = p - value->data;
+	return NGX_DECLINED;
+}
+
+/* Content-Language: 21 states, 6 byte classes, from grammars/content-language.abnf */
+static const u_char ngx_header_inspect_grammar_content_language_classes[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  3,  0,  0,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  0,  0,  0,  0,  0,  0,
+	 0,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,
+	 5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  0,  0,  0,  0,  0,
+	 0,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,
+	 5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static ngx_int_t ngx_header_inspect_grammar_content_language(ngx_str_t *value, ngx_uint_t *pos) {
+	const u_char *cls = ngx_header_inspect_grammar_content_language_classes;
+	u_char *p, *end;
+
+	p = value->data + *pos;
+	end = value->data + value->len;
+
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s2;
+		case 5:
+			p++;
+			goto s3;
+		default:
+			goto reject;
+	}
+
+s2:
+	while ((p != end) && ((0x00000006U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 5) {
+		p++;
+		goto s3;
+	}
+	goto reject;
+
+s3:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 5:
+			p++;
+			goto s7;
+		default:
+			goto reject;
+	}
+
+s4:
+	while ((p != end) && (cls[*p] == 2)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 5:
+			p++;
+			goto s3;
+		case 1:
+			p++;
+			goto s8;
+		default:
+			goto reject;
+	}
+
+s5:
+	if (p == end) {
+		goto again;
+	}
+	if ((0x00000030U >> cls[*p]) & 1) {
+		p++;
+		goto s9;
+	}
+	goto reject;
+
+s6:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 2) {
+		p++;
+		goto s4;
+	}
+	goto reject;
+
+s7:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 5:
+			p++;
+			goto s10;
+		default:
+			goto reject;
+	}
+
+s8:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 5:
+			p++;
+			goto s3;
+		case 2:
+			p++;
+			goto s4;
+		default:
+			goto reject;
+	}
+
+s9:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 4:
+		case 5:
+			p++;
+			goto s11;
+		default:
+			goto reject;
+	}
+
+s10:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 5:
+			p++;
+			goto s12;
+		default:
+			goto reject;
+	}
+
+s11:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 4:
+		case 5:
+			p++;
+			goto s13;
+		default:
+			goto reject;
+	}
+
+s12:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 5:
+			p++;
+			goto s14;
+		default:
+			goto reject;
+	}
+
+s13:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 4:
+		case 5:
+			p++;
+			goto s15;
+		default:
+			goto reject;
+	}
+
+s14:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 5:
+			p++;
+			goto s16;
+		default:
+			goto reject;
+	}
+
+s15:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 4:
+		case 5:
+			p++;
+			goto s17;
+		default:
+			goto reject;
+	}
+
+s16:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 5:
+			p++;
+			goto s18;
+		default:
+			goto reject;
+	}
+
+s17:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 4:
+		case 5:
+			p++;
+			goto s19;
+		default:
+			goto reject;
+	}
+
+s18:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 5:
+			p++;
+			goto s20;
+		default:
+			goto reject;
+	}
+
+s19:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 4:
+		case 5:
+			p++;
+			goto s21;
+		default:
+			goto reject;
+	}
+
+s20:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		default:
+			goto reject;
+	}
+
+s21:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		case 4:
+		case 5:
+			p++;
+			goto s20;
+		default:
+			goto reject;
+	}
+
+accept:
+	*pos = p - value->data;
+	return NGX_OK;
+
+again:
+	*pos = p - value->data;
+	return NGX_AGAIN;
+
+reject:
+	*pos = p - value->data;
+	return NGX_DECLINED;
+}
+
+/* Content-Type: 11 states, 9 byte classes, from grammars/content-type.abnf */
+static const u_char ngx_header_inspect_grammar_content_type_classes[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 1,  2,  3,  2,  2,  2,  2,  2,  4,  4,  2,  2,  4,  2,  2,  5,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  4,  6,  4,  7,  4,  4,
+	 4,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  4,  8,  4,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  4,  2,  4,  2,  0,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+};
+
+static ngx_int_t ngx_header_inspect_grammar_content_type(ngx_str_t *value, ngx_uint_t *pos) {
+	const u_char *cls = ngx_header_inspect_grammar_content_type_classes;
+	u_char *p, *end;
+
+	p = value->data + *pos;
+	end = value->data + value->len;
+
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 2) {
+		p++;
+		goto s2;
+	}
+	goto reject;
+
+s2:
+	while ((p != end) && (cls[*p] == 2)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 5) {
+		p++;
+		goto s3;
+	}
+	goto reject;
+
+s3:
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 2) {
+		p++;
+		goto s4;
+	}
+	goto reject;
+
+s4:
+	while ((p != end) && (cls[*p] == 2)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 6:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		default:
+			goto reject;
+	}
+
+s5:
+	while ((p != end) && ((0x00000042U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	if (cls[*p] == 2) {
+		p++;
+		goto s7;
+	}
+	goto reject;
+
+s6:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 6) {
+		p++;
+		goto s5;
+	}
+	goto reject;
+
+s7:
+	while ((p != end) && (cls[*p] == 2)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 7) {
+		p++;
+		goto s8;
+	}
+	goto reject;
+
+s8:
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 2:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s9;
+		default:
+			goto reject;
+	}
+
+s9:
+	while ((p != end) && ((0x000000f6U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 3:
+			p++;
+			goto s10;
+		case 8:
+			p++;
+			goto s11;
+		default:
+			goto reject;
+	}
+
+s10:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 6:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s6;
+		default:
+			goto reject;
+	}
+
+s11:
+	if (p == end) {
+		goto again;
+	}
+	if ((0x000001feU >> cls[*p]) & 1) {
+		p++;
+		goto s9;
+	}
+	goto reject;
+
+accept:
+	*pos = p - value->data;
+	return NGX_OK;
+
+again:
+	*pos = p - value->data;
+	return NGX_AGAIN;
+
+reject:
+	*pos = p - value->data;
+	return NGX_DECLINED;
+}
+
+/* If-Match: 10 states, 8 byte classes, from grammars/if-match.abnf */
+static const u_char ngx_header_inspect_grammar_if_match_classes[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 1,  2,  3,  2,  2,  2,  2,  2,  2,  2,  4,  2,  5,  2,  2,  6,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  7,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  0,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+};
+
+static ngx_int_t ngx_header_inspect_grammar_if_match(ngx_str_t *value, ngx_uint_t *pos) {
+	const u_char *cls = ngx_header_inspect_grammar_if_match_classes;
+	u_char *p, *end;
+
+	p = value->data + *pos;
+	end = value->data + value->len;
+
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 4:
+			p++;
+			goto s2;
+		case 7:
+			p++;
+			goto s3;
+		case 5:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		default:
+			goto reject;
+	}
+
+s2:
+	if (p == end) {
+		goto accept;
+	}
+	goto reject;
+
+s3:
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 6) {
+		p++;
+		goto s6;
+	}
+	goto reject;
+
+s4:
+	while ((p != end) && ((0x00000022U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 7:
+			p++;
+			goto s3;
+		case 3:
+			p++;
+			goto s5;
+		default:
+			goto reject;
+	}
+
+s5:
+	while ((p != end) && ((0x000000f4U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 3) {
+		p++;
+		goto s7;
+	}
+	goto reject;
+
+s6:
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 3) {
+		p++;
+		goto s5;
+	}
+	goto reject;
+
+s7:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 1:
+			p++;
+			goto s8;
+		case 5:
+			p++;
+			goto s9;
+		default:
+			goto reject;
+	}
+
+s8:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 5) {
+		p++;
+		goto s9;
+	}
+	goto reject;
+
+s9:
+	while ((p != end) && (cls[*p] == 5)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 7:
+			p++;
+			goto s3;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s10;
+		default:
+			goto reject;
+	}
+
+s10:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 7:
+			p++;
+			goto s3;
+		case 3:
+			p++;
+			goto s5;
+		case 5:
+			p++;
+			goto s9;
+		default:
+			goto reject;
+	}
+
+accept:
+	*pos = p - value->data;
+	return NGX_OK;
+
+again:
+	*pos = p - value->data;
+	return NGX_AGAIN;
+
+reject:
+	*pos = p - value->data;
+	return NGX_DECLINED;
+}
+
+/* If-None-Match: 10 states, 8 byte classes, from grammars/if-none-match.abnf */
+static const u_char ngx_header_inspect_grammar_if_none_match_classes[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 1,  2,  3,  2,  2,  2,  2,  2,  2,  2,  4,  2,  5,  2,  2,  6,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  7,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  0,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+};
+
+static ngx_int_t ngx_header_inspect_grammar_if_none_match(ngx_str_t *value, ngx_uint_t *pos) {
+	const u_char *cls = ngx_header_inspect_grammar_if_none_match_classes;
+	u_char *p, *end;
+
+	p = value->data + *pos;
+	end = value->data + value->len;
+
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 4:
+			p++;
+			goto s2;
+		case 7:
+			p++;
+			goto s3;
+		case 5:
+			p++;
+			goto s4;
+		case 3:
+			p++;
+			goto s5;
+		default:
+			goto reject;
+	}
+
+s2:
+	if (p == end) {
+		goto accept;
+	}
+	goto reject;
+
+s3:
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 6) {
+		p++;
+		goto s6;
+	}
+	goto reject;
+
+s4:
+	while ((p != end) && ((0x00000022U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 7:
+			p++;
+			goto s3;
+		case 3:
+			p++;
+			goto s5;
+		default:
+			goto reject;
+	}
+
+s5:
+	while ((p != end) && ((0x000000f4U >> cls[*p]) & 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 3) {
+		p++;
+		goto s7;
+	}
+	goto reject;
+
+s6:
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 3) {
+		p++;
+		goto s5;
+	}
+	goto reject;
+
+s7:
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 1:
+			p++;
+			goto s8;
+		case 5:
+			p++;
+			goto s9;
+		default:
+			goto reject;
+	}
+
+s8:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	if (cls[*p] == 5) {
+		p++;
+		goto s9;
+	}
+	goto reject;
+
+s9:
+	while ((p != end) && (cls[*p] == 5)) {
+		p++;
+	}
+	if (p == end) {
+		goto accept;
+	}
+	switch (cls[*p]) {
+		case 7:
+			p++;
+			goto s3;
+		case 3:
+			p++;
+			goto s5;
+		case 1:
+			p++;
+			goto s10;
+		default:
+			goto reject;
+	}
+
+s10:
+	while ((p != end) && (cls[*p] == 1)) {
+		p++;
+	}
+	if (p == end) {
+		goto again;
+	}
+	switch (cls[*p]) {
+		case 7:
+			p++;
+			goto s3;
+		case 3:
+			p++;
+			goto s5;
+		case 5:
+			p++;
+			goto s9;
+		default:
+			goto reject;
+	}
+
+accept:
+	*pos = p - value->data;
+	return NGX_OK;
+
+again:
+	*pos = p - value->data;
+	return NGX_AGAIN;
+
+reject:
+	*pos = p - value->data;
+	return NGX_DECLINED;
+}
@@ -0,0 +1,542 @@
+#!/usr/bin/env python3
+#
+# Compiles the header grammars in grammars/*.abnf into minimized DFAs and
+# writes each one out as a C function with a label per state.
+#
+#	abnf2c.py -o ngx_http_header_inspect_grammars.h -I grammars/common grammars/*.abnf
+#
+# Every file given on the command line emits its first rule, rules from
+# the -I directories are only available for reference.  The grammars must
+# be regular: a rule may not refer to itself, directly or not.
+#
+# ABNF as in RFC 5234, plus the list extension of RFC 9110 section 5.6.1
+# ("#element" and "1#element", in the lenient recipient form).  Quoted
+# strings are case-insensitive unless written as %s"...".
+
+import argparse
+import os
+import re
+import sys
+
+ALL = (1 << 256) - 1
+
+
+def bits(lo, hi=None):
+    if hi is None:
+        hi = lo
+    return ((1 << (hi + 1)) - 1) ^ ((1 << lo) - 1)
+
+
+def charset(chars):
+    s = 0
+    for c in chars:
+        s |= 1 << c
+    return s
+
+
+# RFC 5234 appendix B.1
+CORE = {
+    'ALPHA': ('set', bits(0x41, 0x5a) | bits(0x61, 0x7a)),
+    'BIT': ('set', charset(b'01')),
+    'CHAR': ('set', bits(0x01, 0x7f)),
+    'CR': ('set', bits(0x0d)),
+    'CTL': ('set', bits(0x00, 0x1f) | bits(0x7f)),
+    'DIGIT': ('set', bits(0x30, 0x39)),
+    'DQUOTE': ('set', bits(0x22)),
+    'HEXDIG': ('set', bits(0x30, 0x39) | charset(b'ABCDEFabcdef')),
+    'HTAB': ('set', bits(0x09)),
+    'LF': ('set', bits(0x0a)),
+    'OCTET': ('set', ALL),
+    'SP': ('set', bits(0x20)),
+    'VCHAR': ('set', bits(0x21, 0x7e)),
+    'WSP': ('set', bits(0x20) | bits(0x09)),
+}
+
+
+class GrammarError(Exception):
+    pass
+
+
+TOKEN = re.compile(r'''
+      (?P<ws>\s+)
+    | (?P<comment>;[^\n]*)
+    | (?P<defas>=/|=)
+    | (?P<repeat>\d*\*\d*|\d*\#\d*|\d+)
+    | (?P<name>[A-Za-z][A-Za-z0-9-]*)
+    | (?P<string>%[si])?"(?P<chars>[^"]*)"
+    | (?P<num>%[xdb][0-9A-Fa-f]+(?:-[0-9A-Fa-f]+|(?:\.[0-9A-Fa-f]+)+)?)
+    | (?P<punct>[/()\[\]])
+    | (?P<prose><[^>]*>)
+''', re.X)
+
+
+def tokenize(text, where):
+    pos = 0
+    out = []
+    while pos < len(text):
+        m = TOKEN.match(text, pos)
+        if m is None:
+            raise GrammarError('%s: cannot parse "%s"' % (where, text[pos:pos + 20]))
+        pos = m.end()
+        kind = m.lastgroup
+        if kind in ('ws', 'comment'):
+            continue
+        if kind == 'prose':
+            raise GrammarError('%s: prose values are not supported' % where)
+        if kind == 'chars':
+            out.append(('string', (m.group('string') or '%i', m.group('chars'))))
+        else:
+            out.append((kind, m.group(kind)))
+    return out
+
+
+def numval(text):
+    base = {'x': 16, 'd': 10, 'b': 2}[text[1]]
+    body = text[2:]
+    if '-' in body:
+        lo, hi = (int(v, base) for v in body.split('-'))
+        return ('set', bits(lo, hi))
+    return ('cat', [('set', bits(int(v, base))) for v in body.split('.')])
+
+
+def literal(kind, chars):
+    items = []
+    for ch in chars.encode('latin-1'):
+        s = bits(ch)
+        if kind == '%i' and chr(ch).isalpha():
+            s |= bits(ord(chr(ch).swapcase()))
+        items.append(('set', s))
+    return ('cat', items)
+
+
+class Parser:
+    def __init__(self, tokens, where):
+        self.tokens = tokens
+        self.pos = 0
+        self.where = where
+
+    def peek(self):
+        return self.tokens[self.pos] if self.pos < len(self.tokens) else (None, None)
+
+    def take(self, kind, value=None):
+        k, v = self.peek()
+        if k != kind or (value is not None and v != value):
+            raise GrammarError('%s: expected %s, got "%s"' % (self.where, value or kind, v))
+        self.pos += 1
+        return v
+
+    def alternation(self):
+        alts = [self.concatenation()]
+        while self.peek() == ('punct', '/'):
+            self.pos += 1
+            alts.append(self.concatenation())
+        return alts[0] if len(alts) == 1 else ('alt', alts)
+
+    def concatenation(self):
+        items = []
+        while True:
+            k, v = self.peek()
+            if k is None or (k == 'punct' and v in '/)]'):
+                break
+            items.append(self.repetition())
+        if not items:
+            raise GrammarError('%s: empty concatenation' % self.where)
+        return items[0] if len(items) == 1 else ('cat', items)
+
+    def repetition(self):
+        k, v = self.peek()
+        if k != 'repeat':
+            return self.element()
+        self.pos += 1
+        e = self.element()
+        if '#' in v:
+            lo, hi = v.split('#')
+            if hi != '' or lo not in ('', '0', '1'):
+                raise GrammarError('%s: only #element and 1#element lists are supported' % self.where)
+            # 1#element => *( "," OWS ) element *( OWS "," [ OWS element ] )
+            comma = ('set', bits(0x2c))
+            ows = ('ref', 'OWS')
+            lst = ('cat', [('rep', 0, None, ('cat', [comma, ows])), e,
+                           ('rep', 0, None, ('cat', [ows, comma, ('rep', 0, 1, ('cat', [ows, e]))]))])
+            return lst if lo == '1' else ('rep', 0, 1, lst)
+        if '*' in v:
+            lo, hi = v.split('*')
+            return ('rep', int(lo or 0), int(hi) if hi else None, e)
+        return ('rep', int(v), int(v), e)
+
+    def element(self):
+        k, v = self.peek()
+        self.pos += 1
+        if k == 'name':
+            return ('ref', v)
+        if k == 'string':
+            return literal(*v)
+        if k == 'num':
+            return numval(v)
+        if (k, v) == ('punct', '('):
+            e = self.alternation()
+            self.take('punct', ')')
+            return e
+        if (k, v) == ('punct', '['):
+            e = self.alternation()
+            self.take('punct', ']')
+            return ('rep', 0, 1, e)
+        raise GrammarError('%s: unexpected "%s"' % (self.where, v))
+
+
+def load(path, rules):
+    """Parses a file into rules, returns the name of its first rule."""
+    with open(path, encoding='latin-1') as f:
+        text = f.read()
+
+    # a rule continues on indented lines
+    chunks = []
+    for lineno, line in enumerate(text.split('\n'), 1):
+        if line.strip() == '' or line.lstrip().startswith(';'):
+            continue
+        if line[0] in ' \t':
+            if not chunks:
+                raise GrammarError('%s:%d: continuation without a rule' % (path, lineno))
+            chunks[-1][1].append(line)
+        else:
+            chunks.append((lineno, [line]))
+
+    first = None
+    for lineno, lines in chunks:
+        where = '%s:%d' % (path, lineno)
+        tokens = tokenize('\n'.join(lines), where)
+        if len(tokens) < 3 or tokens[0][0] != 'name' or tokens[1][0] != 'defas':
+            raise GrammarError('%s: expected "rulename = elements"' % where)
+        p = Parser(tokens[2:], where)
+        e = p.alternation()
+        if p.pos != len(p.tokens):
+            raise GrammarError('%s: trailing "%s"' % (where, p.peek()[1]))
+        name = tokens[0][1].lower()
+        if tokens[1][1] == '=/':
+            if name not in rules:
+                raise GrammarError('%s: "=/" for undefined rule %s' % (where, tokens[0][1]))
+            rules[name] = (rules[name][0], ('alt', [rules[name][1], e]))
+        else:
+            if name in rules:
+                raise GrammarError('%s: rule %s redefined' % (where, tokens[0][1]))
+            rules[name] = (tokens[0][1], e)
+        if first is None:
+            first = tokens[0][1]
+    return first
+
+
+class NFA:
+    def __init__(self, rules):
+        self.rules = rules
+        self.eps = []
+        self.edges = []
+        self.active = []
+
+    def state(self):
+        self.eps.append([])
+        self.edges.append([])
+        return len(self.eps) - 1
+
+    def build(self, e, s, t):
+        """Adds e between the states s and t."""
+        kind = e[0]
+        if kind == 'set':
+            self.edges[s].append((e[1], t))
+        elif kind == 'cat':
+            if not e[1]:
+                self.eps[s].append(t)
+            for i, item in enumerate(e[1]):
+                m = t if i == len(e[1]) - 1 else self.state()
+                self.build(item, s, m)
+                s = m
+        elif kind == 'alt':
+            for item in e[1]:
+                a, b = self.state(), self.state()
+                self.eps[s].append(a)
+                self.eps[b].append(t)
+                self.build(item, a, b)
+        elif kind == 'rep':
+            _, lo, hi, item = e
+            for _ in range(lo):
+                m = self.state()
+                self.build(item, s, m)
+                s = m
+            if hi is None:
+                a, b = self.state(), self.state()
+                self.eps[s].append(a)
+                self.eps[b].append(a)
+                self.eps[a].append(t)
+                self.build(item, a, b)
+            else:
+                for _ in range(hi - lo):
+                    self.eps[s].append(t)
+                    m = self.state()
+                    self.build(item, s, m)
+                    s = m
+                self.eps[s].append(t)
+        elif kind == 'ref':
+            name = e[1].lower()
+            if name not in self.rules and name.upper() in CORE:
+                return self.build(CORE[name.upper()], s, t)
+            if name not in self.rules:
+                raise GrammarError('undefined rule %s' % e[1])
+            if name in self.active:
+                raise GrammarError('rule %s is recursive, only regular grammars are supported' % e[1])
+            self.active.append(name)
+            self.build(self.rules[name][1], s, t)
+            self.active.pop()
+
+
+def closure(nfa, states):
+    stack = list(states)
+    seen = set(states)
+    while stack:
+        for t in nfa.eps[stack.pop()]:
+            if t not in seen:
+                seen.add(t)
+                stack.append(t)
+    return frozenset(seen)
+
+
+def partition(sets):
+    """Splits the byte range into blocks that no set cuts through."""
+    blocks = [ALL]
+    for s in sets:
+        out = []
+        for b in blocks:
+            for part in (b & s, b & ~s):
+                if part:
+                    out.append(part)
+        blocks = out
+    return blocks
+
+
+def compile_rule(rules, name):
+    nfa = NFA(rules)
+    start, final = nfa.state(), nfa.state()
+    nfa.build(('ref', name), start, final)
+
+    blocks = partition({s for edges in nfa.edges for s, _ in edges})
+    lowest = [(b & -b).bit_length() - 1 for b in blocks]
+
+    # subset construction, states are sets of NFA states
+    dead = frozenset()
+    first = closure(nfa, [start])
+    index = {dead: 0, first: 1}
+    order = [dead, first]
+    trans = []
+    i = 0
+    while i < len(order):
+        cur = order[i]
+        row = []
+        for c in lowest:
+            nxt = set()
+            for s in sorted(cur):
+                for cs, t in nfa.edges[s]:
+                    if cs >> c & 1:
+                        nxt.add(t)
+            nxt = closure(nfa, nxt) if nxt else dead
+            if nxt not in index:
+                index[nxt] = len(order)
+                order.append(nxt)
+            row.append(index[nxt])
+        trans.append(row)
+        i += 1
+    accept = [final in s for s in order]
+
+    # Moore minimization, the dead and the start state keep their numbers
+    group = [0 if not accept[s] else 1 for s in range(len(order))]
+    while True:
+        sig = {}
+        new = []
+        for s in range(len(order)):
+            key = (group[s], tuple(group[t] for t in trans[s]))
+            new.append(sig.setdefault(key, len(sig)))
+        if len(sig) == len(set(group)):
+            break
+        group = new
+
+    if group[0] == group[1]:
+        raise GrammarError('rule %s matches nothing' % name)
+    if len(sig) > 255:
+        raise GrammarError('rule %s needs %d states, at most 255 fit' % (name, len(sig)))
+
+    # renumber: dead 0, start 1, the rest breadth first
+    num = {group[0]: 0, group[1]: 1}
+    queue = [1]
+    rep = {}
+    for s in range(len(order)):
+        rep.setdefault(group[s], s)
+    while queue:
+        s = queue.pop(0)
+        for t in trans[s]:
+            if group[t] not in num:
+                num[group[t]] = len(num)
+                queue.append(rep[group[t]])
+    nstates = len(num)
+    table = [None] * nstates
+    final_states = [False] * nstates
+    for g, n in num.items():
+        table[n] = [num[group[t]] for t in trans[rep[g]]]
+        final_states[n] = accept[rep[g]]
+
+    # merge blocks the table cannot tell apart into byte classes
+    columns = {}
+    classes = [0] * 256
+    for b, block in enumerate(blocks):
+        col = tuple(table[s][b] for s in range(nstates))
+        columns.setdefault(col, []).append(block)
+    # class 0 is the one of NUL, like in the runtime compiled tables
+    cols = sorted(columns.items(), key=lambda kv: min((blk & -blk).bit_length() for blk in kv[1]))
+    nxt = [[0] * len(cols) for _ in range(nstates)]
+    for k, (col, blks) in enumerate(cols):
+        for blk in blks:
+            for c in range(256):
+                if blk >> c & 1:
+                    classes[c] = k
+        for s in range(nstates):
+            nxt[s][k] = col[s]
+
+    return classes, nxt, final_states
+
+
+def cname(name):
+    return 'ngx_header_inspect_grammar_' + re.sub(r'[^a-z0-9]', '_', name.lower())
+
+
+def emit(name, src, classes, nxt, accept):
+    """Writes the DFA as a function with a label per state."""
+    ident = cname(name)
+    nstates, nclasses = len(nxt), len(nxt[0])
+    if nclasses > 32:
+        raise GrammarError('rule %s needs %d byte classes, at most 32 fit' % (name, nclasses))
+
+    def test(ks):
+        if len(ks) == 1:
+            return 'cls[*p] == %d' % ks[0]
+        return '(0x%08xU >> cls[*p]) & 1' % sum(1 << k for k in ks)
+
+    targets = {t for s in range(1, nstates) for t in nxt[s] if t not in (0, s)}
+    used = set()
+    body = []
+    for s in range(1, nstates):
+        loop = [k for k in range(nclasses) if nxt[s][k] == s]
+        outs = {}
+        for k in range(nclasses):
+            if nxt[s][k] not in (0, s):
+                outs.setdefault(nxt[s][k], []).append(k)
+
+        if s in targets:
+            body.append('s%d:' % s)
+        if loop:
+            body.append('\twhile ((p != end) && (%s)) {' % test(loop))
+            body.append('\t\tp++;')
+            body.append('\t}')
+        end = 'accept' if accept[s] else 'again'
+        used.add(end)
+        body.append('\tif (p == end) {')
+        body.append('\t\tgoto %s;' % end)
+        body.append('\t}')
+        used.add('reject')
+        if not outs:
+            body.append('\tgoto reject;')
+        elif len(outs) == 1 and len(list(outs.values())[0]) < nclasses - len(loop):
+            t, ks = list(outs.items())[0]
+            body.append('\tif (%s) {' % test(ks))
+            body.append('\t\tp++;')
+            body.append('\t\tgoto s%d;' % t)
+            body.append('\t}')
+            body.append('\tgoto reject;')
+        else:
+            body.append('\tswitch (cls[*p]) {')
+            for t, ks in sorted(outs.items()):
+                for k in ks:
+                    body.append('\t\tcase %d:' % k)
+                body.append('\t\t\tp++;')
+                body.append('\t\t\tgoto s%d;' % t)
+            body.append('\t\tdefault:')
+            body.append('\t\t\tgoto reject;')
+            body.append('\t}')
+        body.append('')
+
+    out = []
+    out.append('/* %s: %d states, %d byte classes, from %s */' % (name, nstates - 1, nclasses, src))
+    out.append('static const u_char %s_classes[256] = {' % ident)
+    for row in range(0, 256, 16):
+        out.append('\t%s,' % ', '.join('%2d' % v for v in classes[row:row + 16]))
+    out.append('};')
+    out.append('')
+    out.append('static ngx_int_t %s(ngx_str_t *value, ngx_uint_t *pos) {' % ident)
+    out.append('\tconst u_char *cls = %s_classes;' % ident)
+    out.append('\tu_char *p, *end;')
+    out.append('')
+    out.append('\tp = value->data + *pos;')
+    out.append('\tend = value->data + value->len;')
+    out.append('')
+    out += body
+    for label, rc in (('accept', 'NGX_OK'), ('again', 'NGX_AGAIN'), ('reject', 'NGX_DECLINED')):
+        if label in used:
+            out.append('%s:' % label)
+            out.append('\t*pos = p - value->data;')
+            out.append('\treturn %s;' % rc)
+            out.append('')
+    out[-1] = '}'
+    out.append('')
+    return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description='compile ABNF header grammars into DFA tables')
+    ap.add_argument('-o', '--output', required=True)
+    ap.add_argument('-I', '--include', action='append', default=[],
+                    help='directory with shared rules')
+    ap.add_argument('grammars', nargs='+')
+    args = ap.parse_args()
+
+    try:
+        rules = {}
+        for d in args.include:
+            for f in sorted(os.listdir(d)):
+                if f.endswith('.abnf'):
+                    load(os.path.join(d, f), rules)
+
+        tops = []
+        for path in sorted(args.grammars):
+            tops.append((load(path, rules), path))
+
+        out = ['/*',
+               ' * Generated by tools/abnf2c.py from the grammars directory, do not edit.',
+               ' */',
+               '']
+        for name, path in tops:
+            src = 'grammars/' + os.path.basename(path)
+            out += emit(name, src, *compile_rule(rules, name))
+    except GrammarError as e:
+        sys.stderr.write('abnf2c: %s\n' % e)
+        return 1
+
+    text = '\n'.join(out)
+    try:
+        with open(args.output) as f:
+            if f.read() == text:
+                return 0
+    except OSError:
+        pass
+    # a failed write must not leave a truncated header behind
+    tmp = args.output + '.tmp'
+    try:
+        with open(tmp, 'w') as f:
+            f.write(text)
+        os.replace(tmp, args.output)
+    except OSError as e:
+        sys.stderr.write('abnf2c: %s\n' % e)
+        try:
+            os.unlink(tmp)
+        except OSError:
+            pass
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+#
+# Prints the requests recorded in an inspect_headers_capture file, oldest
+# first, while nginx keeps writing to it.
+#
+#	capture-dump.py /var/spool/nginx/inspect.capture
+#	capture-dump.py --json --follow /var/spool/nginx/inspect.capture
+#
+# The file is only read.  A slot is copied between two reads of its
+# sequence number; when they differ, or the number is odd, a worker was
+# writing to it and the slot is left out.  The layout is the one of
+# ngx_header_inspect_ring_t and ngx_header_inspect_rec_t on a 64-bit
+# little-endian host.
+
+import argparse
+import json
+import mmap
+import os
+import struct
+import sys
+import time
+
+MAGIC = b'NHIC'
+VERSION = 1
+
+RING = struct.Struct('<4sHHIIIIQ')        # magic .. next
+REC = struct.Struct('<QQIIHHHH')          # seq, msec, pid, len, flags, nviolations, nheaders, addr_len
+SEQ = struct.Struct('<Q')
+VIOLATION = struct.Struct('<HHi')         # index, code, pos
+LENGTHS = struct.Struct('<HH')            # name, value
+
+BLOCKED = 0x0001
+TRUNCATED = 0x0002
+STRIPPED = 0x0004
+
+
+class Capture:
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.inode = os.fstat(f.fileno()).st_ino
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+        if len(self.map) < RING.size:
+            raise ValueError('%s: too short for a capture file' % path)
+
+        (magic, version, ncodes, self.nslots, self.slot_size, self.slots,
+         codes, _) = RING.unpack_from(self.map, 0)
+
+        if magic != MAGIC:
+            raise ValueError('%s: not a capture file' % path)
+        if version != VERSION:
+            raise ValueError('%s: capture version %d, expected %d' % (path, version, VERSION))
+        if self.slots + self.nslots * self.slot_size > len(self.map):
+            raise ValueError('%s: slots run past the end of the file' % path)
+
+        names = bytes(self.map[codes:self.slots]).split(b'\0')
+        self.codes = [n.decode('ascii', 'replace') for n in names[:ncodes]]
+
+    def code(self, c):
+        return self.codes[c] if c < len(self.codes) else str(c)
+
+    def slot(self, i):
+        off = self.slots + i * self.slot_size
+
+        seq = SEQ.unpack_from(self.map, off)[0]
+        if seq == 0 or seq & 1:
+            return None
+        data = bytes(self.map[off:off + self.slot_size])
+        if SEQ.unpack_from(self.map, off)[0] != seq:
+            return None
+
+        try:
+            return self.parse(seq // 2 - 1, data)
+        except (struct.error, IndexError):
+            return None
+
+    def parse(self, ticket, data):
+        (_, msec, pid, length, flags, nviolations, nheaders,
+         addr_len) = REC.unpack_from(data, 0)
+        if REC.size + length > len(data):
+            return None
+
+        p = REC.size
+        violations = []
+        for _ in range(nviolations):
+            index, code, pos = VIOLATION.unpack_from(data, p)
+            violations.append({'index': index, 'code': self.code(code), 'pos': pos})
+            p += VIOLATION.size
+
+        addr = data[p:p + addr_len].decode('ascii', 'replace')
+        p += addr_len
+
+        headers = []
+        for _ in range(nheaders):
+            nlen, vlen = LENGTHS.unpack_from(data, p)
+            p += LENGTHS.size
+            if p + nlen + vlen > REC.size + length:
+                return None
+            name = data[p:p + nlen].decode('latin-1')
+            value = data[p + nlen:p + nlen + vlen].decode('latin-1')
+            headers.append((name, value))
+            p += nlen + vlen
+
+        for v in violations:
+            if v['index'] < len(headers):
+                v['header'] = headers[v['index']][0]
+
+        return {
+            'ticket': ticket,
+            'time': msec / 1000.0,
+            'pid': pid,
+            'client': addr,
+            'blocked': bool(flags & BLOCKED),
+            'truncated': bool(flags & TRUNCATED),
+            'stripped': bool(flags & STRIPPED),
+            'violations': violations,
+            'headers': headers,
+        }
+
+    def records(self, after=-1):
+        recs = [r for r in map(self.slot, range(self.nslots))
+                if r is not None and r['ticket'] > after]
+        return sorted(recs, key=lambda r: r['ticket'])
+
+
+def show(rec, as_json, out):
+    if as_json:
+        rec = dict(rec, headers=[{'name': n, 'value': v} for n, v in rec['headers']])
+        out.write(json.dumps(rec) + '\n')
+        return
+
+    stamp = time.strftime('%Y-%m-%dT%H:%M:%S', time.gmtime(rec['time']))
+    out.write('#%d %s.%03dZ %s pid %d%s%s%s\n' % (
+        rec['ticket'], stamp, int(rec['time'] * 1000) % 1000, rec['client'], rec['pid'],
+        ' blocked' if rec['blocked'] else '',
+        ' stripped' if rec['stripped'] else '',
+        ' truncated' if rec['truncated'] else ''))
+
+    marks = {}
+    for v in rec['violations']:
+        marks.setdefault(v['index'], []).append('%s@%d' % (v['code'], v['pos']))
+
+    for i, (name, value) in enumerate(rec['headers']):
+        mark = '  <- ' + ', '.join(marks[i]) if i in marks else ''
+        out.write('    %s: %r%s\n' % (name, value, mark))
+    out.write('\n')
+
+
+def main():
+    ap = argparse.ArgumentParser(description='print the requests of an inspect_headers_capture file')
+    ap.add_argument('file')
+    ap.add_argument('--json', action='store_true', help='one JSON object per line')
+    ap.add_argument('-f', '--follow', action='store_true', help='keep printing new records')
+    ap.add_argument('--interval', type=float, default=1.0,
+                    help='seconds between polls with --follow')
+    args = ap.parse_args()
+
+    try:
+        cap = Capture(args.file)
+    except (OSError, ValueError) as e:
+        sys.stderr.write('%s\n' % e)
+        return 1
+
+    last = -1
+    try:
+        while True:
+            for rec in cap.records(last):
+                show(rec, args.json, sys.stdout)
+                last = rec['ticket']
+            sys.stdout.flush()
+            if not args.follow:
+                return 0
+            time.sleep(args.interval)
+            # a reload with another size or record replaces the file
+            try:
+                if os.stat(args.file).st_ino != cap.inode:
+                    cap = Capture(args.file)
+                    last = -1
+            except (OSError, ValueError):
+                pass
+    except (KeyboardInterrupt, BrokenPipeError):
+        return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
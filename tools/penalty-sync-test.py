@@ -0,0 +1,295 @@
+#!/usr/bin/env python3
+#
+# Runs a few nginx instances on 127.0.0.1 that share their penalty box
+# with inspect_headers_penalty_sync, and reports how long it takes for a
+# client boxed on one of them to be rejected by all, and what a sync
+# datagram costs the worker that merges it.
+#
+#	penalty-sync-test.py /usr/local/nginx/sbin/nginx
+#	penalty-sync-test.py --nodes 5 --interval 200ms --flood 5000 ./objs/nginx
+#
+# The nginx binary has to be built with this module.  Each node gets a
+# directory of its own under a temporary one, kept with --keep.  The
+# client address is the key, and all requests come from 127.0.0.1, so
+# this tool itself is the client put in the box on the first node.
+
+import argparse
+import hashlib
+import hmac
+import os
+import re
+import shutil
+import signal
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+MAGIC = b'NHIP'
+VERSION = 2
+HEADER = struct.Struct('!4sBBHI')         # magic, version, reserved, entries, time sent
+ENTRY = struct.Struct('!IB')              # ms left, key length
+MAC = 20                                  # HMAC-SHA1 of the rest
+DGRAM = 1400
+SECRET = b'penalty-sync-test-secret'
+
+BAD = 'Range: bytes=x\r\n'
+
+SENT = re.compile(r'sent (\d+) boxed clients in (\d+) datagrams of (\d+) bytes to (\d+) peers')
+
+CONF = '''
+worker_processes 1;
+error_log logs/error.log info;
+pid logs/nginx.pid;
+
+events {
+    worker_connections 64;
+}
+
+http {
+    access_log off;
+
+    inspect_headers_penalty zone=penalty:%(zone)s threshold=%(threshold)d ttl=%(ttl)s;
+    inspect_headers_penalty_sync listen=127.0.0.1:%(sync)d %(peers)s interval=%(interval)s secret=%(secret)s;
+
+    server {
+        listen 127.0.0.1:%(http)d;
+        inspect_headers on;
+
+        location / {
+            return 200 "ok\\n";
+        }
+    }
+}
+'''
+
+
+class Node:
+
+    def __init__(self, nginx, root, i, args):
+        self.i = i
+        self.http = args.port + 2 * i
+        self.sync = args.port + 2 * i + 1
+        self.prefix = os.path.join(root, 'node%d' % i)
+        self.nginx = nginx
+        self.proc = None
+
+        os.makedirs(os.path.join(self.prefix, 'logs'))
+        peers = ' '.join('peer=127.0.0.1:%d' % (args.port + 2 * j + 1)
+                         for j in range(args.nodes) if j != i)
+        with open(os.path.join(self.prefix, 'nginx.conf'), 'w') as f:
+            f.write(CONF % {'zone': args.zone, 'threshold': args.threshold, 'ttl': args.ttl,
+                            'sync': self.sync, 'peers': peers, 'interval': args.interval,
+                            'secret': SECRET.decode(), 'http': self.http})
+
+    def start(self):
+        self.proc = subprocess.Popen([self.nginx, '-p', self.prefix + '/', '-c', 'nginx.conf',
+                                      '-g', 'daemon off;'])
+
+    def stop(self):
+        if self.proc is None or self.proc.poll() is not None:
+            return
+        self.proc.send_signal(signal.SIGQUIT)
+        try:
+            self.proc.wait(5)
+        except subprocess.TimeoutExpired:
+            self.proc.kill()
+            self.proc.wait()
+
+    def status(self, bad=False):
+        """The status of a GET /, None if nothing answered."""
+        try:
+            s = socket.create_connection(('127.0.0.1', self.http), timeout=2)
+        except OSError:
+            return None
+        try:
+            s.sendall(('GET / HTTP/1.1\r\nHost: localhost\r\n%sConnection: close\r\n\r\n'
+                       % (BAD if bad else '')).encode('ascii'))
+            line = s.makefile('rb').readline()
+        except OSError:
+            return None
+        finally:
+            s.close()
+        parts = line.split()
+        return int(parts[1]) if len(parts) > 1 else None
+
+    def worker(self):
+        """The pid of the worker, the one that holds the sync socket."""
+        for pid in os.listdir('/proc'):
+            if not pid.isdigit():
+                continue
+            try:
+                with open('/proc/%s/stat' % pid) as f:
+                    stat = f.read()
+            except OSError:
+                continue
+            if int(stat.rsplit(')', 1)[1].split()[1]) == self.proc.pid:
+                return int(pid)
+        return None
+
+    def log(self):
+        with open(os.path.join(self.prefix, 'logs', 'error.log'), errors='replace') as f:
+            return f.read()
+
+
+def cpu(pid):
+    """User and system time of a process, in seconds."""
+    with open('/proc/%d/stat' % pid) as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+
+
+def udp_drops(port):
+    """Datagrams dropped by the full receive buffer of the socket on port."""
+    with open('/proc/net/udp') as f:
+        for line in f.readlines()[1:]:
+            fields = line.split()
+            if int(fields[1].split(':')[1], 16) == port:
+                return int(fields[-1])
+    return 0
+
+
+def datagram(keys, left):
+    body = b''.join(ENTRY.pack(left, len(k)) + k for k in keys)
+    d = HEADER.pack(MAGIC, VERSION, 0, len(keys), int(time.time()) & 0xffffffff) + body
+    return d + hmac.new(SECRET, d, hashlib.sha1).digest()
+
+
+def wait_up(nodes, timeout=10):
+    deadline = time.time() + timeout
+    for n in nodes:
+        while n.status() is None:
+            if n.proc.poll() is not None:
+                raise RuntimeError('node %d exited, see %s/logs/error.log' % (n.i, n.prefix))
+            if time.time() > deadline:
+                raise RuntimeError('node %d does not answer on port %d' % (n.i, n.http))
+            time.sleep(0.05)
+
+
+def converge(nodes, args):
+    first, rest = nodes[0], nodes[1:]
+
+    sent = 0
+    while first.status(bad=True) == 200:
+        sent += 1
+        if sent > args.threshold * 10:
+            raise RuntimeError('node 0 does not box the client, is the module built in?')
+    boxed = time.time()
+
+    print('node 0 boxed the client after %d bad requests' % sent)
+
+    seen = {}
+    deadline = boxed + args.timeout
+    while len(seen) < len(rest) and time.time() < deadline:
+        for n in rest:
+            if n.i not in seen and n.status() not in (200, None):
+                seen[n.i] = time.time() - boxed
+        time.sleep(0.005)
+
+    for n in rest:
+        if n.i in seen:
+            print('node %d rejects it after %.1f ms' % (n.i, seen[n.i] * 1000))
+        else:
+            print('node %d still lets it in after %.1f s' % (n.i, args.timeout))
+
+    if len(seen) < len(rest):
+        return False
+
+    print('converged in %.1f ms' % (max(seen.values()) * 1000))
+
+    entries = datagrams = size = 0
+    for m in SENT.finditer(first.log()):
+        entries += int(m.group(1))
+        datagrams += int(m.group(2))
+        size += int(m.group(3))
+    if datagrams:
+        print('node 0 sent %d entries in %d datagrams, %d bytes, %.1f bytes per entry, to each peer'
+              % (entries, datagrams, size, size / entries))
+    return True
+
+
+def flood(node, args):
+    """Sends args.flood datagrams of made up clients to a node, and measures its worker."""
+    pid = node.worker()
+    if pid is None:
+        print('no worker found for node %d' % node.i)
+        return
+
+    per = (DGRAM - HEADER.size - MAC) // (ENTRY.size + 4)
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    drops = udp_drops(node.sync)
+    before = cpu(pid)
+
+    n = 0
+    for d in range(args.flood):
+        keys = [struct.pack('!BBBB', 10, (n + k) >> 16 & 0xff, (n + k) >> 8 & 0xff, (n + k) & 0xff)
+                for k in range(per)]
+        n += per
+        s.sendto(datagram(keys, 60000), ('127.0.0.1', node.sync))
+        if d % 32 == 31:
+            time.sleep(0.001)
+
+    time.sleep(0.5)
+    spent = cpu(pid) - before
+    drops = udp_drops(node.sync) - drops
+    s.close()
+
+    got = args.flood - drops
+    print('node %d merged %d datagrams of %d entries (%d dropped) in %.0f ms of cpu' % (
+        node.i, got, per, drops, spent * 1000))
+    if got and spent:
+        print('%.1f us per datagram, %.2f us per entry' % (spent * 1e6 / got, spent * 1e6 / (got * per)))
+    elif got:
+        print('below the clock tick, send more with --flood')
+
+
+def main():
+    ap = argparse.ArgumentParser(description='measure inspect_headers_penalty_sync on 127.0.0.1')
+    ap.add_argument('nginx', help='nginx binary built with the module')
+    ap.add_argument('--nodes', type=int, default=3)
+    ap.add_argument('--port', type=int, default=18080,
+                    help='first port; node i listens on port+2i for HTTP and port+2i+1 for sync')
+    ap.add_argument('--interval', default='1s', help='inspect_headers_penalty_sync interval')
+    ap.add_argument('--threshold', type=int, default=3)
+    ap.add_argument('--ttl', default='1m')
+    ap.add_argument('--zone', default='1m', help='size of the penalty zone of each node')
+    ap.add_argument('--timeout', type=float, default=30.0,
+                    help='seconds to wait for the other nodes')
+    ap.add_argument('--flood', type=int, default=2000,
+                    help='datagrams sent to node 1 to measure the merge, 0 to skip')
+    ap.add_argument('--keep', action='store_true', help='keep the configurations and logs')
+    args = ap.parse_args()
+
+    if args.nodes < 2:
+        ap.error('--nodes must be at least 2')
+
+    root = tempfile.mkdtemp(prefix='penalty-sync-')
+    nodes = [Node(os.path.abspath(args.nginx), root, i, args) for i in range(args.nodes)]
+
+    ok = False
+    try:
+        for n in nodes:
+            n.start()
+        wait_up(nodes)
+        ok = converge(nodes, args)
+        if args.flood:
+            flood(nodes[1], args)
+    except (OSError, RuntimeError) as e:
+        sys.stderr.write('%s\n' % e)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for n in nodes:
+            n.stop()
+        if args.keep:
+            print('configurations and logs in %s' % root)
+        else:
+            shutil.rmtree(root, ignore_errors=True)
+
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())